@@ -0,0 +1,171 @@
+#include <armadillo>
+#include <cmath>
+#include <algorithm> // std::min, std::max
+#include "config.h"
+#include "belief.h"
+#include "rng.h"
+#include "fatal_error.h"
+#include "adaptivestepper.h"
+
+using arma::mat;
+
+/**
+ * @brief Constructor for AdaptiveStepper. 
+ * @details Expects a Config with set \ref urPrior and \ref decisionThresh, and optionally 
+ * \ref contextMeanSpacing and \ref targetMeanSpacing (default 1 on both) and 
+ * \ref adaptiveCrossingTol (default 1e-4). The belief must not decay, since the block 
+ * updates assume every sample comes from the true stimulus. 
+ * 
+ * @param c the Config
+ * @param b the Belief to update (its true stimulus and starting posterior should be set before run())
+ * @param dvWeights weights on the posterior giving the decision variable
+ * @param contextNoise SD of one context sample
+ * @param contextSampsPerStep context samples per timestep (e.g. 2 with two flankers)
+ * @param targetNoise SD of one target sample
+ * @param targetSampsPerStep target samples per timestep
+ */
+AdaptiveStepper::AdaptiveStepper(const Config * c, Belief * b, const mat & dvWeights, double contextNoise, int contextSampsPerStep, double targetNoise, int targetSampsPerStep): _belief(b), _dvWeights(dvWeights), _contextNoise(contextNoise), _targetNoise(targetNoise), _contextSampsPerStep(contextSampsPerStep), _targetSampsPerStep(targetSampsPerStep), _blocksComputed(0){
+    double thresh = c->get<double>("decisionThresh"); 
+    _crossingTol = c->keyExists("adaptiveCrossingTol") ? c->get<double>("adaptiveCrossingTol") : 1e-4; 
+    #ifndef DISABLE_ERROR_CHECKS
+    if (thresh <= 0.5 || thresh >= 1) throw fatal_error() << "ERROR: AdaptiveStepper needs decisionThresh in (0.5, 1), got " << thresh; 
+    if (_crossingTol <= 0 || _crossingTol >= 1) throw fatal_error() << "ERROR: adaptiveCrossingTol should be in (0, 1), got " << _crossingTol; 
+    if (contextNoise <= 0 || targetNoise <= 0) throw fatal_error() << "ERROR: AdaptiveStepper needs positive context and target noise!"; 
+    #endif
+    _bound = log(thresh / (1 - thresh)); 
+    mat urPrior = c->get<mat>("urPrior"); 
+    double contextSpacing = c->keyExists("contextMeanSpacing") ? c->get<double>("contextMeanSpacing") : 1; 
+    double targetSpacing = c->keyExists("targetMeanSpacing") ? c->get<double>("targetMeanSpacing") : 1; 
+    _contextMeans.set_size(urPrior.n_rows, urPrior.n_cols); 
+    _targetMeans.set_size(urPrior.n_rows, urPrior.n_cols); 
+    for (unsigned i=0; i<urPrior.n_rows; ++i){
+        for (unsigned j=0; j<urPrior.n_cols; ++j){
+            _contextMeans(i,j) = i * contextSpacing; 
+            _targetMeans(i,j) = j * targetSpacing; 
+        }
+    }
+    // one sample moves every log posterior by (mean * sample)/noise^2 plus a constant, so relative to 
+    // the middle mean no entry moves by more than (span/2) * sample/noise^2. The log odds are a 
+    // difference of two log-sum-exps, each moving no more than the largest entry, hence the factor 2. 
+    double contextSpan = (urPrior.n_rows - 1) * contextSpacing; 
+    double targetSpan = (urPrior.n_cols - 1) * targetSpacing; 
+    _maxStepSd = contextSpan * sqrt(double(contextSampsPerStep)) / contextNoise + targetSpan * sqrt(double(targetSampsPerStep)) / targetNoise; 
+}
+
+/**
+ * @brief Sample until the decision variable crosses threshold. 
+ * @details Leaves the belief at the posterior of the crossing step. 
+ * 
+ * @param maxSteps give up after this many timesteps
+ * @param dv set to the decision variable at the crossing step
+ * @return the step (counting from 1) at which the decision variable crossed, or -1 if it did not within maxSteps. 
+ */
+int AdaptiveStepper::run(int maxSteps, double & dv){
+    // blocks are sized so the distance to the nearer bound is this many (bounding) SDs of the block's change
+    static const double blockSds = 3; 
+    int step = 0; 
+    mat post = _belief->getBelief(); 
+    double logOdds = _logOdds(post); 
+    while (step < maxSteps){
+        double distance = _bound - fabs(logOdds); 
+        double blockSteps = pow(distance / (blockSds * _localStepSd(post)), 2); 
+        int nSteps = int(std::max(1.0, std::min(blockSteps, double(maxSteps - step)))); 
+        double contextSum = _belief->drawSum(Context, _contextNoise, nSteps * _contextSampsPerStep); 
+        double targetSum = _belief->drawSum(Target, _targetNoise, nSteps * _targetSampsPerStep); 
+        int crossed = _refine(post, logOdds, nSteps, contextSum, targetSum); 
+        post = _belief->getBelief(); 
+        if (crossed > 0){
+            dv = arma::accu(_dvWeights % post); 
+            return step + crossed; 
+        }
+        logOdds = _logOdds(post); 
+        step += nSteps; 
+    }
+    dv = arma::accu(_dvWeights % post); 
+    return -1; 
+}
+
+/**
+ * @brief Find the first crossing within a block of timesteps with known evidence sums. 
+ * @details Updates the belief to the end of the block. If the block may contain a crossing, 
+ * splits it with a gaussian bridge draw and recurses into the halves in order. 
+ * 
+ * @param start posterior at the start of the block
+ * @param startLogOdds log odds of the decision variable at the start of the block
+ * @param nSteps timesteps in the block
+ * @param contextSum sum of the context samples in the block
+ * @param targetSum sum of the target samples in the block
+ * @return the step within the block (counting from 1) of the first crossing, with the belief 
+ * left there, or 0 if there was none, with the belief left at the end of the block. 
+ */
+int AdaptiveStepper::_refine(const mat & start, double startLogOdds, int nSteps, double contextSum, double targetSum){
+    _belief->setBelief(start); 
+    _belief->updateFromSum(Context, contextSum, nSteps * _contextSampsPerStep, _contextNoise); 
+    _belief->updateFromSum(Target, targetSum, nSteps * _targetSampsPerStep, _targetNoise); 
+    ++_blocksComputed; 
+    mat end = _belief->getBelief(); 
+    double endLogOdds = _logOdds(end); 
+    bool endCrossed = fabs(endLogOdds) > _bound; 
+    if (nSteps == 1) return endCrossed ? 1 : 0; 
+    if (!endCrossed){
+        double stepSd = std::max(_localStepSd(start), _localStepSd(end)); 
+        if (_bridgeCrossingProb(startLogOdds, endLogOdds, stepSd, nSteps) <= _crossingTol) return 0; 
+    }
+    // split: the sum of the first n1 of n samples with total S is N(S n1/n, noise^2 n1 (n-n1)/n)
+    int firstSteps = nSteps / 2; 
+    double contextN = nSteps * _contextSampsPerStep, contextN1 = firstSteps * _contextSampsPerStep; 
+    double targetN = nSteps * _targetSampsPerStep, targetN1 = firstSteps * _targetSampsPerStep; 
+    double firstContextSum = contextN1 == 0 ? 0 : RNG::rnorm(contextSum * contextN1 / contextN, _contextNoise * sqrt(contextN1 * (contextN - contextN1) / contextN)); 
+    double firstTargetSum = targetN1 == 0 ? 0 : RNG::rnorm(targetSum * targetN1 / targetN, _targetNoise * sqrt(targetN1 * (targetN - targetN1) / targetN)); 
+    int crossed = _refine(start, startLogOdds, firstSteps, firstContextSum, firstTargetSum); 
+    if (crossed > 0) return crossed; 
+    mat mid = _belief->getBelief(); 
+    crossed = _refine(mid, _logOdds(mid), nSteps - firstSteps, contextSum - firstContextSum, targetSum - firstTargetSum); 
+    return crossed > 0 ? firstSteps + crossed : 0; 
+}
+
+/**
+ * @brief Log odds of the decision variable for a posterior. 
+ */
+double AdaptiveStepper::_logOdds(const mat & post){
+    double dv = arma::accu(_dvWeights % post); 
+    return log(dv / (1 - dv)); 
+}
+
+/**
+ * @brief SD of the change in the log odds of the decision variable over one timestep, at a posterior. 
+ * @details The log odds are \f$\log\sum_A w p - \log\sum_B (1-w) p\f$, and the derivative of 
+ * each term in the sum of the evidence from a source is the weighted posterior mean of that 
+ * source's evidence mean, over the noise variance. So the log odds move by the difference of those 
+ * means times the sum, whose per-step SD is known. Capped at the global bound _maxStepSd. 
+ */
+double AdaptiveStepper::_localStepSd(const mat & post){
+    mat forWeights = _dvWeights % post; 
+    mat againstWeights = (1 - _dvWeights) % post; 
+    double forMass = arma::accu(forWeights), againstMass = arma::accu(againstWeights); 
+    if (forMass <= 0 || againstMass <= 0) return _maxStepSd; 
+    double contextSlope = (arma::accu(forWeights % _contextMeans) / forMass - arma::accu(againstWeights % _contextMeans) / againstMass) / _contextNoise; 
+    double targetSlope = (arma::accu(forWeights % _targetMeans) / forMass - arma::accu(againstWeights % _targetMeans) / againstMass) / _targetNoise; 
+    double sd = sqrt(_contextSampsPerStep * contextSlope * contextSlope + _targetSampsPerStep * targetSlope * targetSlope); 
+    return std::min(sd, _maxStepSd); 
+}
+
+/**
+ * @brief Probability that a gaussian bridge between two points inside the bounds leaves them. 
+ * @details For a bridge over t steps with per-step SD s starting at distance a from a bound 
+ * and ending at distance b from it, the probability of touching the bound is exp(-2ab/(s^2 t)). 
+ * We add this up over both bounds. 
+ */
+double AdaptiveStepper::_bridgeCrossingProb(double startLogOdds, double endLogOdds, double stepSd, int nSteps){
+    double var = stepSd * stepSd * nSteps; 
+    double upper = exp(-2 * (_bound - startLogOdds) * (_bound - endLogOdds) / var); 
+    double lower = exp(-2 * (_bound + startLogOdds) * (_bound + endLogOdds) / var); 
+    return upper + lower; 
+}
+
+/**
+ * @brief Number of block updates computed so far (including splits), for checking the speedup. 
+ */
+int AdaptiveStepper::getBlocksComputed(){
+    return _blocksComputed; 
+}
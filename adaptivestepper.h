@@ -0,0 +1,56 @@
+// include guard
+#ifndef ADAPTIVESTEPPER_H
+#define ADAPTIVESTEPPER_H
+
+#include <armadillo>
+#include "config.h"
+#include "belief.h"
+
+/**
+ * @brief Runs the sampling loop of a trial in large blocks of timesteps while far from threshold. 
+ * @details Without decay, the posterior after a block of timesteps only depends on the sum of 
+ * the evidence samples in the block (see Belief::updateFromSum()), and that sum is a single 
+ * gaussian draw. So while the decision variable is far from threshold we update with one draw 
+ * per block. The block size shrinks as the decision variable approaches threshold, so that 
+ * crossing within a block is unlikely. Whenever it could have happened anyway (the end of the 
+ * block is past threshold, or the probability that a gaussian bridge between the block 
+ * endpoints crosses is above \ref adaptiveCrossingTol), the block is split in half by drawing 
+ * the sum of the first half conditioned on the block sum, and both halves are checked 
+ * in order, down to single timesteps. The SD of the log odds of the decision variable per 
+ * timestep, needed for both, comes from linearizing the log odds in the evidence sums. The 
+ * crossing step is thus on the same grid as stepping through every timestep, with the same 
+ * distribution up to the crossing tolerance: each block taken whole may hide a crossing (and 
+ * an earlier decision) with probability up to \ref adaptiveCrossingTol, so the result is 
+ * approximate, slightly late and slightly more accurate. 
+ * 
+ * The decision variable is a weighted sum of the posterior, accu(dvWeights % posterior), 
+ * and sampling stops once it is above \ref decisionThresh or below 1-\ref decisionThresh. 
+ * The linearization needs the decision variable to be monotone in each evidence sum, as 
+ * Flanker's marginal over the target is; AX-CPT's probability of a match is not. 
+ */
+class AdaptiveStepper{
+    public: 
+        AdaptiveStepper(const Config * c, Belief * b, const arma::mat & dvWeights, double contextNoise, int contextSampsPerStep, double targetNoise, int targetSampsPerStep); 
+        int run(int maxSteps, double & dv); 
+        int getBlocksComputed(); 
+
+    protected: 
+        int _refine(const arma::mat & start, double startLogOdds, int nSteps, double contextSum, double targetSum); 
+        double _logOdds(const arma::mat & post); 
+        double _localStepSd(const arma::mat & post); 
+        double _bridgeCrossingProb(double startLogOdds, double endLogOdds, double stepSd, int nSteps); 
+        Belief * _belief; ///< the belief we are updating (not owned)
+        arma::mat _dvWeights; ///< the decision variable is accu(_dvWeights % posterior)
+        double _bound; ///< log odds of \ref decisionThresh
+        double _contextNoise; ///< SD of one context sample
+        double _targetNoise; ///< SD of one target sample
+        int _contextSampsPerStep; ///< context samples per timestep
+        int _targetSampsPerStep; ///< target samples per timestep
+        double _maxStepSd; ///< upper bound on the SD of the change in the decision variable's log odds per timestep
+        arma::mat _contextMeans; ///< mean of the context evidence for each hypothesis (context, target)
+        arma::mat _targetMeans; ///< mean of the target evidence for each hypothesis (context, target)
+        double _crossingTol; ///< split blocks whose bridge crossing probability exceeds this (see \ref adaptiveCrossingTol)
+        int _blocksComputed; ///< number of block updates done (including splits), for checking the speedup
+};
+
+#endif
@@ -0,0 +1,75 @@
+// include guard
+#ifndef ARRAYVIEW_H
+#define ARRAYVIEW_H
+
+#include <vector>
+
+using std::vector;
+
+/**
+ * @brief Read-only view of a contiguous run of stored values (no copy). 
+ * @details Valid as long as the storage it views is not appended to. 
+ * @tparam T the stored type
+ */
+template<typename T>
+class ArrayView {
+public: 
+	typedef const T * const_iterator; ///< iterators are plain pointers
+	ArrayView(): _data(nullptr), _size(0) {}
+	ArrayView(const T * data, unsigned size): _data(data), _size(size) {}
+	ArrayView(const vector<T> & v, unsigned begin, unsigned end): _data(v.data() + begin), _size(end - begin) {}
+	const T & operator[](unsigned i) const { return _data[i]; }
+	const T * data() const { return _data; }
+	unsigned size() const { return _size; }
+	bool empty() const { return _size == 0; }
+	const_iterator begin() const { return _data; }
+	const_iterator end() const { return _data + _size; }
+protected: 
+	const T * _data; ///< first element
+	unsigned _size; ///< number of elements
+}; 
+
+/**
+ * @brief Positions [begin, end) of the values a datum stored for one trial. 
+ */
+struct TrialSegment {
+	int trialId; ///< the trial (trace) ID
+	unsigned begin; ///< position of the first value of the trial
+	unsigned end; ///< one past the position of the last value of the trial
+	unsigned size() const { return end - begin; } ///< number of values in the trial
+}; 
+
+/**
+ * @brief Iterable range of the TrialSegment's of a datum, computed lazily from its trial IDs. 
+ * @details For use in range-for loops, e.g. 
+ * for (TrialSegment s : d.getSegments()) ArrayView<double> times(d.getTimes(), s.begin, s.end); 
+ * Nothing is copied or allocated. Values of a trial are assumed to be stored contiguously, 
+ * which holds for everything recorded through Recorder. 
+ */
+class TrialSegments {
+public: 
+	/// Forward iterator over segments. 
+	class const_iterator {
+	public: 
+		const_iterator(const vector<int> * ids, unsigned pos): _ids(ids), _pos(pos) {}
+		TrialSegment operator*() const {
+			unsigned end = _pos; 
+			while (end < _ids->size() && (*_ids)[end] == (*_ids)[_pos]) ++end; 
+			TrialSegment s = {(*_ids)[_pos], _pos, end}; 
+			return s; 
+		}
+		const_iterator & operator++() { _pos = (**this).end; return *this; }
+		bool operator!=(const const_iterator & other) const { return _pos != other._pos; }
+		bool operator==(const const_iterator & other) const { return _pos == other._pos; }
+	protected: 
+		const vector<int> * _ids; ///< trial IDs of the datum
+		unsigned _pos; ///< start of the current segment
+	}; 
+	explicit TrialSegments(const vector<int> & ids): _ids(&ids) {}
+	const_iterator begin() const { return const_iterator(_ids, 0); }
+	const_iterator end() const { return const_iterator(_ids, _ids->size()); }
+protected: 
+	const vector<int> * _ids; ///< trial IDs of the datum
+}; 
+
+#endif
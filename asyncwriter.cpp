@@ -0,0 +1,99 @@
+#include "asyncwriter.h"
+#include "fatal_error.h"
+
+/**
+ * @brief Start the writer thread.
+ * @param maxPending most jobs allowed to wait before submit() blocks
+ */
+AsyncWriter::AsyncWriter(unsigned maxPending): _maxPending(maxPending > 0 ? maxPending : 1), _busy(false), _closing(false), _thread(&AsyncWriter::_run, this) {}
+
+/**
+ * @brief Run the remaining jobs and stop the thread (exceptions from jobs are dropped here, call close() to see them).
+ */
+AsyncWriter::~AsyncWriter(){
+	try {
+		close();
+	} catch (...) {}
+}
+
+/**
+ * @brief Queue a job to run on the writer thread, waiting for room in the queue if it is full.
+ * @details The job must own (or otherwise keep alive until the next flush()) everything it reads.
+ */
+void AsyncWriter::submit(std::function<void()> job){
+	std::unique_lock<std::mutex> lock(_mutex);
+	#ifndef DISABLE_ERROR_CHECKS
+	if (_closing) throw fatal_error() << "ERROR: submitting output to an AsyncWriter after close()!";
+	#endif
+	_done.wait(lock, [this]{ return _jobs.size() < _maxPending; });
+	_jobs.push_back(std::move(job));
+	_wake.notify_one();
+}
+
+/**
+ * @brief Wait until every submitted job has run.
+ * @details Rethrows the first exception a job threw since the last flush().
+ */
+void AsyncWriter::flush(){
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this]{ return _jobs.empty() && !_busy; });
+	_rethrow();
+}
+
+/**
+ * @brief Run the remaining jobs and stop the thread (no more jobs can be submitted).
+ * @details Rethrows the first exception a job threw since the last flush().
+ */
+void AsyncWriter::close(){
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_closing = true;
+		_wake.notify_one();
+	}
+	if (_thread.joinable()) _thread.join();
+	std::lock_guard<std::mutex> lock(_mutex);
+	_rethrow();
+}
+
+/**
+ * @brief Can jobs still be submitted?
+ */
+bool AsyncWriter::isOpen() const {
+	return _thread.joinable();
+}
+
+/**
+ * @brief The writer thread: run jobs in order until closed and out of jobs.
+ */
+void AsyncWriter::_run(){
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true){
+		_wake.wait(lock, [this]{ return !_jobs.empty() || _closing; });
+		if (_jobs.empty()) return;
+		std::function<void()> job = std::move(_jobs.front());
+		_jobs.pop_front();
+		_busy = true;
+		_done.notify_all(); // there is room in the queue
+		lock.unlock();
+		try {
+			job();
+		} catch (...) {
+			std::lock_guard<std::mutex> errorLock(_mutex);
+			if (!_error) _error = std::current_exception();
+		}
+		job = nullptr; // release what the job held before reporting it done
+		lock.lock();
+		_busy = false;
+		_done.notify_all();
+	}
+}
+
+/**
+ * @brief Rethrow (and forget) the stored exception, if any. Call with _mutex held.
+ */
+void AsyncWriter::_rethrow(){
+	if (!_error) return;
+	std::exception_ptr e = _error;
+	_error = nullptr;
+	std::rethrow_exception(e);
+}
@@ -0,0 +1,49 @@
+// include guard
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+#include <functional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/**
+ * @brief Runs output jobs (formatting and writing) on a background thread.
+ * @details Jobs are run one at a time, in the order they were submitted, so jobs writing
+ * to the same stream stay in order. At most maxPending jobs wait in the queue: submit()
+ * blocks until there is room, which bounds the memory held by queued output. flush() is
+ * the barrier: it returns once every submitted job has run (rethrowing the first exception
+ * a job threw, if any), after which the data the jobs read can be changed or freed again.
+ * close() flushes and stops the thread; the destructor closes too.
+ *
+ * Recorder writes through one if given one (Recorder::setAsyncWriter()), and the batch
+ * runners print the results of each input line through one while the next line runs.
+ */
+class AsyncWriter {
+public:
+	explicit AsyncWriter(unsigned maxPending=8);
+	~AsyncWriter();
+	void submit(std::function<void()> job);
+	void flush();
+	void close();
+	bool isOpen() const;
+
+protected:
+	AsyncWriter(const AsyncWriter &) = delete;
+	AsyncWriter & operator=(const AsyncWriter &) = delete;
+	void _run();
+	void _rethrow();
+	std::deque<std::function<void()> > _jobs; ///< jobs not yet started
+	unsigned _maxPending; ///< most jobs allowed to wait in _jobs
+	bool _busy; ///< is the thread running a job?
+	bool _closing; ///< has close() been called?
+	std::exception_ptr _error; ///< first exception thrown by a job, until rethrown
+	std::mutex _mutex; ///< guards everything above
+	std::condition_variable _wake; ///< signals the thread that there are jobs (or it should stop)
+	std::condition_variable _done; ///< signals waiters that a job was taken or finished
+	std::thread _thread; ///< the writer thread (started last, after the members it uses)
+};
+
+#endif
@@ -0,0 +1,372 @@
+#include "batchmerge.h"
+#include "fatal_error.h"
+#include "utils.h"
+#include "csvwriter.h"
+#include "config.h"
+#include "task.h"
+#include "recorder.h"
+#include <sstream>
+#include <set>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+
+/**
+ * @brief Constructor for BatchMerger (nothing added yet).
+ */
+BatchMerger::BatchMerger(): _nShards(0) {}
+
+/**
+ * @brief Add the output of one shard.
+ * @param in the runner's output
+ * @param name what to call it in error messages (e.g. the file name)
+ */
+void BatchMerger::add(std::istream & in, const std::string & name){
+	std::vector<std::vector<BatchRow> > blocks;
+	std::set<std::string> seen; // keys of the current block
+	std::string line;
+	BatchRow row;
+	while (std::getline(in, line)){
+		if (!_parseRow(line, row)) continue;
+		std::ostringstream key;
+		key << row.context << "," << row.target << "," << row.variable;
+		if (blocks.empty() || !seen.insert(key.str()).second){
+			blocks.push_back(std::vector<BatchRow>());
+			seen.clear();
+			seen.insert(key.str());
+		}
+		blocks.back().push_back(row);
+	}
+	#ifndef DISABLE_ERROR_CHECKS
+	if (blocks.empty()) throw fatal_error() << "ERROR: found no batch runner rows in " << name << "!";
+	if (_nShards > 0 && blocks.size() != _blocks.size()) throw fatal_error() << "ERROR: " << name << " has results for " << blocks.size() << " parameter lines, the outputs before it for " << _blocks.size() << "!";
+	#endif
+	if (_nShards == 0) _blocks.resize(blocks.size());
+	for (unsigned b=0; b<blocks.size(); ++b){
+		for (const BatchRow & r : blocks[b]) _addRow(_blocks[b], r, _nShards);
+	}
+	++_nShards;
+}
+
+/**
+ * @brief Parse a row of runner output (context,target,variable,mean,variance,n, NA for missing values).
+ * @return false if the line is not such a row (e.g. the header)
+ */
+bool BatchMerger::_parseRow(const std::string & line, BatchRow & row){
+	std::vector<std::string> fields;
+	std::istringstream in(line);
+	std::string field;
+	while (std::getline(in, field, ',')) fields.push_back(field);
+	if (fields.size() != 6 || fields[2].empty()) return false;
+	char * end;
+	row.context = std::strtol(fields[0].c_str(), &end, 10);
+	if (fields[0].empty() || *end != '\0') return false;
+	row.target = std::strtol(fields[1].c_str(), &end, 10);
+	if (fields[1].empty() || *end != '\0') return false;
+	row.variable = fields[2];
+	double * values[2] = {&row.mean, &row.variance};
+	for (unsigned i=0; i<2; ++i){
+		if (fields[3 + i] == "NA"){
+			*values[i] = std::numeric_limits<double>::quiet_NaN();
+			continue;
+		}
+		*values[i] = std::strtod(fields[3 + i].c_str(), &end);
+		if (fields[3 + i].empty() || *end != '\0') return false;
+	}
+	row.n = std::strtol(fields[5].c_str(), &end, 10);
+	return !fields[5].empty() && *end == '\0';
+}
+
+/**
+ * @brief How a variable is merged.
+ * @param variable the variable of a row
+ * @param[out] name the curve (e.g. CorrectRT_cdf) for curve points, else the variable
+ * @param[out] time the time of a curve point
+ */
+BatchMerger::Kind BatchMerger::_kindOf(const std::string & variable, std::string & name, double & time){
+	const char * markers[3] = {"_cdf", "_caf", "_q"};
+	const Kind kinds[3] = {CDF, CAF, QUANTILE};
+	name = variable;
+	for (unsigned i=0; i<3; ++i){
+		size_t pos = variable.rfind(markers[i]);
+		if (pos == std::string::npos) continue;
+		std::string number = variable.substr(pos + std::string(markers[i]).size());
+		char * end;
+		double x = std::strtod(number.c_str(), &end);
+		if (number.empty() || *end != '\0') continue;
+		if (kinds[i] != QUANTILE){
+			name = variable.substr(0, pos + std::string(markers[i]).size());
+			time = x;
+		}
+		return kinds[i];
+	}
+	return MOMENTS;
+}
+
+/**
+ * @brief Merge a row of shard number shard into block.
+ */
+void BatchMerger::_addRow(Block & block, const BatchRow & row, unsigned shard){
+	std::string name;
+	double time = 0;
+	Kind kind = _kindOf(row.variable, name, time);
+	std::ostringstream key;
+	key << row.context << "," << row.target << "," << name;
+	auto found = block.index.find(key.str());
+	if (found == block.index.end()){
+		Entry e;
+		e.context = row.context;
+		e.target = row.target;
+		e.variable = name;
+		e.kind = kind;
+		e.n = 0;
+		e.mean = 0;
+		e.ssq = 0;
+		found = block.index.insert(std::make_pair(key.str(), unsigned(block.entries.size()))).first;
+		block.entries.push_back(e);
+	}
+	Entry & e = block.entries[found->second];
+	if (row.n <= 0 || std::isnan(row.mean)) return;
+	switch (kind){
+		case MOMENTS: {
+			// from the shard's mean and sum of square deviations
+			double ssq = row.n > 1 && !std::isnan(row.variance) ? row.variance * (row.n - 1) : 0;
+			utils::RunningMoments<double>::combine(e.mean, e.ssq, e.n, row.mean, ssq, row.n);
+			e.n += row.n;
+			break;
+		}
+		case QUANTILE:
+			e.mean += row.mean * row.n;
+			e.n += row.n;
+			break;
+		case CAF: {
+			std::pair<double, double> & bin = e.caf[time];
+			bin.first += std::round(row.mean * row.n);
+			bin.second += row.n;
+			break;
+		}
+		case CDF: {
+			std::pair<int, std::map<double, double> > & cdf = e.cdfs[shard];
+			cdf.first = row.n;
+			cdf.second[time] = row.mean;
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Print the merged rows (with the runners' header), with the fewest digits that read back exactly.
+ */
+void BatchMerger::write(std::ostream & out) const {
+	CsvWriter csv(true);
+	csv.attach(out);
+	csv.raw("context,target,variable,mean,variance,n\n");
+	for (const Block & block : _blocks){
+		for (const Entry & e : block.entries){
+			switch (e.kind){
+				case MOMENTS:
+					csv.field(e.context); csv.field(e.target); csv.field(e.variable);
+					if (e.n > 0) csv.field(e.mean);
+					else csv.field("NA");
+					if (e.n > 1) csv.field(e.ssq / (e.n - 1));
+					else csv.field("NA");
+					csv.field(int(e.n));
+					csv.endRow();
+					break;
+				case QUANTILE:
+					csv.field(e.context); csv.field(e.target); csv.field(e.variable);
+					if (e.n > 0) csv.field(e.mean / e.n);
+					else csv.field("NA");
+					csv.field("NA"); csv.field(int(e.n));
+					csv.endRow();
+					break;
+				case CAF:
+					for (const auto & bin : e.caf){
+						std::ostringstream variable;
+						variable << e.variable << bin.first;
+						csv.field(e.context); csv.field(e.target); csv.field(variable.str());
+						csv.field(bin.second.first / bin.second.second); csv.field("NA"); csv.field(int(bin.second.second));
+						csv.endRow();
+					}
+					break;
+				case CDF: {
+					// every shard's CDF is a step function between its points (0 before the first)
+					std::set<double> times;
+					double n = 0;
+					for (const auto & shard : e.cdfs){
+						n += shard.second.first;
+						for (const auto & point : shard.second.second) times.insert(point.first);
+					}
+					for (double t : times){
+						double value = 0;
+						for (const auto & shard : e.cdfs){
+							const std::map<double, double> & points = shard.second.second;
+							auto after = points.upper_bound(t);
+							if (after != points.begin()) value += shard.second.first * std::prev(after)->second;
+						}
+						std::ostringstream variable;
+						variable << e.variable << t;
+						csv.field(e.context); csv.field(e.target); csv.field(variable.str());
+						csv.field(value / n); csv.field("NA"); csv.field(int(n));
+						csv.endRow();
+					}
+					break;
+				}
+			}
+		}
+	}
+	csv.detach();
+}
+
+/**
+ * @brief Number of parameter lines (blocks of rows) in the outputs.
+ */
+unsigned BatchMerger::getNBlocks() const {
+	return _blocks.size();
+}
+
+/**
+ * @brief Number of outputs added.
+ */
+unsigned BatchMerger::getNShards() const {
+	return _nShards;
+}
+
+/**
+ * @brief Collect the rows of a parameter line (see BatchRows) from the datums BatchExperiment registered. 
+ * @param r the Recorder the experiment ran with
+ * @param t the task it ran (for the names of its datums)
+ * @param c the Config of the line, containing \ref nContexts and \ref nTargets, and optionally 
+ * \ref batchQuantiles with \ref quantileLevels, \ref batchHistograms, \ref batchCaf, 
+ * \ref aggregateTraces or \ref responseLockedWindow 
+ */
+BatchRows::BatchRows(Recorder & r, Task & t, Config & c){
+	int nContexts = c.get<int>("nContexts");
+	int nTargets = c.get<int>("nTargets");
+	std::vector<std::string> summaryDatumNames = t.getSummaryDatumNames();
+	std::vector<std::string> traceDatumNames = t.getTraceDatumNames();
+	double na = std::numeric_limits<double>::quiet_NaN();
+	bool quantiles = c.keyExists("batchQuantiles") && c.get<int>("batchQuantiles");
+	std::vector<double> levels = {0.1, 0.3, 0.5, 0.7, 0.9};
+	if (c.keyExists("quantileLevels")) levels = arma::conv_to<std::vector<double> >::from(arma::vectorise(c.get<arma::mat>("quantileLevels")));
+	for (unsigned i=0; i<summaryDatumNames.size(); ++i){
+		for (int ctx=0; ctx<nContexts; ++ctx){
+			for (int tgt=0; tgt<nTargets; ++tgt){
+				std::string key = Task::conditionLabel(ctx, tgt) + summaryDatumNames[i];
+				const SummaryDatum<double> & d = r.getDatum<SummaryDatum<double> >(key);
+				_add(ctx, tgt, summaryDatumNames[i], d.getMean(), d.getVariance(), d.getN());
+				if (!quantiles) continue;
+				std::vector<double> qs = r.getDatum<QuantileSketchDatum>(key).getQuantiles(levels);
+				for (unsigned j=0; j<qs.size(); ++j){
+					std::ostringstream variable;
+					variable << summaryDatumNames[i] << "_q" << levels[j];
+					_add(ctx, tgt, variable.str(), qs[j], na, d.getN());
+				}
+			}
+		}
+	}
+	bool histograms = c.keyExists("batchHistograms") && c.get<int>("batchHistograms");
+	if (histograms && std::count(summaryDatumNames.begin(), summaryDatumNames.end(), "CorrectRT") && std::count(summaryDatumNames.begin(), summaryDatumNames.end(), "IncorrectRT")){
+		for (int ctx=0; ctx<nContexts; ++ctx){
+			for (int tgt=0; tgt<nTargets; ++tgt){
+				const HistogramDatum & correct = r.getDatum<HistogramDatum>(Task::conditionLabel(ctx, tgt) + "CorrectRT");
+				const HistogramDatum & error = r.getDatum<HistogramDatum>(Task::conditionLabel(ctx, tgt) + "IncorrectRT");
+				arma::vec correctCdf = correct.getDefectiveCdf(error), errorCdf = error.getDefectiveCdf(correct);
+				int n = correct.getN() + error.getN();
+				// only the ticks where either CDF steps
+				for (unsigned k=0; k<correct.getNBins(); ++k){
+					if (correct.getCounts()[k] == 0 && error.getCounts()[k] == 0) continue;
+					std::ostringstream correctVariable, errorVariable;
+					correctVariable << "CorrectRT_cdf" << k * correct.getBinWidth();
+					errorVariable << "IncorrectRT_cdf" << k * correct.getBinWidth();
+					_add(ctx, tgt, correctVariable.str(), correctCdf[k], na, n);
+					_add(ctx, tgt, errorVariable.str(), errorCdf[k], na, n);
+				}
+			}
+		}
+	}
+	if (c.keyExists("batchCaf") && c.get<int>("batchCaf")){
+		for (int ctx=0; ctx<nContexts; ++ctx){
+			for (int tgt=0; tgt<nTargets; ++tgt){
+				const ConditionalAccuracyDatum & caf = r.getDatum<ConditionalAccuracyDatum>(Task::conditionLabel(ctx, tgt) + "CAF");
+				arma::vec acc = caf.getAccuracy();
+				for (unsigned k=0; k<caf.getNBins(); ++k){
+					if (caf.getTotal()[k] == 0) continue;
+					std::ostringstream variable;
+					variable << "Accuracy_caf" << k * caf.getBinWidth();
+					_add(ctx, tgt, variable.str(), acc[k], na, caf.getTotal()[k]);
+				}
+				if (caf.getOverflowTotal() > 0) _add(ctx, tgt, "Accuracy_cafinf", double(caf.getOverflowCorrect()) / caf.getOverflowTotal(), na, caf.getOverflowTotal());
+			}
+		}
+	}
+	bool aggregate = c.keyExists("aggregateTraces") && c.get<int>("aggregateTraces");
+	bool responseLocked = c.keyExists("responseLockedWindow");
+	for (unsigned i=0; i<traceDatumNames.size() && (aggregate || responseLocked); ++i){
+		for (int ctx=0; ctx<nContexts; ++ctx){
+			for (int tgt=0; tgt<nTargets; ++tgt){
+				std::string key = Task::conditionLabel(ctx, tgt) + traceDatumNames[i];
+				if (aggregate){
+					const TrajectoryDatum & d = r.getDatum<TrajectoryDatum>(key);
+					arma::mat means = d.getMeans(), vars = d.getVariances();
+					for (unsigned s=0; s<d.getNSteps(); ++s){
+						if (d.getN(s) == 0) continue;
+						for (unsigned j=0; j<d.getWidth(); ++j){
+							std::ostringstream variable;
+							variable << traceDatumNames[i] << j << "_t" << s * d.getTimePerStep();
+							_add(ctx, tgt, variable.str(), means(s, j), d.getN(s) > 1 ? vars(s, j) : na, d.getN(s));
+						}
+					}
+				} else {
+					const ResponseLockedDatum & d = r.getDatum<ResponseLockedDatum>(key);
+					arma::mat means = d.getMeans(), vars = d.getVariances();
+					for (int offset = 1 - int(d.getWindow()); offset <= int(d.getTail()); ++offset){
+						if (d.getN(offset) == 0) continue;
+						unsigned k = offset + d.getWindow() - 1;
+						for (unsigned j=0; j<d.getWidth(); ++j){
+							std::ostringstream variable;
+							variable << traceDatumNames[i] << j << "_r" << offset;
+							_add(ctx, tgt, variable.str(), means(k, j), d.getN(offset) > 1 ? vars(k, j) : na, d.getN(offset));
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Append a row. 
+ */
+void BatchRows::_add(int context, int target, const std::string & variable, double mean, double variance, int n){
+	BatchRow row = {context, target, variable, mean, variance, n};
+	_rows.push_back(row);
+}
+
+/**
+ * @brief Print the rows (without a header), with the fewest digits that read back exactly, so 
+ * BatchMerger combines shards exactly. 
+ */
+void BatchRows::write(std::ostream & out) const {
+	CsvWriter csv(true);
+	csv.attach(out);
+	for (const BatchRow & row : _rows){
+		csv.field(row.context); csv.field(row.target); csv.field(row.variable);
+		if (std::isnan(row.mean)) csv.field("NA");
+		else csv.field(row.mean);
+		if (std::isnan(row.variance)) csv.field("NA");
+		else csv.field(row.variance);
+		csv.field(row.n);
+		csv.endRow();
+	}
+	csv.detach();
+}
+
+/**
+ * @brief The rows, in the order they are printed. 
+ */
+const std::vector<BatchRow> & BatchRows::getRows() const {
+	return _rows;
+}
@@ -0,0 +1,105 @@
+// include guard
+#ifndef BATCHMERGE_H
+#define BATCHMERGE_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+class Config;
+class Task;
+class Recorder;
+
+/// A row of a batch runner's output: context,target,variable,mean,variance,n. 
+struct BatchRow {
+	int context, target; ///< the condition
+	std::string variable; ///< e.g. RT, RT_q0.1, CorrectRT_cdf530
+	double mean, variance; ///< NaN for NA
+	int n; ///< number of observations
+};
+
+/**
+ * @brief The rows a batch runner prints for one parameter line, collected after a BatchExperiment. 
+ * @details For every summary datum and condition, a mean/variance/n row, followed with 
+ * \ref batchQuantiles by a row per \ref quantileLevels (default .1 .3 .5 .7 .9) like RT_q0.1, with 
+ * the estimate as the mean. Then the defective CDFs of CorrectRT and IncorrectRT with 
+ * \ref batchHistograms, on rows like CorrectRT_cdf530 with P(RT <= 530, correct) as the mean (at 
+ * the ticks where either steps); the CAF with \ref batchCaf, on rows like Accuracy_caf500 with the 
+ * accuracy of the bin as the mean and its size as n (Accuracy_cafinf for the overflow bin); and 
+ * the aggregated posteriors with \ref aggregateTraces or \ref responseLockedWindow, on rows like 
+ * post2_t120 or post2_r-5 (NA variance with one timepoint). This is the format BatchMerger reads. 
+ * The rows are copied out of the Recorder, so it can be reset (and the next line run) before 
+ * they are written, e.g. by an AsyncWriter. 
+ */
+class BatchRows {
+public:
+	BatchRows(Recorder & r, Task & t, Config & c);
+	void write(std::ostream & out) const;
+	const std::vector<BatchRow> & getRows() const;
+
+protected:
+	void _add(int context, int target, const std::string & variable, double mean, double variance, int n);
+	std::vector<BatchRow> _rows; ///< in the order they are printed
+};
+
+/**
+ * @brief Merges the outputs of batch runners run on shards of the same parameter lines.
+ * @details An expensive parameter line can be split across jobs, each running the same
+ * lines (with their own seeds and share of \ref maxTrials); add() the output of each job,
+ * and write() prints what one job running all their trials would have, in the same
+ * context,target,variable,mean,variance,n format:
+ *
+ * - mean/variance/n rows (summaries, and aggregated posteriors like post2_t120 or post2_r-5)
+ *   are combined exactly with Chan et al.'s pairwise update (utils::RunningMoments, as in the datums' merge());
+ * - accuracy curve points (Accuracy_caf500) exactly, by adding up correct and total responses;
+ * - defective CDF points (CorrectRT_cdf530) exactly, as the n-weighted average of each
+ *   shard's CDF (a step function between its points), at every time any shard has a point;
+ * - quantile rows (RT_q0.1) as the n-weighted average of the shards' quantiles (Vincent
+ *   averaging), which is not exact but close for shards of the same distribution.
+ *
+ * The runners and write() print numbers with the fewest digits that read back to the same
+ * double (CsvWriter's shortest mode), so no precision is lost between them (exactly means up
+ * to floating point rounding). An output holds one block of rows per input line, and a new
+ * block starts at the first row whose context, target and variable already came up in the
+ * current one; every shard has to have the same number of blocks.
+ * Other lines (the header, the runner's goodbye) are skipped. Rows come out in the order
+ * they first came up, with the points of a curve together and sorted by time.
+ */
+class BatchMerger {
+public:
+	BatchMerger();
+	void add(std::istream & in, const std::string & name="input");
+	void write(std::ostream & out) const;
+	unsigned getNBlocks() const;
+	unsigned getNShards() const;
+
+protected:
+	/// Kinds of rows, by how they are merged.
+	enum Kind { MOMENTS, QUANTILE, CAF, CDF };
+	/// The merged rows of one variable (or of one curve, e.g. all CorrectRT_cdf points) of a condition.
+	struct Entry {
+		int context, target; ///< the condition
+		std::string variable; ///< the variable, or the curve's name (e.g. CorrectRT_cdf)
+		Kind kind; ///< how it is merged
+		double n; ///< observations so far (MOMENTS, QUANTILE)
+		double mean; ///< mean so far (MOMENTS), or sum of n * quantile (QUANTILE)
+		double ssq; ///< sum of square deviations so far (MOMENTS)
+		std::map<double, std::pair<double, double> > caf; ///< correct and total responses by time (CAF)
+		std::map<unsigned, std::pair<int, std::map<double, double> > > cdfs; ///< n and CDF points by time of each shard that has the curve (CDF)
+	};
+	/// The merged rows of one input line.
+	struct Block {
+		std::vector<Entry> entries; ///< in the order they came up
+		std::unordered_map<std::string, unsigned> index; ///< position in entries by context, target and variable (or curve)
+	};
+	static bool _parseRow(const std::string & line, BatchRow & row);
+	static Kind _kindOf(const std::string & variable, std::string & name, double & time);
+	void _addRow(Block & block, const BatchRow & row, unsigned shard);
+	std::vector<Block> _blocks; ///< the merged output, one block per input line
+	unsigned _nShards; ///< outputs added so far
+};
+
+#endif
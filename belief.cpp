@@ -1,6 +1,8 @@
 #include <vector>
 #include <armadillo>
 #include <cmath>
+#include <limits>
+#include <algorithm> // std::max
 #include "config.h" 
 #include "rng.h" // for noisifying sample pre-update
 #include "fatal_error.h"
@@ -57,6 +59,22 @@ DecayBelief::DecayBelief(const Config * c): Belief(c){
         _decayRate = 0; 
     }
     _contextMarginals = sum(_urPrior, 1); 
+    _cumContextProb = arma::cumsum(_contextMarginals); // cumsum so we can do categorical draw on it
+}
+
+/**
+ * @brief Constructor for ForgetBelief. 
+ * @details Expects a Config with set \ref urPrior and optionally \ref contextMeanSpacing 
+ * and \ref targetMeanSpacing as does its parent Belief, and optionally \ref forgetProb 
+ * (default 0, which is equivalent to the parent Belief). 
+ */
+ForgetBelief::ForgetBelief(const Config * c): Belief(c), _rememberedContext(-1), _forgetUpdate(-1), _nContextUpdates(0){
+    _forgetProb = c->keyExists("forgetProb") ? c->get<double>("forgetProb") : 0; 
+    #ifndef DISABLE_ERROR_CHECKS
+    if (_forgetProb < 0 || _forgetProb > 1) throw fatal_error() << "ERROR: forgetProb should be in [0, 1], got " << _forgetProb; 
+    #endif
+    _cumContextProb = arma::cumsum(arma::sum(_urPrior,1)); // sum rows, then cumsum so we can do categorical draw on it
+    reset(); 
 }
 
 /**
@@ -81,11 +99,59 @@ void Belief::setTrueStim(int trueContext, int trueTarget){
 
 /**
  * @brief Return the current belief posterior. 
+ * @details A reference to the posterior itself, valid until the next update: copy it 
+ * to keep it. 
  */
-mat Belief::getBelief(){
+const mat & Belief::getBelief() const {
     return _belief; 
 }
 
+/**
+ * @brief Overwrite the current belief posterior (e.g. to go back to an earlier state). 
+ */
+void Belief::setBelief(const mat & belief){
+    #ifndef DISABLE_ERROR_CHECKS
+    if (belief.n_rows != _nContexts || belief.n_cols != _nTargets) throw fatal_error() << "ERROR: setting a " << belief.n_rows << "x" << belief.n_cols << " belief but have " << _nContexts << " contexts and " << _nTargets << " targets!"; 
+    #endif
+    _belief = belief; 
+}
+
+/**
+ * @brief Draw the sum of n samples of evidence from the true stimulus. 
+ * @details Equivalent in distribution to summing the samples n calls to update() would draw. 
+ * 
+ * @param source where to draw from -- Context or Target
+ * @param noise the SD of the sampling distribution of one sample
+ * @param n number of samples
+ */
+double Belief::drawSum(UpdateSource source, double noise, int n){
+    double truth = source == Context ? _trueContext : _trueTarget; 
+    return RNG::rnorm(n * truth, sqrt(n) * noise); 
+}
+
+/**
+ * @brief Update the posterior from n samples at once, given their sum. 
+ * @details The sum is a sufficient statistic for the gaussian evidence, so this gives the 
+ * same posterior as n calls to update() with samples summing to sum: 
+ * \f$ P(e_{1..n} \mid \mu) \propto \exp\left(\frac{\mu \sum_k e_k - n\mu^2/2}{\sigma^2}\right) \f$. 
+ * The likelihood is computed in log space so large n does not underflow. 
+ * 
+ * @param source where the samples came from -- Context or Target
+ * @param sum the sum of the samples
+ * @param n number of samples
+ * @param noise the SD of the sampling distribution of one sample
+ */
+void Belief::updateFromSum(UpdateSource source, double sum, int n, double noise){
+    for (unsigned i=0; i<_nContexts; ++i){
+        for (unsigned j=0; j<_nTargets; ++j){
+            double mean = source == Context ? i*_contextMeanSpacing : j*_targetMeanSpacing; 
+            _lik(i,j) = (mean * sum - n * mean * mean / 2) / (noise * noise); // log likelihood here
+        }
+    }
+    _belief %= arma::exp(_lik - _lik.max()); 
+    _belief = _belief / utils::kahanSum(_belief); 
+}
+
 /**
  * @brief Reset the current belief posterior to the trial-start prior. 
  */
@@ -215,7 +281,6 @@ int DecayBelief::updateFromContext(double noise, double trialTime, PriorType dec
     } else {
         double pCorrectUpdate = exp(-_decayRate*(trialTime)); ///< \todo can precompute pCorrectUpdate once for the whole sim as long as we set/can know maxTrialTime somewhere
         double truth, normalizer, samp; 
-        arma::vec cumContextProb = arma::cumsum(arma::sum(_urPrior,1)); // sum rows, then cumsum so we can do categorical draw on it    
         int goodRetrieval = RNG::rbernoulli(pCorrectUpdate); 
         if (goodRetrieval == 0){ // if we did a bad retrieval 
             truth = -1; 
@@ -225,7 +290,7 @@ int DecayBelief::updateFromContext(double noise, double trialTime, PriorType dec
                 // do a categorical draw on marginal context prob
                 // horribly non-idiomatic? We just count up until we cross cumulative prob threshold
                 double p = RNG::runif(1); 
-                for (truth=0; p >= cumContextProb[truth]; ++truth)
+                for (truth=0; p >= _cumContextProb[truth]; ++truth)
                     ; 
             }
             #ifndef DISABLE_ERROR_CHECKS
@@ -251,54 +316,73 @@ int DecayBelief::updateFromContext(double noise, double trialTime, PriorType dec
 
 /**
  * @brief Belief update with a context that can be forgotten. 
- * @details Perform an update with some probability (_forgetProb) of forgetting the 
- * true context at each update, and sampling from a random context after that point. 
+ * @details Perform a context update, forgetting the true context if this is the update 
+ * drawn in reset(), and sampling from a random context from that point on. 
  * 
  * @param noise SD of the sampling distribution of the evidence. 
  * @param forgetTo What to draw upon forgetting. Uniform means a uniformly random context; 
- * Prior means one drawn according to the trial-level prior. 
+ * Informative means one drawn according to the trial-level prior. 
  * 
- * @return -1 if haven't forgotten, otherwise the index of the sampled contect. 
+ * @return the index of the context sampled from on the update that forgets, -1 on every other update. 
  */
 int ForgetBelief::contextForgetUpdate(double noise, PriorType forgetTo) {
-    if (_forgetProb == 0 || _forgot) { // don't waste computation if we forgot already or can't forget
-        updateFromContext(noise);
-        return -1; // signal that we drew the correct one
-    }
-    // check if we forgot
-    if (RNG::rbernoulli(_forgetProb) == 1) { // forgot now
+    ++_nContextUpdates; 
+    int drawFrom = -1; // signal that we drew the correct one (or forgot already)
+    if (!_forgot && _nContextUpdates == _forgetUpdate){ // forgot now
         _forgot = true; 
-        int drawFrom = -1; 
-        arma::vec cumContextProb = arma::cumsum(arma::sum(_urPrior,1)); // sum rows, then cumsum so we can do categorical draw on it
         if (forgetTo == Uniform){
             drawFrom = RNG::runif_int(_nContexts-1); // open interval
         } else if (forgetTo == Informative){
             // do a categorical draw on marginal context prob
-            // horribly non-idiomatic? We just count up until we cross cumulative prob threshold
             double p = RNG::runif(1); 
-            for (drawFrom=0; p >= cumContextProb[drawFrom]; ++drawFrom); 
+            for (drawFrom=0; drawFrom < _nContexts-1 && p >= _cumContextProb[drawFrom]; ++drawFrom); 
         }
         #ifndef DISABLE_ERROR_CHECKS
-    else throw fatal_error() << "Unknown forgetTo!";
-    if (drawFrom >= _nContexts || drawFrom < 0) throw fatal_error() << "failed to draw any contexts? Do you have a proper distribution?";
+        else throw fatal_error() << "Unknown forgetTo!";
+        if (drawFrom >= _nContexts || drawFrom < 0) throw fatal_error() << "failed to draw any contexts? Do you have a proper distribution?";
         #endif    
-    _trueContext = drawFrom; 
-    updateFromContext(noise);
-    return drawFrom; 
-    } else { // did not forget
-        updateFromContext(noise);
-        return -1; // signal that we drew the correct one
+        _trueContext = drawFrom; 
     }
+    update(Context, noise); 
+    return drawFrom; 
 }
 
 /**
- * @brief Reset the belief to the trial-level "urPrior" and unset the forgotten flag
+ * @brief Set the context and target being sampled from, remembering the context for reset(). 
+ */
+void ForgetBelief::setTrueStim(int trueContext, int trueTarget){
+    Belief::setTrueStim(trueContext, trueTarget); 
+    _rememberedContext = trueContext; 
+}
+
+/**
+ * @brief Reset the belief to the trial-level "urPrior", restore the true context and draw when it is forgotten. 
+ * @details Forgetting with probability p at each update means the first forgotten update is 
+ * geometric on {1, 2, ...}, drawn by inversion as \f$\lceil \log U / \log(1-p) \rceil\f$. 
  */
 void ForgetBelief::reset(){
     _forgot = false; 
+    _nContextUpdates = 0; 
+    _trueContext = _rememberedContext; 
+    if (_forgetProb <= 0){
+        _forgetUpdate = std::numeric_limits<int>::max(); 
+    } else if (_forgetProb >= 1){
+        _forgetUpdate = 1; 
+    } else {
+        double u = 1 - RNG::runif(1); // in (0, 1], so the log is finite
+        double k = ceil(log(u) / log1p(-_forgetProb)); 
+        _forgetUpdate = k < std::numeric_limits<int>::max() ? std::max(1, int(k)) : std::numeric_limits<int>::max(); 
+    }
     Belief::reset(); 
 }
 
+/**
+ * @brief Index (from 1) of the context update at which the context is forgotten on this trial (mostly for testing). 
+ */
+int ForgetBelief::getForgetUpdate(){
+    return _forgetUpdate; 
+}
+
 /**
  * @brief Compute the likelihoods of the joint probabilities of all contexts
  * and targets from an incoming sample.
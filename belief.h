@@ -21,7 +21,10 @@ class Belief{
         virtual void update(UpdateSource source, double noise); 
         virtual void setTrueStim(int trueContext, int trueTarget);
         virtual void reset(); 
-        virtual arma::mat getBelief(); 
+        virtual const arma::mat & getBelief() const; 
+        void setBelief(const arma::mat & belief);
+        double drawSum(UpdateSource source, double noise, int n);
+        void updateFromSum(UpdateSource source, double sum, int n, double noise);
         Belief(const Config * c);
         arma::mat getLik(); // for testing
         
@@ -53,22 +56,33 @@ class DecayBelief: public Belief{
         virtual void _computeLikelihoods(double samp, double noise, UpdateSource source, double pCorrectUpdate=1);
     protected:
         arma::vec _contextMarginals; ///< precomputed marginal probabilities of contexts, for the likelihood computation
+        arma::vec _cumContextProb; ///< cumulative marginal prior of the contexts, for drawing a decayed context
         double _decayRate; ///< \f$\beta\f$, the decay rate. 
 };
 
 /**
- * @brief Class implementing a belief update where the context can be forgotten at any timestep. 
- * \warning NOT TESTED! This is equivalent on average to exponential decay so this is largely out of use. 
- * \todo finish and test ForgetBelief. 
+ * @brief Class implementing a belief update where the context can be forgotten at any update. 
+ * @details At each context update, the true context is forgotten with probability 
+ * \ref forgetProb, after which context samples come from a randomly drawn context for the rest 
+ * of the trial. Rather than drawing a Bernoulli on every update, the index of the update at 
+ * which the context is forgotten is drawn once per trial from the geometric distribution in 
+ * reset(), which gives the same distribution. This is equivalent on average to the exponential 
+ * decay of DecayBelief. 
  */
 class ForgetBelief: public Belief{
     public:
+        ForgetBelief(const Config * c);
+        virtual void setTrueStim(int trueContext, int trueTarget);
         virtual void reset(); 
-        ForgetBelief(const Config * c); ///< you know this is broken because there's no constructor
-        int contextForgetUpdate(double noise, PriorType decayTo=Informative);
+        int contextForgetUpdate(double noise, PriorType forgetTo=Informative);
+        int getForgetUpdate();
     protected:
-        double _forgetProb; ///< probability of forgetting the context at each timepoint
+        double _forgetProb; ///< probability of forgetting the context at each update
         bool _forgot = false; ///< has the context been forgotten? 
+        int _rememberedContext; ///< the actual context of the trial (_trueContext is replaced upon forgetting)
+        int _forgetUpdate; ///< index (from 1) of the context update at which the context is forgotten this trial
+        int _nContextUpdates; ///< context updates so far this trial
+        arma::vec _cumContextProb; ///< cumulative marginal prior of the contexts, for drawing a context upon forgetting
 };
 
 #endif
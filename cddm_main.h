@@ -4,9 +4,14 @@
 #include "config.h"
 #include "task.h"
 #include "recorder.h"
+#include "asyncwriter.h"
 #include "experiment.h"
 #include "architecture.h"
 #include "belief.h"
+#include "firstpassage.h"
+#include "adaptivestepper.h"
+#include "decisioncache.h"
+#include "batchmerge.h"
 #include "rng.h"
 #include "utils.h"
 
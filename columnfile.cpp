@@ -0,0 +1,313 @@
+#include "columnfile.h"
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using arma::mat;
+
+static const char _magic[8] = {'C','D','D','M','C','O','L','1'};
+
+/**
+ * @brief Open (truncate) filename and write the header.
+ */
+ColumnFileWriter::ColumnFileWriter(const std::string & filename): _file(fopen(filename.c_str(), "wb")), _filename(filename), _offset(0) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (_file == nullptr) throw fatal_error() << "ERROR: could not open " << filename << " for writing!";
+	#endif
+	_write(_magic, sizeof(_magic));
+	_writeInt(0); // directory offset, filled in by close()
+}
+
+/**
+ * @brief Close the file if close() wasn't called.
+ */
+ColumnFileWriter::~ColumnFileWriter(){
+	if (_file != nullptr){
+		try {
+			close();
+		} catch (...) {}
+	}
+}
+
+/**
+ * @brief Start a new datum; the following column() and index() calls belong to it.
+ * @param name datum key
+ * @param nRows number of values in each of its columns
+ */
+void ColumnFileWriter::beginDatum(const std::string & name, size_t nRows){
+	DatumEntry d = {name, int64_t(nRows), std::vector<ColumnEntry>(), 0, 0};
+	_datums.push_back(d);
+}
+
+/**
+ * @brief Write the directory, point the header at it and close the file.
+ */
+void ColumnFileWriter::close(){
+	if (_file == nullptr) return;
+	_align();
+	int64_t directoryOffset = _offset;
+	_writeInt(_datums.size());
+	for (unsigned i=0; i<_datums.size(); ++i){
+		const DatumEntry & d = _datums[i];
+		_writeString(d.name);
+		_writeInt(d.nRows);
+		_writeInt(d.columns.size());
+		for (unsigned j=0; j<d.columns.size(); ++j){
+			_writeString(d.columns[j].name);
+			_writeInt(d.columns[j].type);
+			_writeInt(d.columns[j].offset);
+		}
+		_writeInt(d.nTrials);
+		_writeInt(d.indexOffset);
+	}
+	bool ok = fseek(_file, sizeof(_magic), SEEK_SET) == 0 && fwrite(&directoryOffset, sizeof(directoryOffset), 1, _file) == 1;
+	ok = fclose(_file) == 0 && ok;
+	_file = nullptr;
+	#ifndef DISABLE_ERROR_CHECKS
+	if (!ok) throw fatal_error() << "ERROR: failed writing " << _filename << "!";
+	#endif
+}
+
+void ColumnFileWriter::_write(const void * data, size_t bytes){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (_file == nullptr) throw fatal_error() << "ERROR: writing to " << _filename << " after it was closed!";
+	#endif
+	if (bytes > 0 && fwrite(data, 1, bytes, _file) != bytes){
+		throw fatal_error() << "ERROR: failed writing " << _filename << "!";
+	}
+	_offset += bytes;
+}
+
+/**
+ * @brief Pad with zeros to the next multiple of 8 bytes.
+ */
+void ColumnFileWriter::_align(){
+	static const char zeros[8] = {0};
+	_write(zeros, (8 - _offset % 8) % 8);
+}
+
+void ColumnFileWriter::_writeInt(int64_t x){
+	_write(&x, sizeof(x));
+}
+
+void ColumnFileWriter::_writeString(const std::string & s){
+	_writeInt(s.size());
+	_write(s.data(), s.size());
+}
+
+/**
+ * @brief Map filename into memory and read its directory.
+ */
+ColumnFileReader::ColumnFileReader(const std::string & filename): _filename(filename), _data(nullptr), _size(0) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) throw fatal_error() << "ERROR: could not open " << filename << "!";
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(_magic) + sizeof(int64_t)){
+		::close(fd);
+		throw fatal_error() << "ERROR: " << filename << " is too short to be a column file!";
+	}
+	_size = st.st_size;
+	void * p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping stays valid
+	if (p == MAP_FAILED) throw fatal_error() << "ERROR: could not map " << filename << "!";
+	_data = static_cast<const char *>(p);
+	try {
+		if (memcmp(_data, _magic, sizeof(_magic)) != 0) throw fatal_error() << "ERROR: " << filename << " is not a column file!";
+		size_t header = sizeof(_magic);
+		size_t pos = _readInt(header);
+		int64_t nDatums = _readInt(pos);
+		for (int64_t i=0; i<nDatums; ++i){
+			DatumInfo d;
+			d.name = _readString(pos);
+			d.nRows = _readInt(pos);
+			int64_t nColumns = _readInt(pos);
+			for (int64_t j=0; j<nColumns; ++j){
+				Column c;
+				c.name = _readString(pos);
+				int64_t type = _readInt(pos);
+				if (type != COLUMN_INT32 && type != COLUMN_FLOAT64) throw fatal_error() << "ERROR: unknown column type " << type << " in " << filename << "!";
+				c.type = ColumnType(type);
+				int64_t offset = _readInt(pos);
+				c.data = _ptr(offset, d.nRows * (c.type == COLUMN_INT32 ? sizeof(int32_t) : sizeof(double)));
+				d.columns.push_back(c);
+			}
+			d.nTrials = _readInt(pos);
+			int64_t indexOffset = _readInt(pos);
+			d.index = reinterpret_cast<const int64_t *>(_ptr(indexOffset, d.nTrials * 3 * sizeof(int64_t)));
+			_datums.push_back(d);
+		}
+	} catch (...) {
+		munmap(const_cast<char *>(_data), _size);
+		throw;
+	}
+}
+
+/**
+ * @brief Unmap the file (invalidating views returned by the reader).
+ */
+ColumnFileReader::~ColumnFileReader(){
+	munmap(const_cast<char *>(_data), _size);
+}
+
+/**
+ * @brief Names of the datums in the file, in the order they were written.
+ */
+std::vector<std::string> ColumnFileReader::getDatumNames() const {
+	std::vector<std::string> names;
+	for (unsigned i=0; i<_datums.size(); ++i) names.push_back(_datums[i].name);
+	return names;
+}
+
+/**
+ * @brief Is there a datum called datum in the file?
+ */
+bool ColumnFileReader::hasDatum(const std::string & datum) const {
+	for (unsigned i=0; i<_datums.size(); ++i){
+		if (_datums[i].name == datum) return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Number of rows of a datum.
+ */
+size_t ColumnFileReader::getNRows(const std::string & datum) const {
+	return _datum(datum).nRows;
+}
+
+/**
+ * @brief Names of the columns of a datum, in order.
+ */
+std::vector<std::string> ColumnFileReader::getColumnNames(const std::string & datum) const {
+	const DatumInfo & d = _datum(datum);
+	std::vector<std::string> names;
+	for (unsigned j=0; j<d.columns.size(); ++j) names.push_back(d.columns[j].name);
+	return names;
+}
+
+/**
+ * @brief Type of the values of a column.
+ */
+ColumnType ColumnFileReader::getColumnType(const std::string & datum, const std::string & column) const {
+	return _column(_datum(datum), column).type;
+}
+
+/**
+ * @brief A float64 column, viewed in place in the mapping (valid as long as the reader).
+ */
+ArrayView<double> ColumnFileReader::getColumn(const std::string & datum, const std::string & column) const {
+	const DatumInfo & d = _datum(datum);
+	const Column & c = _column(d, column);
+	if (c.type != COLUMN_FLOAT64) throw fatal_error() << "ERROR: column " << column << " of " << datum << " is not float64!";
+	return ArrayView<double>(reinterpret_cast<const double *>(c.data), d.nRows);
+}
+
+/**
+ * @brief An int32 column, viewed in place in the mapping (valid as long as the reader).
+ */
+ArrayView<int32_t> ColumnFileReader::getIntColumn(const std::string & datum, const std::string & column) const {
+	const DatumInfo & d = _datum(datum);
+	const Column & c = _column(d, column);
+	if (c.type != COLUMN_INT32) throw fatal_error() << "ERROR: column " << column << " of " << datum << " is not int32!";
+	return ArrayView<int32_t>(reinterpret_cast<const int32_t *>(c.data), d.nRows);
+}
+
+/**
+ * @brief The trial IDs in a datum's trial index (empty if the datum has none).
+ */
+std::vector<int> ColumnFileReader::getTrialIds(const std::string & datum) const {
+	const DatumInfo & d = _datum(datum);
+	std::vector<int> ids(d.nTrials);
+	for (size_t i=0; i<d.nTrials; ++i) ids[i] = d.index[3*i];
+	return ids;
+}
+
+/**
+ * @brief The rows of a trial in a datum, found by binary search of its trial index.
+ */
+TrialSegment ColumnFileReader::getTrialSegment(const std::string & datum, int trialId) const {
+	const DatumInfo & d = _datum(datum);
+	size_t lo = 0, hi = d.nTrials;
+	while (lo < hi){
+		size_t mid = (lo + hi) / 2;
+		if (d.index[3*mid] < trialId) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo == d.nTrials || d.index[3*lo] != trialId) throw fatal_error() << "ERROR: trial " << trialId << " is not in datum " << datum << " of " << _filename << "!";
+	TrialSegment s = {trialId, unsigned(d.index[3*lo+1]), unsigned(d.index[3*lo+2])};
+	return s;
+}
+
+/**
+ * @brief The rows of one trial of a datum, all columns converted to double.
+ * @details For a TraceDatum this is the trial's trace, as in TraceDatum::getTraces().
+ */
+mat ColumnFileReader::getTrial(const std::string & datum, int trialId) const {
+	TrialSegment s = getTrialSegment(datum, trialId);
+	mat out;
+	_fillRows(_datum(datum), s.begin, s.end, out);
+	return out;
+}
+
+/**
+ * @brief All rows of a datum as a matrix (the same values as its CSV file).
+ */
+mat ColumnFileReader::getMat(const std::string & datum) const {
+	const DatumInfo & d = _datum(datum);
+	mat out;
+	_fillRows(d, 0, d.nRows, out);
+	return out;
+}
+
+void ColumnFileReader::_fillRows(const DatumInfo & d, size_t begin, size_t end, mat & out) const {
+	out.set_size(end - begin, d.columns.size());
+	for (unsigned j=0; j<d.columns.size(); ++j){
+		double * col = out.colptr(j);
+		if (d.columns[j].type == COLUMN_FLOAT64){
+			const double * src = reinterpret_cast<const double *>(d.columns[j].data);
+			std::copy(src + begin, src + end, col);
+		} else {
+			const int32_t * src = reinterpret_cast<const int32_t *>(d.columns[j].data);
+			std::copy(src + begin, src + end, col);
+		}
+	}
+}
+
+const ColumnFileReader::DatumInfo & ColumnFileReader::_datum(const std::string & name) const {
+	for (unsigned i=0; i<_datums.size(); ++i){
+		if (_datums[i].name == name) return _datums[i];
+	}
+	throw fatal_error() << "ERROR: no datum " << name << " in " << _filename << "!";
+}
+
+const ColumnFileReader::Column & ColumnFileReader::_column(const DatumInfo & d, const std::string & name) const {
+	for (unsigned j=0; j<d.columns.size(); ++j){
+		if (d.columns[j].name == name) return d.columns[j];
+	}
+	throw fatal_error() << "ERROR: datum " << d.name << " of " << _filename << " has no column " << name << "!";
+}
+
+int64_t ColumnFileReader::_readInt(size_t & pos) const {
+	int64_t x;
+	memcpy(&x, _ptr(pos, sizeof(x)), sizeof(x));
+	pos += sizeof(x);
+	return x;
+}
+
+std::string ColumnFileReader::_readString(size_t & pos) const {
+	int64_t n = _readInt(pos);
+	std::string s(_ptr(pos, n), n);
+	pos += n;
+	return s;
+}
+
+/**
+ * @brief Pointer to bytes [offset, offset + bytes) of the file, checking they are in it.
+ */
+const char * ColumnFileReader::_ptr(int64_t offset, size_t bytes) const {
+	if (offset < 0 || size_t(offset) > _size || bytes > _size - offset) throw fatal_error() << "ERROR: " << _filename << " is truncated or corrupt!";
+	return _data + offset;
+}
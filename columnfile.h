@@ -0,0 +1,194 @@
+// include guard
+#ifndef COLUMNFILE_H
+#define COLUMNFILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <algorithm>
+#include <armadillo>
+
+#include "arrayview.h"
+#include "fatal_error.h"
+
+/**
+ * @brief Type codes of the columns in a column file.
+ */
+enum ColumnType {
+	COLUMN_INT32 = 1, ///< 32-bit signed integers (trial IDs, contexts, targets, counts)
+	COLUMN_FLOAT64 = 2 ///< doubles (everything else)
+};
+
+/**
+ * @brief Writes the datums of a Recorder into a single binary file of typed columns.
+ * @details Layout (all integers and doubles in the byte order of the writing machine,
+ * which is little-endian on everything we run on):
+ *
+ * - bytes 0-7: the magic string "CDDMCOL1"; bytes 8-15: int64 offset of the directory.
+ * - the data: every column of every datum as one contiguous array (int32 or float64),
+ *   followed by the datum's trial index, an array of nTrials (int64 trial ID, int64 first
+ *   row, int64 one past the last row) triples. Every array starts at a multiple of 8 bytes,
+ *   so a memory-mapped file can be read in place.
+ * - the directory: int64 number of datums, then for each datum its name (int64 length, then
+ *   the characters), int64 nRows, int64 nColumns, for each column its name, int64 type
+ *   (ColumnType) and int64 offset of its array, and finally int64 nTrials and int64 offset
+ *   of its trial index.
+ *
+ * Datums describe themselves in IDatum::writeColumns() by calling beginDatum(), column()
+ * once per column and (if their rows belong to trials) index(). R/read_cddm_columns.R
+ * reads the file with plain readBin() calls, and ColumnFileReader gives random access to
+ * it in C++.
+ */
+class ColumnFileWriter {
+public:
+	explicit ColumnFileWriter(const std::string & filename);
+	~ColumnFileWriter();
+	void beginDatum(const std::string & name, size_t nRows);
+	template<typename T> void column(const std::string & name, const T * data, size_t stride=1);
+	template<typename Stored, typename T> void columnAs(const std::string & name, const T * data, size_t stride=1);
+	template<typename Segments> void index(const Segments & segments);
+	void close();
+
+protected:
+	/// A column as stored in the directory.
+	struct ColumnEntry {
+		std::string name; ///< column name
+		int64_t type; ///< ColumnType
+		int64_t offset; ///< offset of the column's array in the file
+	};
+	/// A datum as stored in the directory.
+	struct DatumEntry {
+		std::string name; ///< datum key
+		int64_t nRows; ///< number of rows (the length of every column)
+		std::vector<ColumnEntry> columns; ///< the datum's columns
+		int64_t nTrials; ///< number of trials in the index (0 if not indexed)
+		int64_t indexOffset; ///< offset of the trial index
+	};
+	ColumnFileWriter(const ColumnFileWriter &) = delete;
+	ColumnFileWriter & operator=(const ColumnFileWriter &) = delete;
+	void _write(const void * data, size_t bytes);
+	void _align();
+	void _writeInt(int64_t x);
+	void _writeString(const std::string & s);
+	FILE * _file; ///< the file, nullptr once closed
+	std::string _filename; ///< name of the file (for error messages)
+	int64_t _offset; ///< bytes written so far
+	std::vector<DatumEntry> _datums; ///< directory so far
+};
+
+/**
+ * @brief Memory-mapped, random access reader for files written by ColumnFileWriter.
+ * @details Opening the file only parses its directory; columns are returned as views into
+ * the mapping (so nothing is read from disk until used), and getTrial() finds a trial
+ * through the datum's trial index by binary search. Trial IDs within a datum are
+ * increasing, as everything recorded through Recorder is.
+ */
+class ColumnFileReader {
+public:
+	explicit ColumnFileReader(const std::string & filename);
+	~ColumnFileReader();
+	std::vector<std::string> getDatumNames() const;
+	bool hasDatum(const std::string & datum) const;
+	size_t getNRows(const std::string & datum) const;
+	std::vector<std::string> getColumnNames(const std::string & datum) const;
+	ColumnType getColumnType(const std::string & datum, const std::string & column) const;
+	ArrayView<double> getColumn(const std::string & datum, const std::string & column) const;
+	ArrayView<int32_t> getIntColumn(const std::string & datum, const std::string & column) const;
+	std::vector<int> getTrialIds(const std::string & datum) const;
+	TrialSegment getTrialSegment(const std::string & datum, int trialId) const;
+	arma::mat getTrial(const std::string & datum, int trialId) const;
+	arma::mat getMat(const std::string & datum) const;
+
+protected:
+	/// A column of the directory.
+	struct Column {
+		std::string name; ///< column name
+		ColumnType type; ///< type of the values
+		const char * data; ///< start of the values in the mapping
+	};
+	/// A datum of the directory.
+	struct DatumInfo {
+		std::string name; ///< datum key
+		size_t nRows; ///< length of every column
+		std::vector<Column> columns; ///< the datum's columns
+		size_t nTrials; ///< number of entries in the trial index
+		const int64_t * index; ///< the trial index (nTrials triples)
+	};
+	ColumnFileReader(const ColumnFileReader &) = delete;
+	ColumnFileReader & operator=(const ColumnFileReader &) = delete;
+	const DatumInfo & _datum(const std::string & name) const;
+	const Column & _column(const DatumInfo & d, const std::string & name) const;
+	void _fillRows(const DatumInfo & d, size_t begin, size_t end, arma::mat & out) const;
+	int64_t _readInt(size_t & pos) const;
+	std::string _readString(size_t & pos) const;
+	const char * _ptr(int64_t offset, size_t bytes) const;
+	std::string _filename; ///< name of the file (for error messages)
+	const char * _data; ///< the mapping
+	size_t _size; ///< size of the file
+	std::vector<DatumInfo> _datums; ///< the directory
+};
+
+/**
+ * @brief Write a column of the current datum (nRows values starting at data).
+ * @details Integral types are stored as int32, everything else as float64.
+ * @param name column name
+ * @param data first value
+ * @param stride distance between consecutive values (e.g. the row width for one column of a row-major buffer)
+ */
+template<typename T>
+void ColumnFileWriter::column(const std::string & name, const T * data, size_t stride){
+	columnAs<typename std::conditional<std::is_integral<T>::value, int32_t, double>::type>(name, data, stride);
+}
+
+/**
+ * @brief Write a column of the current datum, converting the values to Stored.
+ * @details E.g. columnAs<int32_t>() for trial IDs kept in a buffer of doubles.
+ * @tparam Stored int32_t or double
+ */
+template<typename Stored, typename T>
+void ColumnFileWriter::columnAs(const std::string & name, const T * data, size_t stride){
+	static_assert(std::is_same<Stored, int32_t>::value || std::is_same<Stored, double>::value, "column files store int32 or double");
+	#ifndef DISABLE_ERROR_CHECKS
+	if (_datums.empty()) throw fatal_error() << "ERROR: writing column " << name << " to " << _filename << " before beginDatum()!";
+	#endif
+	_align();
+	ColumnEntry c = {name, std::is_same<Stored, int32_t>::value ? COLUMN_INT32 : COLUMN_FLOAT64, _offset};
+	_datums.back().columns.push_back(c);
+	size_t n = _datums.back().nRows;
+	if (stride == 1 && std::is_same<T, Stored>::value){
+		_write(data, n * sizeof(Stored));
+		return;
+	}
+	// gather (and convert) in chunks
+	static const size_t chunk = 4096;
+	Stored buf[chunk];
+	for (size_t i=0; i<n; i+=chunk){
+		size_t m = std::min(chunk, n - i);
+		for (size_t k=0; k<m; ++k) buf[k] = Stored(data[(i + k) * stride]);
+		_write(buf, m * sizeof(Stored));
+	}
+}
+
+/**
+ * @brief Write the trial index of the current datum.
+ * @param segments the TrialSegment's of the datum (anything iterable, e.g. TrialSegments or a vector)
+ */
+template<typename Segments>
+void ColumnFileWriter::index(const Segments & segments){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (_datums.empty()) throw fatal_error() << "ERROR: writing a trial index to " << _filename << " before beginDatum()!";
+	#endif
+	_align();
+	_datums.back().indexOffset = _offset;
+	int64_t n = 0;
+	for (TrialSegment s : segments){
+		int64_t triple[3] = {s.trialId, s.begin, s.end};
+		_write(triple, sizeof(triple));
+		++n;
+	}
+	_datums.back().nTrials = n;
+}
+
+#endif
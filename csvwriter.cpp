@@ -0,0 +1,296 @@
+#include "csvwriter.h"
+#include "fatal_error.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+/**
+ * @param shortest write doubles shortest round trip instead of in the datums' formats
+ * @param bufferBytes size of the buffer (at least 64 bytes are used)
+ */
+CsvWriter::CsvWriter(bool shortest, size_t bufferBytes): _out(nullptr), _buffer(std::max(bufferBytes, size_t(64))), _pos(0), _rowStart(true), _shortest(shortest) {
+	setFormat(GENERAL, 6);
+}
+
+/**
+ * @brief Write out whatever is still buffered.
+ */
+CsvWriter::~CsvWriter(){
+	if (_out != nullptr && _pos > 0) _out->write(_buffer.data(), _pos);
+}
+
+/**
+ * @brief Start writing to out (at the start of a row), keeping the buffer.
+ */
+void CsvWriter::attach(std::ostream & out){
+	detach();
+	_out = &out;
+	_rowStart = true;
+}
+
+/**
+ * @brief Write out the buffer and stop writing to the attached stream.
+ */
+void CsvWriter::detach(){
+	if (_out == nullptr) return;
+	flush();
+	_out = nullptr;
+}
+
+/**
+ * @brief Write the buffer to the attached stream.
+ */
+void CsvWriter::flush(){
+	if (_pos == 0) return;
+	#ifndef DISABLE_ERROR_CHECKS
+	if (_out == nullptr) throw fatal_error() << "ERROR: CsvWriter has no stream to write to!";
+	#endif
+	_out->write(_buffer.data(), _pos);
+	_pos = 0;
+}
+
+/**
+ * @brief Set the format of the numbers that follow (ignored for doubles in shortest mode).
+ * @param notation GENERAL (%g) or SCIENTIFIC (%e)
+ * @param precision as for printf
+ */
+void CsvWriter::setFormat(Notation notation, int precision){
+	_notation = notation;
+	_precision = precision;
+	int digits = std::min(notation == SCIENTIFIC ? precision + 1 : precision, 18);
+	_integerLimit = 1;
+	for (int i=0; i<digits; ++i) _integerLimit *= 10;
+}
+
+/**
+ * @brief Does the writer write doubles shortest round trip?
+ */
+bool CsvWriter::isShortest() const {
+	return _shortest;
+}
+
+/**
+ * @brief Write a double in the current format (or shortest round trip).
+ */
+void CsvWriter::field(double x){
+	_separate();
+	if (_shortest){
+		_writeShortest(x);
+		return;
+	}
+	if (_notation == SCIENTIFIC){
+		// armadillo writes zeros unsigned and spells out nan and inf
+		if (x == 0) x = 0;
+		if (std::isnan(x)){
+			_put("nan");
+			return;
+		}
+		if (std::isinf(x)){
+			_put(x < 0 ? "-inf" : "inf");
+			return;
+		}
+	}
+	if (std::fabs(x) < _integerLimit && x == double(static_cast<long long>(x)) && !(x == 0 && std::signbit(x))){
+		if (_notation == SCIENTIFIC) _scientificInteger(static_cast<long long>(x));
+		else _integer(static_cast<long long>(x));
+		return;
+	}
+	char * p = _reserve(32);
+	_pos += snprintf(p, 32, _notation == SCIENTIFIC ? "%.*e" : "%.*g", _precision, x);
+}
+
+/**
+ * @brief Write a float (as std::ostream does, i.e. as the double it converts to).
+ */
+void CsvWriter::field(float x){
+	field(double(x));
+}
+
+/**
+ * @brief Write a long double in the current format (or shortest round trip for a long double).
+ */
+void CsvWriter::field(long double x){
+	_separate();
+	char * p = _reserve(48);
+	if (!_shortest){
+		_pos += snprintf(p, 48, _notation == SCIENTIFIC ? "%.*Le" : "%.*Lg", _precision, x);
+		return;
+	}
+	for (int precision=15; precision<=21; ++precision){
+		int n = snprintf(p, 48, "%.*Lg", precision, x);
+		if (precision == 21 || strtold(p, nullptr) == x || std::isnan(x)){
+			_pos += n;
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Write an integer.
+ */
+void CsvWriter::field(int x){
+	_separate();
+	_integer(x);
+}
+
+/**
+ * @brief Write an unsigned integer.
+ */
+void CsvWriter::field(unsigned x){
+	_separate();
+	_integer(x);
+}
+
+/**
+ * @brief Write an integer.
+ */
+void CsvWriter::field(long long x){
+	_separate();
+	_integer(x);
+}
+
+/**
+ * @brief Write a string field as is (no quoting, so it shouldn't contain commas).
+ */
+void CsvWriter::field(const char * s){
+	_separate();
+	_put(s);
+}
+
+/**
+ * @brief Write a string field as is (no quoting, so it shouldn't contain commas).
+ */
+void CsvWriter::field(const std::string & s){
+	field(s.c_str());
+}
+
+/**
+ * @brief Write text as is, without separators (e.g. a datum's own CSV string).
+ */
+void CsvWriter::raw(const std::string & s){
+	if (s.empty()) return;
+	if (s.size() > _buffer.size()){
+		flush();
+		#ifndef DISABLE_ERROR_CHECKS
+		if (_out == nullptr) throw fatal_error() << "ERROR: CsvWriter has no stream to write to!";
+		#endif
+		_out->write(s.data(), s.size());
+	} else {
+		memcpy(_reserve(s.size()), s.data(), s.size());
+		_pos += s.size();
+	}
+	_rowStart = s[s.size()-1] == '\n';
+}
+
+/**
+ * @brief End the current row.
+ */
+void CsvWriter::endRow(){
+	*_reserve(1) = '\n';
+	++_pos;
+	_rowStart = true;
+}
+
+/**
+ * @brief Put a comma before every field but the first of a row.
+ */
+void CsvWriter::_separate(){
+	if (!_rowStart){
+		*_reserve(1) = ',';
+		++_pos;
+	}
+	_rowStart = false;
+}
+
+/**
+ * @brief Append a short string (shorter than the buffer). 
+ */
+void CsvWriter::_put(const char * s){
+	size_t n = strlen(s);
+	memcpy(_reserve(n), s, n);
+	_pos += n;
+}
+
+/**
+ * @brief Make room for n bytes at _pos (n must fit in the buffer), flushing if needed.
+ */
+char * CsvWriter::_reserve(size_t n){
+	if (_pos + n > _buffer.size()) flush();
+	return _buffer.data() + _pos;
+}
+
+/**
+ * @brief Write the decimal digits of x.
+ */
+void CsvWriter::_integer(long long x){
+	char digits[24];
+	int n = 0;
+	unsigned long long u = x < 0 ? 0ULL - static_cast<unsigned long long>(x) : x;
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	char * p = _reserve(n + 1);
+	if (x < 0){
+		*p++ = '-';
+		++_pos;
+	}
+	for (int i=n-1; i>=0; --i) *p++ = digits[i];
+	_pos += n;
+}
+
+/**
+ * @brief Write an integer with at most precision+1 digits as %e would (exactly, since no rounding is needed).
+ */
+void CsvWriter::_scientificInteger(long long x){
+	char digits[24];
+	int n = 0;
+	unsigned long long u = x < 0 ? 0ULL - static_cast<unsigned long long>(x) : x;
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	char * start = _reserve(_precision + 10);
+	char * p = start;
+	if (x < 0) *p++ = '-';
+	*p++ = digits[n-1];
+	if (_precision > 0) *p++ = '.';
+	for (int i=0; i<_precision; ++i) *p++ = i < n-1 ? digits[n-2-i] : '0';
+	*p++ = 'e';
+	*p++ = '+';
+	int exponent = n - 1;
+	*p++ = '0' + exponent / 10;
+	*p++ = '0' + exponent % 10;
+	_pos += p - start;
+}
+
+/**
+ * @brief Write x with the fewest significant digits that read back as x.
+ * @details Integers below 1e15 are written as integers. Otherwise %.15g is shortest if
+ * anything with 15 digits or fewer round trips (since %g drops trailing zeros), and
+ * 17 digits always do.
+ */
+void CsvWriter::_writeShortest(double x){
+	if (std::isnan(x)){
+		_put("nan");
+		return;
+	}
+	if (std::isinf(x)){
+		_put(x < 0 ? "-inf" : "inf");
+		return;
+	}
+	if (std::fabs(x) < 1e15 && x == double(static_cast<long long>(x)) && !(x == 0 && std::signbit(x))){
+		_integer(static_cast<long long>(x));
+		return;
+	}
+	char * p = _reserve(32);
+	for (int precision=15; precision<=17; ++precision){
+		int n = snprintf(p, 32, "%.*g", precision, x);
+		if (precision == 17 || strtod(p, nullptr) == x){
+			_pos += n;
+			return;
+		}
+	}
+}
@@ -0,0 +1,68 @@
+// include guard
+#ifndef CSVWRITER_H
+#define CSVWRITER_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+/**
+ * @brief Buffered CSV writer that formats numbers straight into a reusable buffer.
+ * @details Fields are appended to a buffer of bufferBytes (allocated once, and kept
+ * when the writer is attached to the next stream), which is written to the attached
+ * std::ostream whenever it fills up, so files are written incrementally rather than
+ * built as one string. Separators are handled by the writer: call field() for each
+ * value and endRow() at the end of each row.
+ *
+ * By default numbers are formatted the way our CSVs always were, so output is byte for
+ * byte the same as before: GENERAL is what std::ostream does with a given precision
+ * (printf's %g), SCIENTIFIC is armadillo's csv_ascii (%e, with zero unsigned and nan and
+ * inf spelled out). Integral values take a fast path that never calls printf. In shortest
+ * mode every double is instead written with the fewest significant digits (at most 17)
+ * that read back to exactly the same double, whatever format the datum asks for.
+ */
+class CsvWriter {
+public:
+	/// How numbers are formatted outside shortest mode.
+	enum Notation {
+		GENERAL, ///< printf's %g, what std::ostream does by default
+		SCIENTIFIC ///< printf's %e, as armadillo's csv_ascii
+	};
+	explicit CsvWriter(bool shortest=false, size_t bufferBytes=1 << 16);
+	~CsvWriter();
+	void attach(std::ostream & out);
+	void detach();
+	void flush();
+	void setFormat(Notation notation, int precision);
+	bool isShortest() const;
+	void field(double x);
+	void field(float x);
+	void field(long double x);
+	void field(int x);
+	void field(unsigned x);
+	void field(long long x);
+	void field(const char * s);
+	void field(const std::string & s);
+	void raw(const std::string & s);
+	void endRow();
+
+protected:
+	CsvWriter(const CsvWriter &) = delete;
+	CsvWriter & operator=(const CsvWriter &) = delete;
+	void _separate();
+	char * _reserve(size_t n);
+	void _integer(long long x);
+	void _scientificInteger(long long x);
+	void _put(const char * s);
+	void _writeShortest(double x);
+	std::ostream * _out; ///< stream the buffer is written to, nullptr if detached
+	std::vector<char> _buffer; ///< formatted text not yet written
+	size_t _pos; ///< bytes used in _buffer
+	bool _rowStart; ///< is the next field the first of its row?
+	bool _shortest; ///< write shortest round trip doubles whatever the format?
+	Notation _notation; ///< notation for numbers (outside shortest mode)
+	int _precision; ///< precision for numbers (outside shortest mode)
+	long long _integerLimit; ///< 10^precision (GENERAL) or 10^(precision+1) (SCIENTIFIC), integers below this take the fast path
+};
+
+#endif
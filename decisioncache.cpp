@@ -0,0 +1,83 @@
+#include "decisioncache.h"
+#include "fatal_error.h"
+
+const std::vector<std::string> DecisionCache::nondecisionKeys = {"eblMean", "eblSd", "motorPlanMean", "motorExecMean", "motorSd"}; 
+
+/**
+ * @brief Constructor for DecisionCache. 
+ * @param capacity maximum number of parameter sets to keep
+ */
+DecisionCache::DecisionCache(unsigned capacity): _capacity(capacity), _recording(false){
+    #ifndef DISABLE_ERROR_CHECKS
+    if (capacity == 0) throw fatal_error() << "ERROR: DecisionCache needs a capacity of at least 1!"; 
+    #endif
+}
+
+/**
+ * @brief Build the cache key for a Config: its string representation with the nondecision keys removed. 
+ */
+std::string DecisionCache::decisionKey(const Config * c){
+    Config decisionPart = *c; 
+    for (unsigned i=0; i<nondecisionKeys.size(); ++i){
+        if (decisionPart.keyExists(nondecisionKeys[i])) decisionPart.unset(nondecisionKeys[i]); 
+    }
+    return decisionPart.stringRepr(); 
+}
+
+/**
+ * @brief Check whether a finished run with this key is cached. 
+ */
+bool DecisionCache::contains(const std::string & key){
+    return _entries.find(key) != _entries.end(); 
+}
+
+/**
+ * @brief Get the cached decisions for a key, in the order the trials were run. 
+ */
+const std::vector<DecisionSample> & DecisionCache::getSamples(const std::string & key){
+    std::map<std::string, std::vector<DecisionSample> >::const_iterator it = _entries.find(key); 
+    #ifndef DISABLE_ERROR_CHECKS
+    if (it == _entries.end()) throw fatal_error() << "ERROR: no cached decisions for key " << key; 
+    #endif
+    return it->second; 
+}
+
+/**
+ * @brief Start recording a run under key. 
+ * @details Anything recorded since an earlier start() without a matching finish() 
+ * (e.g. because the run threw) is discarded. 
+ */
+void DecisionCache::start(const std::string & key){
+    _currentKey = key; 
+    _current.clear(); 
+    _recording = true; 
+}
+
+/**
+ * @brief Record the decision of one trial. Does nothing unless a run was started. 
+ */
+void DecisionCache::record(const DecisionSample & s){
+    if (_recording) _current.push_back(s); 
+}
+
+/**
+ * @brief Finish recording the current run and store it, dropping the oldest run if over capacity. 
+ */
+void DecisionCache::finish(){
+    if (!_recording) return; 
+    _recording = false; 
+    if (!contains(_currentKey)) _order.push_back(_currentKey); 
+    _entries[_currentKey].swap(_current); 
+    _current.clear(); 
+    while (_order.size() > _capacity){
+        _entries.erase(_order.front()); 
+        _order.pop_front(); 
+    }
+}
+
+/**
+ * @brief Number of parameter sets in the cache. 
+ */
+unsigned DecisionCache::size(){
+    return _entries.size(); 
+}
@@ -0,0 +1,55 @@
+// include guard
+#ifndef DECISIONCACHE_H
+#define DECISIONCACHE_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "config.h"
+
+/**
+ * @brief The outcome of the decision process on one trial, without any nondecision time. 
+ */
+struct DecisionSample{
+    int context; ///< context shown on the trial
+    int target; ///< target shown on the trial
+    double decisionTime; ///< time (in ms, from the start of decision sampling) at which the decision was made
+    int resp; ///< the response
+    bool premature; ///< true if this was a premature response made without sampling (see \ref pPrematureResp)
+};
+
+/**
+ * @brief Caches decision times and responses across runs with different nondecision parameters. 
+ * @details RT in the tasks is decision time plus independently drawn eye-brain lag, motor 
+ * planning and motor execution durations from Architecture. When only those nondecision 
+ * parameters change (e.g. when fitting \ref eblMean and friends), rerunning the decision 
+ * process is wasted work. An Experiment running a Task that has a DecisionCache stores the 
+ * DecisionSample of every trial under a key built from the decision-relevant part of the 
+ * Config (everything but the nondecision keys). If a later run has the same key, the trials 
+ * are replayed from the cache with Task::replay(), which only draws fresh nondecision times. 
+ * 
+ * The cache holds a bounded number of parameter sets, dropping the oldest first. 
+ */
+class DecisionCache{
+    public: 
+        DecisionCache(unsigned capacity=16); 
+        static std::string decisionKey(const Config * c); 
+        bool contains(const std::string & key); 
+        const std::vector<DecisionSample> & getSamples(const std::string & key); 
+        void start(const std::string & key); 
+        void record(const DecisionSample & s); 
+        void finish(); 
+        unsigned size(); 
+        static const std::vector<std::string> nondecisionKeys; ///< Config keys that only affect nondecision times 
+
+    protected: 
+        std::map<std::string, std::vector<DecisionSample> > _entries; ///< finished runs by decision key
+        std::deque<std::string> _order; ///< keys in _entries, oldest first (for eviction)
+        unsigned _capacity; ///< maximum number of parameter sets to keep
+        bool _recording; ///< true between start() and finish()
+        std::string _currentKey; ///< key of the run being recorded
+        std::vector<DecisionSample> _current; ///< samples of the run being recorded
+};
+
+#endif
@@ -18,11 +18,18 @@ AxcptTask::~AxcptTask(){
  * \ref retentionIntervalDur. Also containing either \ref totalNoise and \ref proportionContextNoise, 
  * or \ref contextNoise and \ref targetNoise. Also optionally contains \ref retentionNoise 
  * (which is otherwise set to \ref contextNoise or \ref totalNoise * \ref proportionContextNoise, 
- * depending on what is available). 
+ * depending on what is available). Optionally contains \ref decisionThreshes to sweep several 
+ * thresholds in one pass; \ref adaptiveStepping is rejected (see AdaptiveStepper). With 
+ * \ref useForgetBelief set, the context is forgotten (ForgetBelief, \ref forgetProb) instead of decaying. 
  * @param r a Recorder. 
  */
 AxcptTask::AxcptTask(const Config * c, Recorder * r):Task(c,r),_arch(Architecture(c)), _trialTime(-1), _nPrecomputeSamps(-1), _decayTo(Informative) {
-    _belief = new DecayBelief(c); 
+    _useForgetBelief = _config->keyExists("useForgetBelief") && _config->get<int>("useForgetBelief") == 1; 
+    if (_useForgetBelief){
+        _belief = new ForgetBelief(c); 
+    } else {
+        _belief = new DecayBelief(c); 
+    }
     _traceDatumNames = {"post"}; 
     _summaryDatumNames = {"RT", "Resp", "Acc","CorrectRT","IncorrectRT"};
     _eventDatumNames = {"eblEvent", "motorPlanEvent", "motorExecEvent", "samplingBothEvent", "samplingContextEvent"}; 
@@ -65,21 +72,47 @@ AxcptTask::AxcptTask(const Config * c, Recorder * r):Task(c,r),_arch(Architectur
     if (_decisionThresh < 0) throw fatal_error() << "ERROR: decisionThresh < 0, did you set it (MinimalArchAxcptTask is implemented in prob space, not log space)?";
     if (_decisionThresh >= 1) throw fatal_error() << "ERROR: decisionThresh >=1 (MinimalArchAxcptTask is implemented in prob space, not log space) ";
     #endif
-    _belief = new DecayBelief(c);  // create a new one, will be cleared by the minimal arch destructor
     _retentionIntervalDur = _config->get<double>("retentionIntervalDur");
+    _setupThresholdSweep({"DecisionTime", "RT", "Resp", "Acc"}); 
+    _sweepDecisionTimes.resize(_decisionThreshes.size()); 
+    _sweepResps.resize(_decisionThreshes.size()); 
+    _postId = _traceDatumId("post"); 
+    if (_decisionThreshes.empty()){
+        _rtId = _summaryDatumId("RT"); 
+        _respId = _summaryDatumId("Resp"); 
+        _accId = _summaryDatumId("Acc"); 
+        _correctRtId = _summaryDatumId("CorrectRT"); 
+        _incorrectRtId = _summaryDatumId("IncorrectRT"); 
+    } else {
+        _sweepDecisionTimeIds = _threshDatumIds("DecisionTime"); 
+        _sweepRTIds = _threshDatumIds("RT"); 
+        _sweepRespIds = _threshDatumIds("Resp"); 
+        _sweepAccIds = _threshDatumIds("Acc"); 
+    }
+    _eblEventId = _eventDatumId("eblEvent"); 
+    _motorPlanEventId = _eventDatumId("motorPlanEvent"); 
+    _motorExecEventId = _eventDatumId("motorExecEvent"); 
+    _samplingBothEventId = _eventDatumId("samplingBothEvent"); 
+    _samplingContextEventId = _eventDatumId("samplingContextEvent"); 
     if (!c->keyExists("decayTo")){
         _decayTo = Informative; 
     } else {
         _decayTo = _config->get<int>("decayTo") == 0 ? Informative : Uniform; // this is going to bite us? 
     }
+    #ifndef DISABLE_ERROR_CHECKS
+    // the probability that context and target match isn't monotone in the evidence sums, so 
+    // AdaptiveStepper's linearized crossing probabilities don't hold, and it can't see the latched stop
+    if (_config->keyExists("adaptiveStepping") && _config->get<int>("adaptiveStepping") == 1) throw fatal_error() << "ERROR: adaptiveStepping is only supported in FlankerTask, AX-CPT has to step through every timestep!"; 
+    #endif
 }
 
 /**
  * @brief Record the current posterior into Recorder. 
+ * @param keep keep it even in decimated traces (see \ref traceEvery), e.g. at a threshold crossing
+ * @param decision is this the posterior the response is decided on (see \ref responseLockedWindow)? 
  */
-void AxcptTask::_recordBelief(){
-    mat post = _belief->getBelief(); 
-    _recorder->updateDatum(_trialLabel + "post", Timepoint(_trialTime,vectorise(post)));
+void AxcptTask::_recordBelief(bool keep, bool decision){
+    _recordTrace(_postId, Timepoint(_trialTime, _belief->getBelief(), keep, decision)); // views the posterior, the datum copies it into its storage
 }
 
 /**
@@ -92,7 +125,8 @@ void AxcptTask::_recordBelief(){
  * and target are sampled, the former from memory. If the decision threshold has been
  * crossed when the target appears, motor planning starts immediately. Otherwise, 
  * both are sampled from until a decision threshold over the response is reached, 
- * at which point motor planning commences. 
+ * at which point motor planning commences. With \ref decisionThreshes set, all thresholds 
+ * are run in one pass (see AxcptTask::_runThresholdSweep()). 
  */
 void AxcptTask::run(){
     drawTrialType();
@@ -102,9 +136,9 @@ void AxcptTask::run(){
     int cresp = _context == _target ? 1 : 0; 
     double eblDur = _arch.drawEBL(); 
     _nPrecomputeSamps = (_retentionIntervalDur) / _timePerStep; 
-    _recorder->updateDatum(_trialLabel+"eblEvent", Event(_retentionIntervalDur, _retentionIntervalDur+eblDur)); 
+    _recordEvent(_eblEventId, Event(_retentionIntervalDur, _retentionIntervalDur+eblDur)); 
     _precomputeSamples(); 
-    mat post; 
+    const mat & post = _belief->getBelief(); // the posterior itself, so it follows every update
     double dv=0, oldDv=0; 
     int samp = 0; 
     double sampStart = _trialTime; 
@@ -113,71 +147,213 @@ void AxcptTask::run(){
         int prematureResponse = RNG::rbernoulli(_pPrematureResponse);
 
         if (prematureResponse==1){
-            // immediately start motor planning
-            double motorPlanning = _arch.drawMotorPlanning(); 
-            double motorTimeDur = _arch.drawMotorExec(); 
             // coin flip for the response
-            double resp = RNG::rbernoulli(0.5);
-            int acc = resp == cresp; 
-            _recorder->updateDatum(_trialLabel+"motorPlanEvent", Event(0, motorPlanning)); 
-            _recorder->updateDatum(_trialLabel + "Resp", double(resp));
-            _recorder->updateDatum(_trialLabel + "Acc", double(acc)); 
-            _recorder->updateDatum(_trialLabel+"motorExecEvent", Event(0, motorTimeDur)); 
-            _recorder->updateDatum(_trialLabel + "RT", motorTimeDur);
+            int resp = RNG::rbernoulli(0.5);
+            if (!_decisionThreshes.empty()){
+                // motor planning starts immediately, so RT is just motor execution
+                double motorPlanning = _arch.drawMotorPlanning(); 
+                double motorTimeDur = _arch.drawMotorExec(); 
+                int acc = resp == cresp; 
+                _recordEvent(_motorPlanEventId, Event(0, motorPlanning)); 
+                _recordEvent(_motorExecEventId, Event(0, motorTimeDur)); 
+                // a premature response is the same response for every threshold
+                for (unsigned k=0; k<_decisionThreshes.size(); ++k){
+                    _recordSummary(_sweepDecisionTimeIds[k], 0.0);
+                    _recordSummary(_sweepRespIds[k], double(resp));
+                    _recordSummary(_sweepAccIds[k], double(acc)); 
+                    _recordSummary(_sweepRTIds[k], motorTimeDur);
+                }
+                return; 
+            }
+            _cacheDecision(0, resp, true); 
+            _respondPrematurely(resp, cresp); 
             return; // finish the trial
         }
         
     }
     
-    for (samp; samp < _maxSamps; ++samp){
-        static_cast<DecayBelief*>(_belief)->updateFromContext(_contextNoise, _trialTime, _decayTo); 
+    if (!_decisionThreshes.empty()){
+        _runThresholdSweep(cresp, eblDur); 
+    } else {
+        for (; samp < _maxSamps; ++samp){
+            _updateFromContext(_contextNoise); 
+            _belief->updateFromTarget(_targetNoise); 
+            _trialTime += _timePerStep; 
+            oldDv = dv; 
+            dv = trace(post);
+            // if we crossed threshold OR DV hasn't changed based on the last sample (usually means we latched)
+            bool decided = dv > _decisionThresh || dv < (1-_decisionThresh) || (fabs(oldDv-dv) <= DBL_TOL); 
+            _recordBelief(decided, decided); // the decision is kept in decimated traces
+            if (decided){
+                // std::cout << dv << " " << (1-dv) << " " << _decisionThresh << std::endl; 
+                // 1 is left, 0 is right
+                int resp = dv > 0.5 ? 1 : 0; 
+                _cacheDecision(_trialTime - _retentionIntervalDur, resp); 
+                _respond(resp, cresp, eblDur, true); 
+                break; 
+            }            
+        }
+    }
+    _recordEvent(_samplingBothEventId, Event(sampStart, _trialTime)); 
+    #ifndef DISABLE_ERROR_CHECKS
+    if (samp == _maxSamps) throw fatal_error() << "ERROR: hit maxSamps (" << _maxSamps << ")! If you're sure you know what you're doing, you can increase maxSamps to prevent this, but verifying that you really need this many should be a first step!"; 
+    #endif
+
+}
+
+/**
+ * @brief Commit to a response and run out the motor components of the trial. 
+ * @details Records the response, accuracy, motor planning and execution events and the RT 
+ * (from target onset, into CorrectRT or IncorrectRT as well). During motor planning we keep 
+ * sampling (for d'oh effects and plotting) if sampleDuringMotorPlan is set, otherwise the 
+ * trial time just advances over it. 
+ * 
+ * @param resp the response (0 or 1)
+ * @param cresp the correct response
+ * @param eblDur the eye-brain lag drawn for this trial
+ * @param sampleDuringMotorPlan whether to keep updating the belief during motor planning
+ */
+void AxcptTask::_respond(int resp, int cresp, double eblDur, bool sampleDuringMotorPlan){
+    double motorPlanning = _arch.drawMotorPlanning(); 
+    _recordEvent(_motorPlanEventId, Event(_trialTime, _trialTime + motorPlanning)); 
+    // response is locked in now. but we sample for d'oh effects and plotting
+    int acc = resp == cresp ? 1 : 0; 
+    // use ints for resp and cresp to not run into float comparison issues...
+    // but then convert to doubles for mean and variance
+    _recordSummary(_respId, double(resp));
+    _recordSummary(_accId, double(acc)); 
+    int sampsDuringMotorPlan = motorPlanning / _timePerStep; 
+    if (sampleDuringMotorPlan){
+        // keep sampling during planning just for plotting
+        for (int i=0; i < sampsDuringMotorPlan; ++i){
+            _belief->updateFromContext(_contextNoise); 
+            _belief->updateFromTarget(_targetNoise); 
+            _trialTime += _timePerStep; 
+            _recordBelief(); 
+        }
+    } else {
+        _trialTime += sampsDuringMotorPlan * _timePerStep; 
+    }
+    double motorTimeDur = _arch.drawMotorExec(); 
+    _recordEvent(_motorExecEventId, Event(_trialTime, _trialTime + motorTimeDur)); 
+    double rt = _trialTime + motorTimeDur - _retentionIntervalDur + eblDur;
+    _recordSummary(_rtId, rt);
+    if (acc == 1){
+        _recordSummary(_correctRtId, rt);
+    } else {
+        _recordSummary(_incorrectRtId, rt);
+    }
+    _recordResponse(rt, acc == 1); 
+}
+
+/**
+ * @brief Respond as soon as the target comes on without sampling (see \ref pPrematureResp). 
+ * @details Motor planning starts immediately. Records the response, accuracy, motor 
+ * planning and execution events and the RT, which is just the motor execution time. 
+ * CorrectRT and IncorrectRT only hold the RTs of sampled decisions, so they are left alone. 
+ * 
+ * @param resp the response (0 or 1)
+ * @param cresp the correct response
+ */
+void AxcptTask::_respondPrematurely(int resp, int cresp){
+    double motorPlanning = _arch.drawMotorPlanning(); 
+    double motorTimeDur = _arch.drawMotorExec(); 
+    int acc = resp == cresp; 
+    _recordEvent(_motorPlanEventId, Event(0, motorPlanning)); 
+    _recordSummary(_respId, double(resp));
+    _recordSummary(_accId, double(acc)); 
+    _recordEvent(_motorExecEventId, Event(0, motorTimeDur)); 
+    _recordSummary(_rtId, motorTimeDur);
+    _recordResponse(motorTimeDur, acc == 1); 
+}
+
+/**
+ * @brief Replay a trial from a DecisionCache with new nondecision times. 
+ * @details Records the same trial-level datums and events as run(), but the decision time 
+ * and response come from the cache, so only the eye-brain lag and motor durations are drawn. 
+ * Neither the retention interval nor the posterior trace are simulated, but the retention 
+ * interval's samplingContextEvent is recorded as in run(). 
+ * 
+ * @param s the cached decision (decision time from target onset)
+ */
+void AxcptTask::replay(const DecisionSample & s){
+    _setTrialType(s.context, s.target); 
+    int cresp = _context == _target ? 1 : 0; 
+    double eblDur = _arch.drawEBL(); 
+    _nPrecomputeSamps = (_retentionIntervalDur) / _timePerStep; 
+    _recordEvent(_eblEventId, Event(_retentionIntervalDur, _retentionIntervalDur+eblDur)); 
+    _recordEvent(_samplingContextEventId, Event(0, _nPrecomputeSamps*_timePerStep)); 
+    if (s.premature){
+        _respondPrematurely(s.resp, cresp); 
+        return; 
+    }
+    _trialTime = _retentionIntervalDur + s.decisionTime; 
+    _respond(s.resp, cresp, eblDur, false); 
+    _recordEvent(_samplingBothEventId, Event(_retentionIntervalDur, _trialTime)); 
+}
+
+/**
+ * @brief Run the both-sampling part of a trial once for all thresholds in \ref decisionThreshes. 
+ * @details The evidence trajectory does not depend on the threshold, so we sample until the 
+ * largest threshold is crossed (or the decision variable latches), noting the time and response 
+ * at which each smaller one was crossed on the way. The nondecision components (eye-brain lag, 
+ * motor planning and execution) are drawn once per trial and shared by all thresholds. Records 
+ * DecisionTime (from target onset), RT, Resp and Acc for every threshold, and the motor planning 
+ * and execution events of the largest threshold, where sampling (and the trace) stops. 
+ * 
+ * @param cresp the correct response
+ * @param eblDur the eye-brain lag drawn for this trial
+ */
+void AxcptTask::_runThresholdSweep(int cresp, double eblDur){
+    unsigned nextThresh = 0; 
+    double dv = 0, oldDv = 0; 
+    int samp = 0; 
+    for (; samp < _maxSamps && nextThresh < _decisionThreshes.size(); ++samp){
+        _updateFromContext(_contextNoise); 
         _belief->updateFromTarget(_targetNoise); 
-        post = _belief->getBelief();
+        const mat & post = _belief->getBelief();
         _trialTime += _timePerStep; 
-        _recordBelief(); 
         oldDv = dv; 
         dv = trace(post);
-        // if we crossed threshold OR DV hasn't changed based on the last sample (usually means we latched)
-        if (dv > _decisionThresh || dv < (1-_decisionThresh) || (fabs(oldDv-dv) <= DBL_TOL)){
-            // std::cout << dv << " " << (1-dv) << " " << _decisionThresh << std::endl; 
-            double motorPlanning = _arch.drawMotorPlanning(); 
-            _recorder->updateDatum(_trialLabel+"motorPlanEvent", Event(_trialTime, _trialTime + motorPlanning)); 
-            // response is locked in now. but we sample for d'oh effects and plotting
-            // 1 is left, 0 is right
-            int resp = dv > 0.5 ? 1 : 0; 
-            int acc = resp == cresp ? 1 : 0; 
-            // use ints for resp and cresp to not run into float comparison issues...
-            // but then convert to doubles for mean and variance
-            _recorder->updateDatum(_trialLabel + "Resp", double(resp));
-            _recorder->updateDatum(_trialLabel + "Acc", double(acc)); 
-            // keep sampling during planning just for plotting
-            int sampsDuringMotorPlan = motorPlanning / _timePerStep; 
-            int i=0; 
-            for (i; i < sampsDuringMotorPlan; ++i){
-                _belief->updateFromContext(_contextNoise); 
-                _belief->updateFromTarget(_targetNoise); 
-                post = _belief->getBelief();
-                _trialTime += _timePerStep; 
-                _recordBelief(); 
-            }
-            double motorTimeDur = _arch.drawMotorExec(); 
-            _recorder->updateDatum(_trialLabel+"motorExecEvent", Event(_trialTime, _trialTime + motorTimeDur)); 
-            double rt = _trialTime + motorTimeDur - _retentionIntervalDur + eblDur;
-            _recorder->updateDatum(_trialLabel + "RT", rt);
-            if (acc == 1){
-                _recorder->updateDatum(_trialLabel + "CorrectRT", rt);
-            } else {
-                _recorder->updateDatum(_trialLabel + "IncorrectRT", rt);
-            }
-            break; 
-        }            
+        bool latched = fabs(oldDv-dv) <= DBL_TOL; 
+        _recordBelief(latched || dv > _decisionThreshes[nextThresh] || dv < (1-_decisionThreshes[nextThresh])); 
+        // thresholds are sorted, so crossing one means we crossed all the ones below it too
+        while (nextThresh < _decisionThreshes.size() && (dv > _decisionThreshes[nextThresh] || dv < (1-_decisionThreshes[nextThresh]) || latched)){
+            _sweepDecisionTimes[nextThresh] = _trialTime - _retentionIntervalDur; 
+            _sweepResps[nextThresh] = dv > 0.5 ? 1 : 0; 
+            ++nextThresh; 
+        }
     }
-
-    _recorder->updateDatum(_trialLabel+"samplingBothEvent", Event(sampStart, _trialTime)); 
     #ifndef DISABLE_ERROR_CHECKS
-    if (samp == _maxSamps) throw fatal_error() << "ERROR: hit maxSamps (" << _maxSamps << ")! If you're sure you know what you're doing, you can increase maxSamps to prevent this, but verifying that you really need this many should be a first step!"; 
+    if (nextThresh < _decisionThreshes.size()) throw fatal_error() << "ERROR: hit maxSamps (" << _maxSamps << ") before crossing decisionThresh " << _decisionThreshes[nextThresh] << "! If you're sure you know what you're doing, you can increase maxSamps to prevent this, but verifying that you really need this many should be a first step!"; 
     #endif
+    // the trial (and its trace) ends at the largest threshold, so its motor events follow that decision
+    double motorPlanning = _arch.drawMotorPlanning(); 
+    int sampsDuringMotorPlan = motorPlanning / _timePerStep; 
+    double motorExecStart = _trialTime + sampsDuringMotorPlan * _timePerStep; 
+    double motorTimeDur = _arch.drawMotorExec(); 
+    _recordEvent(_motorPlanEventId, Event(_trialTime, _trialTime + motorPlanning)); 
+    _recordEvent(_motorExecEventId, Event(motorExecStart, motorExecStart + motorTimeDur)); 
+    for (unsigned k=0; k<_decisionThreshes.size(); ++k){
+        double rt = _sweepDecisionTimes[k] + sampsDuringMotorPlan * _timePerStep + motorTimeDur + eblDur; 
+        _recordSummary(_sweepDecisionTimeIds[k], _sweepDecisionTimes[k]);
+        _recordSummary(_sweepRespIds[k], double(_sweepResps[k]));
+        _recordSummary(_sweepAccIds[k], double(_sweepResps[k] == cresp ? 1 : 0)); 
+        _recordSummary(_sweepRTIds[k], rt);
+    }
+}
 
+/**
+ * @brief Update from (memory of) the context, with decay or forgetting as configured. 
+ * @details Upon decay or forgetting, a context sample is drawn according to \ref decayTo. 
+ * @param noise SD of the context evidence distribution
+ * @return -1 for a sample from the true context, otherwise the context sampled from. 
+ */
+int AxcptTask::_updateFromContext(double noise){
+    if (_useForgetBelief){
+        return static_cast<ForgetBelief*>(_belief)->contextForgetUpdate(noise, _decayTo); 
+    }
+    return static_cast<DecayBelief*>(_belief)->updateFromContext(noise, _trialTime, _decayTo); 
 }
 
 /**
@@ -187,7 +363,7 @@ void AxcptTask::_precomputeSamples(){
     for (unsigned samp=0; samp < _nPrecomputeSamps; ++samp){
         _recordBelief(); 
         _trialTime += _timePerStep; 
-        static_cast<DecayBelief*>(_belief)->updateFromContext(_retentionNoise, _trialTime, _decayTo); 
+        _updateFromContext(_retentionNoise); 
     }
-    _recorder->updateDatum(_trialLabel+"samplingContextEvent", Event(0, _nPrecomputeSamps*_timePerStep)); 
+    _recordEvent(_samplingContextEventId, Event(0, _nPrecomputeSamps*_timePerStep)); 
 }
@@ -16,10 +16,15 @@ public:
     AxcptTask(const Config * c, Recorder * r);
     ~AxcptTask(); 
     virtual void run(); 
+    virtual void replay(const DecisionSample & s); 
 
 protected: 
     virtual void _precomputeSamples();
-    void _recordBelief();
+    void _recordBelief(bool keep=false, bool decision=false);
+    int _updateFromContext(double noise);
+    void _respond(int resp, int cresp, double eblDur, bool sampleDuringMotorPlan);
+    void _respondPrematurely(int resp, int cresp);
+    void _runThresholdSweep(int cresp, double eblDur);
 
     Belief * _belief; ///< pointer to the belief object. 
     Architecture _arch; ///< the cognitive architecture object. 
@@ -35,6 +40,13 @@ protected:
     int _maxTrials; ///< Number of trials to run. 
     int _maxSamps; ///< Maximum number of samples to allow per trial (this is a sentry for infinite loops, hitting this throws an error). 
     PriorType _decayTo; ///< Determines how to draw a "bad" context sample (from the prior or at uniform).
+    bool _useForgetBelief; ///< Forget the context (ForgetBelief) instead of decaying it (DecayBelief), see \ref useForgetBelief. 
+    std::vector<double> _sweepDecisionTimes; ///< Time (from target onset) each threshold in the sweep was crossed on the current trial. 
+    std::vector<int> _sweepResps; ///< Response at each threshold in the sweep on the current trial. 
+    unsigned _postId; ///< ID of the "post" trace datum. 
+    unsigned _rtId, _respId, _accId, _correctRtId, _incorrectRtId; ///< IDs of the trial-level summary datums (unused when sweeping thresholds). 
+    unsigned _eblEventId, _motorPlanEventId, _motorExecEventId, _samplingBothEventId, _samplingContextEventId; ///< IDs of the event datums. 
+    std::vector<unsigned> _sweepDecisionTimeIds, _sweepRTIds, _sweepRespIds, _sweepAccIds; ///< IDs of the per-threshold summary datums when sweeping thresholds. 
 };
 
 
@@ -30,7 +30,22 @@ int main(int argc, const char * argv[]) {
         populateDefaults(&c); // this has to happen AFTER config is loaded from string -- it writes defaults where there is nothing written
         AxcptTask t(&c, &r); 
         EventExperiment be(&c, &t, &r); 
+        AsyncWriter writer; 
+        bool columnFile = c.keyExists("columnFile") && c.get<int>("columnFile"); 
+        bool async = c.keyExists("asyncOutput") && c.get<int>("asyncOutput"); 
+        if (async) r.setAsyncWriter(&writer); // format and write on a background thread, see asyncOutput
+        if (c.keyExists("csvShortest")) r.setCsvShortest(c.get<int>("csvShortest")); // see csvShortest
+        if (c.keyExists("memoryBudgetMB")){ // see memoryBudgetMB and memoryPolicy
+            Recorder::MemoryPolicy memoryPolicy = Recorder::memoryPolicyFromString(c.keyExists("memoryPolicy") ? c.get<string>("memoryPolicy") : "stop"); 
+            #ifndef DISABLE_ERROR_CHECKS
+        if (memoryPolicy == Recorder::SPILL) throw fatal_error() << "ERROR: memoryPolicy=spill needs traces to stream, and the event runners have none!"; 
+            #endif
+            r.setMemoryBudget(size_t(c.get<double>("memoryBudgetMB") * 1024 * 1024), memoryPolicy, "axcptEvent_output"); 
+        }
         be.run(); 
-        r.writeToFiles("axcptEvent_output"); 
+        if (columnFile) r.writeColumnFile("axcptEvent_output.cddm"); // one binary file, see columnFile
+        else r.writeToFiles("axcptEvent_output"); 
+        writer.close(); // wait for the output to be written
+        if (r.overMemoryBudget()) r.writeMemoryReport(std::cerr); 
     }
 }
\ No newline at end of file
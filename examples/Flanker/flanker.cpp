@@ -3,6 +3,7 @@
 #include <iostream>
 
 FlankerTask::~FlankerTask(){
+    delete _adaptiveStepper; 
     delete _belief; 
 }
 
@@ -12,13 +13,14 @@ FlankerTask::~FlankerTask(){
  * @details Grabs the configuration, does some error checking, and initializes things. 
  * 
  * @param c A Config, containing \ref timePerStep, \ref maxTrials, \ref maxSamps, 
- * \ref contextNoise, \ref targetNoise, \ref decisionThresh, and \ref pPrematureResp
+ * \ref contextNoise, \ref targetNoise, \ref decisionThresh, and \ref pPrematureResp, and 
+ * optionally \ref directFirstPassage, \ref adaptiveStepping or \ref decisionThreshes. 
  * @param r a Recorder. 
  */
-FlankerTask::FlankerTask(const Config * c, Recorder * r): Task(c, r), _arch(Architecture(c)), _trialTime(-1){
+FlankerTask::FlankerTask(const Config * c, Recorder * r): Task(c, r), _arch(Architecture(c)), _trialTime(-1), _adaptiveStepper(nullptr){
     _belief = new Belief(c); 
     _traceDatumNames = {"post"}; 
-    _summaryDatumNames = {"RT", "Resp", "Acc"};
+    _summaryDatumNames = {"RT", "Resp", "Acc", "CorrectRT", "IncorrectRT"};
     _eventDatumNames = {"eblEvent", "motorPlanEvent", "motorExecEvent", "samplingEvent"}; 
     _timePerStep = _config->get<double>("timePerStep"); 
     _maxTrials = _config->get<int>("maxTrials"); 
@@ -33,14 +35,181 @@ FlankerTask::FlankerTask(const Config * c, Recorder * r): Task(c, r), _arch(Arch
     if (_decisionThresh < 0) throw fatal_error() << "ERROR: decisionThresh < 0, did you set it (FlankerTask is implemented in prob space, not log space)?";
     if (_decisionThresh >= 1) throw fatal_error() << "ERROR: decisionThresh >=1 (FlankerTask is implemented in prob space, not log space) ";
     #endif
+    _setupThresholdSweep({"DecisionTime", "RT", "Resp", "Acc"}); 
+    _sweepDecisionTimes.resize(_decisionThreshes.size()); 
+    _sweepResps.resize(_decisionThreshes.size()); 
+    _postId = _traceDatumId("post"); 
+    if (_decisionThreshes.empty()){
+        _rtId = _summaryDatumId("RT"); 
+        _respId = _summaryDatumId("Resp"); 
+        _accId = _summaryDatumId("Acc"); 
+        _correctRtId = _summaryDatumId("CorrectRT"); 
+        _incorrectRtId = _summaryDatumId("IncorrectRT"); 
+    } else {
+        _sweepDecisionTimeIds = _threshDatumIds("DecisionTime"); 
+        _sweepRTIds = _threshDatumIds("RT"); 
+        _sweepRespIds = _threshDatumIds("Resp"); 
+        _sweepAccIds = _threshDatumIds("Acc"); 
+    }
+    _eblEventId = _eventDatumId("eblEvent"); 
+    _motorPlanEventId = _eventDatumId("motorPlanEvent"); 
+    _motorExecEventId = _eventDatumId("motorExecEvent"); 
+    _samplingEventId = _eventDatumId("samplingEvent"); 
+    // if the decision variable is a 1D random walk we can skip the timestep loop entirely
+    _useDirectFirstPassage = _decisionThreshes.empty() && _config->keyExists("directFirstPassage") && _config->get<int>("directFirstPassage") == 1 && FirstPassageSampler::isOneDimensional(_config); 
+    if (_useDirectFirstPassage){
+        for (unsigned t=0; t < _trialDist.n_cols; ++t){
+            _firstPassage.push_back(FirstPassageSampler(_config, t)); 
+        }
+    }
+    if (_decisionThreshes.empty() && !_useDirectFirstPassage && _config->keyExists("adaptiveStepping") && _config->get<int>("adaptiveStepping") == 1){
+        // two context samples per step (we have two flankers), and the decision variable is the marginal of target 0
+        mat dvWeights = arma::zeros<mat>(_trialDist.n_rows, _trialDist.n_cols); 
+        dvWeights.col(0).fill(1); 
+        _adaptiveStepper = new AdaptiveStepper(_config, _belief, dvWeights, _contextNoise, 2, _targetNoise, 1); 
+    }
 }
 
 /**
  * @brief Record the current posterior into Recorder. 
+ * @param keep keep it even in decimated traces (see \ref traceEvery), e.g. at a threshold crossing
+ * @param decision is this the posterior the response is decided on (see \ref responseLockedWindow)? 
+ */
+void FlankerTask::_recordBelief(bool keep, bool decision){
+    _recordTrace(_postId, Timepoint(_trialTime, _belief->getBelief(), keep, decision)); // views the posterior, the datum copies it into its storage
+}
+
+/**
+ * @brief Commit to a response and run out the motor components of the trial. 
+ * @details Records the response, accuracy, motor planning and execution events and the RT 
+ * (also as CorrectRT or IncorrectRT). 
+ * During motor planning we keep sampling (for d'oh effects and plotting) if sampleDuringMotorPlan
+ * is set, otherwise the trial time just advances over it. 
+ * 
+ * @param resp the response (0 or 1)
+ * @param cresp the correct response
+ * @param eblDur the eye-brain lag drawn for this trial
+ * @param sampleDuringMotorPlan whether to keep updating the belief during motor planning
+ */
+void FlankerTask::_respond(int resp, int cresp, double eblDur, bool sampleDuringMotorPlan){
+    double motorPlanning = _arch.drawMotorPlanning(); 
+    _recordEvent(_motorPlanEventId, Event(_trialTime, _trialTime + motorPlanning)); 
+    int acc = resp == cresp ? 1 : 0; 
+    // use ints for resp and cresp to not run into float comparison issues...
+    // but then convert to doubles for mean and variance
+    _recordSummary(_respId, double(resp));
+    _recordSummary(_accId, double(acc)); 
+    // response is locked in now. but we sample for d'oh effects and plotting
+    int sampsDuringMotorPlan = motorPlanning / _timePerStep; 
+    if (sampleDuringMotorPlan){
+        for (int i=0; i < sampsDuringMotorPlan; ++i){
+            _belief->updateFromContext(_contextNoise); 
+            _belief->updateFromTarget(_targetNoise); 
+            _trialTime += _timePerStep; 
+            _recordBelief(); 
+        }
+    } else {
+        _trialTime += sampsDuringMotorPlan * _timePerStep; 
+    }
+    double motorTimeDur = _arch.drawMotorExec(); 
+    _recordEvent(_motorExecEventId, Event(_trialTime, _trialTime + motorTimeDur)); 
+    double rt = _trialTime + motorTimeDur + eblDur;
+    _recordSummary(_rtId, rt);
+    _recordSummary(acc == 1 ? _correctRtId : _incorrectRtId, rt); 
+    _recordResponse(rt, acc == 1); 
+}
+
+/**
+ * @brief Respond at t0 without sampling (see \ref pPrematureResp). 
+ * @details Motor planning starts immediately. Records the response, accuracy, motor 
+ * planning and execution events and the RT, which is just the motor execution time. 
+ * CorrectRT and IncorrectRT only hold the RTs of sampled decisions, so they are left alone. 
+ * 
+ * @param resp the response (0 or 1)
+ * @param cresp the correct response
+ */
+void FlankerTask::_respondPrematurely(int resp, int cresp){
+    double motorPlanning = _arch.drawMotorPlanning(); 
+    double motorTimeDur = _arch.drawMotorExec(); 
+    int acc = resp == cresp; 
+    _recordEvent(_motorPlanEventId, Event(0, motorPlanning)); 
+    _recordSummary(_respId, double(resp));
+    _recordSummary(_accId, double(acc)); 
+    _recordEvent(_motorExecEventId, Event(0, motorTimeDur)); 
+    _recordSummary(_rtId, motorTimeDur);
+    _recordResponse(motorTimeDur, acc == 1); 
+}
+
+/**
+ * @brief Replay a trial from a DecisionCache with new nondecision times. 
+ * @details Records the same trial-level datums and events as run(), but the decision time 
+ * and response come from the cache, so only the eye-brain lag and motor durations are drawn. 
+ * No posterior trace is recorded. 
+ * 
+ * @param s the cached decision
+ */
+void FlankerTask::replay(const DecisionSample & s){
+    _setTrialType(s.context, s.target); 
+    int cresp = _target == 0 ? 0 : 1; 
+    double eblDur = _arch.drawEBL(); 
+    _recordEvent(_eblEventId, Event(0, eblDur)); 
+    if (s.premature){
+        _respondPrematurely(s.resp, cresp); 
+        return; 
+    }
+    _trialTime = s.decisionTime; 
+    _respond(s.resp, cresp, eblDur, false); 
+    _recordEvent(_samplingEventId, Event(0, _trialTime)); 
+}
+
+/**
+ * @brief Run the sampling part of a trial once for all thresholds in \ref decisionThreshes. 
+ * @details The evidence trajectory does not depend on the threshold, so we sample until the 
+ * largest threshold is crossed, noting the time and response at which each smaller one was 
+ * crossed on the way. The nondecision components (eye-brain lag, motor planning and execution) 
+ * are drawn once per trial and shared by all thresholds. Records DecisionTime, RT, Resp and Acc 
+ * for every threshold, and the motor planning and execution events of the largest threshold, 
+ * where sampling (and the trace) stops. 
+ * 
+ * @param cresp the correct response
+ * @param eblDur the eye-brain lag drawn for this trial
  */
-void FlankerTask::_recordBelief(){
-    mat post = _belief->getBelief(); 
-    _recorder->updateDatum(_trialLabel + "post", Timepoint(_trialTime,vectorise(post)));
+void FlankerTask::_runThresholdSweep(int cresp, double eblDur){
+    unsigned nextThresh = 0; 
+    int samp = 0; 
+    for (; samp < _maxSamps && nextThresh < _decisionThreshes.size(); ++samp){
+        _belief->updateFromContext(_contextNoise); 
+        _belief->updateFromContext(_contextNoise); 
+        _belief->updateFromTarget(_targetNoise); 
+        const mat & post = _belief->getBelief();
+        _trialTime += _timePerStep; 
+        double dv = post(0,0) + post(1, 0); 
+        bool crossed = dv > _decisionThreshes[nextThresh] || dv < (1-_decisionThreshes[nextThresh]); 
+        _recordBelief(crossed); 
+        // thresholds are sorted, so crossing one means we crossed all the ones below it too
+        while (nextThresh < _decisionThreshes.size() && (dv > _decisionThreshes[nextThresh] || dv < (1-_decisionThreshes[nextThresh]))){
+            _sweepDecisionTimes[nextThresh] = _trialTime; 
+            _sweepResps[nextThresh] = dv > 0.5 ? 0 : 1; 
+            ++nextThresh; 
+        }
+    }
+    #ifndef DISABLE_ERROR_CHECKS
+    if (nextThresh < _decisionThreshes.size()) throw fatal_error() << "ERROR: hit maxSamps (" << _maxSamps << ") before crossing decisionThresh " << _decisionThreshes[nextThresh] << "! If you're sure you know what you're doing, you can increase maxSamps to prevent this, but verifying that you really need this many should be a first step!"; 
+    #endif
+    // the trial (and its trace) ends at the largest threshold, so its motor events follow that decision
+    double motorPlanning = _arch.drawMotorPlanning(); 
+    int sampsDuringMotorPlan = motorPlanning / _timePerStep; 
+    double motorExecStart = _trialTime + sampsDuringMotorPlan * _timePerStep; 
+    double motorTimeDur = _arch.drawMotorExec(); 
+    _recordEvent(_motorPlanEventId, Event(_trialTime, _trialTime + motorPlanning)); 
+    _recordEvent(_motorExecEventId, Event(motorExecStart, motorExecStart + motorTimeDur)); 
+    for (unsigned k=0; k<_decisionThreshes.size(); ++k){
+        double rt = _sweepDecisionTimes[k] + sampsDuringMotorPlan * _timePerStep + motorTimeDur + eblDur; 
+        _recordSummary(_sweepDecisionTimeIds[k], _sweepDecisionTimes[k]);
+        _recordSummary(_sweepRespIds[k], double(_sweepResps[k]));
+        _recordSummary(_sweepAccIds[k], double(_sweepResps[k] == cresp ? 1 : 0)); 
+        _recordSummary(_sweepRTIds[k], rt);
+    }
 }
 
 /**
@@ -49,9 +218,14 @@ void FlankerTask::_recordBelief(){
  * If this happens, motor planning commences immediatley. Otherwise,
  * context and target are both sampled from until a decision threshold over 
  * the target identity is reached, at which point motor planning commences. 
+ * With \ref directFirstPassage set and a one-dimensional decision variable, the crossing 
+ * step and response are drawn directly from FirstPassageSampler instead, and no posterior 
+ * trace is recorded. With \ref adaptiveStepping set, AdaptiveStepper takes large steps 
+ * while far from threshold, and only the posterior at the decision is recorded. With 
+ * \ref decisionThreshes set, all thresholds are run in one pass (see FlankerTask::_runThresholdSweep()). 
  */
 void FlankerTask::run(){
-    mat post; 
+    const mat & post = _belief->getBelief(); // the posterior itself, so it follows every update
     double dv; 
     int samp = 0; 
 
@@ -60,73 +234,83 @@ void FlankerTask::run(){
     double eblDur = _arch.drawEBL(); 
 
     double sampStart = _trialTime; 
-    drawTrialType(); // provided by Task superclass, populates _context and _target, and _trialLabel
+    drawTrialType(); // provided by Task superclass, populates _context and _target, and _condition
 
     int cresp = _target == 0 ? 0 : 1; 
 
     _belief->setTrueStim(_context, _target);
     _belief->reset(); 
-    _recorder->updateDatum(_trialLabel+"eblEvent", Event(0, eblDur)); 
+    _recordEvent(_eblEventId, Event(0, eblDur)); 
     
     // to mimic Yu et al 2009, introduce parameter gamma that governs an early random response at t0
     if (_pPrematureResponse>0){
         int prematureResponse = RNG::rbernoulli(_pPrematureResponse);
 
         if (prematureResponse==1){
-            // immediately start motor planning
-            double motorPlanning = _arch.drawMotorPlanning(); 
-            double motorTimeDur = _arch.drawMotorExec(); 
             // coin flip for the response
-            double resp = RNG::rbernoulli(0.5);
-            int acc = resp == cresp; 
-            _recorder->updateDatum(_trialLabel+"motorPlanEvent", Event(0, motorPlanning)); 
-            _recorder->updateDatum(_trialLabel + "Resp", double(resp));
-            _recorder->updateDatum(_trialLabel + "Acc", double(acc)); 
-            _recorder->updateDatum(_trialLabel+"motorExecEvent", Event(0, motorTimeDur)); 
-            _recorder->updateDatum(_trialLabel + "RT", motorTimeDur);
+            int resp = RNG::rbernoulli(0.5);
+            if (!_decisionThreshes.empty()){
+                // motor planning starts immediately, so RT is just motor execution
+                double motorPlanning = _arch.drawMotorPlanning(); 
+                double motorTimeDur = _arch.drawMotorExec(); 
+                int acc = resp == cresp; 
+                _recordEvent(_motorPlanEventId, Event(0, motorPlanning)); 
+                _recordEvent(_motorExecEventId, Event(0, motorTimeDur)); 
+                // a premature response is the same response for every threshold
+                for (unsigned k=0; k<_decisionThreshes.size(); ++k){
+                    _recordSummary(_sweepDecisionTimeIds[k], 0.0);
+                    _recordSummary(_sweepRespIds[k], double(resp));
+                    _recordSummary(_sweepAccIds[k], double(acc)); 
+                    _recordSummary(_sweepRTIds[k], motorTimeDur);
+                }
+                return; 
+            }
+            _cacheDecision(0, resp, true); 
+            _respondPrematurely(resp, cresp); 
             return; // finish the trial
         }
         
     }
     
-    for (samp; samp < _maxSamps; ++samp){
-        // update from context twice! we have two flankers
-        _belief->updateFromContext(_contextNoise); 
-        _belief->updateFromContext(_contextNoise); 
-        _belief->updateFromTarget(_targetNoise); 
-        post = _belief->getBelief();
-        _trialTime += _timePerStep; 
-        _recordBelief(); 
-        dv = post(0,0) + post(1, 0); 
-        if (dv > _decisionThresh || dv < (1-_decisionThresh)){
-            double motorPlanning = _arch.drawMotorPlanning(); 
-            _recorder->updateDatum(_trialLabel+"motorPlanEvent", Event(_trialTime, _trialTime + motorPlanning)); 
-            // response is locked in now. but we sample for d'oh effects and plotting
-            // 1 is left, 0 is right
-            int resp = dv > 0.5 ? 0 : 1; 
-            int acc = resp == cresp ? 1 : 0; 
-            // use ints for resp and cresp to not run into float comparison issues...
-            // but then convert to doubles for mean and variance
-            _recorder->updateDatum(_trialLabel + "Resp", double(resp));
-            _recorder->updateDatum(_trialLabel + "Acc", double(acc)); 
-            // keep sampling during planning just for plotting
-            int sampsDuringMotorPlan = motorPlanning / _timePerStep; 
-            int i=0; 
-            for (i; i < sampsDuringMotorPlan; ++i){
-                _belief->updateFromContext(_contextNoise); 
-                _belief->updateFromTarget(_targetNoise); 
-                post = _belief->getBelief();
-                _trialTime += _timePerStep; 
-                _recordBelief(); 
-            }
-            double motorTimeDur = _arch.drawMotorExec(); 
-            _recorder->updateDatum(_trialLabel+"motorExecEvent", Event(_trialTime, _trialTime + motorTimeDur)); 
-            double rt = _trialTime + motorTimeDur + eblDur;
-            _recorder->updateDatum(_trialLabel + "RT", rt);
-            break; 
-        }            
+    if (!_decisionThreshes.empty()){
+        _runThresholdSweep(cresp, eblDur); 
+    } else if (_useDirectFirstPassage){
+        // the decision variable is a 1D random walk, so draw the crossing directly
+        int resp; 
+        int steps = _firstPassage[_target].sample(resp); // throws if we would have hit maxSamps
+        _trialTime += steps * _timePerStep; 
+        _cacheDecision(_trialTime, resp); 
+        _respond(resp, cresp, eblDur, false); 
+    } else if (_adaptiveStepper != nullptr){
+        int steps = _adaptiveStepper->run(_maxSamps, dv); 
+        #ifndef DISABLE_ERROR_CHECKS
+        if (steps < 0) throw fatal_error() << "ERROR: hit maxSamps (" << _maxSamps << ")! If you're sure you know what you're doing, you can increase maxSamps to prevent this, but verifying that you really need this many should be a first step!"; 
+        #endif
+        _trialTime += steps * _timePerStep; 
+        _recordBelief(true, true); 
+        int resp = dv > 0.5 ? 0 : 1; 
+        _cacheDecision(_trialTime, resp); 
+        _respond(resp, cresp, eblDur, false); 
+    } else {
+        for (; samp < _maxSamps; ++samp){
+            // update from context twice! we have two flankers
+            _belief->updateFromContext(_contextNoise); 
+            _belief->updateFromContext(_contextNoise); 
+            _belief->updateFromTarget(_targetNoise); 
+            _trialTime += _timePerStep; 
+            dv = post(0,0) + post(1, 0); 
+            bool crossed = dv > _decisionThresh || dv < (1-_decisionThresh); 
+            _recordBelief(crossed, crossed); // the crossing is kept in decimated traces, and is the decision
+            if (crossed){
+                // 1 is left, 0 is right
+                int resp = dv > 0.5 ? 0 : 1; 
+                _cacheDecision(_trialTime, resp); 
+                _respond(resp, cresp, eblDur, true); 
+                break; 
+            }            
+        }
     }
-    _recorder->updateDatum(_trialLabel+"samplingEvent", Event(sampStart, _trialTime)); 
+    _recordEvent(_samplingEventId, Event(sampStart, _trialTime)); 
     #ifndef DISABLE_ERROR_CHECKS
     if (samp == _maxSamps) throw fatal_error() << "ERROR: hit maxSamps (" << _maxSamps << ")! If you're sure you know what you're doing, you can increase maxSamps to prevent this, but verifying that you really need this many should be a first step!"; 
     #endif
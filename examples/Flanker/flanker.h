@@ -16,9 +16,13 @@ public:
     FlankerTask(const Config * c, Recorder * r);
     ~FlankerTask(); 
     virtual void run(); 
+    virtual void replay(const DecisionSample & s); 
 
 protected: 
-    void _recordBelief();
+    void _recordBelief(bool keep=false, bool decision=false);
+    void _respond(int resp, int cresp, double eblDur, bool sampleDuringMotorPlan);
+    void _respondPrematurely(int resp, int cresp);
+    void _runThresholdSweep(int cresp, double eblDur);
     Belief * _belief;  ///< pointer to the belief object. 
     Architecture _arch; ///< the cognitive architecture object. 
     double _trialTime; ///< Current trial time. 
@@ -29,6 +33,15 @@ protected:
     double _pPrematureResponse; ///< Probability of responding instantlly at random without sampling, following \cite Yu2009. 
     int _maxTrials; ///< Number of trials to run. 
     int _maxSamps; ///< Maximum number of samples to allow per trial (this is a sentry for infinite loops, hitting this throws an error). 
+    bool _useDirectFirstPassage; ///< Draw the crossing directly instead of stepping (see \ref directFirstPassage). 
+    std::vector<FirstPassageSampler> _firstPassage; ///< One first-passage sampler per true target, used if _useDirectFirstPassage. 
+    AdaptiveStepper * _adaptiveStepper; ///< Runs the sampling loop in large steps if \ref adaptiveStepping is set, otherwise nullptr. 
+    std::vector<double> _sweepDecisionTimes; ///< Time each threshold in the sweep was crossed on the current trial. 
+    std::vector<int> _sweepResps; ///< Response at each threshold in the sweep on the current trial. 
+    unsigned _postId; ///< ID of the "post" trace datum. 
+    unsigned _rtId, _respId, _accId, _correctRtId, _incorrectRtId; ///< IDs of the trial-level summary datums (unused when sweeping thresholds). 
+    unsigned _eblEventId, _motorPlanEventId, _motorExecEventId, _samplingEventId; ///< IDs of the event datums. 
+    std::vector<unsigned> _sweepDecisionTimeIds, _sweepRTIds, _sweepRespIds, _sweepAccIds; ///< IDs of the per-threshold summary datums when sweeping thresholds. 
 };
 
 void populateDefaults(Config * c);
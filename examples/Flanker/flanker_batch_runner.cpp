@@ -14,15 +14,16 @@ int main(int argc, const char * argv[]) {
     arma::arma_rng::set_seed_random();
     Config c; 
     Recorder r;
-    IncrementalMeanVarianceDatum<double> d; 
+    DecisionCache cache; // shared across input lines, see cacheDecisions
+    AsyncWriter writer; // prints the results of a line while the next one runs
     std::string in;
     populateDefaults(&c); 
     FlankerTask t(&c, &r); 
-    vector<string> summaryDatumNames = t.getSummaryDatumNames(); 
     std::cout << "context,target,variable,mean,variance,n" << std::endl; 
     while(std::cin){
         getline(std::cin, in);
         if (in.empty()){
+            writer.close(); 
             std::cout << "Found empty input line, exiting!" << std::endl;
             return 0;
         }
@@ -30,18 +31,13 @@ int main(int argc, const char * argv[]) {
             c.loadFromString(in); 
             populateDefaults(&c); // this has to happen AFTER config is loaded from string -- it writes defaults where there is nothing written
             FlankerTask t(&c, &r); 
+            if (c.keyExists("cacheDecisions") && c.get<int>("cacheDecisions") == 1) t.setDecisionCache(&cache); 
             BatchExperiment be(&c, &t, &r); 
             be.run(); 
             arma::mat tdist; 
             tdist = c.get<arma::mat>("urPrior"); 
-            for (unsigned i=0; i<summaryDatumNames.size(); ++i){
-                for (unsigned c = 0; c < 2; c++){
-                    for (unsigned t = 0; t< 2; t++){
-                        d = r.getDatum<IncrementalMeanVarianceDatum<double> >("Context" + to_string(c) + "_Target" + to_string(t) + "_" + summaryDatumNames[i]); 
-                        std::cout << c<< ","<<t  << ","<< summaryDatumNames[i] << "," << d.getMean() << "," << d.getVariance() << "," << d.getN() << std::endl; 
-                    }
-                }
-            }
+            BatchRows rows(r, t, c); // copies the results, since r.reset() drops the datums before the writer gets to them
+            writer.submit([rows]{ rows.write(std::cout); }); 
             r.reset(); 
         }
     }
@@ -28,7 +28,29 @@ int main(int argc, const char * argv[]) {
         populateDefaults(&c); // this has to happen AFTER config is loaded from string -- it writes defaults where there is nothing written
         FlankerTask t(&c, &r); 
         TraceExperiment be(&c, &t, &r); 
+        AsyncWriter writer; 
+        bool columnFile = c.keyExists("columnFile") && c.get<int>("columnFile"); 
+        bool async = c.keyExists("asyncOutput") && c.get<int>("asyncOutput"); 
+        #ifndef DISABLE_ERROR_CHECKS
+        // streamed traces are written to CSV, which writeColumnFile() refuses at the end of the run
+        if (columnFile && c.keyExists("traceBufferMB")) throw fatal_error() << "ERROR: traceBufferMB can't be combined with columnFile!"; 
+        #endif
+        if (async) r.setAsyncWriter(&writer); // format and write on a background thread, see asyncOutput
+        if (c.keyExists("csvShortest")) r.setCsvShortest(c.get<int>("csvShortest")); // see csvShortest
+        if (c.keyExists("memoryBudgetMB")){ // see memoryBudgetMB and memoryPolicy
+            Recorder::MemoryPolicy memoryPolicy = Recorder::memoryPolicyFromString(c.keyExists("memoryPolicy") ? c.get<string>("memoryPolicy") : "stop"); 
+            #ifndef DISABLE_ERROR_CHECKS
+        if (columnFile && memoryPolicy == Recorder::SPILL) throw fatal_error() << "ERROR: memoryPolicy=spill can't be combined with columnFile!"; 
+            #endif
+            r.setMemoryBudget(size_t(c.get<double>("memoryBudgetMB") * 1024 * 1024), memoryPolicy, "flankerTrace_output"); 
+        }
+        if (c.keyExists("traceBufferMB") || (async && !columnFile)){ // bounded memory, see traceBufferMB
+            r.streamToFiles("flankerTrace_output", size_t((c.keyExists("traceBufferMB") ? c.get<double>("traceBufferMB") : 16) * 1024 * 1024)); 
+        }
         be.run(); 
-        r.writeToFiles("flankerTrace_output"); 
+        if (columnFile) r.writeColumnFile("flankerTrace_output.cddm"); // one binary file, see columnFile
+        else r.writeToFiles("flankerTrace_output"); 
+        writer.close(); // wait for the output to be written
+        if (r.overMemoryBudget()) r.writeMemoryReport(std::cerr); 
     }
 }
\ No newline at end of file
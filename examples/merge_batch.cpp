@@ -0,0 +1,26 @@
+#include "batchmerge.h"
+#include <iostream>
+#include <fstream>
+
+/**
+ * Merges the outputs of a batch runner (e.g. flanker_batch) run as several jobs on the same
+ * parameter lines into what one job running all their trials would have printed (see
+ * BatchMerger), e.g. ./merge_batch shard1.csv shard2.csv shard3.csv > merged.csv
+ */
+int main(int argc, const char * argv[]) {
+    if (argc < 2){
+        std::cerr << "usage: " << argv[0] << " output1 [output2 ...] (merged rows go to stdout)" << std::endl;
+        return 1;
+    }
+    BatchMerger merger;
+    for (int i=1; i<argc; ++i){
+        std::ifstream in(argv[i]);
+        if (!in){
+            std::cerr << "could not open " << argv[i] << std::endl;
+            return 1;
+        }
+        merger.add(in, argv[i]);
+    }
+    merger.write(std::cout);
+    return 0;
+}
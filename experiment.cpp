@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <cmath>
 
 using std::vector;
 using std::string; 
@@ -17,55 +18,142 @@ Experiment::Experiment(Config * c, Task * t, Recorder * r): _config(c), _task(t)
 	_maxTrials = _config->get<int>("maxTrials"); 
 }
 
+/**
+ * @brief Register the task's trace datums for experiments that don't store traces. 
+ * @details They are DummyDatum%s, or TrajectoryDatum%s (per-step means, variances and 
+ * optionally quantiles, in fixed memory) if \ref aggregateTraces is set, with 
+ * \ref trajectorySteps steps (default \ref maxSamps) of \ref timePerStep and 
+ * \ref trajectoryQuantileBins bins (default 0, no quantiles), or ResponseLockedDatum%s 
+ * keeping only response-locked averages if \ref responseLockedWindow is set. 
+ */
+void Experiment::_registerUnstoredTraceDatums(int nContexts, int nTargets){
+	vector<string> traceDatumNames = _task->getTraceDatumNames(); 
+	bool aggregate = _config->keyExists("aggregateTraces") && _config->get<int>("aggregateTraces"); 
+	bool responseLocked = _config->keyExists("responseLockedWindow"); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (aggregate && responseLocked) throw fatal_error() << "ERROR: aggregateTraces and responseLockedWindow can't both be set, pick one trace datum!"; 
+	#endif
+	unsigned steps = 0, bins = 0; 
+	double timePerStep = 0; 
+	if (aggregate){
+		steps = _config->keyExists("trajectorySteps") ? _config->get<int>("trajectorySteps") : _config->get<int>("maxSamps"); 
+		bins = _config->keyExists("trajectoryQuantileBins") ? _config->get<int>("trajectoryQuantileBins") : 0; 
+		timePerStep = _config->get<double>("timePerStep"); 
+	}
+	for (unsigned i=0; i<traceDatumNames.size(); ++i){
+		for (unsigned c = 0; c < nContexts; c++){
+			for (unsigned t = 0; t< nTargets; t++){
+				if (aggregate) _recorder->registerDatum(Task::conditionLabel(c, t) + traceDatumNames[i], TrajectoryDatum(timePerStep, steps, bins));
+				else if (responseLocked) _recorder->registerDatum(Task::conditionLabel(c, t) + traceDatumNames[i], _responseLockedDatum(false));
+				else _recorder->registerDatum(Task::conditionLabel(c, t) + traceDatumNames[i], DummyDatum<Timepoint>());
+			}
+		}
+	}
+}
+
+/**
+ * @brief A ResponseLockedDatum with \ref responseLockedWindow and \ref responseLockedTail (default 30) timepoints. 
+ * @param storeTraces store every trial's window, not just the averages
+ */
+ResponseLockedDatum Experiment::_responseLockedDatum(bool storeTraces){
+	int window = _config->get<int>("responseLockedWindow"); 
+	int tail = _config->keyExists("responseLockedTail") ? _config->get<int>("responseLockedTail") : 30; 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (window < 1 || tail < 0) throw fatal_error() << "ERROR: responseLockedWindow should be at least 1 and responseLockedTail not negative, got " << window << " and " << tail; 
+	#endif
+	return ResponseLockedDatum(window, tail, storeTraces); 
+}
+
 /**
  * @brief Run trials in the task until maxTrials is hit or Recorder says we've had enough. 
+ * @details If the task has a DecisionCache holding decisions for its (decision-relevant) 
+ * parameters, the cached trials are replayed instead, which only redraws nondecision times. 
+ * Otherwise the decisions of this run are stored in the cache for later. Binds the task's 
+ * datum handles first, so the datums have to be registered by now (the constructors of the 
+ * subclasses do that). 
  * \todo a simple place to parallelize with OpenMP is here, since trials can be run independently. 
  */
 void Experiment::run(){
+	_task->bindDatums(); 
+	DecisionCache * cache = _task->getDecisionCache(); 
+	if (cache != nullptr && cache->contains(_task->getDecisionKey())){
+		const vector<DecisionSample> & samples = cache->getSamples(_task->getDecisionKey()); 
+		for (unsigned tr=0; tr<samples.size(); tr++){
+			_recorder->newTrial(); 
+			_task->replay(samples[tr]); 
+			if (_recorder->recordedEnough()) break; 
+		}
+		return; 
+	}
+	if (cache != nullptr) cache->start(_task->getDecisionKey()); 
 // this is where the #omp pragma parallel for can happen
 	for (unsigned tr=0; tr<_maxTrials; tr++){
 		_recorder->newTrial(); 
 		_task->run(); 
 		if (_recorder->recordedEnough()) break; 		
 	}
+	if (cache != nullptr) cache->finish(); 
 }	
 
 /**
  * @brief Constructor for BatchExperiment. 
  * @details TraceDatum and EventDatum are both set to DummyDatum to save space
- * and time in batch simulation. Only record trial-level summary information using
- * IncrementalMeanVarianceDatum. 
+ * and time in batch simulation (traces can be aggregated instead, see 
+ * _registerUnstoredTraceDatums()). Only record trial-level summary information using
+ * IncrementalMeanVarianceDatum, or QuantileSketchDatum (which also gives quantiles, 
+ * in fixed memory) if \ref batchQuantiles is set, or HistogramDatum (the whole 
+ * distribution in ticks, in fixed memory) if \ref batchHistograms is set. If 
+ * \ref batchCaf is set, also records a ConditionalAccuracyDatum per trial type 
+ * (key Context0_Target0_CAF etc.), which tasks fill with Task::_recordResponse(). 
  * 
  * @param c Config, containing at least \ref maxTrials (required by parent), 
- * \ref nContexts, and \ref nTargets.
+ * \ref nContexts, and \ref nTargets, and optionally \ref batchQuantiles and 
+ * \ref quantileCompression (default 100), or \ref batchHistograms and 
+ * \ref histogramTicks (default 1000, with bins of \ref timePerStep), and 
+ * \ref batchCaf with \ref cafBinWidth (default 50) and \ref cafBins (default 100). 
+ * The last two need CorrectRT, IncorrectRT and responses, which a task sweeping 
+ * \ref decisionThreshes doesn't record, so they are rejected with a sweep. 
  * @param t A Task. 
  * @param r A recorder. 
  */
 BatchExperiment::BatchExperiment(Config * c, Task * t, Recorder * r): Experiment(c, t, r) {
 	int nContexts = _config->get<int>("nContexts");
 	int nTargets = _config->get<int>("nTargets"); 
-	vector<string> traceDatumNames = t->getTraceDatumNames(); 
 	vector<string> summaryDatumNames = t->getSummaryDatumNames(); 
 	vector<string> eventDatumNames = t->getEventDatumNames(); 
-	for (unsigned i=0; i<traceDatumNames.size(); ++i){
+	bool quantiles = _config->keyExists("batchQuantiles") && _config->get<int>("batchQuantiles"); 
+	double compression = _config->keyExists("quantileCompression") ? _config->get<double>("quantileCompression") : 100; 
+	bool histograms = _config->keyExists("batchHistograms") && _config->get<int>("batchHistograms"); 
+	unsigned ticks = _config->keyExists("histogramTicks") ? _config->get<int>("histogramTicks") : 1000; 
+	bool caf = _config->keyExists("batchCaf") && _config->get<int>("batchCaf"); 
+	double cafBinWidth = _config->keyExists("cafBinWidth") ? _config->get<double>("cafBinWidth") : 50; 
+	unsigned cafBins = _config->keyExists("cafBins") ? _config->get<int>("cafBins") : 100; 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (quantiles && histograms) throw fatal_error() << "ERROR: batchQuantiles and batchHistograms can't both be set, pick one summary datum!"; 
+	if (!t->getDecisionThreshes().empty() && (histograms || caf)) throw fatal_error() << "ERROR: decisionThreshes records no CorrectRT, IncorrectRT or responses per threshold, so it can't be combined with batchHistograms or batchCaf!"; 
+	#endif
+	_registerUnstoredTraceDatums(nContexts, nTargets); 
+	
+	for (unsigned i=0; i<summaryDatumNames.size(); ++i){
 		for (unsigned c = 0; c < nContexts; c++){
 			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + traceDatumNames[i], DummyDatum<Timepoint>());
+				if (quantiles) _recorder->registerDatum(Task::conditionLabel(c, t) + summaryDatumNames[i], QuantileSketchDatum(compression));
+				else if (histograms) _recorder->registerDatum(Task::conditionLabel(c, t) + summaryDatumNames[i], HistogramDatum(_config->get<double>("timePerStep"), ticks));
+				else _recorder->registerDatum(Task::conditionLabel(c, t) + summaryDatumNames[i], IncrementalMeanVarianceDatum<double>());
 			}
 		}
 	}
-	
-	for (unsigned i=0; i<summaryDatumNames.size(); ++i){
+	for (unsigned i=0; i<eventDatumNames.size(); ++i){
 		for (unsigned c = 0; c < nContexts; c++){
 			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + summaryDatumNames[i], IncrementalMeanVarianceDatum<double>());
+				_recorder->registerDatum(Task::conditionLabel(c, t) + eventDatumNames[i], DummyDatum<Event>());
 			}
 		}
 	}
-	for (unsigned i=0; i<eventDatumNames.size(); ++i){
+	if (caf){
 		for (unsigned c = 0; c < nContexts; c++){
 			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + eventDatumNames[i], DummyDatum<Event>());
+				_recorder->registerDatum(Task::conditionLabel(c, t) + "CAF", ConditionalAccuracyDatum(cafBinWidth, cafBins));
 			}
 		}
 	}
@@ -74,8 +162,13 @@ BatchExperiment::BatchExperiment(Config * c, Task * t, Recorder * r): Experiment
 /**
  * @brief Constructor for EventExperiment. 
  * @details This gives conditional RT distributions without storing belief traces. 
- * TraceDatum is set to DummyDatum to save space and time in simulation. 
- * Record events in EventDatum and trial-level summary information using IncrementalMeanVarianceDatum. 
+ * TraceDatum is set to DummyDatum to save space and time in simulation (or to 
+ * TrajectoryDatum with \ref aggregateTraces, see _registerUnstoredTraceDatums()). Events and 
+ * trial-level summary information go into a single TrialTable (one row per trial, 
+ * written to trials.csv), preallocated for \ref maxTrials trials. With \ref reservoirTrials 
+ * set, they go into SampledRawVectorsDatum%s and SampledEventDatum%s instead, which keep 
+ * a uniform sample of that many trials per trial type (the same trials for all datums of a 
+ * trial type) and exact summaries, so memory doesn't grow with \ref maxTrials. 
  * 
  * @param c Config, containing at least \ref maxTrials (required by parent), 
  * \ref nContexts, and \ref nTargets.
@@ -85,28 +178,26 @@ BatchExperiment::BatchExperiment(Config * c, Task * t, Recorder * r): Experiment
 EventExperiment::EventExperiment(Config * c, Task * t, Recorder * r): Experiment(c, t, r) {
 	int nContexts = _config->get<int>("nContexts");
 	int nTargets = _config->get<int>("nTargets"); 
-	vector<string> traceDatumNames = t->getTraceDatumNames(); 
+	_registerUnstoredTraceDatums(nContexts, nTargets); 
+	if (!_config->keyExists("reservoirTrials")){
+		_recorder->registerTrialTable(TrialTable(t->getSummaryDatumNames(), t->getEventDatumNames(), _maxTrials)); 
+		return; 
+	}
+	int capacity = _config->get<int>("reservoirTrials"); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (capacity < 1) throw fatal_error() << "ERROR: reservoirTrials should be at least 1, got " << capacity; 
+	#endif
 	vector<string> summaryDatumNames = t->getSummaryDatumNames(); 
 	vector<string> eventDatumNames = t->getEventDatumNames(); 
-	for (unsigned i=0; i<traceDatumNames.size(); ++i){
-		for (unsigned c = 0; c < nContexts; c++){
-			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + traceDatumNames[i], DummyDatum<Timepoint>());
-			}
-		}
-	}
-	
-	for (unsigned i=0; i<summaryDatumNames.size(); ++i){
-		for (unsigned c = 0; c < nContexts; c++){
-			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + summaryDatumNames[i], RawVectorsDatum<double>());
+	for (unsigned c = 0; c < nContexts; c++){
+		for (unsigned t = 0; t< nTargets; t++){
+			// one reservoir per condition, so all its datums keep the same trials
+			std::shared_ptr<TrialReservoir> reservoir = std::make_shared<TrialReservoir>(capacity); 
+			for (unsigned i=0; i<summaryDatumNames.size(); ++i){
+				_recorder->registerDatum(Task::conditionLabel(c, t) + summaryDatumNames[i], SampledRawVectorsDatum<double>(reservoir));
 			}
-		}
-	}
-	for (unsigned i=0; i<eventDatumNames.size(); ++i){
-		for (unsigned c = 0; c < nContexts; c++){
-			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + eventDatumNames[i], EventDatum());
+			for (unsigned i=0; i<eventDatumNames.size(); ++i){
+				_recorder->registerDatum(Task::conditionLabel(c, t) + eventDatumNames[i], SampledEventDatum(reservoir));
 			}
 		}
 	}
@@ -116,10 +207,19 @@ EventExperiment::EventExperiment(Config * c, Task * t, Recorder * r): Experiment
  * @brief Constructor for TraceExperiment. 
  * @details Records everything: belief traces, events, RTs, accuracies. Generates 
  * far more data than the others -- best to use for trial-level visualization but 
- * not for anything else. 
+ * not for anything else. Each TraceDatum reserves space up front for its share of 
+ * \ref maxTrials (by \ref trialDist) times \ref expectedStepsPerTrial timepoints 
+ * (divided by \ref traceEvery), and decimates its traces by \ref traceEvery and \ref traceEpsilon. 
+ * With \ref responseLockedWindow set, posteriors go into ResponseLockedDatum%s instead, 
+ * which keep only the window before each decision and a tail after it. 
+ * With \ref compactTraces set, they go into CompactTraceDatum%s, which store them quantized 
+ * to \ref tracePrecision and delta encoded (same output, in a fraction of the memory). 
 
  * @param c Config, containing at least \ref maxTrials (required by parent), 
- * \ref nContexts, and \ref nTargets.
+ * \ref nContexts, and \ref nTargets, and optionally \ref trialDist and 
+ * \ref expectedStepsPerTrial (default 100), \ref traceEvery (default 1) and 
+ * \ref traceEpsilon (default 0), or \ref compactTraces with \ref timePerStep and 
+ * \ref tracePrecision (default 2^-16). 
  * @param t A Task. 
  * @param r A recorder. 
  */
@@ -129,10 +229,27 @@ TraceExperiment::TraceExperiment(Config * c, Task * t, Recorder * r): Experiment
 	vector<string> traceDatumNames = t->getTraceDatumNames(); 
 	vector<string> summaryDatumNames = t->getSummaryDatumNames(); 
 	vector<string> eventDatumNames = t->getEventDatumNames(); 
+	double expectedSteps = _config->keyExists("expectedStepsPerTrial") ? _config->get<double>("expectedStepsPerTrial") : 100; 
+	mat trialDist = _config->keyExists("trialDist") ? _config->get<mat>("trialDist") : mat(nContexts, nTargets, arma::fill::ones) / (nContexts * nTargets); 
+	int every = _config->keyExists("traceEvery") ? _config->get<int>("traceEvery") : 1; 
+	double epsilon = _config->keyExists("traceEpsilon") ? _config->get<double>("traceEpsilon") : 0; 
+	bool responseLocked = _config->keyExists("responseLockedWindow"); 
+	bool compact = _config->keyExists("compactTraces") && _config->get<int>("compactTraces"); 
+	double precision = _config->keyExists("tracePrecision") ? _config->get<double>("tracePrecision") : 1.0 / 65536; 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (every < 1) throw fatal_error() << "ERROR: traceEvery should be at least 1, got " << every; 
+	if (epsilon < 0) throw fatal_error() << "ERROR: traceEpsilon should not be negative, got " << epsilon; 
+	if (compact && (responseLocked || every > 1 || epsilon > 0)) throw fatal_error() << "ERROR: compactTraces can't be combined with responseLockedWindow, traceEvery or traceEpsilon!"; 
+	#endif
 	for (unsigned i=0; i<traceDatumNames.size(); ++i){
 		for (unsigned c = 0; c < nContexts; c++){
 			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + traceDatumNames[i], TraceDatum());
+				// decimated traces keep about one in every timepoints, plus the last one
+				double keptSteps = every > 1 ? expectedSteps / every + 1 : expectedSteps; 
+				unsigned expectedTimepoints = unsigned(ceil(_maxTrials * trialDist(c, t) * keptSteps)); 
+				if (responseLocked) _recorder->registerDatum(Task::conditionLabel(c, t) + traceDatumNames[i], _responseLockedDatum(true));
+				else if (compact) _recorder->registerDatum(Task::conditionLabel(c, t) + traceDatumNames[i], CompactTraceDatum(_config->get<double>("timePerStep"), precision));
+				else _recorder->registerDatum(Task::conditionLabel(c, t) + traceDatumNames[i], TraceDatum(expectedTimepoints, every, epsilon));
 			}
 		}
 	}
@@ -140,14 +257,14 @@ TraceExperiment::TraceExperiment(Config * c, Task * t, Recorder * r): Experiment
 	for (unsigned i=0; i<summaryDatumNames.size(); ++i){
 		for (unsigned c = 0; c < nContexts; c++){
 			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + summaryDatumNames[i], RawVectorsDatum<double>());
+				_recorder->registerDatum(Task::conditionLabel(c, t) + summaryDatumNames[i], RawVectorsDatum<double>());
 			}
 		}
 	}
 	for (unsigned i=0; i<eventDatumNames.size(); ++i){
 		for (unsigned c = 0; c < nContexts; c++){
 			for (unsigned t = 0; t< nTargets; t++){
-				_recorder->registerDatum("Context" + to_string(c) + "_Target" + to_string(t) + "_" + eventDatumNames[i], EventDatum());
+				_recorder->registerDatum(Task::conditionLabel(c, t) + eventDatumNames[i], EventDatum());
 			}
 		}
 	}
@@ -25,6 +25,8 @@ public:
 
 protected:
 	Experiment(Config * conf, Task * t, Recorder * r);  // instantiate me via my children who set up the recorder
+	void _registerUnstoredTraceDatums(int nContexts, int nTargets); 
+	ResponseLockedDatum _responseLockedDatum(bool storeTraces); 
 	Config * _config; ///< pointer to the configuration object
 	Task * _task; ///< pointer to a subclass of Task
 	Recorder * _recorder; ///< pointer to the recorder
@@ -59,7 +61,8 @@ public:
  * @brief Subclass for event experiments. 
  * @details Records all events but not posterior trajectories. This is useful for 
  * looking at raw conditional RT distributions (and other things like motor planning
- * times) but not necessarily trajectories. 
+ * times) but not necessarily trajectories. Everything is in one TrialTable, so 
+ * the observations of a trial are in one row rather than joined by trial ID. 
  */
 class EventExperiment : public Experiment {
 public: 
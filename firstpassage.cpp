@@ -0,0 +1,198 @@
+#include <armadillo>
+#include <cmath>
+#include <vector>
+#include <algorithm> // std::upper_bound
+#include "config.h"
+#include "rng.h"
+#include "fatal_error.h"
+#include "firstpassage.h"
+
+using arma::mat;
+using arma::vec;
+
+/**
+ * @brief Constructor for FirstPassageSampler from a task Config.
+ * @details Expects a Config with set \ref urPrior, \ref targetNoise, \ref decisionThresh
+ * and \ref maxSamps, and optionally \ref targetMeanSpacing (default 1) and
+ * \ref firstPassageGridResolution (default 10). The walk is over the log posterior
+ * odds of target 0 versus target 1, so the upper bound corresponds to deciding for
+ * target 0. Only valid if FirstPassageSampler::isOneDimensional() is true for the Config.
+ *
+ * @param c the Config
+ * @param trueTarget the target evidence is drawn from (0 or 1)
+ */
+FirstPassageSampler::FirstPassageSampler(const Config * c, int trueTarget): _truncated(false), _maxSteps(0){
+    #ifndef DISABLE_ERROR_CHECKS
+    if (!isOneDimensional(c)) throw fatal_error() << "ERROR: FirstPassageSampler needs a factorized urPrior over two targets and no decay!";
+    if (trueTarget < 0 || trueTarget > 1) throw fatal_error() << "ERROR: FirstPassageSampler only supports targets 0 and 1, got " << trueTarget;
+    #endif
+    mat urPrior = c->get<mat>("urPrior");
+    double targetNoise = c->get<double>("targetNoise");
+    double spacing = c->keyExists("targetMeanSpacing") ? c->get<double>("targetMeanSpacing") : 1;
+    double thresh = c->get<double>("decisionThresh");
+    double gridResolution = c->keyExists("firstPassageGridResolution") ? c->get<double>("firstPassageGridResolution") : 10;
+    arma::rowvec targetMarginals = sum(urPrior, 0);
+    // log likelihood ratio of one target sample x is (s^2 - 2xs)/(2 sigma^2), with x ~ N(trueTarget, sigma)
+    // (Belief draws samples around the target's index, whatever the spacing of the means)
+    double start = log(targetMarginals(0) / targetMarginals(1));
+    double drift = (spacing * spacing - 2 * trueTarget * spacing) / (2 * targetNoise * targetNoise);
+    double sd = spacing / targetNoise;
+    _computePMF(start, drift, sd, log(thresh / (1 - thresh)), c->get<int>("maxSamps"), gridResolution);
+}
+
+/**
+ * @brief Constructor for FirstPassageSampler from the parameters of the walk directly.
+ * @param start starting point of the walk
+ * @param drift mean increment per step
+ * @param sd standard deviation of the increment per step
+ * @param bound the walk stops when it is above bound or below -bound
+ * @param maxSteps maximum number of steps
+ * @param gridResolution number of grid cells per sd of the increment
+ */
+FirstPassageSampler::FirstPassageSampler(double start, double drift, double sd, double bound, int maxSteps, double gridResolution): _truncated(false), _maxSteps(0){
+    _computePMF(start, drift, sd, bound, maxSteps, gridResolution);
+}
+
+/**
+ * @brief Check whether the Config describes a one-dimensional decision variable.
+ * @details True if \ref urPrior has two targets and is the outer product of its
+ * context and target marginals (so context evidence never moves the target marginal),
+ * both targets have nonzero prior, and \ref decayRate is 0 or unset.
+ */
+bool FirstPassageSampler::isOneDimensional(const Config * c){
+    if (!c->keyExists("urPrior") || !c->keyExists("targetNoise")) return false;
+    if (c->keyExists("decayRate") && c->get<double>("decayRate") != 0) return false;
+    mat urPrior = c->get<mat>("urPrior");
+    if (urPrior.n_cols != 2) return false;
+    vec contextMarginals = sum(urPrior, 1);
+    arma::rowvec targetMarginals = sum(urPrior, 0);
+    if (targetMarginals(0) <= 0 || targetMarginals(1) <= 0) return false;
+    mat factorized = contextMarginals * targetMarginals;
+    return arma::abs(urPrior - factorized).max() < 1e-10;
+}
+
+/**
+ * @brief Compute the first-passage PMF by propagating the density of the walk on a grid.
+ * @details The first step is computed analytically from the (point) starting position.
+ * After that, the surviving probability mass is kept in grid cells between the bounds,
+ * and each step convolves it with the (banded) Gaussian increment kernel, moving the mass
+ * that lands outside the bounds into the PMF. Once the surviving mass shrinks by the same
+ * factor every step (the density has reached its quasi-stationary shape), the rest of the
+ * PMF is a geometric tail and is filled in without further propagation. 
+ */
+void FirstPassageSampler::_computePMF(double start, double drift, double sd, double bound, int maxSteps, double gridResolution){
+    #ifndef DISABLE_ERROR_CHECKS
+    if (sd <= 0) throw fatal_error() << "ERROR: FirstPassageSampler needs a positive increment sd, got " << sd;
+    if (bound <= 0) throw fatal_error() << "ERROR: FirstPassageSampler needs a positive bound (decisionThresh > 0.5), got " << bound;
+    if (gridResolution <= 0) throw fatal_error() << "ERROR: firstPassageGridResolution must be positive, got " << gridResolution;
+    #endif
+    static const double survivalTol = 1e-12;
+    static const double stationaryTol = 1e-9;
+    static const double kernelWidth = 8; // in sds
+    _maxSteps = maxSteps;
+    double lower = -bound;
+    int nCells = std::max(1, int(ceil(2 * bound * gridResolution / sd)));
+    double h = 2 * bound / nCells;
+    // exit probabilities and the banded kernel depend only on the cell, so precompute them
+    vec upOut(nCells), lowOut(nCells), density(nCells), next(nCells);
+    for (int i=0; i<nCells; ++i){
+        double centre = lower + (i + 0.5) * h;
+        upOut[i] = 1 - RNG::pnorm(bound, centre + drift, sd);
+        lowOut[i] = RNG::pnorm(lower, centre + drift, sd);
+        density[i] = RNG::pnorm(lower + (i+1) * h, start + drift, sd) - RNG::pnorm(lower + i * h, start + drift, sd);
+    }
+    int dMin = std::max(-(nCells-1), int(floor((drift - kernelWidth * sd) / h)));
+    int dMax = std::min(nCells-1, int(ceil((drift + kernelWidth * sd) / h)));
+    vec kernel(dMax - dMin + 1);
+    for (int d=dMin; d<=dMax; ++d){
+        kernel[d-dMin] = RNG::pnorm((d + 0.5) * h, drift, sd) - RNG::pnorm((d - 0.5) * h, drift, sd);
+    }
+    std::vector<double> up, low;
+    up.push_back(1 - RNG::pnorm(bound, start + drift, sd));
+    low.push_back(RNG::pnorm(lower, start + drift, sd));
+    double survival = arma::accu(density);
+    // hazard is the proportion of the surviving mass that exits in a step, upShare the proportion of that going up
+    double hazard = 0, oldHazard = -1, upShare = 0, oldUpShare = -1;
+    while (int(up.size()) < maxSteps && survival > survivalTol){
+        if (hazard > 0 && fabs(hazard - oldHazard) < stationaryTol * hazard && fabs(upShare - oldUpShare) < stationaryTol){
+            // the density has settled into its quasi-stationary shape and every quantity now
+            // shrinks by the same factor per step, so we can extend the PMF without propagating
+            up.push_back(up.back() * (1 - hazard));
+            low.push_back(low.back() * (1 - hazard));
+            survival *= 1 - hazard;
+            continue;
+        }
+        double upNow = arma::dot(density, upOut);
+        double lowNow = arma::dot(density, lowOut);
+        up.push_back(upNow);
+        low.push_back(lowNow);
+        next.zeros();
+        for (int i=0; i<nCells; ++i){
+            if (density[i] == 0) continue;
+            int jMin = std::max(0, i + dMin);
+            int jMax = std::min(nCells-1, i + dMax);
+            for (int j=jMin; j<=jMax; ++j){
+                next[j] += density[i] * kernel[j - i - dMin];
+            }
+        }
+        density.swap(next);
+        oldHazard = hazard;
+        oldUpShare = upShare;
+        hazard = (upNow + lowNow) / survival;
+        upShare = upNow + lowNow > 0 ? upNow / (upNow + lowNow) : 0;
+        survival = arma::accu(density);
+    }
+    _truncated = survival > survivalTol;
+    _upperPMF = vec(up);
+    _lowerPMF = vec(low);
+    _cdf.resize(2 * up.size());
+    double cum = 0;
+    for (unsigned k=0; k<up.size(); ++k){
+        cum += up[k];
+        _cdf[2*k] = cum;
+        cum += low[k];
+        _cdf[2*k+1] = cum;
+    }
+}
+
+/**
+ * @brief Draw the first-passage step and the bound that was crossed.
+ * @param resp set to 0 if the upper bound was crossed (decision for target 0), 1 for the lower bound.
+ * @return the step (counting from 1) at which the walk first left the bounds.
+ */
+int FirstPassageSampler::sample(int & resp){
+    double u = RNG::runif(1);
+    std::vector<double>::iterator it = std::upper_bound(_cdf.begin(), _cdf.end(), u);
+    if (it == _cdf.end()){
+        #ifndef DISABLE_ERROR_CHECKS
+        if (_truncated) throw fatal_error() << "ERROR: hit maxSamps (" << _maxSteps << ")! If you're sure you know what you're doing, you can increase maxSamps to prevent this, but verifying that you really need this many should be a first step!";
+        #endif
+        --it; // remaining mass is below survivalTol, attribute it to the last step
+    }
+    int idx = it - _cdf.begin();
+    resp = idx % 2;
+    return idx / 2 + 1;
+}
+
+/**
+ * @brief Return the probability of first crossing the upper bound at each step (mostly for testing).
+ */
+vec FirstPassageSampler::getUpperPMF(){
+    return _upperPMF;
+}
+
+/**
+ * @brief Return the probability of first crossing the lower bound at each step (mostly for testing).
+ */
+vec FirstPassageSampler::getLowerPMF(){
+    return _lowerPMF;
+}
+
+/**
+ * @brief Return the expected number of steps to crossing.
+ */
+double FirstPassageSampler::getMeanSteps(){
+    vec total = _upperPMF + _lowerPMF;
+    vec steps = arma::linspace<vec>(1, total.n_elem, total.n_elem);
+    return arma::dot(total, steps) / arma::accu(total);
+}
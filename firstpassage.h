@@ -0,0 +1,45 @@
+// include guard
+#ifndef FIRSTPASSAGE_H
+#define FIRSTPASSAGE_H
+
+#include <armadillo>
+#include "config.h"
+
+/**
+ * @brief Samples first-passage times of a one-dimensional log-odds random walk directly, from a numerically computed PMF.
+ * @details When the decision variable of a task depends only on the target
+ * (the urPrior factorizes into context and target marginals, there are two
+ * targets, and there is no decay), the log posterior odds of the target after \f$n\f$
+ * steps is a Gaussian random walk with constant drift and constant bounds
+ * \f$\pm\log\frac{\theta}{1-\theta}\f$. Rather than iterating Belief::update()
+ * every timestep, we compute the probability mass function of the first-passage
+ * step and the bound hit once (by propagating the density of the walk on a fine
+ * grid with absorbing bounds), and then every trial is a single categorical draw.
+ *
+ * The PMF is computed up to \ref maxSamps steps, or until the probability of not
+ * having crossed yet is negligible. It is an approximation: the density is held on a grid
+ * of \ref firstPassageGridResolution cells per SD of the increment (default 10), and past
+ * the point where its shape stops changing the PMF is extrapolated as a geometric tail, so
+ * the draws carry the discretization error of both (small next to sampling error at the
+ * default resolution, see the tests against stepping through Belief).
+ */
+class FirstPassageSampler{
+    public:
+        FirstPassageSampler(const Config * c, int trueTarget);
+        FirstPassageSampler(double start, double drift, double sd, double bound, int maxSteps, double gridResolution=10);
+        static bool isOneDimensional(const Config * c);
+        int sample(int & resp);
+        arma::vec getUpperPMF();
+        arma::vec getLowerPMF();
+        double getMeanSteps();
+
+    protected:
+        void _computePMF(double start, double drift, double sd, double bound, int maxSteps, double gridResolution);
+        arma::vec _upperPMF; ///< probability of first crossing the upper bound at each step (index 0 is step 1)
+        arma::vec _lowerPMF; ///< probability of first crossing the lower bound at each step (index 0 is step 1)
+        std::vector<double> _cdf; ///< cumulative probability over (step, bound) pairs, interleaved upper then lower, used for drawing
+        bool _truncated; ///< true if the PMF stopped at maxSteps with non-negligible probability of not crossing
+        int _maxSteps; ///< maximum number of steps (\ref maxSamps)
+};
+
+#endif
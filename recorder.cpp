@@ -1,70 +1,359 @@
 #include "recorder.h"
+#include "asyncwriter.h"
+#include "rng.h"
 #include <armadillo> 
 #include <iostream>
 #include <sys/stat.h>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cstring>
+#include <iterator>
 
 using arma::mat; 
 using arma::vec; 
+
+/**
+ * @brief The datum's CSV as a string, written through writeCsv() (for getStringRepr()). 
+ */
+std::string IDatum::_csvString() const {
+	std::ostringstream out; 
+	CsvWriter csv; 
+	csv.attach(out); 
+	writeCsv(csv); 
+	csv.detach(); 
+	return out.str(); 
+}
+
+/**
+ * @brief Constructor for Recorder (empty, before the first trial). 
+ */
+Recorder::Recorder(): _trialId(-1), _trialTable(nullptr), _csvShortest(false), _asyncWriter(nullptr), _memoryBudget(0), _memoryPolicy(STOP), _memoryActed(false), _memoryAtAction(0), _memoryStopped(false) {}
+
 /**
  * @brief Return true if we have enough data. 
  * @details Subclass from this if you want to stop sampling when some condition is hit
- * (for example, standard errors shrink enough). 
- * @return false -- might return true in subclasses
+ * (for example, standard errors shrink enough); subclasses should also stop when this 
+ * does, which is when the memory budget could not be kept (see setMemoryBudget()). 
+ * @return false unless recording stopped for memory -- might return true in subclasses
  */
 bool Recorder::recordedEnough(){ 
-	return false; 
+	return _memoryStopped; 
 } 
 
 /**
- * @brief Tell all the datums we started a new trial. 
+ * @brief Start a new trial. 
  * @details Some types of data we record care about the start of a new trial
- * (e.g. trajectories) so this is where we tell them about it. 
+ * (e.g. trajectories). They all read the trial counter incremented here, so 
+ * this does not have to visit every datum. 
  */
 void Recorder::newTrial(){
-	for (umapi it = _contents.begin(); it != _contents.end(); ++it){
-		it->second->newTrial(); 
-	}
+	++_trialId; 
+	if (_memoryBudget > 0 && _trialId % 64 == 0) _enforceMemoryBudget(); 
+}
+
+/**
+ * @brief ID of the current trial (-1 before the first newTrial()). 
+ */
+int Recorder::getTrialId(){
+	return _trialId; 
+}
+
+/**
+ * @brief Check whether a datum is registered under key. 
+ */
+bool Recorder::hasDatum(const string & key){
+	return _index.find(key) != _index.end(); 
+}
+
+/**
+ * @brief Slot of a datum by name (throws if it is not registered). 
+ */
+int Recorder::_slotOf(const string & key){
+	umapi it = _index.find(key); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (it == _index.end()) throw fatal_error() << "ERROR: attempting to access datum " << key << " which was not registered to the recorder!"; 
+	#endif
+	return it->second; 
 }
 
 /**
  * @brief Return all the keys (and therefore data) recorder knows.
  */
 void Recorder::printKnownKeys(){
-	for (umapi it = _contents.begin(); it != _contents.end(); ++it){
+	for (umapi it = _index.begin(); it != _index.end(); ++it){
 		std::cout << it->first << " "; 
 	}	
 }
 
 /**
  * @brief Dump all datums in recorder to CSV. 
- * @details This calls getStringRepr on each datum. 
+ * @details Each datum writes its CSV through one CsvWriter, whose buffer is reused from 
+ * file to file, so no datum is built up as a string first. Datums streaming to their files 
+ * (see streamToFiles()) just write out what they still buffer and close their files. 
  * 
  * @param basedir directory of where all the CSVs go. 
  */
 void Recorder::writeToFiles(string basedir){
-	std::ofstream f; 
+	std::shared_ptr<CsvWriter> csv = std::make_shared<CsvWriter>(_csvShortest, 1 << 20); 
 	// I think this creates the dir as permission 775
 	mkdir(basedir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-	for (umapi it = _contents.begin(); it != _contents.end(); ++it){
+	for (umapi it = _index.begin(); it != _index.end(); ++it){
+		IDatum * datum = _slots[it->second].get(); 
+		if (datum->isStreaming()){
+			datum->finishStream(); 
+			continue; 
+		}
 		std::string filename = basedir + "/" + it->first + ".csv"; 
-		f.open(filename); 
-		f << it->second->getStringRepr(); 
-		f.close(); 
+		std::function<void()> write = [csv, datum, filename]{
+			std::ofstream f(filename); 
+			csv->attach(f); 
+			datum->writeCsv(*csv); 
+			csv->detach(); 
+		}; 
+		if (_asyncWriter != nullptr) _asyncWriter->submit(write); 
+		else write(); 
+	}
+}
+
+/**
+ * @brief Write output through a background writer (nullptr to go back to writing directly). 
+ * @details writeToFiles() then only queues the files, and streamed traces are formatted and 
+ * written while the simulation goes on. The datums are read by the writer thread until 
+ * writer->flush() (or close()), so don't record into them before that; reset() flushes the 
+ * writer itself. Call before streamToFiles(). 
+ * @param writer the writer (not owned, must outlive its use by the Recorder)
+ */
+void Recorder::setAsyncWriter(AsyncWriter * writer){
+	_asyncWriter = writer; 
+	for (unsigned i=0; i<_slots.size(); ++i){
+		_slots[i]->attachAsyncWriter(writer); 
 	}
 }
 
 /**
- * @brief Delete both the data and known data types. 
+ * @brief Write numbers in CSVs with the fewest digits that read back exactly. 
+ * @details By default every datum keeps the number format our CSVs always had (e.g. 12 
+ * significant digits for traces). Shortest round trip output is lossless and usually 
+ * shorter, but the bytes differ from the default. Applies to writeToFiles() and to 
+ * streamToFiles() called afterwards. 
+ */
+void Recorder::setCsvShortest(bool shortest){
+	_csvShortest = shortest; 
+}
+
+/**
+ * @brief Have datums that can (e.g. TraceDatum) write their CSVs to basedir during the run. 
+ * @details Call after the datums are registered and before running; writeToFiles() 
+ * (with the same basedir) finishes the files. The buffer is split evenly between 
+ * the streaming datums, so the traces held in memory stay around bufferBytes in total. 
+ * Datums already streaming are left as they are. 
+ * 
+ * @param basedir directory of where all the CSVs go. 
+ * @param bufferBytes memory to allow for buffered traces in total
+ */
+void Recorder::streamToFiles(string basedir, size_t bufferBytes){
+	mkdir(basedir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+	vector<umapi> streamable; 
+	for (umapi it = _index.begin(); it != _index.end(); ++it){
+		if (_slots[it->second]->canStream() && !_slots[it->second]->isStreaming()) streamable.push_back(it); 
+	}
+	for (unsigned i=0; i<streamable.size(); ++i){
+		_slots[streamable[i]->second]->streamTo(basedir + "/" + streamable[i]->first + ".csv", bufferBytes / streamable.size(), _csvShortest); 
+	}
+}
+
+/**
+ * @brief Write all datums into a single binary file of typed columns (see ColumnFileWriter). 
+ * @details An alternative to writeToFiles(): one file per run instead of one CSV per datum, 
+ * readable in place with ColumnFileReader. Datums are written in the order of their keys, 
+ * and datums with nothing to write (DummyDatum) are left out. Not possible for datums 
+ * streamed to CSV during the run. 
+ * @param filename the file to write (truncated)
+ */
+void Recorder::writeColumnFile(string filename){
+	vector<string> keys; 
+	for (umapi it = _index.begin(); it != _index.end(); ++it){
+		#ifndef DISABLE_ERROR_CHECKS
+		if (_slots[it->second]->isStreaming()) throw fatal_error() << "ERROR: datum " << it->first << " was streamed to CSV, can't write it to a column file!"; 
+		#endif
+		keys.push_back(it->first); 
+	}
+	std::sort(keys.begin(), keys.end()); 
+	ColumnFileWriter out(filename); 
+	for (unsigned i=0; i<keys.size(); ++i){
+		_slots[_index[keys[i]]]->writeColumns(out, keys[i]); 
+	}
+	out.close(); 
+}
+
+/**
+ * @brief Delete both the data and known data types, and restart the trial counter. 
+ * @details Invalidates all handles. Waits for the background writer (if any) to finish 
+ * with the datums first. 
  */
 void Recorder::reset(){
-	_contents.clear(); 
+	if (_asyncWriter != nullptr) _asyncWriter->flush(); 
+	_index.clear(); 
+	_slots.clear(); 
+	_trialId = -1; 
+	_trialTable = nullptr; 
+	_memoryActed = false; 
+	_memoryAtAction = 0; 
+	_memoryStopped = false; 
+	_memoryLog.clear(); 
+}
+
+/**
+ * @brief Parse a memory policy name: spill, freeze or stop. 
+ */
+Recorder::MemoryPolicy Recorder::memoryPolicyFromString(const string & name){
+	if (name == "spill") return SPILL; 
+	if (name == "freeze") return FREEZE; 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (name != "stop") throw fatal_error() << "ERROR: unknown memory policy " << name << " (expected spill, freeze or stop)!"; 
+	#endif
+	return STOP; 
+}
+
+/**
+ * @brief Cap the memory the datums hold, with a policy for when they outgrow it. 
+ * @details Checked every 64 trials (in newTrial()), against bytesUsed(). The first time 
+ * the datums are over budget, SPILL streams the datums that can to spillDir (with half 
+ * the budget as their buffer, see streamToFiles(); finish with writeToFiles(spillDir)), 
+ * and FREEZE freezes every datum that grows with observations (see IDatum::freeze()): 
+ * they keep what they recorded, with the same type and output format, and store nothing 
+ * more, while summaries (e.g. OnlineGMMDatum's mixture) keep updating. Handles stay valid. 
+ * If that was not enough by the next check (for SPILL, still over budget; for FREEZE, 
+ * over budget and still growing), for SPILL with nothing to stream, or for STOP, 
+ * recording stops: recordedEnough() turns true and the experiment ends after the current 
+ * trial, with what was recorded so far intact. writeMemoryReport() tells what happened. 
+ * The budget survives reset(). 
+ * 
+ * @param bytes memory to allow (0 for no budget)
+ * @param policy what to do over budget
+ * @param spillDir directory for SPILL
+ */
+void Recorder::setMemoryBudget(size_t bytes, MemoryPolicy policy, const string & spillDir){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (policy == SPILL && spillDir.empty()) throw fatal_error() << "ERROR: spilling over the memory budget needs a directory to spill to!"; 
+	#endif
+	_memoryBudget = bytes; 
+	_memoryPolicy = policy; 
+	_spillDir = spillDir; 
+}
+
+/**
+ * @brief Bytes held by all datums (see IDatum::bytesUsed()). 
+ */
+size_t Recorder::bytesUsed() const {
+	size_t total = 0; 
+	for (unsigned i=0; i<_slots.size(); ++i) total += _slots[i]->bytesUsed(); 
+	return total; 
+}
+
+/**
+ * @brief Bytes held by each datum, by key. 
+ */
+std::map<string,size_t> Recorder::getMemoryUsage() const {
+	std::map<string,size_t> usage; 
+	for (auto it = _index.begin(); it != _index.end(); ++it) usage[it->first] = _slots[it->second]->bytesUsed(); 
+	return usage; 
+}
+
+/**
+ * @brief Have the datums gone over the memory budget at some check? 
+ */
+bool Recorder::overMemoryBudget() const {
+	return !_memoryLog.empty(); 
+}
+
+/**
+ * @brief Write the memory held by each datum, the total and the budget as datum,bytes CSV, 
+ * followed by a comment line (starting with #) for each action taken over budget. 
+ */
+void Recorder::writeMemoryReport(std::ostream & out) const {
+	std::map<string,size_t> usage = getMemoryUsage(); 
+	out << "datum,bytes" << std::endl; 
+	for (auto it = usage.begin(); it != usage.end(); ++it) out << it->first << "," << it->second << std::endl; 
+	out << "total," << bytesUsed() << std::endl; 
+	if (_memoryBudget > 0) out << "budget," << _memoryBudget << std::endl; 
+	for (unsigned i=0; i<_memoryLog.size(); ++i) out << "# " << _memoryLog[i] << std::endl; 
+}
+
+/**
+ * @brief Check the datums against the memory budget, and apply the policy if they are over. 
+ */
+void Recorder::_enforceMemoryBudget(){
+	if (_memoryStopped) return; 
+	size_t used = bytesUsed(); 
+	if (used <= _memoryBudget) return; 
+	std::ostringstream msg; 
+	msg << "at trial " << _trialId << ": " << used << " bytes over the budget of " << _memoryBudget << ", "; 
+	bool canSpill = false; 
+	for (unsigned i=0; i<_slots.size(); ++i) canSpill = canSpill || (_slots[i]->canStream() && !_slots[i]->isStreaming()); 
+	if (_memoryPolicy == SPILL && !_memoryActed && canSpill){
+		streamToFiles(_spillDir, _memoryBudget / 2); 
+		msg << "streaming to " << _spillDir; 
+	} else if (_memoryPolicy == FREEZE && _memoryActed && used <= _memoryAtAction){
+		return; // frozen over budget, but not growing
+	} else if (_memoryPolicy == FREEZE && !_memoryActed){
+		vector<string> keys; 
+		for (umapi it = _index.begin(); it != _index.end(); ++it){
+			IDatum * datum = _slots[it->second].get(); 
+			if (datum->isStreaming() || datum->isFrozen() || !datum->freeze()) continue; 
+			keys.push_back(it->first); 
+		}
+		std::sort(keys.begin(), keys.end()); 
+		msg << "freezing"; 
+		for (unsigned i=0; i<keys.size(); ++i) msg << " " << keys[i]; 
+	} else {
+		_memoryStopped = true; 
+		if (_memoryPolicy == SPILL && !_memoryActed) msg << "nothing to spill, "; 
+		msg << "stopped recording"; 
+	}
+	_memoryActed = true; 
+	_memoryAtAction = bytesUsed(); 
+	_memoryLog.push_back(msg.str()); 
+}
+
+/**
+ * @brief Register a TrialTable, stored under the key "trials". 
+ * @details Tasks record trial-level observations and events into it instead of into 
+ * per-condition datums (see Task::bindDatums()). 
+ */
+void Recorder::registerTrialTable(const TrialTable & ex){
+	registerDatum("trials", ex); 
+	_trialTable = static_cast<TrialTable*>(_slots.back().get()); 
+}
+
+/**
+ * @brief The registered TrialTable, or nullptr if there is none. 
+ */
+TrialTable * Recorder::getTrialTable(){
+	return _trialTable; 
 }
 
 /**
  * @param t the time of the observation. 
  * @param v the vector-valued observation.
+ * @param keep keep it whatever the TraceDatum's decimation policy
+ * @param decision is this the timepoint the trial's response was decided at? 
+ */
+Timepoint::Timepoint(double t, const vec & v, bool keep, bool decision): time(t), value(v), keep(keep), decision(decision) {} 
+
+/**
+ * @brief Timepoint viewing the elements of a matrix (in column-major order) without copying them. 
+ * @details The value uses m's memory, so this is for passing a posterior straight to 
+ * the datum that stores it (e.g. _recordTrace(id, Timepoint(time, belief.getBelief()))), 
+ * not for keeping: m must outlive the Timepoint and not be resized. Copies of the 
+ * Timepoint own their values. 
+ * @param t the time of the observation. 
+ * @param m the matrix-valued observation (e.g. a posterior)
+ * @param keep keep it whatever the TraceDatum's decimation policy (e.g. at a threshold crossing)
+ * @param decision is this the timepoint the trial's response was decided at? 
  */
-Timepoint::Timepoint(double t, vec v): time(t), value(v) {} 
+Timepoint::Timepoint(double t, const mat & m, bool keep, bool decision): time(t), value(const_cast<double*>(m.memptr()), m.n_elem, false, true), keep(keep), decision(decision) {} 
 
 /**
  * @param start event start time
@@ -81,8 +370,9 @@ Event::Event(double start, double end): startTime(start), endTime(end) {
 /**
  * @brief Record an event. 
  */
-void EventDatum::record(Event val){
-	_traceIds.push_back(_latestTraceId);
+void EventDatum::record(const Event & val){
+	if (_frozen) return; 
+	_traceIds.push_back(_currentTrialId());
 	_startTimes.push_back(val.startTime);
 	_endTimes.push_back(val.endTime);
 }
@@ -95,7 +385,7 @@ void EventDatum::record(Event val){
  * First column is the trace (trial) the event is in, second column
  * is the start, and third column is the end. 
  */
-mat EventDatum::getEventTimes(){
+mat EventDatum::getEventTimes() const {
 	if (_startTimes.empty()){
 		return mat(); 
 	}
@@ -117,14 +407,67 @@ void EventDatum::newTrial(){
 
 /**
  * @brief Return a string representation of this event datum. 
- * @details Used in data dumps. 
- * @return A CSV dump of the output of EventDatum::getEventTimes(). 
+ * @details Used in data dumps. Written straight from the stored columns. 
+ * @return A CSV dump of the output of EventDatum::getEventTimes() (in armadillo's csv_ascii format). 
  */
-std::string EventDatum::getStringRepr(){
-	mat tmp = getEventTimes(); 
-	std::ostringstream out; 
-	tmp.save(out, arma::csv_ascii); 
-	return out.str(); 
+std::string EventDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t EventDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_startTimes) + _bytesOf(_endTimes) + _bytesOf(_traceIds); 
+}
+
+/**
+ * @brief Stop storing events (the ones stored so far stay). 
+ */
+bool EventDatum::freeze(){
+	_frozen = true; 
+	return true; 
+}
+
+/**
+ * @brief Write the "trial,start,end" rows (in armadillo's csv_ascii format). 
+ */
+void EventDatum::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::SCIENTIFIC, 12); 
+	for (unsigned i=0; i<_startTimes.size(); ++i){
+		out.field(double(_traceIds[i])); 
+		out.field(_startTimes[i]); 
+		out.field(_endTimes[i]); 
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Event start times (one per recorded event). 
+ */
+const vector<double> & EventDatum::getStartTimes() const {
+	return _startTimes; 
+}
+
+/**
+ * @brief Event end times (one per recorded event). 
+ */
+const vector<double> & EventDatum::getEndTimes() const {
+	return _endTimes; 
+}
+
+/**
+ * @brief Trial IDs of the events. 
+ */
+const vector<int> & EventDatum::getTraceIds() const {
+	return _traceIds; 
+}
+
+/**
+ * @brief Iterate over the events of each trial (positions into the start and end times). 
+ */
+TrialSegments EventDatum::getSegments() const {
+	return TrialSegments(_traceIds); 
 }
 
 /**
@@ -132,192 +475,2490 @@ std::string EventDatum::getStringRepr(){
  * @details Aliased to EventDatum::getMatRepr() here but 
  * might be used differently in other Datums. 
  */
-mat EventDatum::getMatRepr(){
+mat EventDatum::getMatRepr() const {
 	return getEventTimes(); 
 }
 
 /**
- * @brief Record a new timepoint to our trace. 
- * @details Records the timepoint and the trace it came from. 
- * @param val Timepoint to record. 
+ * @brief Write the events as columns trial, start and end, indexed by trial. 
  */
-void TraceDatum::record(Timepoint val){
-	_traceIds.push_back(_latestTraceId);
-	_times.push_back(val.time); 
-	_values.push_back(val.value); 	
-	// if (_traceIds.empty()){
-	// 	_traceIds.push_back(0); 
-	// 	return; 
-	// }
-	// int traceId = _traceIds.back(); 
-	// if(_times.back() >= val.time){ // if our time index is equal or lower than the last index then we start a new trace:
-	// 	_traceIds.push_back(traceId+1); 
-	// }  else {
-	// 	_traceIds.push_back(traceId); 
-	// }
-	// _times.push_back(val.time); 
-	// #ifndef DISABLE_ERROR_CHECKS
-	// 	if(val.value.size() != _values.back().size()) throw fatal_error() << "ERROR: current value for this TraceDatum is of length " << val.value.size() << " but the pervious one recorded was of length" << _values.back().size() << "! That is almost certainly a mistake and TraceDatum's getTraces() method can't handle it!";
-	// #endif
-	// _values.push_back(val.value); 
+void EventDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	out.beginDatum(key, _traceIds.size()); 
+	out.column("trial", _traceIds.data()); 
+	out.column("start", _startTimes.data()); 
+	out.column("end", _endTimes.data()); 
+	out.index(getSegments()); 
 }
 
 /**
- * @brief Get all the traces this datum knows about. 
- * @return a matrix with as many rows as timepoints, and as many columns as 
- * there are values in the TimePoint vector for this TraceDatum, +2. The 
- * first two columns are the trace (trial) ID and trial time, and the remaining
- * columns are the vectors at each timepoint (for example, posteriors). 
- */
-mat TraceDatum::getTraces(){
-	// this is not the most efficient way to do this... but is the fastest to write and this will at most get called a handful of times
-	// #ifndef DISABLE_ERROR_CHECKS
-		// if (_traceIds.empty()) throw fatal_error() << "Attempting to get traces but none were recorded!";
-	// #endif
-	if (_traceIds.empty()){
-		return mat(); 
+ * @brief Constructor for TrialReservoir. 
+ * @param capacity the most trials to keep (see \ref reservoirTrials)
+ */
+TrialReservoir::TrialReservoir(unsigned capacity): _slotTrials(capacity, -1), _nSeen(0), _lastTrial(-2), _lastSlot(-1) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (capacity == 0) throw fatal_error() << "ERROR: TrialReservoir needs room for at least one trial!"; 
+	#endif
+}
+
+/**
+ * @brief The slot a trial's values go in, or -1 if the trial is not in the sample. 
+ * @details Drawn the first time a trial is asked about (trials come in order, so only 
+ * the latest one is remembered), and the same for every later call in that trial. 
+ */
+int TrialReservoir::slotFor(int trialId){
+	if (trialId == _lastTrial) return _lastSlot; 
+	_lastTrial = trialId; 
+	int k = _nSeen++; 
+	int slot = k < int(_slotTrials.size()) ? k : RNG::runif_int(k); // uniform over the k+1 trials seen
+	_lastSlot = slot < int(_slotTrials.size()) ? slot : -1; 
+	if (_lastSlot >= 0) _slotTrials[_lastSlot] = trialId; 
+	return _lastSlot; 
+}
+
+/**
+ * @brief Return the trial a slot holds now (-1 if it is empty). 
+ */
+int TrialReservoir::trialInSlot(unsigned slot) const {
+	return _slotTrials[slot]; 
+}
+
+/**
+ * @brief Return the filled slots, in the order of the trials they hold. 
+ */
+vector<unsigned> TrialReservoir::keptSlots() const {
+	vector<unsigned> slots; 
+	for (unsigned i=0; i<_slotTrials.size(); ++i){
+		if (_slotTrials[i] >= 0) slots.push_back(i); 
+	}
+	std::sort(slots.begin(), slots.end(), [this](unsigned a, unsigned b){ return _slotTrials[a] < _slotTrials[b]; }); 
+	return slots; 
+}
+
+/**
+ * @brief Return the most trials kept. 
+ */
+unsigned TrialReservoir::getCapacity() const {
+	return _slotTrials.size(); 
+}
+
+/**
+ * @brief Return the number of trials seen (kept or not). 
+ */
+int TrialReservoir::getNSeen() const {
+	return _nSeen; 
+}
+
+/**
+ * @brief Constructor for SampledEventDatum. 
+ * @param reservoir the condition's TrialReservoir (share it with the condition's other sampled datums)
+ */
+SampledEventDatum::SampledEventDatum(std::shared_ptr<TrialReservoir> reservoir): _reservoir(reservoir), _slots(reservoir->getCapacity()), _slotTrials(reservoir->getCapacity(), -1) {}
+
+/**
+ * @brief Add the event's duration to the exact summary, and keep the event if its trial is in the sample. 
+ */
+void SampledEventDatum::record(const Event & val){
+	_durations.record(val.endTime - val.startTime); 
+	int trial = _currentTrialId(); 
+	int slot = _reservoir->slotFor(trial); 
+	if (slot < 0) return; 
+	if (_slotTrials[slot] != trial){
+		_slotTrials[slot] = trial; 
+		_slots[slot].clear(); 
 	}
-	mat out(_times.size(), 2+_values.back().size()); 
-	for (unsigned i=0; i<_times.size(); ++i){
-		out(i,0) = _traceIds[i]; 
-		out(i,1) = _times[i];
-		for (unsigned j=0; j < _values.back().size(); ++j){
-			out(i,2+j) = _values[i][j]; 
+	_slots[slot].push_back(val); 
+}
+
+/**
+ * @brief Times of the events of the sampled trials, in trial order, as in EventDatum::getEventTimes(). 
+ */
+mat SampledEventDatum::getEventTimes() const {
+	vector<double> rows; 
+	for (unsigned slot : _reservoir->keptSlots()){
+		if (_slotTrials[slot] != _reservoir->trialInSlot(slot)) continue; 
+		for (const Event & e : _slots[slot]){
+			rows.push_back(_slotTrials[slot]); 
+			rows.push_back(e.startTime); 
+			rows.push_back(e.endTime); 
 		}
 	}
-	return out; 
+	if (rows.empty()) return mat(); 
+	return mat(rows.data(), 3, rows.size() / 3).t(); 
 }
 
 /**
- * @brief Return a string (CSV) representation of this TraceDatum. 
- * @details A string dump of TraceDatum::getTraces() 
+ * @brief Return the number of all events (not just the sampled ones). 
  */
-std::string TraceDatum::getStringRepr(){
-	mat tmp = getTraces(); 
-	std::ostringstream out; 
-	tmp.save(out, arma::csv_ascii); 
-	return out.str(); 
+int SampledEventDatum::getN() const {
+	return _durations.getN(); 
 }
 
+/**
+ * @brief Return the mean duration of all events (exact). 
+ */
+double SampledEventDatum::getDurationMean() const {
+	return _durations.getMean(); 
+}
 
 /**
- * @brief Tell TraceDatum we started a new trial. 
- * @details Increments the current traceID
+ * @brief Return the variance of the durations of all events (exact). 
  */
-void TraceDatum::newTrial(){
-	++_latestTraceId; 
+double SampledEventDatum::getDurationVariance() const {
+	return _durations.getVariance(); 
 }
 
 /**
- * @brief Return a matrix representation of the datum. 
- * @details Aliased to TraceDatum::getMatRepr() here but 
- * might be used differently in other Datums. 
+ * @brief Return the CSV of the sampled trials (see writeCsv()). 
  */
-mat TraceDatum::getMatRepr(){
-	return getTraces(); 
+std::string SampledEventDatum::getStringRepr() const {
+	return _csvString(); 
 }
 
 /**
- * @brief A datum that estimates a gaussian mixture model from its incoming data stream. 
- * @details This provides a compact nonparametric distribution of anything we might want 
- * to record (e.g. RTs). 
- * 
- * @param ngauss number of gaussians. 
- * @param expectedNObs number of observations we expect (a good guess helps save us some memory allocations).
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
  */
-GMMDatum::GMMDatum(int ngauss, int expectedNObs): _ngauss(ngauss), _estimateIsFresh(false), _n(0){
-	_rawData = rowvec(expectedNObs); 
-	_model = arma::gmm_diag();
+size_t SampledEventDatum::bytesUsed() const {
+	size_t bytes = sizeof(*this) + _bytesOf(_slots) + _bytesOf(_slotTrials); 
+	for (const vector<Event> & slot : _slots) bytes += _bytesOf(slot); 
+	return bytes; 
 }
 
+/**
+ * @brief Write "trial,start,end" rows of the sampled trials, like EventDatum. 
+ */
+void SampledEventDatum::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::SCIENTIFIC, 12); 
+	for (unsigned slot : _reservoir->keptSlots()){
+		if (_slotTrials[slot] != _reservoir->trialInSlot(slot)) continue; 
+		for (const Event & e : _slots[slot]){
+			out.field(double(_slotTrials[slot])); 
+			out.field(e.startTime); 
+			out.field(e.endTime); 
+			out.endRow(); 
+		}
+	}
+}
 
 /**
- * @brief Return the mean of the current observation set. 
- * @return Mean of the observations (using kahan sum to keep floats precise)
+ * @brief Write the sampled events as columns trial, start and end, indexed by trial. 
  */
-double GMMDatum::getMean(){
-	return utils::mean(_rawData); // using kahan sum on the back end
+void SampledEventDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	vector<int> ids; 
+	vector<double> starts, ends; 
+	for (unsigned slot : _reservoir->keptSlots()){
+		if (_slotTrials[slot] != _reservoir->trialInSlot(slot)) continue; 
+		for (const Event & e : _slots[slot]){
+			ids.push_back(_slotTrials[slot]); 
+			starts.push_back(e.startTime); 
+			ends.push_back(e.endTime); 
+		}
+	}
+	out.beginDatum(key, ids.size()); 
+	out.column("trial", ids.data()); 
+	out.column("start", starts.data()); 
+	out.column("end", ends.data()); 
+	out.index(TrialSegments(ids)); 
 }
 
 /**
- * @brief Return the variance of the current observation set. 
- * @return Variance of the observations (using kahan sum to keep floats precise)
+ * @brief Tell the datum that we started a new trial. 
  */
-double GMMDatum::getVariance(){
-	return utils::variance(_rawData); 
+void SampledEventDatum::newTrial(){
+	++_latestTraceId; 
 }
 
 /**
- * @brief Record a new value. 
- * @details Also marks our latest GMM estimate as not fresh, 
- * and resizes the observation vector if needed. 
+ * @brief Constructor for TraceDatum. 
+ * @param expectedTimepoints number of timepoints to reserve space for (e.g. trials times 
+ * expected steps per trial), so recording does not reallocate; 0 to grow as needed. 
+ * @param every keep only every every-th timepoint of a trace (see \ref traceEvery), 1 to keep all
+ * @param epsilon keep only timepoints where some value moved by more than epsilon since the 
+ * last kept one (see \ref traceEpsilon), 0 to keep all
  */
-void GMMDatum::record(double val){
-	// if we run out of space, double the space
-	if (_rawData.n_elem == _n) _rawData.resize(_n*2); 
-	_rawData[_n++] = val; 
-	_estimateIsFresh = false; 
+TraceDatum::TraceDatum(unsigned expectedTimepoints, unsigned every, double epsilon): _touched(0), _width(0), _expectedTimepoints(expectedTimepoints), _bufferBytes(0), 
+	_every(every > 0 ? every : 1), _epsilon(epsilon), _stepInTrace(0), _lastKeptRow(0), _latestIsProvisional(false) {}
+
+/**
+ * @brief Record a new timepoint to our trace. 
+ * @details Appends a row with the trace the timepoint came from, its time and its values, 
+ * or overwrites the last row if the decimation policy dropped it. 
+ * @param val Timepoint to record. 
+ */
+void TraceDatum::record(const Timepoint & val){
+	if (_frozen) return; 
+	if (_width == 0){
+		_width = 2 + val.value.n_elem; 
+		size_t expectedRows = _expectedTimepoints; 
+		if (_stream) expectedRows = std::min(expectedRows, _bufferBytes / (sizeof(double) * _width) + 1); 
+		_rows.reserve(expectedRows * _width); 
+	}
+	#ifndef DISABLE_ERROR_CHECKS
+	if (2 + val.value.n_elem != _width) throw fatal_error() << "ERROR: recording a timepoint of length " << val.value.n_elem << " into a TraceDatum of length " << _width - 2 << "!"; 
+	#endif
+	int traceId = _currentTrialId(); 
+	bool newTrace = _segments.empty() || _segments.back().trialId != traceId; 
+	if (_stream && newTrace && !_segments.empty() && _rows.size() * sizeof(double) >= _bufferBytes){
+		_flush(); // the previous trace is complete, and we are at the buffer size
+	}
+	unsigned row = getNRows(); 
+	if (newTrace){
+		TrialSegment seg = {traceId, row, row}; 
+		_segments.push_back(seg); 
+		_stepInTrace = 0; 
+	} else {
+		++_stepInTrace; 
+	}
+	bool keep = newTrace || val.keep || _passesPolicy(val); 
+	if (_latestIsProvisional && !newTrace){
+		// the previous timepoint was only there as the latest, this one replaces it
+		double * r = &_rows[(row - 1) * _width]; 
+		r[1] = val.time; 
+		std::copy(val.value.memptr(), val.value.memptr() + val.value.n_elem, r + 2); 
+		--row; 
+	} else {
+		++_segments.back().end; 
+		_rows.push_back(traceId); 
+		_rows.push_back(val.time); 
+		_rows.insert(_rows.end(), val.value.memptr(), val.value.memptr() + val.value.n_elem); 
+		_touched = std::max(_touched, _rows.size()); 
+	}
+	if (keep) _lastKeptRow = row; 
+	_latestIsProvisional = !keep; 
 }
 
 /**
- * @brief returns CSV string representation of the GMM
- * @details Returns a CSV with a header and one row per gaussian, 
- * with columns mean, variance, weight.
+ * @brief Would the decimation policy keep this timepoint of the current trace? 
+ * @details It has to be an every-th timepoint, and some value has to have moved by more 
+ * than epsilon since the last kept timepoint (each only if set). 
  */
-std::string GMMDatum::getStringRepr(){
-	_estimateModel();
-	std::ostringstream out; 
-	out << "mean,variance,weight" << std::endl; 
-	for (int i = 0; i<_ngauss; i++){
-		out << _model.means[i] << "," << _model.dcovs[i] << "," << _model.hefts[i] << std::endl; 
-	}	
-	return out.str(); 
+bool TraceDatum::_passesPolicy(const Timepoint & val) const {
+	if (_every > 1 && _stepInTrace % _every != 0) return false; 
+	if (_epsilon <= 0) return true; 
+	const double * kept = &_rows[_lastKeptRow * _width + 2]; 
+	for (unsigned j=0; j<val.value.n_elem; ++j){
+		if (std::fabs(val.value[j] - kept[j]) > _epsilon) return true; 
+	}
+	return false; 
 }
 
 /**
- * @brief Return the number of observations in this datum. 
+ * @brief Get all the traces this datum knows about. 
+ * @return a matrix with as many rows as timepoints, and as many columns as 
+ * there are values in the TimePoint vector for this TraceDatum, +2. The 
+ * first two columns are the trace (trial) ID and trial time, and the remaining
+ * columns are the vectors at each timepoint (for example, posteriors). This 
+ * is a (transposed) copy; use getTracesView() to avoid it. 
  */
-int GMMDatum::getN(){
-	return _n; 
+mat TraceDatum::getTraces() const {
+	return getTracesView().t(); 
 }
 
 /**
- * @brief Estimate a gaussian mixture model for the observations seen so far. 
- * @details Uses armadillo's gmm_diag. 
+ * @brief The traces as a matrix using the datum's storage (no copy). 
+ * @return a matrix with one column per timepoint (the transpose of getTraces()): 
+ * trace ID, time, then the values. Valid until the next record(). 
  */
-void GMMDatum::_estimateModel(){
-	if(_estimateIsFresh) return; 
-	_model.learn(_rawData(arma::span(0,_n-1)), _ngauss, arma::maha_dist, arma::random_subset, 15, 15, 1e-10, false); 
-	_estimateIsFresh = true; 
+const mat TraceDatum::getTracesView() const {
+	if (_rows.empty()){
+		return mat(); 
+	}
+	return mat(const_cast<double*>(_rows.data()), _width, getNRows(), false, true); 
 }
 
 /**
- * @brief Returns the means of the gaussians estimated.
+ * @brief Return a string (CSV) representation of this TraceDatum. 
+ * @details A string dump of TraceDatum::getTraces() (in armadillo's csv_ascii format), 
+ * written straight from the stored rows. 
  */
-rowvec GMMDatum::getGaussMeans(){
-	_estimateModel();
-	return _model.means; 
+std::string TraceDatum::getStringRepr() const {
+	return _csvString(); 
 }
 
 /**
- * @brief Returns the variances of the gaussians estimated.
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ * @details Counts the part of the rows' buffer that has been written to, not all of what 
+ * was reserved for expectedTimepoints, which the system only backs with memory once touched. 
  */
-rowvec GMMDatum::getGaussVars(){
-	_estimateModel();
-	return _model.dcovs;
+size_t TraceDatum::bytesUsed() const {
+	return sizeof(*this) + _touched * sizeof(double) + _bytesOf(_segments); 
 }
 
 /**
- * @brief Returns the weights of the gaussians estimated.
+ * @brief Stop storing timepoints (the traces stored so far stay). 
  */
-rowvec GMMDatum::getGaussWeights(){
-	_estimateModel();
-	return _model.hefts; 
+bool TraceDatum::freeze(){
+	_frozen = true; 
+	return true; 
 }
 
 /**
- * @brief Returns the observations seen so far. 
+ * @brief Write all rows as CSV (in armadillo's csv_ascii format). 
+ */
+void TraceDatum::writeCsv(CsvWriter & out) const {
+	_writeRows(out, 0, getNRows()); 
+}
+
+/**
+ * @brief Write rows [begin, end) as CSV (in armadillo's csv_ascii format). 
  */
-rowvec GMMDatum::getRawData(){
-	return _rawData(arma::span(0,_n-1)); 
-}
\ No newline at end of file
+void TraceDatum::_writeRows(CsvWriter & out, unsigned begin, unsigned end) const {
+	out.setFormat(CsvWriter::SCIENTIFIC, 12); 
+	for (size_t i=size_t(begin)*_width; i<size_t(end)*_width; i+=_width){
+		for (unsigned j=0; j<_width; ++j){
+			out.field(_rows[i+j]); 
+		}
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Stream the traces to a file during the run. 
+ * @details Rows already recorded are written out right away (they should be complete 
+ * traces, so call this between trials), and the buffer is cut down to bufferBytes. 
+ * @param filename the CSV file to write (truncated)
+ * @param bufferBytes hold about this much in memory before writing completed traces 
+ * (a single trace longer than this is held until it completes)
+ * @param shortestCsv write shortest round trip numbers (see Recorder::setCsvShortest())
+ * @return true
+ */
+bool TraceDatum::streamTo(const std::string & filename, size_t bufferBytes, bool shortestCsv){
+	_stream = std::make_shared<std::ofstream>(filename); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (!*_stream) throw fatal_error() << "ERROR: could not open " << filename << " to stream traces to!"; 
+	#endif
+	_csv = std::make_shared<CsvWriter>(shortestCsv); 
+	_csv->attach(*_stream); 
+	_bufferBytes = bufferBytes; 
+	if (getNRows() > 0) _flush(); 
+	else _fitBuffer(); 
+	return true; 
+}
+
+/**
+ * @brief Write the buffered rows to the stream and drop them from memory. 
+ * @details Leaves a buffer of about bufferBytes (see _fitBuffer()). With a background 
+ * writer the full buffer is handed over to it, so until it is written one more buffer is 
+ * held, in the writer's queue. 
+ */
+void TraceDatum::_flush(){
+	if (_asyncWriter != nullptr){
+		// hand the buffer over to the writer thread and carry on in a fresh one
+		std::shared_ptr<TraceDatum> chunk = std::make_shared<TraceDatum>(); 
+		chunk->_width = _width; 
+		chunk->_rows.swap(_rows); 
+		std::shared_ptr<CsvWriter> csv = _csv; 
+		_asyncWriter->submit([chunk, csv]{ chunk->_writeRows(*csv, 0, chunk->getNRows()); }); 
+	} else {
+		_writeRows(*_csv, 0, getNRows()); 
+		_rows.clear(); 
+	}
+	_segments.clear(); 
+	_fitBuffer(); 
+}
+
+/**
+ * @brief Give the (empty) rows a buffer of about bufferBytes when streaming. 
+ * @details A buffer that grew past that (e.g. reserved for expectedTimepoints, or grown by 
+ * a trace longer than the buffer) is released rather than kept with its touched pages. 
+ */
+void TraceDatum::_fitBuffer(){
+	if (_width == 0) return; 
+	size_t values = (_bufferBytes / (sizeof(double) * _width) + 1) * _width; 
+	if (_rows.capacity() > values) vector<double>().swap(_rows); 
+	if (_rows.capacity() == 0){
+		_rows.reserve(values); 
+		_touched = 0; 
+	}
+}
+
+/**
+ * @brief Write out the rows still buffered and close the stream. 
+ */
+void TraceDatum::finishStream(){
+	if (!_stream) return; 
+	_flush(); 
+	vector<double>().swap(_rows); 
+	_touched = 0; 
+	std::shared_ptr<CsvWriter> csv = _csv; 
+	std::shared_ptr<std::ofstream> stream = _stream; 
+	std::function<void()> close = [csv, stream]{
+		csv->detach(); 
+		stream->close(); 
+	}; 
+	if (_asyncWriter != nullptr) _asyncWriter->submit(close); 
+	else close(); 
+	_csv.reset(); 
+	_stream.reset(); 
+}
+
+/**
+ * @brief Is this datum streaming to a file? 
+ */
+bool TraceDatum::isStreaming() const {
+	return bool(_stream); 
+}
+
+/**
+ * @brief All rows, back to back (trace ID, time, values for each timepoint). 
+ */
+const vector<double> & TraceDatum::getRows() const {
+	return _rows; 
+}
+
+/**
+ * @brief Number of values per row (2 + length of the recorded vectors, 0 if nothing recorded). 
+ */
+unsigned TraceDatum::getWidth() const {
+	return _width; 
+}
+
+/**
+ * @brief Number of timepoints recorded. 
+ */
+unsigned TraceDatum::getNRows() const {
+	return _width == 0 ? 0 : _rows.size() / _width; 
+}
+
+/**
+ * @brief Row i (trace ID, time, values), without copying. 
+ */
+ArrayView<double> TraceDatum::getRow(unsigned i) const {
+	return ArrayView<double>(_rows.data() + size_t(i) * _width, _width); 
+}
+
+/**
+ * @brief The rows of each trace (positions for getRow()). 
+ */
+const vector<TrialSegment> & TraceDatum::getSegments() const {
+	return _segments; 
+}
+
+/**
+ * @brief Tell TraceDatum we started a new trial. 
+ * @details Increments the current traceID
+ */
+void TraceDatum::newTrial(){
+	++_latestTraceId; 
+}
+
+/**
+ * @brief Return a matrix representation of the datum. 
+ * @details Aliased to TraceDatum::getMatRepr() here but 
+ * might be used differently in other Datums. 
+ */
+mat TraceDatum::getMatRepr() const {
+	return getTraces(); 
+}
+
+/**
+ * @brief Write the traces as columns trial, time and value0, value1, ..., indexed by trace. 
+ * @details Each column is gathered from the row buffer; the trial IDs are stored as int32. 
+ */
+void TraceDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	unsigned n = getNRows(); 
+	out.beginDatum(key, n); 
+	if (n > 0){
+		out.columnAs<int32_t>("trial", _rows.data(), _width); 
+		out.column("time", _rows.data() + 1, _width); 
+		for (unsigned j=2; j<_width; ++j){
+			std::ostringstream name; 
+			name << "value" << j - 2; 
+			out.column(name.str(), _rows.data() + j, _width); 
+		}
+	}
+	out.index(_segments); 
+}
+
+static const char _traceMagic[8] = {'C','D','D','M','T','R','C','1'}; 
+
+/**
+ * @brief Append x to out as a varint (7 bits per byte, low bits first, the high bit set on all but the last byte). 
+ */
+static void _putVarint(vector<uint8_t> & out, unsigned long long x){
+	while (x >= 0x80){
+		out.push_back(uint8_t(x) | 0x80); 
+		x >>= 7; 
+	}
+	out.push_back(uint8_t(x)); 
+}
+
+/**
+ * @brief Read a varint from in at pos, and move pos past it. 
+ */
+static unsigned long long _getVarint(const vector<uint8_t> & in, size_t & pos){
+	unsigned long long x = 0; 
+	for (unsigned shift=0; ; shift+=7){
+		#ifndef DISABLE_ERROR_CHECKS
+		if (pos >= in.size() || shift > 63) throw fatal_error() << "ERROR: encoded traces are truncated or corrupt!"; 
+		#endif
+		uint8_t b = in[pos++]; 
+		x |= static_cast<unsigned long long>(b & 0x7f) << shift; 
+		if (!(b & 0x80)) return x; 
+	}
+}
+
+/**
+ * @brief Zigzag code of x (0, -1, 1, -2, ... go to 0, 1, 2, 3, ...), so small differences of either sign make short varints. 
+ */
+static unsigned long long _zigzag(long long x){
+	return (static_cast<unsigned long long>(x) << 1) ^ static_cast<unsigned long long>(x >> 63); 
+}
+
+/**
+ * @brief Undo _zigzag(). 
+ */
+static long long _unzigzag(unsigned long long x){
+	return static_cast<long long>(x >> 1) ^ -static_cast<long long>(x & 1); 
+}
+
+/**
+ * @brief Constructor for CompactTraceDatum. 
+ * @param timePerStep time between steps (\ref timePerStep); recorded times are rounded to steps
+ * @param precision quantization step of the values (see \ref tracePrecision)
+ * @param blockSize most timepoints per block
+ */
+CompactTraceDatum::CompactTraceDatum(double timePerStep, double precision, unsigned blockSize): _timePerStep(timePerStep), _precision(precision), _blockSize(blockSize), 
+	_cells(0), _nRows(0), _blockRows(0), _blockTrial(0), _blockFirstStep(0), _lastClosedTrial(0) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (timePerStep <= 0 || precision <= 0 || blockSize == 0) throw fatal_error() << "ERROR: CompactTraceDatum needs a positive timePerStep, precision and blockSize, got " << timePerStep << ", " << precision << " and " << blockSize; 
+	#endif
+}
+
+/**
+ * @brief Record a new timepoint to our trace. 
+ * @details Quantizes it into the open block, first closing the block if the timepoint 
+ * doesn't continue it (a new trace, a gap in the steps, or a full block). 
+ */
+void CompactTraceDatum::record(const Timepoint & val){
+	if (_frozen) return; 
+	if (_nRows == 0) _cells = val.value.n_elem; 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (val.value.n_elem != _cells) throw fatal_error() << "ERROR: recording a timepoint of length " << val.value.n_elem << " into a CompactTraceDatum of length " << _cells << "!"; 
+	#endif
+	int traceId = _currentTrialId(); 
+	long long step = std::llround(val.time / _timePerStep); 
+	if (_blockRows > 0 && (traceId != _blockTrial || step != _blockFirstStep + _blockRows || _blockRows == _blockSize)){
+		_closeBlock(); 
+	}
+	if (_blockRows == 0){
+		_blockTrial = traceId; 
+		_blockFirstStep = step; 
+	}
+	for (unsigned j=0; j<_cells; ++j){
+		_block.push_back(std::llround(val.value[j] / _precision)); 
+	}
+	++_blockRows; 
+	++_nRows; 
+}
+
+/**
+ * @brief Encode the open block onto the closed ones. 
+ */
+void CompactTraceDatum::_closeBlock(){
+	if (_blockRows == 0) return; 
+	_encodeBlock(_bytes, _blockTrial - _lastClosedTrial, _blockFirstStep, _block, _blockRows, _cells); 
+	_lastClosedTrial = _blockTrial; 
+	_block.clear(); 
+	_blockRows = 0; 
+}
+
+/**
+ * @brief Append a block to out: the trace ID difference, first step and number of 
+ * timepoints, then each value's difference from the previous timepoint's (all varints). 
+ */
+void CompactTraceDatum::_encodeBlock(vector<uint8_t> & out, int trialDelta, long long firstStep, const vector<long long> & block, unsigned rows, unsigned cells){
+	_putVarint(out, _zigzag(trialDelta)); 
+	_putVarint(out, _zigzag(firstStep)); 
+	_putVarint(out, rows); 
+	for (unsigned j=0; j<cells; ++j){
+		_putVarint(out, _zigzag(block[j])); 
+	}
+	for (size_t i=cells; i<size_t(rows)*cells; ++i){
+		_putVarint(out, _zigzag(block[i] - block[i - cells])); 
+	}
+}
+
+/**
+ * @brief Tell CompactTraceDatum we started a new trial. 
+ * @details Increments the current traceID
+ */
+void CompactTraceDatum::newTrial(){
+	++_latestTraceId; 
+}
+
+/**
+ * @brief The encoded traces: a header (magic "CDDMTRC1", then the number of cells and of 
+ * timepoints as varints, then timePerStep and precision as doubles), then the blocks. 
+ * @details Includes the open block, without closing it. 
+ */
+vector<uint8_t> CompactTraceDatum::getEncoded() const {
+	vector<uint8_t> out(_traceMagic, _traceMagic + 8); 
+	_putVarint(out, _cells); 
+	_putVarint(out, _nRows); 
+	const uint8_t * timePerStep = reinterpret_cast<const uint8_t *>(&_timePerStep); 
+	const uint8_t * precision = reinterpret_cast<const uint8_t *>(&_precision); 
+	out.insert(out.end(), timePerStep, timePerStep + sizeof(double)); 
+	out.insert(out.end(), precision, precision + sizeof(double)); 
+	out.reserve(out.size() + _bytes.size() + 2 * _block.size() + 16); 
+	out.insert(out.end(), _bytes.begin(), _bytes.end()); 
+	if (_blockRows > 0) _encodeBlock(out, _blockTrial - _lastClosedTrial, _blockFirstStep, _block, _blockRows, _cells); 
+	return out; 
+}
+
+/**
+ * @brief Decode traces encoded by getEncoded(). 
+ * @return a matrix in the layout of TraceDatum::getTraces(): one row per timepoint, with 
+ * the trace ID, the time and the values (to within the precision). 
+ */
+mat CompactTraceDatum::decode(const vector<uint8_t> & encoded){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (encoded.size() < 8 || !std::equal(_traceMagic, _traceMagic + 8, encoded.begin())) throw fatal_error() << "ERROR: not encoded traces (no CDDMTRC1 header)!"; 
+	#endif
+	size_t pos = 8; 
+	unsigned cells = _getVarint(encoded, pos); 
+	size_t nRows = _getVarint(encoded, pos); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (pos + 2 * sizeof(double) > encoded.size()) throw fatal_error() << "ERROR: encoded traces are truncated or corrupt!"; 
+	#endif
+	double timePerStep, precision; 
+	std::memcpy(&timePerStep, &encoded[pos], sizeof(double)); 
+	std::memcpy(&precision, &encoded[pos + sizeof(double)], sizeof(double)); 
+	pos += 2 * sizeof(double); 
+	mat traces(nRows, 2 + cells); 
+	vector<long long> values(cells); 
+	size_t row = 0; 
+	int trial = 0; 
+	while (pos < encoded.size()){
+		trial += int(_unzigzag(_getVarint(encoded, pos))); 
+		long long step = _unzigzag(_getVarint(encoded, pos)); 
+		size_t rows = _getVarint(encoded, pos); 
+		#ifndef DISABLE_ERROR_CHECKS
+		if (row + rows > nRows) throw fatal_error() << "ERROR: encoded traces are truncated or corrupt!"; 
+		#endif
+		for (size_t i=0; i<rows; ++i, ++row){
+			traces(row, 0) = trial; 
+			traces(row, 1) = (step + i) * timePerStep; 
+			for (unsigned j=0; j<cells; ++j){
+				long long delta = _unzigzag(_getVarint(encoded, pos)); 
+				values[j] = i == 0 ? delta : values[j] + delta; 
+				traces(row, 2 + j) = values[j] * precision; 
+			}
+		}
+	}
+	#ifndef DISABLE_ERROR_CHECKS
+	if (row != nRows) throw fatal_error() << "ERROR: encoded traces are truncated or corrupt!"; 
+	#endif
+	return traces; 
+}
+
+/**
+ * @brief Write getEncoded() to a file. 
+ */
+void CompactTraceDatum::writeEncoded(const std::string & filename) const {
+	std::ofstream f(filename, std::ios::binary); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (!f) throw fatal_error() << "ERROR: could not open " << filename << " to write encoded traces to!"; 
+	#endif
+	vector<uint8_t> encoded = getEncoded(); 
+	f.write(reinterpret_cast<const char *>(encoded.data()), encoded.size()); 
+}
+
+/**
+ * @brief Decode a file written by writeEncoded() (see decode()). 
+ */
+mat CompactTraceDatum::readEncoded(const std::string & filename){
+	std::ifstream f(filename, std::ios::binary); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (!f) throw fatal_error() << "ERROR: could not open encoded traces " << filename << "!"; 
+	#endif
+	vector<uint8_t> encoded((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()); 
+	return decode(encoded); 
+}
+
+/**
+ * @brief All the traces, decoded (see decode()). 
+ */
+mat CompactTraceDatum::getTraces() const {
+	return decode(getEncoded()); 
+}
+
+/**
+ * @brief Number of values per decoded row (2 + length of the recorded vectors, 0 if nothing recorded). 
+ */
+unsigned CompactTraceDatum::getWidth() const {
+	return _nRows == 0 ? 0 : 2 + _cells; 
+}
+
+/**
+ * @brief Number of timepoints recorded. 
+ */
+unsigned CompactTraceDatum::getNRows() const {
+	return _nRows; 
+}
+
+/**
+ * @brief The quantization step of the values. 
+ */
+double CompactTraceDatum::getPrecision() const {
+	return _precision; 
+}
+
+/**
+ * @brief Return a string (CSV) representation of the decoded traces, in TraceDatum's format. 
+ */
+std::string CompactTraceDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t CompactTraceDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_bytes) + _bytesOf(_block); 
+}
+
+/**
+ * @brief Stop storing timepoints (the traces stored so far stay). 
+ */
+bool CompactTraceDatum::freeze(){
+	_frozen = true; 
+	return true; 
+}
+
+/**
+ * @brief Write the decoded traces as CSV, in TraceDatum's format (armadillo's csv_ascii). 
+ */
+void CompactTraceDatum::writeCsv(CsvWriter & out) const {
+	mat traces = getTraces(); 
+	out.setFormat(CsvWriter::SCIENTIFIC, 12); 
+	for (unsigned i=0; i<traces.n_rows; ++i){
+		for (unsigned j=0; j<traces.n_cols; ++j){
+			out.field(traces(i, j)); 
+		}
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Write the decoded traces as columns trial, time and value0, value1, ..., indexed by trace, like TraceDatum. 
+ */
+void CompactTraceDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	mat traces = getTraces(); 
+	vector<TrialSegment> segments; 
+	for (unsigned i=0; i<traces.n_rows; ++i){
+		int trialId = int(traces(i, 0)); 
+		if (segments.empty() || segments.back().trialId != trialId){
+			TrialSegment seg = {trialId, i, i}; 
+			segments.push_back(seg); 
+		}
+		++segments.back().end; 
+	}
+	out.beginDatum(key, traces.n_rows); 
+	if (traces.n_rows > 0){
+		out.columnAs<int32_t>("trial", traces.colptr(0)); 
+		out.column("time", traces.colptr(1)); 
+		for (unsigned j=2; j<traces.n_cols; ++j){
+			std::ostringstream name; 
+			name << "value" << j - 2; 
+			out.column(name.str(), traces.colptr(j)); 
+		}
+	}
+	out.index(segments); 
+}
+
+/**
+ * @brief Constructor for ResponseLockedDatum. 
+ * @param window timepoints to keep up to and including the decision (see \ref responseLockedWindow)
+ * @param tail timepoints to keep after the decision (see \ref responseLockedTail)
+ * @param storeTraces store the committed timepoints of every trial, not just their averages
+ */
+ResponseLockedDatum::ResponseLockedDatum(unsigned window, unsigned tail, bool storeTraces): _window(window), _tail(tail), _storeTraces(storeTraces), _width(0), _ringStart(0), _ringSize(0), _trialId(-2), _decided(false), _decisionTime(0), _tailKept(0), _nDecisions(0), _n(window + tail, 0) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (window == 0) throw fatal_error() << "ERROR: ResponseLockedDatum needs a window of at least one timepoint (the decision)!"; 
+	#endif
+}
+
+/**
+ * @brief Empty the ring buffer for a new trial. 
+ */
+void ResponseLockedDatum::_startTrial(int trialId){
+	_trialId = trialId; 
+	_ringStart = 0; 
+	_ringSize = 0; 
+	_decided = false; 
+	_tailKept = 0; 
+}
+
+/**
+ * @brief Buffer a timepoint, commit the buffer if it is the decision, or keep it as part of the tail after one. 
+ */
+void ResponseLockedDatum::record(const Timepoint & val){
+	if (_width == 0){
+		_width = val.value.n_elem; 
+		_ring.assign(size_t(_window) * (1 + _width), 0); 
+		_mean.assign(_n.size() * _width, 0); 
+		_ssq.assign(_n.size() * _width, 0); 
+	}
+	#ifndef DISABLE_ERROR_CHECKS
+	if (val.value.n_elem != _width) throw fatal_error() << "ERROR: recording a vector of " << val.value.n_elem << " values into a ResponseLockedDatum of " << _width << "!"; 
+	#endif
+	if (_currentTrialId() != _trialId) _startTrial(_currentTrialId()); 
+	if (_decided){
+		if (_tailKept < _tail) _commit(val.time, val.value.memptr(), ++_tailKept); 
+		return; 
+	}
+	// overwrite the oldest timepoint once the ring is full
+	unsigned slot; 
+	if (_ringSize < _window){
+		slot = (_ringStart + _ringSize) % _window; 
+		++_ringSize; 
+	} else {
+		slot = _ringStart; 
+		_ringStart = (_ringStart + 1) % _window; 
+	}
+	double * entry = &_ring[size_t(slot) * (1 + _width)]; 
+	entry[0] = val.time; 
+	std::copy(val.value.begin(), val.value.end(), entry + 1); 
+	if (!val.decision) return; 
+	_decided = true; 
+	_decisionTime = val.time; 
+	++_nDecisions; 
+	for (unsigned i=0; i<_ringSize; ++i){
+		const double * e = &_ring[size_t((_ringStart + i) % _window) * (1 + _width)]; 
+		_commit(e[0], e + 1, int(i) - int(_ringSize) + 1); 
+	}
+}
+
+/**
+ * @brief Keep a timepoint of the current trial at an offset from its decision: add it to the averages, and store it with storeTraces. 
+ */
+void ResponseLockedDatum::_commit(double time, const double * values, int offset){
+	if (_storeTraces && !_frozen){
+		_rows.push_back(_trialId); 
+		_rows.push_back(time - _decisionTime); 
+		_rows.insert(_rows.end(), values, values + _width); 
+	}
+	unsigned k = offset + _window - 1; 
+	int n = ++_n[k]; 
+	double * mean = &_mean[size_t(k) * _width]; 
+	double * ssq = &_ssq[size_t(k) * _width]; 
+	for (unsigned j=0; j<_width; ++j) utils::RunningMoments<double>::update(mean[j], ssq[j], n, values[j]); 
+}
+
+/**
+ * @brief Start a new trial. 
+ */
+void ResponseLockedDatum::newTrial(){
+	++_latestTraceId; 
+}
+
+/**
+ * @brief Return the number of timepoints kept up to and including the decision. 
+ */
+unsigned ResponseLockedDatum::getWindow() const {
+	return _window; 
+}
+
+/**
+ * @brief Return the number of timepoints kept after the decision. 
+ */
+unsigned ResponseLockedDatum::getTail() const {
+	return _tail; 
+}
+
+/**
+ * @brief Return the number of cells of the recorded vectors (0 before the first record()). 
+ */
+unsigned ResponseLockedDatum::getWidth() const {
+	return _width; 
+}
+
+/**
+ * @brief Return the number of stored timepoints (0 without storeTraces). 
+ */
+unsigned ResponseLockedDatum::getNRows() const {
+	return _width == 0 ? 0 : _rows.size() / (2 + _width); 
+}
+
+/**
+ * @brief Return the number of trials with a decision. 
+ */
+int ResponseLockedDatum::getNDecisions() const {
+	return _nDecisions; 
+}
+
+/**
+ * @brief The stored timepoints, one per row: trace ID, time relative to the decision, then the values. 
+ */
+mat ResponseLockedDatum::getTraces() const {
+	if (_rows.empty()) return mat(); 
+	return mat(const_cast<double*>(_rows.data()), 2 + _width, getNRows()).t(); 
+}
+
+/**
+ * @brief Return the number of committed timepoints at an offset from the decision (-window+1 to tail). 
+ */
+int ResponseLockedDatum::getN(int offset) const {
+	return _n[offset + _window - 1]; 
+}
+
+/**
+ * @brief Mean of each cell (column) at each offset (row i is offset i - window + 1); NaN where nothing was committed. 
+ */
+mat ResponseLockedDatum::getMeans() const {
+	mat means(_n.size(), _width); 
+	for (unsigned k=0; k<_n.size(); ++k){
+		for (unsigned j=0; j<_width; ++j){
+			means(k, j) = _n[k] > 0 ? _mean[size_t(k) * _width + j] : arma::datum::nan; 
+		}
+	}
+	return means; 
+}
+
+/**
+ * @brief Variance of each cell (column) at each offset (rows as in getMeans()); NaN where fewer than two timepoints were committed. 
+ */
+mat ResponseLockedDatum::getVariances() const {
+	mat vars(_n.size(), _width); 
+	for (unsigned k=0; k<_n.size(); ++k){
+		for (unsigned j=0; j<_width; ++j){
+			vars(k, j) = _n[k] > 1 ? _ssq[size_t(k) * _width + j] / (_n[k] - 1) : arma::datum::nan; 
+		}
+	}
+	return vars; 
+}
+
+/**
+ * @brief Add another ResponseLockedDatum's committed timepoints to this one (exactly, up to rounding). 
+ * @details Means and variances are combined offset by offset, and stored timepoints are 
+ * appended (with their trial IDs, as they are). The window, tail and storeTraces have to 
+ * match. A trial still open in either datum is not merged. 
+ */
+void ResponseLockedDatum::merge(const ResponseLockedDatum & other){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (other._window != _window || other._tail != _tail || other._storeTraces != _storeTraces) throw fatal_error() << "ERROR: merging a ResponseLockedDatum with a window of " << other._window << " and tail of " << other._tail << " into one with " << _window << " and " << _tail << " (or storing traces differently)!"; 
+	if (_width != 0 && other._width != 0 && other._width != _width) throw fatal_error() << "ERROR: merging a ResponseLockedDatum of " << other._width << " values into one of " << _width << "!"; 
+	#endif
+	if (other._width == 0) return; 
+	if (_width == 0){
+		_width = other._width; 
+		_ring.assign(size_t(_window) * (1 + _width), 0); 
+		_mean.assign(_n.size() * _width, 0); 
+		_ssq.assign(_n.size() * _width, 0); 
+	}
+	for (unsigned k=0; k<_n.size(); ++k){
+		for (size_t i = size_t(k) * _width; i < size_t(k + 1) * _width; ++i){
+			utils::RunningMoments<double>::combine(_mean[i], _ssq[i], _n[k], other._mean[i], other._ssq[i], other._n[k]); 
+		}
+		_n[k] += other._n[k]; 
+	}
+	_rows.insert(_rows.end(), other._rows.begin(), other._rows.end()); 
+	_nDecisions += other._nDecisions; 
+}
+
+/**
+ * @brief Return the CSV of the datum (see writeCsv()). 
+ */
+std::string ResponseLockedDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t ResponseLockedDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_ring) + _bytesOf(_rows) + _bytesOf(_n) + _bytesOf(_mean) + _bytesOf(_ssq); 
+}
+
+/**
+ * @brief Stop storing windows (the ones stored so far stay), while the response-locked averages keep updating (false without storeTraces). 
+ */
+bool ResponseLockedDatum::freeze(){
+	if (!_storeTraces) return false; 
+	_frozen = true; 
+	return true; 
+}
+
+/**
+ * @brief Write the stored timepoints in TraceDatum's format with storeTraces, else a header and offset,n,mean0,...,variance0,... per committed offset. 
+ */
+void ResponseLockedDatum::writeCsv(CsvWriter & out) const {
+	if (_storeTraces){
+		out.setFormat(CsvWriter::SCIENTIFIC, 12); 
+		for (size_t i=0; i<_rows.size(); i+=2+_width){
+			for (unsigned j=0; j<2+_width; ++j) out.field(_rows[i+j]); 
+			out.endRow(); 
+		}
+		return; 
+	}
+	out.setFormat(CsvWriter::GENERAL, 12); 
+	std::ostringstream header; 
+	header << "offset,n"; 
+	for (unsigned j=0; j<_width; ++j) header << ",mean" << j; 
+	for (unsigned j=0; j<_width; ++j) header << ",variance" << j; 
+	header << "\n"; 
+	out.raw(header.str()); 
+	for (unsigned k=0; k<_n.size(); ++k){
+		if (_n[k] == 0) continue; 
+		out.field(int(k) - int(_window) + 1); 
+		out.field(_n[k]); 
+		for (unsigned j=0; j<_width; ++j) out.field(_mean[size_t(k) * _width + j]); 
+		for (unsigned j=0; j<_width; ++j){
+			if (_n[k] > 1) out.field(_ssq[size_t(k) * _width + j] / (_n[k] - 1)); 
+			else out.field("NA"); 
+		}
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Write the stored timepoints as columns trial, time and value0, value1, ... with storeTraces, else columns offset, n, mean0, ..., variance0, ... 
+ */
+void ResponseLockedDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	if (_storeTraces){
+		unsigned n = getNRows(); 
+		out.beginDatum(key, n); 
+		if (n == 0) return; 
+		out.columnAs<int32_t>("trial", _rows.data(), 2 + _width); 
+		out.column("time", _rows.data() + 1, 2 + _width); 
+		for (unsigned j=0; j<_width; ++j){
+			std::ostringstream name; 
+			name << "value" << j; 
+			out.column(name.str(), _rows.data() + 2 + j, 2 + _width); 
+		}
+		return; 
+	}
+	mat means = getMeans(), vars = getVariances(); 
+	vector<int> offsets(_n.size()); 
+	for (unsigned k=0; k<_n.size(); ++k) offsets[k] = int(k) - int(_window) + 1; 
+	out.beginDatum(key, _n.size()); 
+	out.column("offset", offsets.data()); 
+	out.column("n", _n.data()); 
+	for (unsigned j=0; j<_width; ++j){
+		std::ostringstream meanName, varName; 
+		meanName << "mean" << j; 
+		varName << "variance" << j; 
+		out.column(meanName.str(), means.colptr(j)); 
+		out.column(varName.str(), vars.colptr(j)); 
+	}
+}
+
+/**
+ * @brief Constructor for TrajectoryDatum. 
+ * @param timePerStep width of a step (\ref timePerStep)
+ * @param nSteps number of steps to keep (see \ref trajectorySteps); later timepoints only count in getOverflow()
+ * @param quantileBins histogram bins over [0, 1] per step and cell for quantiles (see \ref trajectoryQuantileBins), 0 for none
+ * @param quantileLevels quantiles written to the CSV and columns (if quantileBins > 0)
+ */
+TrajectoryDatum::TrajectoryDatum(double timePerStep, unsigned nSteps, unsigned quantileBins, const vector<double> & quantileLevels): _timePerStep(timePerStep), _nSteps(nSteps), _quantileBins(quantileBins), _quantileLevels(quantileLevels), _width(0), _n(nSteps, 0), _overflow(0) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (timePerStep <= 0) throw fatal_error() << "ERROR: TrajectoryDatum step width should be positive, got " << timePerStep; 
+	if (nSteps == 0) throw fatal_error() << "ERROR: TrajectoryDatum needs at least one step!"; 
+	#endif
+}
+
+/**
+ * @brief Allocate the per-step, per-cell storage once the width of the vectors is known. 
+ */
+void TrajectoryDatum::_allocate(unsigned width){
+	_width = width; 
+	_mean.assign(size_t(_nSteps) * _width, 0); 
+	_ssq.assign(size_t(_nSteps) * _width, 0); 
+	_bins.assign(size_t(_nSteps) * _width * _quantileBins, 0); 
+}
+
+/**
+ * @brief Add a timepoint to the summary of its step. 
+ */
+void TrajectoryDatum::record(const Timepoint & val){
+	if (_width == 0) _allocate(val.value.n_elem); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (val.value.n_elem != _width) throw fatal_error() << "ERROR: recording a vector of " << val.value.n_elem << " values into a TrajectoryDatum of " << _width << "!"; 
+	#endif
+	double step = std::floor(val.time / _timePerStep + 0.5); 
+	if (step >= _nSteps){
+		++_overflow; 
+		return; 
+	}
+	unsigned s = step > 0 ? unsigned(step) : 0; 
+	int n = ++_n[s]; 
+	double * mean = &_mean[size_t(s) * _width]; 
+	double * ssq = &_ssq[size_t(s) * _width]; 
+	for (unsigned j=0; j<_width; ++j) utils::RunningMoments<double>::update(mean[j], ssq[j], n, val.value[j]); 
+	if (_quantileBins == 0) return; 
+	int * bins = &_bins[size_t(s) * _width * _quantileBins]; 
+	for (unsigned j=0; j<_width; ++j){
+		double b = std::floor(val.value[j] * _quantileBins); 
+		unsigned k = b <= 0 ? 0 : (b >= _quantileBins ? _quantileBins - 1 : unsigned(b)); 
+		++bins[j * _quantileBins + k]; 
+	}
+}
+
+/**
+ * @brief Return the width of a step. 
+ */
+double TrajectoryDatum::getTimePerStep() const {
+	return _timePerStep; 
+}
+
+/**
+ * @brief Return the number of steps kept. 
+ */
+unsigned TrajectoryDatum::getNSteps() const {
+	return _nSteps; 
+}
+
+/**
+ * @brief Return the number of cells of the recorded vectors (0 before the first record()). 
+ */
+unsigned TrajectoryDatum::getWidth() const {
+	return _width; 
+}
+
+/**
+ * @brief Return the number of timepoints recorded at a step. 
+ */
+int TrajectoryDatum::getN(unsigned step) const {
+	return _n[step]; 
+}
+
+/**
+ * @brief Return the number of timepoints past the last step. 
+ */
+int TrajectoryDatum::getOverflow() const {
+	return _overflow; 
+}
+
+/**
+ * @brief Mean of each cell (column) at each step (row); NaN at steps nothing was recorded at. 
+ */
+mat TrajectoryDatum::getMeans() const {
+	mat means(_nSteps, _width); 
+	for (unsigned s=0; s<_nSteps; ++s){
+		for (unsigned j=0; j<_width; ++j){
+			means(s, j) = _n[s] > 0 ? _mean[size_t(s) * _width + j] : arma::datum::nan; 
+		}
+	}
+	return means; 
+}
+
+/**
+ * @brief Variance of each cell (column) at each step (row); NaN at steps with fewer than two timepoints. 
+ */
+mat TrajectoryDatum::getVariances() const {
+	mat vars(_nSteps, _width); 
+	for (unsigned s=0; s<_nSteps; ++s){
+		for (unsigned j=0; j<_width; ++j){
+			vars(s, j) = _n[s] > 1 ? _ssq[size_t(s) * _width + j] / (_n[s] - 1) : arma::datum::nan; 
+		}
+	}
+	return vars; 
+}
+
+/**
+ * @brief Quantile q of a cell at a step, interpolated within its histogram bin (NaN without bins or timepoints). 
+ */
+double TrajectoryDatum::getQuantile(unsigned step, unsigned cell, double q) const {
+	if (_quantileBins == 0 || _n[step] == 0) return arma::datum::nan; 
+	const int * bins = &_bins[(size_t(step) * _width + cell) * _quantileBins]; 
+	double target = q * _n[step]; 
+	double cumulative = 0; 
+	for (unsigned k=0; k<_quantileBins; ++k){
+		if (bins[k] > 0 && cumulative + bins[k] >= target){
+			return (k + (target - cumulative) / bins[k]) / _quantileBins; 
+		}
+		cumulative += bins[k]; 
+	}
+	return 1; 
+}
+
+/**
+ * @brief Return the quantile levels written to the CSV and columns. 
+ */
+const vector<double> & TrajectoryDatum::getQuantileLevels() const {
+	return _quantileLevels; 
+}
+
+/**
+ * @brief Add another TrajectoryDatum's timepoints to this one (exactly, up to rounding). 
+ * @details Means and variances are combined step by step, and histograms are added. The 
+ * steps and bins have to match. 
+ */
+void TrajectoryDatum::merge(const TrajectoryDatum & other){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (other._timePerStep != _timePerStep || other._nSteps != _nSteps || other._quantileBins != _quantileBins) throw fatal_error() << "ERROR: merging a TrajectoryDatum of " << other._nSteps << " steps of " << other._timePerStep << " (" << other._quantileBins << " bins) into one of " << _nSteps << " steps of " << _timePerStep << " (" << _quantileBins << " bins)!"; 
+	if (_width != 0 && other._width != 0 && other._width != _width) throw fatal_error() << "ERROR: merging a TrajectoryDatum of " << other._width << " values into one of " << _width << "!"; 
+	#endif
+	_overflow += other._overflow; 
+	if (other._width == 0) return; 
+	if (_width == 0) _allocate(other._width); 
+	for (unsigned s=0; s<_nSteps; ++s){
+		for (size_t i = size_t(s) * _width; i < size_t(s + 1) * _width; ++i){
+			utils::RunningMoments<double>::combine(_mean[i], _ssq[i], _n[s], other._mean[i], other._ssq[i], other._n[s]); 
+		}
+		_n[s] += other._n[s]; 
+	}
+	for (size_t i=0; i<_bins.size(); ++i) _bins[i] += other._bins[i]; 
+}
+
+/**
+ * @brief Return the CSV of the trajectory summary (see writeCsv()). 
+ */
+std::string TrajectoryDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t TrajectoryDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_n) + _bytesOf(_mean) + _bytesOf(_ssq) + _bytesOf(_bins); 
+}
+
+/**
+ * @brief Write a header and one row per recorded step and cell: time,cell,n,mean,variance, then the quantiles if there are bins. 
+ */
+void TrajectoryDatum::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::GENERAL, 12); 
+	out.raw("time,cell,n,mean,variance"); 
+	if (_quantileBins > 0){
+		for (double q : _quantileLevels){
+			std::ostringstream name; 
+			name << ",q" << q; 
+			out.raw(name.str()); 
+		}
+	}
+	out.raw("\n"); 
+	for (unsigned s=0; s<_nSteps; ++s){
+		if (_n[s] == 0) continue; 
+		for (unsigned j=0; j<_width; ++j){
+			size_t i = size_t(s) * _width + j; 
+			out.field(s * _timePerStep); 
+			out.field(j); 
+			out.field(_n[s]); 
+			out.field(_mean[i]); 
+			if (_n[s] > 1) out.field(_ssq[i] / (_n[s] - 1)); 
+			else out.field("NA"); 
+			if (_quantileBins > 0){
+				for (double q : _quantileLevels) out.field(getQuantile(s, j, q)); 
+			}
+			out.endRow(); 
+		}
+	}
+}
+
+/**
+ * @brief Write the rows of the CSV as columns time, cell, n, mean, variance (NaN for single timepoints) and q<level>. 
+ */
+void TrajectoryDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	vector<double> times, means, vars; 
+	vector<int> cells, ns; 
+	vector<vector<double> > quantiles(_quantileBins > 0 ? _quantileLevels.size() : 0); 
+	for (unsigned s=0; s<_nSteps; ++s){
+		if (_n[s] == 0) continue; 
+		for (unsigned j=0; j<_width; ++j){
+			size_t i = size_t(s) * _width + j; 
+			times.push_back(s * _timePerStep); 
+			cells.push_back(j); 
+			ns.push_back(_n[s]); 
+			means.push_back(_mean[i]); 
+			vars.push_back(_n[s] > 1 ? _ssq[i] / (_n[s] - 1) : arma::datum::nan); 
+			for (unsigned l=0; l<quantiles.size(); ++l) quantiles[l].push_back(getQuantile(s, j, _quantileLevels[l])); 
+		}
+	}
+	out.beginDatum(key, times.size()); 
+	if (times.empty()) return; 
+	out.column("time", times.data()); 
+	out.column("cell", cells.data()); 
+	out.column("n", ns.data()); 
+	out.column("mean", means.data()); 
+	out.column("variance", vars.data()); 
+	for (unsigned l=0; l<quantiles.size(); ++l){
+		std::ostringstream name; 
+		name << "q" << _quantileLevels[l]; 
+		out.column(name.str(), quantiles[l].data()); 
+	}
+}
+
+/**
+ * @brief A datum that estimates a gaussian mixture model from its incoming data stream. 
+ * @details This provides a compact nonparametric distribution of anything we might want 
+ * to record (e.g. RTs). 
+ * 
+ * @param ngauss number of gaussians. 
+ * @param expectedNObs number of observations we expect (a good guess helps save us some memory allocations).
+ */
+GMMDatum::GMMDatum(int ngauss, int expectedNObs): _ngauss(ngauss), _estimateIsFresh(false){
+	_rawData = rowvec(expectedNObs); 
+	_model = arma::gmm_diag();
+}
+
+
+/**
+ * @brief Return the mean of the current observation set. 
+ * @return Mean of the observations (kept incrementally, so no rescan of the raw data)
+ */
+double GMMDatum::getMean() const {
+	return _moments.getMean(); 
+}
+
+/**
+ * @brief Return the variance of the current observation set. 
+ * @return Variance of the observations (kept incrementally with Welford's method)
+ */
+double GMMDatum::getVariance() const {
+	return _moments.getVariance(); 
+}
+
+/**
+ * @brief Record a new value. 
+ * @details Also updates the mean and variance, marks our latest GMM estimate 
+ * as not fresh, and resizes the observation vector if needed. 
+ */
+void GMMDatum::record(const double & val){
+	if (_frozen) return; 
+	int n = _moments.getN(); 
+	// if we run out of space, double the space
+	if (_rawData.n_elem == arma::uword(n)) _rawData.resize(n*2); 
+	_rawData[n] = val; 
+	_moments.record(val); 
+	_estimateIsFresh = false; 
+}
+
+/**
+ * @brief returns CSV string representation of the GMM
+ * @details Returns a CSV with a header and one row per gaussian, 
+ * with columns mean, variance, weight.
+ */
+std::string GMMDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t GMMDatum::bytesUsed() const {
+	return sizeof(*this) + size_t(_rawData.n_elem) * sizeof(double) + 3 * size_t(_ngauss) * sizeof(double); 
+}
+
+/**
+ * @brief Stop recording: the mixture is fit to the observations recorded so far. 
+ */
+bool GMMDatum::freeze(){
+	_frozen = true; 
+	return true; 
+}
+
+/**
+ * @brief Write the CSV of getStringRepr() through out. 
+ */
+void GMMDatum::writeCsv(CsvWriter & out) const {
+	_estimateModel();
+	out.setFormat(CsvWriter::GENERAL, 6); 
+	out.raw("mean,variance,weight\n"); 
+	for (int i = 0; i<_ngauss; i++){
+		out.field(_model.means[i]); 
+		out.field(_model.dcovs[i]); 
+		out.field(_model.hefts[i]); 
+		out.endRow(); 
+	}	
+}
+
+/**
+ * @brief Write the mixture as columns mean, variance and weight, one row per gaussian. 
+ */
+void GMMDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	_estimateModel(); 
+	out.beginDatum(key, _ngauss); 
+	out.column("mean", _model.means.memptr()); 
+	out.column("variance", _model.dcovs.memptr()); 
+	out.column("weight", _model.hefts.memptr()); 
+}
+
+/**
+ * @brief Return the number of observations in this datum. 
+ */
+int GMMDatum::getN() const {
+	return _moments.getN(); 
+}
+
+/**
+ * @brief Estimate a gaussian mixture model for the observations seen so far. 
+ * @details Uses armadillo's gmm_diag. The first fit starts from a random subset of the 
+ * observations; later fits are warm-started from the previous estimate (no k-means 
+ * pass), which converges in a few EM iterations when a few observations came in. 
+ */
+void GMMDatum::_estimateModel() const {
+	if(_estimateIsFresh) return; 
+	if (_model.n_gaus() == arma::uword(_ngauss)){
+		_model.learn(_rawData(arma::span(0,_moments.getN()-1)), _ngauss, arma::maha_dist, arma::keep_existing, 0, 15, 1e-10, false); 
+	} else {
+		_model.learn(_rawData(arma::span(0,_moments.getN()-1)), _ngauss, arma::maha_dist, arma::random_subset, 15, 15, 1e-10, false); 
+	}
+	_estimateIsFresh = true; 
+}
+
+/**
+ * @brief Returns the means of the gaussians estimated.
+ */
+rowvec GMMDatum::getGaussMeans() const {
+	_estimateModel();
+	return _model.means; 
+}
+
+/**
+ * @brief Returns the variances of the gaussians estimated.
+ */
+rowvec GMMDatum::getGaussVars() const {
+	_estimateModel();
+	return _model.dcovs;
+}
+
+/**
+ * @brief Returns the weights of the gaussians estimated.
+ */
+rowvec GMMDatum::getGaussWeights() const {
+	_estimateModel();
+	return _model.hefts; 
+}
+
+/**
+ * @brief Returns the observations seen so far. 
+ */
+rowvec GMMDatum::getRawData() const {
+	return _rawData(arma::span(0,_moments.getN()-1)); 
+}
+
+/**
+ * @brief View of the observations seen so far, without copying them. 
+ */
+ArrayView<double> GMMDatum::viewRawData() const {
+	return ArrayView<double>(_rawData.memptr(), _moments.getN()); 
+}
+
+/**
+ * @brief Add another GMMDatum's observations to this one. 
+ * @details Mean and variance are combined exactly and the observations appended, so the next 
+ * estimate is the fit to all of them (warm-started from this datum's mixture). 
+ */
+void GMMDatum::merge(const GMMDatum & other){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (other._ngauss != _ngauss) throw fatal_error() << "ERROR: merging a GMMDatum of " << other._ngauss << " gaussians into one of " << _ngauss << "!"; 
+	#endif
+	int n = _moments.getN(), otherN = other._moments.getN(); 
+	if (otherN == 0) return; 
+	if (_rawData.n_elem < arma::uword(n + otherN)) _rawData.resize(std::max(2 * n, n + otherN)); 
+	std::copy(other._rawData.memptr(), other._rawData.memptr() + otherN, _rawData.memptr() + n); 
+	_moments.merge(other._moments); 
+	_estimateIsFresh = false; 
+}
+
+/**
+ * @brief Constructor for OnlineGMMDatum. 
+ * @param ngauss number of gaussians. 
+ * @param warmup number of observations to buffer and fit in batch before updating online. 
+ * @param keepRawData keep every observation (for getRawData() and refit())? 
+ * @param stepExponent step sizes decay as (n+1)^-stepExponent, in (0.5, 1]. 
+ */
+OnlineGMMDatum::OnlineGMMDatum(int ngauss, int warmup, bool keepRawData, double stepExponent): _ngauss(ngauss), _warmup(warmup), _keepRawData(keepRawData), _stepExponent(stepExponent), _online(false), _fitN(0){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (ngauss < 1) throw fatal_error() << "ERROR: OnlineGMMDatum needs at least one gaussian!"; 
+	if (warmup < ngauss) throw fatal_error() << "ERROR: OnlineGMMDatum warmup (" << warmup << ") must be at least the number of gaussians (" << ngauss << ")!"; 
+	if (stepExponent <= 0.5 || stepExponent > 1) throw fatal_error() << "ERROR: OnlineGMMDatum stepExponent must be in (0.5, 1], got " << stepExponent; 
+	#endif
+	_rawData.reserve(warmup); 
+}
+
+/**
+ * @brief Return the mean of the observations (exact). 
+ */
+double OnlineGMMDatum::getMean() const {
+	return _moments.getMean(); 
+}
+
+/**
+ * @brief Return the variance of the observations (exact). 
+ */
+double OnlineGMMDatum::getVariance() const {
+	return _moments.getVariance(); 
+}
+
+/**
+ * @brief Record a new value. 
+ * @details During warmup the value is buffered (and the buffer fit once it is full). After 
+ * that it takes one stochastic EM step: compute the responsibility of each gaussian for the 
+ * value, move the sufficient statistics towards it by the current step size, and read the 
+ * parameters off the statistics. 
+ */
+void OnlineGMMDatum::record(const double & val){
+	_moments.record(val); 
+	if (!_online || (_keepRawData && !_frozen)) _rawData.push_back(val); 
+	if (!_online){
+		if (_moments.getN() < _warmup) return; 
+		_fitWarmup(); 
+		_online = true; 
+		if (!_keepRawData) vector<double>().swap(_rawData); // free the buffer
+		return; 
+	}
+	// responsibilities, in the log domain so far-off values don't underflow every gaussian
+	rowvec logp(_ngauss); 
+	for (int k=0; k<_ngauss; k++){
+		double d = val - _means[k]; 
+		logp[k] = log(_weights[k]) - 0.5 * log(2 * M_PI * _vars[k]) - 0.5 * d * d / _vars[k]; 
+	}
+	rowvec r = exp(logp - logp.max()); 
+	r /= arma::accu(r); 
+	double step = pow(_moments.getN() + 1, -_stepExponent); 
+	_s0 = (1 - step) * _s0 + step * r; 
+	_s1 = (1 - step) * _s1 + step * val * r; 
+	_s2 = (1 - step) * _s2 + step * val * val * r; 
+	_paramsFromStats(); 
+}
+
+/**
+ * @brief Fit the buffered observations with gmm_diag and set the statistics from the fit. 
+ * @details Also called by the getters before warmup is over, in which case the fit is 
+ * redone only if observations came in since the last one. 
+ */
+void OnlineGMMDatum::_fitWarmup() const {
+	if (_fitN == _moments.getN()) return; 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (_moments.getN() < _ngauss) throw fatal_error() << "ERROR: OnlineGMMDatum can't fit " << _ngauss << " gaussians to " << _moments.getN() << " observations!"; 
+	#endif
+	arma::gmm_diag model; 
+	model.learn(rowvec(_rawData), _ngauss, arma::maha_dist, arma::random_subset, 15, 15, 1e-10, false); 
+	_means = model.means; 
+	_vars = model.dcovs; 
+	_weights = model.hefts; 
+	_s0 = _weights; 
+	_s1 = _weights % _means; 
+	_s2 = _weights % (_vars + square(_means)); 
+	_fitN = _moments.getN(); 
+}
+
+/**
+ * @brief Set the mixture parameters from the sufficient statistics. 
+ * @details Variances are floored at 1e-10 (as gmm_diag does). 
+ */
+void OnlineGMMDatum::_paramsFromStats() const {
+	_weights = _s0 / arma::accu(_s0); 
+	_means = _s1 / _s0; 
+	_vars = _s2 / _s0 - square(_means); 
+	_vars.transform([](double v){ return v < 1e-10 ? 1e-10 : v; }); 
+}
+
+/**
+ * @brief Run a few iterations of batch EM over the kept observations, starting from the current estimate. 
+ * @details Needs keepRawData. The online estimate continues from the refit mixture. 
+ * @param iterations number of EM iterations. 
+ */
+void OnlineGMMDatum::refit(int iterations){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (!_keepRawData) throw fatal_error() << "ERROR: OnlineGMMDatum::refit() needs the raw data, construct it with keepRawData!"; 
+	#endif
+	if (!_online) _fitWarmup(); 
+	arma::gmm_diag model; 
+	model.set_params(_means, _vars, _weights); 
+	model.learn(rowvec(_rawData), _ngauss, arma::maha_dist, arma::keep_existing, 0, iterations, 1e-10, false); 
+	_means = model.means; 
+	_vars = model.dcovs; 
+	_weights = model.hefts; 
+	_s0 = _weights; 
+	_s1 = _weights % _means; 
+	_s2 = _weights % (_vars + square(_means)); 
+}
+
+/**
+ * @brief Add another OnlineGMMDatum's observations to this one. 
+ * @details Mean and variance are combined exactly. Buffered 
+ * observations (a datum still in warmup) are recorded into the other datum's mixture, and 
+ * two online mixtures are combined by averaging their sufficient statistics weighted by 
+ * their numbers of observations, pairing the gaussians in the order of their means. The 
+ * mixture is then an approximation of the one a single run would have learned; with 
+ * keepRawData (on both datums) the observations are appended too, and refit() sharpens it. 
+ */
+void OnlineGMMDatum::merge(const OnlineGMMDatum & other){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (other._ngauss != _ngauss) throw fatal_error() << "ERROR: merging an OnlineGMMDatum of " << other._ngauss << " gaussians into one of " << _ngauss << "!"; 
+	if (_keepRawData && other._online && !other._keepRawData) throw fatal_error() << "ERROR: merging an OnlineGMMDatum without its raw data into one with keepRawData!"; 
+	#endif
+	if (other._moments.getN() == 0) return; 
+	utils::RunningMoments<double> merged = _moments; 
+	merged.merge(other._moments); 
+	vector<double> buffered; 
+	if (!other._online){
+		buffered = other._rawData; 
+	} else if (!_online){
+		// continue from the other datum's mixture, and record our buffer into it
+		buffered.swap(_rawData); 
+		_rawData = _keepRawData ? other._rawData : vector<double>(); 
+		_online = true; 
+		_s0 = other._s0; 
+		_s1 = other._s1; 
+		_s2 = other._s2; 
+		_moments = other._moments; // step sizes go on from the other datum's
+		_paramsFromStats(); 
+	} else {
+		arma::uvec mine = arma::sort_index(_means), theirs = arma::sort_index(other._means); 
+		double w = double(other._moments.getN()) / merged.getN(); 
+		for (int k=0; k<_ngauss; k++){
+			_s0[mine[k]] = (1 - w) * _s0[mine[k]] + w * other._s0[theirs[k]]; 
+			_s1[mine[k]] = (1 - w) * _s1[mine[k]] + w * other._s1[theirs[k]]; 
+			_s2[mine[k]] = (1 - w) * _s2[mine[k]] + w * other._s2[theirs[k]]; 
+		}
+		_paramsFromStats(); 
+		if (_keepRawData) _rawData.insert(_rawData.end(), other._rawData.begin(), other._rawData.end()); 
+	}
+	for (double val : buffered) record(val); 
+	_moments = merged; 
+}
+
+/**
+ * @brief returns CSV string representation of the GMM (the same as GMMDatum's). 
+ */
+std::string OnlineGMMDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t OnlineGMMDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_rawData) + 6 * size_t(_ngauss) * sizeof(double); 
+}
+
+/**
+ * @brief Stop keeping raw data (the ones kept so far stay, for refit()), while the online mixture keeps updating (false without keepRawData or in warmup). 
+ */
+bool OnlineGMMDatum::freeze(){
+	if (!_keepRawData || !_online) return false; 
+	_frozen = true; 
+	return true; 
+}
+
+/**
+ * @brief Write the CSV of getStringRepr() through out: columns mean, variance, weight, one row per gaussian. 
+ */
+void OnlineGMMDatum::writeCsv(CsvWriter & out) const {
+	if (!_online) _fitWarmup(); 
+	out.setFormat(CsvWriter::GENERAL, 6); 
+	out.raw("mean,variance,weight\n"); 
+	for (int i = 0; i<_ngauss; i++){
+		out.field(_means[i]); 
+		out.field(_vars[i]); 
+		out.field(_weights[i]); 
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Write the mixture as columns mean, variance and weight, one row per gaussian. 
+ */
+void OnlineGMMDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	if (!_online) _fitWarmup(); 
+	out.beginDatum(key, _ngauss); 
+	out.column("mean", _means.memptr()); 
+	out.column("variance", _vars.memptr()); 
+	out.column("weight", _weights.memptr()); 
+}
+
+/**
+ * @brief Return the number of observations in this datum. 
+ */
+int OnlineGMMDatum::getN() const {
+	return _moments.getN(); 
+}
+
+/**
+ * @brief Returns the means of the gaussians estimated.
+ */
+rowvec OnlineGMMDatum::getGaussMeans() const {
+	if (!_online) _fitWarmup(); 
+	return _means; 
+}
+
+/**
+ * @brief Returns the variances of the gaussians estimated.
+ */
+rowvec OnlineGMMDatum::getGaussVars() const {
+	if (!_online) _fitWarmup(); 
+	return _vars; 
+}
+
+/**
+ * @brief Returns the weights of the gaussians estimated.
+ */
+rowvec OnlineGMMDatum::getGaussWeights() const {
+	if (!_online) _fitWarmup(); 
+	return _weights; 
+}
+
+/**
+ * @brief Returns the kept observations (all of them with keepRawData, otherwise the warmup buffer, which is empty once warmup is over). 
+ */
+rowvec OnlineGMMDatum::getRawData() const {
+	return rowvec(_rawData); 
+}
+
+/**
+ * @brief Constructor for QuantileSketchDatum. 
+ * @param compression the sketch keeps at most about this many centroids (see \ref quantileCompression); 
+ * quantile errors shrink and memory grows with it. 
+ */
+QuantileSketchDatum::QuantileSketchDatum(double compression): _compression(compression), _bufferSize(size_t(5 * compression)), 
+	_min(std::numeric_limits<double>::quiet_NaN()), _max(std::numeric_limits<double>::quiet_NaN()) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (compression < 10) throw fatal_error() << "ERROR: QuantileSketchDatum compression should be at least 10, got " << compression; 
+	#endif
+	_unmerged.reserve(_bufferSize); 
+}
+
+/**
+ * @brief Add an observation (folding the buffer into the centroids when it is full). 
+ */
+void QuantileSketchDatum::record(const double & val){
+	_moments.record(val); 
+	if (_moments.getN() == 1 || val < _min) _min = val; 
+	if (_moments.getN() == 1 || val > _max) _max = val; 
+	Centroid c = {val, 1}; 
+	_unmerged.push_back(c); 
+	if (_unmerged.size() >= _bufferSize) _compress(); 
+}
+
+/**
+ * @brief Return the mean of the observations (exact). 
+ */
+double QuantileSketchDatum::getMean() const {
+	return _moments.getMean(); 
+}
+
+/**
+ * @brief Return the variance of the observations (exact). 
+ */
+double QuantileSketchDatum::getVariance() const {
+	return _moments.getVariance(); 
+}
+
+/**
+ * @brief Return the number of observations. 
+ */
+int QuantileSketchDatum::getN() const {
+	return _moments.getN(); 
+}
+
+/**
+ * @brief Return the smallest observation (NaN if there are none). 
+ */
+double QuantileSketchDatum::getMin() const {
+	return _min; 
+}
+
+/**
+ * @brief Return the largest observation (NaN if there are none). 
+ */
+double QuantileSketchDatum::getMax() const {
+	return _max; 
+}
+
+/**
+ * @brief Estimate the q-th quantile of the observations. 
+ * @details Centroid i stands for the observations of rank (weight before it) to (weight up 
+ * to and including it), and its mean is placed at the middle of that range. The quantile 
+ * is interpolated linearly between those points, with the minimum at rank 0 and the 
+ * maximum at rank n. 
+ * @param q quantile level in [0, 1]
+ * @return the estimate, or NaN if there are no observations. 
+ */
+double QuantileSketchDatum::getQuantile(double q) const {
+	if (_moments.getN() == 0) return std::numeric_limits<double>::quiet_NaN(); 
+	if (q <= 0) return _min; 
+	if (q >= 1) return _max; 
+	_compress(); 
+	double rank = q * _moments.getN(); 
+	double prevRank = 0, prevValue = _min, weightBefore = 0; 
+	for (const Centroid & c : _centroids){
+		double center = weightBefore + c.weight / 2; 
+		if (rank < center) return prevValue + (c.mean - prevValue) * (rank - prevRank) / (center - prevRank); 
+		prevRank = center; 
+		prevValue = c.mean; 
+		weightBefore += c.weight; 
+	}
+	return prevValue + (_max - prevValue) * (rank - prevRank) / (_moments.getN() - prevRank); 
+}
+
+/**
+ * @brief Estimate several quantiles at once (see getQuantile()). 
+ */
+vector<double> QuantileSketchDatum::getQuantiles(const vector<double> & qs) const {
+	vector<double> out; 
+	out.reserve(qs.size()); 
+	for (double q : qs) out.push_back(getQuantile(q)); 
+	return out; 
+}
+
+/**
+ * @brief Number of centroids in the digest (after folding in the buffer). 
+ */
+unsigned QuantileSketchDatum::getNCentroids() const {
+	_compress(); 
+	return _centroids.size(); 
+}
+
+/**
+ * @brief Add another sketch's observations to this one. 
+ * @details Mean and variance are combined exactly, and the other sketch's centroids are 
+ * folded into this one's at this sketch's compression. 
+ */
+void QuantileSketchDatum::merge(const QuantileSketchDatum & other){
+	if (other._moments.getN() == 0) return; 
+	if (_moments.getN() == 0){
+		_min = other._min; 
+		_max = other._max; 
+	} else {
+		_min = std::min(_min, other._min); 
+		_max = std::max(_max, other._max); 
+	}
+	_moments.merge(other._moments); 
+	_unmerged.insert(_unmerged.end(), other._centroids.begin(), other._centroids.end()); 
+	_unmerged.insert(_unmerged.end(), other._unmerged.begin(), other._unmerged.end()); 
+	_compress(); 
+}
+
+/**
+ * @brief Fold the buffered observations into the centroids. 
+ * @details Sorts the old centroids and the buffer together and merges neighbours greedily, 
+ * as long as a centroid stays within the weight _maxQuantile() allows at its position. 
+ */
+void QuantileSketchDatum::_compress() const {
+	if (_unmerged.empty()) return; 
+	_unmerged.insert(_unmerged.end(), _centroids.begin(), _centroids.end()); 
+	std::sort(_unmerged.begin(), _unmerged.end(), [](const Centroid & a, const Centroid & b){ return a.mean < b.mean; }); 
+	double total = 0; 
+	for (const Centroid & c : _unmerged) total += c.weight; 
+	_centroids.clear(); 
+	Centroid current = _unmerged[0]; 
+	double weightBefore = 0; 
+	double limit = total * _maxQuantile(0); 
+	for (unsigned i=1; i<_unmerged.size(); ++i){
+		const Centroid & next = _unmerged[i]; 
+		if (weightBefore + current.weight + next.weight <= limit){
+			current.weight += next.weight; 
+			current.mean += (next.mean - current.mean) * next.weight / current.weight; 
+		} else {
+			weightBefore += current.weight; 
+			_centroids.push_back(current); 
+			current = next; 
+			limit = total * _maxQuantile(weightBefore / total); 
+		}
+	}
+	_centroids.push_back(current); 
+	_unmerged.clear(); 
+}
+
+/**
+ * @brief Highest quantile a centroid starting at quantile q may reach. 
+ * @details One step of the arcsine scale function k(q) = compression / (2 pi) * asin(2q - 1), 
+ * which allows centroids of about sqrt(q(1-q)) / compression of the weight. 
+ */
+double QuantileSketchDatum::_maxQuantile(double q) const {
+	double k = _compression / (2 * M_PI) * asin(2 * q - 1) + 1; 
+	if (k >= _compression / 4) return 1; 
+	return (sin(k * 2 * M_PI / _compression) + 1) / 2; 
+}
+
+/**
+ * @brief Return the CSV of the sketch (see writeCsv()). 
+ */
+std::string QuantileSketchDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t QuantileSketchDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_centroids) + _bytesOf(_unmerged); 
+}
+
+/**
+ * @brief Write a header and rows of mean,weight: the minimum (weight 0), the centroids and the maximum (weight 0). 
+ */
+void QuantileSketchDatum::writeCsv(CsvWriter & out) const {
+	_compress(); 
+	out.setFormat(CsvWriter::GENERAL, 12); 
+	out.raw("mean,weight\n"); 
+	if (_moments.getN() == 0) return; 
+	out.field(_min); 
+	out.field(0); 
+	out.endRow(); 
+	for (const Centroid & c : _centroids){
+		out.field(c.mean); 
+		out.field(c.weight); 
+		out.endRow(); 
+	}
+	out.field(_max); 
+	out.field(0); 
+	out.endRow(); 
+}
+
+/**
+ * @brief Write the rows of writeCsv() as columns mean and weight. 
+ */
+void QuantileSketchDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	_compress(); 
+	vector<double> means, weights; 
+	if (_moments.getN() > 0){
+		means.push_back(_min); 
+		weights.push_back(0); 
+		for (const Centroid & c : _centroids){
+			means.push_back(c.mean); 
+			weights.push_back(c.weight); 
+		}
+		means.push_back(_max); 
+		weights.push_back(0); 
+	}
+	out.beginDatum(key, means.size()); 
+	if (means.empty()) return; 
+	out.column("mean", means.data()); 
+	out.column("weight", weights.data()); 
+}
+
+/**
+ * @brief Constructor for HistogramDatum. 
+ * @param binWidth width of a bin, i.e. a tick (e.g. \ref timePerStep)
+ * @param nBins number of bins (see \ref histogramTicks): observations up to (nBins - 1) ticks are binned, longer ones overflow
+ */
+HistogramDatum::HistogramDatum(double binWidth, unsigned nBins): _binWidth(binWidth), _counts(nBins, 0), _overflow(0) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (binWidth <= 0) throw fatal_error() << "ERROR: HistogramDatum bin width should be positive, got " << binWidth; 
+	if (nBins == 0) throw fatal_error() << "ERROR: HistogramDatum needs at least one bin!"; 
+	#endif
+}
+
+/**
+ * @brief Count an observation in the bin of its nearest tick (or the overflow bin). 
+ */
+void HistogramDatum::record(const double & val){
+	_moments.record(val); 
+	double tick = std::floor(val / _binWidth + 0.5); 
+	if (tick >= _counts.size()) ++_overflow; 
+	else ++_counts[tick > 0 ? unsigned(tick) : 0]; 
+}
+
+/**
+ * @brief Return the mean of the observations (exact, not from the bins). 
+ */
+double HistogramDatum::getMean() const {
+	return _moments.getMean(); 
+}
+
+/**
+ * @brief Return the variance of the observations (exact, not from the bins). 
+ */
+double HistogramDatum::getVariance() const {
+	return _moments.getVariance(); 
+}
+
+/**
+ * @brief Return the number of observations (including overflow). 
+ */
+int HistogramDatum::getN() const {
+	return _moments.getN(); 
+}
+
+/**
+ * @brief Return the width of a bin. 
+ */
+double HistogramDatum::getBinWidth() const {
+	return _binWidth; 
+}
+
+/**
+ * @brief Return the number of bins (not counting overflow). 
+ */
+unsigned HistogramDatum::getNBins() const {
+	return _counts.size(); 
+}
+
+/**
+ * @brief Return the count of each bin; bin k holds the observations that round to k * getBinWidth(). 
+ */
+const vector<int> & HistogramDatum::getCounts() const {
+	return _counts; 
+}
+
+/**
+ * @brief Return the number of observations past the last bin. 
+ */
+int HistogramDatum::getOverflow() const {
+	return _overflow; 
+}
+
+/**
+ * @brief Defective CDF of these observations, as a fraction of these and rest's together. 
+ * @details Element k is the fraction of all observations (ours and rest's) that are ours 
+ * and at most k ticks, e.g. P(RT <= k ticks, correct) if this histogram holds correct RTs 
+ * and rest holds error RTs. It ends below this datum's share of the total by the overflow. 
+ * @param rest the histogram of the other responses (only its count is used)
+ */
+arma::vec HistogramDatum::getDefectiveCdf(const HistogramDatum & rest) const {
+	arma::vec cdf(_counts.size(), arma::fill::zeros); 
+	double total = double(_moments.getN()) + rest._moments.getN(); 
+	if (total == 0) return cdf; 
+	double cumulative = 0; 
+	for (unsigned k=0; k<_counts.size(); ++k){
+		cumulative += _counts[k]; 
+		cdf[k] = cumulative / total; 
+	}
+	return cdf; 
+}
+
+/**
+ * @brief Add another histogram's observations to this one (exactly). 
+ * @details Counts are added bin by bin, and mean and variance combined. The bins have to match. 
+ */
+void HistogramDatum::merge(const HistogramDatum & other){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (other._binWidth != _binWidth || other._counts.size() != _counts.size()) throw fatal_error() << "ERROR: merging a HistogramDatum of " << other._counts.size() << " bins of " << other._binWidth << " into one of " << _counts.size() << " bins of " << _binWidth << "!"; 
+	#endif
+	if (other._moments.getN() == 0) return; 
+	for (unsigned k=0; k<_counts.size(); ++k) _counts[k] += other._counts[k]; 
+	_overflow += other._overflow; 
+	_moments.merge(other._moments); 
+}
+
+/**
+ * @brief Return the CSV of the histogram (see writeCsv()). 
+ */
+std::string HistogramDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t HistogramDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_counts); 
+}
+
+/**
+ * @brief Write a header and rows of time,count for the nonempty bins, then inf,count if anything overflowed. 
+ */
+void HistogramDatum::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::GENERAL, 12); 
+	out.raw("time,count\n"); 
+	for (unsigned k=0; k<_counts.size(); ++k){
+		if (_counts[k] == 0) continue; 
+		out.field(k * _binWidth); 
+		out.field(_counts[k]); 
+		out.endRow(); 
+	}
+	if (_overflow > 0){
+		out.field("inf"); 
+		out.field(_overflow); 
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Write every bin as columns time and count, then the overflow with time inf. 
+ */
+void HistogramDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	vector<double> times(_counts.size() + 1); 
+	vector<int> counts(_counts); 
+	for (unsigned k=0; k<_counts.size(); ++k) times[k] = k * _binWidth; 
+	times.back() = std::numeric_limits<double>::infinity(); 
+	counts.push_back(_overflow); 
+	out.beginDatum(key, counts.size()); 
+	out.column("time", times.data()); 
+	out.column("count", counts.data()); 
+}
+
+/**
+ * @brief Constructor for Response. 
+ * @param rt response time
+ * @param correct was the response correct? 
+ */
+Response::Response(double rt, bool correct): rt(rt), correct(correct) {}
+
+/**
+ * @brief Constructor for ConditionalAccuracyDatum. 
+ * @param binWidth width of an RT bin (see \ref cafBinWidth)
+ * @param nBins number of bins (see \ref cafBins): RTs from nBins * binWidth on overflow
+ */
+ConditionalAccuracyDatum::ConditionalAccuracyDatum(double binWidth, unsigned nBins): _binWidth(binWidth), _correct(nBins, 0), _total(nBins, 0), _overflowCorrect(0), _overflowTotal(0) {
+	#ifndef DISABLE_ERROR_CHECKS
+	if (binWidth <= 0) throw fatal_error() << "ERROR: ConditionalAccuracyDatum bin width should be positive, got " << binWidth; 
+	if (nBins == 0) throw fatal_error() << "ERROR: ConditionalAccuracyDatum needs at least one bin!"; 
+	#endif
+}
+
+/**
+ * @brief Count a response in the bin of its RT (or the overflow bin). 
+ */
+void ConditionalAccuracyDatum::record(const Response & val){
+	double bin = std::floor(val.rt / _binWidth); 
+	if (bin >= _total.size()){
+		++_overflowTotal; 
+		if (val.correct) ++_overflowCorrect; 
+		return; 
+	}
+	unsigned k = bin > 0 ? unsigned(bin) : 0; 
+	++_total[k]; 
+	if (val.correct) ++_correct[k]; 
+}
+
+/**
+ * @brief Return the number of responses (including overflow). 
+ */
+int ConditionalAccuracyDatum::getN() const {
+	return std::accumulate(_total.begin(), _total.end(), _overflowTotal); 
+}
+
+/**
+ * @brief Return the width of an RT bin. 
+ */
+double ConditionalAccuracyDatum::getBinWidth() const {
+	return _binWidth; 
+}
+
+/**
+ * @brief Return the number of bins (not counting overflow). 
+ */
+unsigned ConditionalAccuracyDatum::getNBins() const {
+	return _total.size(); 
+}
+
+/**
+ * @brief Return the number of correct responses in each bin; bin k starts at k * getBinWidth(). 
+ */
+const vector<int> & ConditionalAccuracyDatum::getCorrect() const {
+	return _correct; 
+}
+
+/**
+ * @brief Return the number of responses in each bin; bin k starts at k * getBinWidth(). 
+ */
+const vector<int> & ConditionalAccuracyDatum::getTotal() const {
+	return _total; 
+}
+
+/**
+ * @brief Return the number of correct responses past the last bin. 
+ */
+int ConditionalAccuracyDatum::getOverflowCorrect() const {
+	return _overflowCorrect; 
+}
+
+/**
+ * @brief Return the number of responses past the last bin. 
+ */
+int ConditionalAccuracyDatum::getOverflowTotal() const {
+	return _overflowTotal; 
+}
+
+/**
+ * @brief Accuracy in each bin (NaN for empty bins). 
+ */
+arma::vec ConditionalAccuracyDatum::getAccuracy() const {
+	arma::vec acc(_total.size()); 
+	for (unsigned k=0; k<_total.size(); ++k){
+		acc[k] = _total[k] > 0 ? double(_correct[k]) / _total[k] : arma::datum::nan; 
+	}
+	return acc; 
+}
+
+/**
+ * @brief Add another CAF's counts to this one (exactly). The bins have to match. 
+ */
+void ConditionalAccuracyDatum::merge(const ConditionalAccuracyDatum & other){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (other._binWidth != _binWidth || other._total.size() != _total.size()) throw fatal_error() << "ERROR: merging a ConditionalAccuracyDatum of " << other._total.size() << " bins of " << other._binWidth << " into one of " << _total.size() << " bins of " << _binWidth << "!"; 
+	#endif
+	for (unsigned k=0; k<_total.size(); ++k){
+		_correct[k] += other._correct[k]; 
+		_total[k] += other._total[k]; 
+	}
+	_overflowCorrect += other._overflowCorrect; 
+	_overflowTotal += other._overflowTotal; 
+}
+
+/**
+ * @brief Return the CSV of the CAF (see writeCsv()). 
+ */
+std::string ConditionalAccuracyDatum::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t ConditionalAccuracyDatum::bytesUsed() const {
+	return sizeof(*this) + _bytesOf(_correct) + _bytesOf(_total); 
+}
+
+/**
+ * @brief Write a header and rows of time,correct,total for the nonempty bins (time is the start of the bin), then inf,correct,total if anything overflowed. 
+ */
+void ConditionalAccuracyDatum::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::GENERAL, 12); 
+	out.raw("time,correct,total\n"); 
+	for (unsigned k=0; k<_total.size(); ++k){
+		if (_total[k] == 0) continue; 
+		out.field(k * _binWidth); 
+		out.field(_correct[k]); 
+		out.field(_total[k]); 
+		out.endRow(); 
+	}
+	if (_overflowTotal > 0){
+		out.field("inf"); 
+		out.field(_overflowCorrect); 
+		out.field(_overflowTotal); 
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Write every bin as columns time, correct and total, then the overflow with time inf. 
+ */
+void ConditionalAccuracyDatum::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	vector<double> times(_total.size() + 1); 
+	vector<int> correct(_correct), total(_total); 
+	for (unsigned k=0; k<_total.size(); ++k) times[k] = k * _binWidth; 
+	times.back() = std::numeric_limits<double>::infinity(); 
+	correct.push_back(_overflowCorrect); 
+	total.push_back(_overflowTotal); 
+	out.beginDatum(key, total.size()); 
+	out.column("time", times.data()); 
+	out.column("correct", correct.data()); 
+	out.column("total", total.data()); 
+}
+
+/**
+ * @brief Constructor for an empty TrialTable (no columns or events). 
+ */
+TrialTable::TrialTable() {}
+
+/**
+ * @brief Constructor for TrialTable. 
+ * @param columnNames names of the trial-level observations (one column each)
+ * @param eventNames names of the events (a start and an end column each)
+ * @param expectedTrials number of rows to preallocate (e.g. \ref maxTrials), so 
+ * rows are appended without reallocating
+ */
+TrialTable::TrialTable(const vector<string> & columnNames, const vector<string> & eventNames, unsigned expectedTrials): _columnNames(columnNames), _eventNames(eventNames), _columns(columnNames.size()), _eventStarts(eventNames.size()), _eventEnds(eventNames.size()){
+	_trialIds.reserve(expectedTrials); 
+	_contexts.reserve(expectedTrials); 
+	_targets.reserve(expectedTrials); 
+	for (unsigned i=0; i<_columns.size(); ++i){
+		_columns[i].reserve(expectedTrials); 
+	}
+	for (unsigned i=0; i<_eventStarts.size(); ++i){
+		_eventStarts[i].reserve(expectedTrials); 
+		_eventEnds[i].reserve(expectedTrials); 
+	}
+}
+
+/**
+ * @brief Make sure there is a row for the current trial (appending an empty one if not). 
+ */
+void TrialTable::_row(){
+	int id = _currentTrialId(); 
+	if (!_trialIds.empty() && _trialIds.back() == id) return; 
+	_trialIds.push_back(id); 
+	_contexts.push_back(-1); 
+	_targets.push_back(-1); 
+	for (unsigned i=0; i<_columns.size(); ++i){
+		_columns[i].push_back(NAN); 
+	}
+	for (unsigned i=0; i<_eventStarts.size(); ++i){
+		_eventStarts[i].push_back(NAN); 
+		_eventEnds[i].push_back(NAN); 
+	}
+}
+
+/**
+ * @brief Set the context and target of the current trial. 
+ */
+void TrialTable::setCondition(int context, int target){
+	_row(); 
+	_contexts.back() = context; 
+	_targets.back() = target; 
+}
+
+/**
+ * @brief Set an observation of the current trial. 
+ * @param column position of the observation in the column names
+ * @param val the value
+ */
+void TrialTable::record(unsigned column, double val){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (column >= _columns.size()) throw fatal_error() << "ERROR: TrialTable has no column " << column << "!"; 
+	#endif
+	_row(); 
+	_columns[column].back() = val; 
+}
+
+/**
+ * @brief Set an event of the current trial. 
+ * @param event position of the event in the event names
+ * @param val the event
+ */
+void TrialTable::recordEvent(unsigned event, const Event & val){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (event >= _eventStarts.size()) throw fatal_error() << "ERROR: TrialTable has no event " << event << "!"; 
+	#endif
+	_row(); 
+	_eventStarts[event].back() = val.startTime; 
+	_eventEnds[event].back() = val.endTime; 
+}
+
+/**
+ * @brief Tell TrialTable we started a new trial (only used when not in a Recorder). 
+ */
+void TrialTable::newTrial(){
+	++_latestTraceId; 
+}
+
+/**
+ * @brief Number of rows (trials with anything recorded). 
+ */
+unsigned TrialTable::getNRows() const {
+	return _trialIds.size(); 
+}
+
+/**
+ * @brief Position of a column by name, or -1 if there is no such column. 
+ */
+int TrialTable::getColumnId(const string & name) const {
+	for (unsigned i=0; i<_columnNames.size(); ++i){
+		if (_columnNames[i] == name) return i; 
+	}
+	return -1; 
+}
+
+/**
+ * @brief Position of an event by name, or -1 if there is no such event. 
+ */
+int TrialTable::getEventId(const string & name) const {
+	for (unsigned i=0; i<_eventNames.size(); ++i){
+		if (_eventNames[i] == name) return i; 
+	}
+	return -1; 
+}
+
+/**
+ * @brief Trial ID of each row. 
+ */
+const vector<int> & TrialTable::getTrialIds() const {
+	return _trialIds; 
+}
+
+/**
+ * @brief Context of each row. 
+ */
+const vector<int> & TrialTable::getContexts() const {
+	return _contexts; 
+}
+
+/**
+ * @brief Target of each row. 
+ */
+const vector<int> & TrialTable::getTargets() const {
+	return _targets; 
+}
+
+/**
+ * @brief An observation column. 
+ */
+const vector<double> & TrialTable::getColumn(unsigned column) const {
+	return _columns.at(column); 
+}
+
+/**
+ * @brief Start times of an event. 
+ */
+const vector<double> & TrialTable::getEventStarts(unsigned event) const {
+	return _eventStarts.at(event); 
+}
+
+/**
+ * @brief End times of an event. 
+ */
+const vector<double> & TrialTable::getEventEnds(unsigned event) const {
+	return _eventEnds.at(event); 
+}
+
+/**
+ * @brief CSV of the table with a header row: trial, context, target, the observations, then 
+ * <event>Start and <event>End for every event. Missing values are written as NA. 
+ */
+std::string TrialTable::getStringRepr() const {
+	return _csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+size_t TrialTable::bytesUsed() const {
+	size_t bytes = sizeof(*this) + _bytesOf(_trialIds) + _bytesOf(_contexts) + _bytesOf(_targets); 
+	for (const vector<double> & column : _columns) bytes += _bytesOf(column); 
+	for (unsigned i=0; i<_eventStarts.size(); ++i) bytes += _bytesOf(_eventStarts[i]) + _bytesOf(_eventEnds[i]); 
+	return bytes; 
+}
+
+/**
+ * @brief Write the header and one row per trial, NA for observations that didn't happen. 
+ */
+void TrialTable::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::GENERAL, 12); 
+	out.field("trial"); 
+	out.field("context"); 
+	out.field("target"); 
+	for (unsigned i=0; i<_columnNames.size(); ++i){
+		out.field(_columnNames[i]); 
+	}
+	for (unsigned i=0; i<_eventNames.size(); ++i){
+		out.field(_eventNames[i] + "Start"); 
+		out.field(_eventNames[i] + "End"); 
+	}
+	out.endRow(); 
+	for (unsigned r=0; r<_trialIds.size(); ++r){
+		out.field(_trialIds[r]); 
+		out.field(_contexts[r]); 
+		out.field(_targets[r]); 
+		for (unsigned i=0; i<_columns.size(); ++i){
+			_writeField(out, _columns[i][r]); 
+		}
+		for (unsigned i=0; i<_eventStarts.size(); ++i){
+			_writeField(out, _eventStarts[i][r]); 
+			_writeField(out, _eventEnds[i][r]); 
+		}
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Write x, or NA if it is NaN (not observed). 
+ */
+void TrialTable::_writeField(CsvWriter & out, double x){
+	if (std::isnan(x)) out.field("NA"); else out.field(x); 
+}
+
+/**
+ * @brief Write the table with the same columns as its CSV (NaN where the CSV has NA), indexed by trial. 
+ */
+void TrialTable::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	out.beginDatum(key, _trialIds.size()); 
+	out.column("trial", _trialIds.data()); 
+	out.column("context", _contexts.data()); 
+	out.column("target", _targets.data()); 
+	for (unsigned i=0; i<_columns.size(); ++i){
+		out.column(_columnNames[i], _columns[i].data()); 
+	}
+	for (unsigned i=0; i<_eventNames.size(); ++i){
+		out.column(_eventNames[i] + "Start", _eventStarts[i].data()); 
+		out.column(_eventNames[i] + "End", _eventEnds[i].data()); 
+	}
+	out.index(TrialSegments(_trialIds)); 
+}
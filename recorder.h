@@ -4,17 +4,26 @@
 #include <string>
 #include <memory>
 #include <unordered_map>
+#include <map>
+#include <fstream>
+#include <vector>
 #include <type_traits>
 #include <numeric>
+#include <algorithm>
 #include <cmath>
 #include <armadillo> 
 
 #include "utils.h"
 #include "fatal_error.h"
+#include "arrayview.h"
+#include "columnfile.h"
+#include "csvwriter.h"
 
 using std::string;
 using arma::rowvec;
 
+class AsyncWriter; 
+
 /**
  * @brief A class that lets us abstract from the type of observations Recorder holds. 
  * @details IDatum is not templated so we can stick it in std::map, even though we're 
@@ -23,11 +32,62 @@ using arma::rowvec;
  */
 class IDatum {
 public: 
-	~IDatum() = default;
+	virtual ~IDatum() = default;
 	/// Record the beginning of a new trial (in subclasses)
 	virtual void newTrial() {}; 
 	/// return a string holding CSV of the datum (in subclasses)
-	virtual std::string getStringRepr() = 0;
+	virtual std::string getStringRepr() const = 0;
+	/// Write the datum's CSV through out (by default, the string from getStringRepr()). 
+	virtual void writeCsv(CsvWriter & out) const { out.raw(getStringRepr()); }
+	/// Follow a trial counter owned by someone else (Recorder) instead of counting newTrial() calls. 
+	void attachTrialCounter(const int * counter) { _trialCounter = counter; }
+	/// Hand output (e.g. streamed traces) to a background writer instead of writing it on the calling thread (nullptr to write directly). 
+	void attachAsyncWriter(AsyncWriter * writer) { _asyncWriter = writer; }
+	/// Can the datum write its file during the run (see streamTo())? 
+	virtual bool canStream() const { return false; }
+	/// Start writing to filename during the run, holding at most about bufferBytes in memory, with shortest round trip numbers if shortestCsv (false if the datum can't stream). 
+	virtual bool streamTo(const std::string & /*filename*/, size_t /*bufferBytes*/, bool /*shortestCsv*/) { return false; }
+	/// Write out whatever is still buffered and close the stream (if streaming). 
+	virtual void finishStream() {}
+	/// Is the datum writing its file during the run? 
+	virtual bool isStreaming() const { return false; }
+	/// Write the datum as typed columns under the name key (nothing by default, see Recorder::writeColumnFile()). 
+	virtual void writeColumns(ColumnFileWriter & /*out*/, const std::string & /*key*/) const {}
+	/// Bytes of memory the datum holds: the object and the buffers it has grown to hold its values (filled or not). 
+	virtual size_t bytesUsed() const { return 0; }
+	/// Stop storing observations from now on, keeping those stored so far and any running summaries (false if the datum doesn't grow with observations, see Recorder::setMemoryBudget()). 
+	virtual bool freeze() { return false; }
+	/// Has freeze() been called? 
+	bool isFrozen() const { return _frozen; }
+protected: 
+	std::string _csvString() const; 
+	/// Bytes of the buffer of v (its capacity: a vector that grew keeps what it grew to, filled or not). 
+	template<typename V> static size_t _bytesOf(const vector<V> & v) { return v.capacity() * sizeof(V); }
+	/// ID of the current trial: the attached counter if there is one, else the datum's own count. 
+	int _currentTrialId() const { return _trialCounter != nullptr ? *_trialCounter : _latestTraceId; }
+	const int * _trialCounter = nullptr; ///< trial counter shared by all datums of a Recorder, or nullptr for standalone datums
+	int _latestTraceId = -1; ///< ID of the latest trial when standalone (initialized at -1 because newTrial will be called to set it to 0)
+	AsyncWriter * _asyncWriter = nullptr; ///< background writer for output, or nullptr to write directly
+	bool _frozen = false; ///< ignore further observations (see freeze())
+}; 
+
+/**
+ * @brief Typed, stable handle to a datum registered in a Recorder. 
+ * @details Obtained once from Recorder::getHandle(), after which recording through it 
+ * (Recorder::updateDatum(const DatumHandle<T>&, ...)) is an array index and a virtual call, 
+ * with no string building, hashing or lookups. Handles stay valid until Recorder::reset(). 
+ * @tparam T the type of observation the datum records. 
+ */
+template<typename T>
+class DatumHandle {
+public: 
+	typedef T value_type; ///< type of observation recorded through this handle
+	DatumHandle(): _slot(-1) {}
+	explicit DatumHandle(int slot): _slot(slot) {}
+	int slot() const { return _slot; } ///< index of the datum in the Recorder
+	bool isValid() const { return _slot >= 0; } ///< false for default-constructed handles
+protected: 
+	int _slot; ///< index of the datum in the Recorder
 }; 
 
 /**
@@ -39,7 +99,9 @@ template<typename T>
 class Datum : public IDatum {
 public:
 	/// Record this datum (implemented in subclasses). 
-	virtual void record(T val) = 0;
+	virtual void record(const T & val) = 0;
+	/// Record a temporary (subclasses that store T can override this to move it in). 
+	virtual void record(T && val) { record(static_cast<const T &>(val)); }
 };
 
 /**
@@ -53,9 +115,9 @@ public:
 template<typename T>
 class SummaryDatum : public Datum<T> {
 public:
-	virtual T getMean() = 0; ///< Return the mean of this set of observations. Defined in subclasses 
-	virtual T getVariance() = 0; ///< Return the variance of this set of observations. Defined in subclasses 
-	virtual int getN() = 0; ///< Return the number of observations in this set. Defined in subclasses 
+	virtual T getMean() const = 0; ///< Return the mean of this set of observations. Defined in subclasses 
+	virtual T getVariance() const = 0; ///< Return the variance of this set of observations. Defined in subclasses 
+	virtual int getN() const = 0; ///< Return the number of observations in this set. Defined in subclasses 
 };
 
 /**
@@ -67,22 +129,159 @@ public:
 class GMMDatum : public SummaryDatum<double> {
 public:
 	GMMDatum(int ngauss=2, int expectedNObs=1000); 
-	virtual double getMean(); 
-	virtual double getVariance();
-	virtual void record(double val); 
-	virtual std::string getStringRepr(); 
-	virtual int getN(); 
-	virtual rowvec getGaussMeans(); 
-	virtual rowvec getGaussVars(); 
-	virtual rowvec getGaussWeights(); 
-	virtual rowvec getRawData(); 
+	virtual double getMean() const; 
+	virtual double getVariance() const;
+	virtual void record(const double & val); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual int getN() const; 
+	virtual rowvec getGaussMeans() const; 
+	virtual rowvec getGaussVars() const; 
+	virtual rowvec getGaussWeights() const; 
+	virtual rowvec getRawData() const; 
+	ArrayView<double> viewRawData() const; 
+	void merge(const GMMDatum & other); 
+	virtual size_t bytesUsed() const; 
+	virtual bool freeze(); 
 protected: 
-	void _estimateModel(); 
-	int _n; ///< number of observations
+	void _estimateModel() const; 
+	utils::RunningMoments<double> _moments; ///< count, mean and sum of square deviations of the observations (the first count of _rawData are used)
 	rowvec _rawData;  ///< the raw observations
-	arma::gmm_diag _model; ///< the GMM object
+	mutable arma::gmm_diag _model; ///< the GMM object (estimated lazily, also by const getters)
+	int _ngauss; ///< number of gaussians to fit
+	mutable bool _estimateIsFresh; ///< has the GMM been updated since the latest observation? 
+};
+
+/**
+ * @brief Learns a gaussian mixture model of incoming double observations online (stochastic EM), without keeping them. 
+ * @details The first warmup observations are buffered and fit with gmm_diag. After that, each 
+ * observation updates the expected sufficient statistics of the mixture (per gaussian: weight, 
+ * weighted sum, weighted sum of squares) with step size (n+1)^-stepExponent, and the mixture 
+ * parameters are read off the statistics, so an observation costs O(ngauss) and memory does 
+ * not grow with the number of observations. stepExponent must be in (0.5, 1]: smaller values 
+ * forget the warmup fit faster. Mean and variance are exact. 
+ * 
+ * With keepRawData the observations are kept too, and refit() runs a few iterations of batch 
+ * EM over them starting from the online estimate (a warm start, much cheaper than the 
+ * from-scratch fit GMMDatum does). The CSV and column output are the same as GMMDatum's. 
+ */
+class OnlineGMMDatum : public SummaryDatum<double> {
+public:
+	OnlineGMMDatum(int ngauss=2, int warmup=500, bool keepRawData=false, double stepExponent=0.6); 
+	virtual double getMean() const; 
+	virtual double getVariance() const;
+	virtual void record(const double & val); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual int getN() const; 
+	virtual rowvec getGaussMeans() const; 
+	virtual rowvec getGaussVars() const; 
+	virtual rowvec getGaussWeights() const; 
+	virtual rowvec getRawData() const; 
+	void refit(int iterations=5); 
+	void merge(const OnlineGMMDatum & other); 
+	virtual size_t bytesUsed() const; 
+	virtual bool freeze(); 
+protected: 
+	void _fitWarmup() const; 
+	void _paramsFromStats() const; 
 	int _ngauss; ///< number of gaussians to fit
-	bool _estimateIsFresh; ///< has the GMM been updated since the latest observation? 
+	int _warmup; ///< number of observations buffered for the initial batch fit
+	bool _keepRawData; ///< keep the observations after warmup (for refit())? 
+	double _stepExponent; ///< step size of observation n is (n+1)^-_stepExponent
+	utils::RunningMoments<double> _moments; ///< count, mean and sum of square deviations of the observations
+	vector<double> _rawData; ///< the warmup buffer, or every observation with _keepRawData
+	mutable bool _online; ///< has the warmup fit been done (so the statistics below are live)? 
+	mutable rowvec _s0; ///< expected weight of each gaussian
+	mutable rowvec _s1; ///< expected weighted sum of the observations under each gaussian
+	mutable rowvec _s2; ///< expected weighted sum of squares of the observations under each gaussian
+	mutable rowvec _means; ///< current gaussian means
+	mutable rowvec _vars; ///< current gaussian variances
+	mutable rowvec _weights; ///< current gaussian weights
+	mutable int _fitN; ///< _n when the parameters were last fit from the warmup buffer
+};
+
+/**
+ * @brief Streaming quantiles of incoming double observations in fixed memory (a merging t-digest). 
+ * @details Observations are buffered and folded into a sorted list of centroids (mean and 
+ * count of a cluster of nearby observations) when the buffer fills. The size of a centroid 
+ * is bounded by the arcsine scale function of its quantile, so centroids are small in the 
+ * tails (the extremes are single observations) and the sketch holds at most about compression 
+ * centroids however many observations it sees. Quantiles are interpolated between centroid 
+ * centers, with the exact minimum and maximum at the ends. Mean and variance are exact. 
+ * 
+ * Two sketches can be merged (merge()), e.g. to combine runs. The CSV and column output are 
+ * the centroids (mean, weight), preceded by the minimum and followed by the maximum with 
+ * weight 0, which is everything the sketch knows about the distribution. 
+ */
+class QuantileSketchDatum : public SummaryDatum<double> {
+public:
+	QuantileSketchDatum(double compression=100); 
+	virtual void record(const double & val); 
+	virtual double getMean() const; 
+	virtual double getVariance() const; 
+	virtual int getN() const; 
+	double getMin() const; 
+	double getMax() const; 
+	double getQuantile(double q) const; 
+	vector<double> getQuantiles(const vector<double> & qs) const; 
+	unsigned getNCentroids() const; 
+	void merge(const QuantileSketchDatum & other); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual size_t bytesUsed() const; 
+protected: 
+	/// A cluster of observations: their mean and how many there are.
+	struct Centroid {
+		double mean; 
+		double weight; 
+	}; 
+	void _compress() const; 
+	double _maxQuantile(double q) const; 
+	double _compression; ///< the sketch keeps at most about this many centroids (more is more accurate)
+	size_t _bufferSize; ///< number of unmerged observations that triggers _compress()
+	mutable vector<Centroid> _centroids; ///< the digest, sorted by mean
+	mutable vector<Centroid> _unmerged; ///< observations (and merged-in centroids) not yet in _centroids
+	utils::RunningMoments<double> _moments; ///< count, mean and sum of square deviations of the observations
+	double _min; ///< smallest observation
+	double _max; ///< largest observation
+};
+
+/**
+ * @brief Histogram of incoming observations in ticks (e.g. RTs in units of \ref timePerStep), in fixed memory. 
+ * @details Every time in the library is a multiple of the timestep, so an RT is a whole 
+ * number of ticks: recording one rounds it to the nearest tick and counts it in that bin, 
+ * which is O(1). Observations past the last bin are counted in an overflow bin (and negative 
+ * ones in bin 0). Mean and variance are exact, so the datum can stand in for 
+ * IncrementalMeanVarianceDatum. Histograms with the same bins merge exactly (merge()), e.g. 
+ * across threads or shards. getDefectiveCdf() gives the defective CDF of, say, correct RTs 
+ * given the histogram of error RTs. 
+ */
+class HistogramDatum : public SummaryDatum<double> {
+public: 
+	HistogramDatum(double binWidth=10, unsigned nBins=1000); 
+	virtual void record(const double & val); 
+	virtual double getMean() const; 
+	virtual double getVariance() const; 
+	virtual int getN() const; 
+	double getBinWidth() const; 
+	unsigned getNBins() const; 
+	const vector<int> & getCounts() const; 
+	int getOverflow() const; 
+	arma::vec getDefectiveCdf(const HistogramDatum & rest) const; 
+	void merge(const HistogramDatum & other); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual size_t bytesUsed() const; 
+protected: 
+	double _binWidth; ///< width of a bin (one tick)
+	vector<int> _counts; ///< observations in each bin; bin k holds values that round to k ticks
+	int _overflow; ///< observations past the last bin
+	utils::RunningMoments<double> _moments; ///< count, mean and sum of square deviations of the observations
 };
 
 /**
@@ -95,18 +294,24 @@ template<typename T>
 class RawVectorsDatum : public SummaryDatum<T> {
 public: 
 	RawVectorsDatum();
-	virtual void record(T val); 
-	virtual T getMean(); 
-	virtual T getVariance(); 
-	virtual int getN(); 
-	vector<T> getRawData(); 
-	virtual std::string getStringRepr(); 
+	virtual void record(const T & val); 
+	virtual T getMean() const; 
+	virtual T getVariance() const; 
+	virtual int getN() const; 
+	const vector<T> & getRawData() const; 
+	const vector<int> & getTraceIds() const; 
+	TrialSegments getSegments() const; 
+	void merge(const RawVectorsDatum<T> & other); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
 	void newTrial();
 
+	virtual size_t bytesUsed() const; 
+	virtual bool freeze(); 
 protected: 
 	vector<T> _rawData; ///< stores the raw data 
 	vector<int> _traceIds; ///< Trial/trace IDs associated with the individual data points
-	int _latestTraceId = -1; ///< ID of the latest trial (initialized at -1 because newTrial will be called to set it to 0)
 };
 
 /**
@@ -119,8 +324,9 @@ protected:
 template<typename T>
 class DummyDatum : public Datum<T> {
 public: 
-	virtual void record(T val); 
-	virtual std::string getStringRepr(); 
+	virtual void record(const T & val); 
+	virtual std::string getStringRepr() const; 
+	virtual size_t bytesUsed() const; 
 };
 
 /**
@@ -134,16 +340,18 @@ template<typename T>
 class IncrementalMeanVarianceDatum : public SummaryDatum<T> {
 public: 
 	IncrementalMeanVarianceDatum(); 
-	virtual void record(T val); 
-	virtual T getMean(); 
-	virtual T getVariance(); 
-	virtual int getN(); 
-	virtual std::string getStringRepr(); 
+	virtual void record(const T & val); 
+	virtual T getMean() const; 
+	virtual T getVariance() const; 
+	virtual int getN() const; 
+	void merge(const IncrementalMeanVarianceDatum<T> & other); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
 
+	virtual size_t bytesUsed() const; 
 protected: 
-	T _mean; ///< mean so far
-	T _ssq;  ///< sum of square deviations so far
-	int _n;  ///< number of observations so far. 
+	utils::RunningMoments<T> _moments; ///< count, mean and sum of square deviations so far
 };
 
 /**
@@ -152,9 +360,12 @@ protected:
  */
 class Timepoint {
 public: 
-	Timepoint(double t, arma::vec v); 
+	Timepoint(double t, const arma::vec & v, bool keep=false, bool decision=false); 
+	Timepoint(double t, const arma::mat & m, bool keep=false, bool decision=false); 
 	double time; ///< timestamp (in ms) of this timepoint
 	arma::vec value; ///< a recorded vector value at this timepoint (e.g. a posterior)
+	bool keep; ///< keep this timepoint whatever TraceDatum's decimation policy (e.g. at a threshold crossing)
+	bool decision; ///< is this the timepoint the trial's response was decided at (see ResponseLockedDatum)? 
 };
 
 /**
@@ -174,115 +385,583 @@ public:
  */
 class EventDatum : public Datum<Event>{
 public:
-	virtual void record(Event val);
-	arma::mat getEventTimes(); 
-	virtual std::string getStringRepr(); 
+	virtual void record(const Event & val);
+	arma::mat getEventTimes() const; 
+	const vector<double> & getStartTimes() const; 
+	const vector<double> & getEndTimes() const; 
+	const vector<int> & getTraceIds() const; 
+	TrialSegments getSegments() const; 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
 	virtual void newTrial(); 
-	arma::mat getMatRepr(); 
+	arma::mat getMatRepr() const; 
+	virtual size_t bytesUsed() const; 
+	virtual bool freeze(); 
 protected:
 	vector<double> _startTimes;  ///< event start times
 	vector<double> _endTimes;  ///< event end times
 	vector<int> _traceIds; ///< trace (trial) IDs associated with the start-end pairs
-	int _latestTraceId = -1;  ///< ID of the latest trial (initialized at -1 because newTrial will be called to set it to 0)
+};
+
+/**
+ * @brief Decides which trials of a condition are kept in a uniform sample of at most capacity trials (reservoir sampling). 
+ * @details Shared (through a std::shared_ptr) by the SampledRawVectorsDatum%s and 
+ * SampledEventDatum%s of one condition, so all of them keep the same trials. The first 
+ * datum to record in a trial draws its fate (Algorithm R: the k-th trial seen replaces a 
+ * random slot with probability capacity / k), and the others follow. The datums check 
+ * which trial each slot belongs to now before reading it, so a datum that didn't record 
+ * in the trial that took over a slot drops its stale values. 
+ */
+class TrialReservoir {
+public: 
+	explicit TrialReservoir(unsigned capacity); 
+	int slotFor(int trialId); 
+	int trialInSlot(unsigned slot) const; 
+	vector<unsigned> keptSlots() const; 
+	unsigned getCapacity() const; 
+	int getNSeen() const; 
+protected: 
+	vector<int> _slotTrials; ///< trial each slot holds (-1 for empty slots)
+	int _nSeen; ///< trials seen so far
+	int _lastTrial; ///< latest trial asked about
+	int _lastSlot; ///< its slot (-1 if not kept)
+};
+
+/**
+ * @brief A RawVectorsDatum that keeps the observations of a uniform sample of trials (see TrialReservoir), in fixed memory. 
+ * @details Mean, variance and N are exact (over every observation), from an 
+ * IncrementalMeanVarianceDatum kept on the side. The raw data, trial IDs and CSV (in 
+ * RawVectorsDatum's format) only cover the sampled trials, in trial order. 
+ * @tparam T type of the observations
+ */
+template<typename T>
+class SampledRawVectorsDatum : public SummaryDatum<T> {
+public: 
+	explicit SampledRawVectorsDatum(std::shared_ptr<TrialReservoir> reservoir); 
+	virtual void record(const T & val); 
+	virtual T getMean() const; 
+	virtual T getVariance() const; 
+	virtual int getN() const; 
+	vector<T> getRawData() const; 
+	vector<int> getTraceIds() const; 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual void newTrial(); 
+	virtual size_t bytesUsed() const; 
+protected: 
+	std::shared_ptr<TrialReservoir> _reservoir; ///< decides which trials are kept (shared with the condition's other sampled datums)
+	vector<vector<T> > _slots; ///< observations of the trial in each reservoir slot
+	vector<int> _slotTrials; ///< trial whose observations are in each slot (stale if it differs from the reservoir's)
+	IncrementalMeanVarianceDatum<T> _summary; ///< exact summary of every observation
+};
+
+/**
+ * @brief An EventDatum that keeps the events of a uniform sample of trials (see TrialReservoir), in fixed memory. 
+ * @details The number of events and the mean and variance of their durations are exact 
+ * (over every event). The event times and CSV (in EventDatum's format) only cover the 
+ * sampled trials, in trial order. 
+ */
+class SampledEventDatum : public Datum<Event> {
+public: 
+	explicit SampledEventDatum(std::shared_ptr<TrialReservoir> reservoir); 
+	virtual void record(const Event & val); 
+	arma::mat getEventTimes() const; 
+	int getN() const; 
+	double getDurationMean() const; 
+	double getDurationVariance() const; 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual void newTrial(); 
+	virtual size_t bytesUsed() const; 
+protected: 
+	std::shared_ptr<TrialReservoir> _reservoir; ///< decides which trials are kept (shared with the condition's other sampled datums)
+	vector<vector<Event> > _slots; ///< events of the trial in each reservoir slot
+	vector<int> _slotTrials; ///< trial whose events are in each slot (stale if it differs from the reservoir's)
+	IncrementalMeanVarianceDatum<double> _durations; ///< exact summary of every event's duration
+};
+
+/**
+ * @brief A response: its RT and whether it was correct. 
+ * @details What ConditionalAccuracyDatum records, once per trial (see Task::_recordResponse()). 
+ */
+class Response {
+public: 
+	Response(double rt, bool correct); 
+	double rt; ///< response time (ms)
+	bool correct; ///< was the response correct? 
+};
+
+/**
+ * @brief Conditional accuracy function (accuracy by RT bin) of incoming responses, in fixed memory. 
+ * @details Keeps, per RT bin, the number of correct responses and of all responses. Bin k 
+ * holds RTs in [k * binWidth, (k+1) * binWidth) (negative RTs go to bin 0); longer RTs are 
+ * counted in an overflow bin. Recording is O(1), so a CAF per condition can be kept over any 
+ * number of trials without storing RTs or traces. Datums with the same bins merge exactly. 
+ * BatchExperiment records one per condition when \ref batchCaf is set. 
+ */
+class ConditionalAccuracyDatum : public Datum<Response> {
+public: 
+	ConditionalAccuracyDatum(double binWidth=50, unsigned nBins=100); 
+	virtual void record(const Response & val); 
+	int getN() const; 
+	double getBinWidth() const; 
+	unsigned getNBins() const; 
+	const vector<int> & getCorrect() const; 
+	const vector<int> & getTotal() const; 
+	int getOverflowCorrect() const; 
+	int getOverflowTotal() const; 
+	arma::vec getAccuracy() const; 
+	void merge(const ConditionalAccuracyDatum & other); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual size_t bytesUsed() const; 
+protected: 
+	double _binWidth; ///< width of an RT bin
+	vector<int> _correct; ///< correct responses in each bin
+	vector<int> _total; ///< all responses in each bin
+	int _overflowCorrect; ///< correct responses past the last bin
+	int _overflowTotal; ///< all responses past the last bin
 };
 
 /**
  * @brief Holds timepoint traces (each a vector, indexed by timepoint)
+ * @details Stored in one contiguous buffer of fixed-width rows (trace ID, time, values), 
+ * in row-major order. The width is set by the first timepoint recorded. Since a row-major 
+ * buffer is a column-major matrix with one column per timepoint, getTracesView() 
+ * exposes it as an arma::mat without copying. 
+ * 
+ * In streaming mode (streamTo()), completed traces are written to the datum's CSV file 
+ * whenever the buffered rows reach the buffer size, so memory stays bounded however many 
+ * trials are run, and the in-memory accessors only see the rows not yet written. The 
+ * finished file is the same as getStringRepr() would have given without streaming. 
+ * 
+ * Traces can be decimated as they are recorded: only every k-th timepoint of a trace, and/or 
+ * only timepoints where some value moved by more than epsilon since the last kept one. The 
+ * first and last timepoints of every trace, and timepoints marked Timepoint::keep (e.g. 
+ * threshold crossings), are always kept. The latest timepoint of a trace is always stored, 
+ * and overwritten by the next one if the policy would have dropped it, so the last timepoint 
+ * is there without the datum having to know when a trace ends. 
  */
 class TraceDatum : public Datum<Timepoint>{
 public:
-	virtual void record(Timepoint val);
-	arma::mat getTraces();
-	virtual std::string getStringRepr();  
+	TraceDatum(unsigned expectedTimepoints=0, unsigned every=1, double epsilon=0); 
+	virtual void record(const Timepoint & val);
+	arma::mat getTraces() const;
+	const arma::mat getTracesView() const; 
+	const vector<double> & getRows() const; 
+	unsigned getWidth() const; 
+	unsigned getNRows() const; 
+	ArrayView<double> getRow(unsigned i) const; 
+	const vector<TrialSegment> & getSegments() const; 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
 	virtual void newTrial(); 
-	arma::mat getMatRepr(); 
+	arma::mat getMatRepr() const; 
+	virtual bool canStream() const { return true; } 
+	virtual bool streamTo(const std::string & filename, size_t bufferBytes, bool shortestCsv); 
+	virtual void finishStream(); 
+	virtual bool isStreaming() const; 
+	virtual size_t bytesUsed() const; 
+	virtual bool freeze(); 
 protected:
-	vector<arma::vec> _values; ///< the raw timepoint traces. Outer is a std::vector for efficient push_back(), inner arma::vec to capture vectorise()'d belief matrices. 
-	vector<double> _times; ///< timestamps of the timepoints 
-	vector<int> _traceIds; ///< trace (trial) ids of the timepoints
-	int _latestTraceId = -1;  ///< ID of the latest trial (initialized at -1 because newTrial will be called to set it to 0)
+	void _writeRows(CsvWriter & out, unsigned begin, unsigned end) const; 
+	void _flush(); 
+	void _fitBuffer(); 
+	bool _passesPolicy(const Timepoint & val) const; 
+	vector<double> _rows; ///< the timepoints, one row of _width values (trace ID, time, values) each
+	size_t _touched; ///< most values _rows has held since its buffer was allocated (the reserved buffer beyond them is untouched)
+	unsigned _width; ///< number of values per row (2 + length of the recorded vectors), 0 until the first record()
+	unsigned _expectedTimepoints; ///< number of rows to reserve space for on the first record()
+	vector<TrialSegment> _segments; ///< rows of each trace, appended to as traces start
+	std::shared_ptr<std::ofstream> _stream; ///< file completed trials are flushed to when streaming, else null (shared so the datum stays copyable)
+	std::shared_ptr<CsvWriter> _csv; ///< writer attached to _stream when streaming
+	size_t _bufferBytes; ///< memory to hold rows in before flushing when streaming
+	unsigned _every; ///< keep every _every-th timepoint of a trace (1 keeps all)
+	double _epsilon; ///< keep timepoints where a value moved by more than this since the last kept one (0 keeps all)
+	unsigned _stepInTrace; ///< timepoints recorded in the current trace so far, minus one
+	unsigned _lastKeptRow; ///< row of the latest timepoint kept by the policy in the current trace
+	bool _latestIsProvisional; ///< is the last row only there because it is the latest (to be overwritten by the next one)? 
+};
+
+/**
+ * @brief Holds timepoint traces like TraceDatum, quantized and delta/varint encoded in blocks. 
+ * @details Values are quantized to integer multiples of precision (fixed point: the default 
+ * 2^-16 is 16 bits over [0, 1], off by at most precision / 2) and times to steps of 
+ * timePerStep, round(time / timePerStep) (the times tasks record are whole steps). Timepoints 
+ * go into blocks of up to blockSize consecutive steps of one trace, so times are implicit: a 
+ * block header holds the trace ID (as the difference from the previous block's), its first 
+ * step and the number of timepoints, all as varints, and each value is stored as the zigzag 
+ * varint of its difference from the same value at the previous timepoint of the block. 
+ * Posteriors change slowly from step to step, so most values take one or two bytes, instead 
+ * of the 8 bytes per value (plus 16 for the trace ID and time) of TraceDatum. A new block 
+ * starts with every trace, after a gap in the steps and every blockSize timepoints; only the 
+ * open block is held unencoded. 
+ * 
+ * getEncoded() gives the encoded stream (a short header, then the blocks) and decode() turns 
+ * it back into what getTraces() returns, which is in TraceDatum's layout (trace ID, time, 
+ * values), as is the CSV. writeEncoded() and readEncoded() do the same through a file. 
+ * TraceExperiment records posteriors with it when \ref compactTraces is set. 
+ */
+class CompactTraceDatum : public Datum<Timepoint> {
+public: 
+	CompactTraceDatum(double timePerStep=10, double precision=1.0/65536, unsigned blockSize=64); 
+	virtual void record(const Timepoint & val); 
+	virtual void newTrial(); 
+	arma::mat getTraces() const; 
+	unsigned getWidth() const; 
+	unsigned getNRows() const; 
+	double getPrecision() const; 
+	vector<uint8_t> getEncoded() const; 
+	static arma::mat decode(const vector<uint8_t> & encoded); 
+	void writeEncoded(const std::string & filename) const; 
+	static arma::mat readEncoded(const std::string & filename); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual size_t bytesUsed() const; 
+	virtual bool freeze(); 
+protected: 
+	void _closeBlock(); 
+	static void _encodeBlock(vector<uint8_t> & out, int trialDelta, long long firstStep, const vector<long long> & block, unsigned rows, unsigned cells); 
+	double _timePerStep; ///< time between steps
+	double _precision; ///< quantization step of the values
+	unsigned _blockSize; ///< most timepoints per block
+	unsigned _cells; ///< number of cells of the recorded vectors, 0 until the first record()
+	unsigned _nRows; ///< timepoints recorded
+	vector<uint8_t> _bytes; ///< the closed blocks, encoded
+	vector<long long> _block; ///< quantized values of the open block, by timepoint then cell
+	unsigned _blockRows; ///< timepoints in the open block
+	int _blockTrial; ///< trace ID of the open block
+	long long _blockFirstStep; ///< step of the first timepoint of the open block
+	int _lastClosedTrial; ///< trace ID of the last closed block (trace IDs are stored as differences from it)
+};
+
+/**
+ * @brief Response-locked windows of the vectors (e.g. posteriors) recorded in each trial: the last window before the decision, and a tail after it. 
+ * @details Timepoints go into a ring buffer of the last window timepoints of the current 
+ * trial, and nothing is kept until one marked as the decision (Timepoint::decision, set by 
+ * the tasks at the threshold crossing) comes in. Then the buffer is committed, and up to tail 
+ * more timepoints (e.g. sampled during motor planning) are kept after it; trials without a 
+ * decision (e.g. premature responses) keep nothing. Memory per trial is bounded by 
+ * window + tail whatever the RT. 
+ * 
+ * Committed timepoints are also averaged online by their offset from the decision (in 
+ * timepoints, i.e. steps in the sampling loops: -window+1 to tail, 0 being the decision), 
+ * which getMeans() and getVariances() return. With storeTraces the committed timepoints are 
+ * stored too and the CSV is in TraceDatum's format (trace ID, time, values), with times 
+ * relative to the decision; without, only the averages are kept (fixed memory whatever the 
+ * number of trials) and the CSV is offset,n,mean0,...,variance0,... per offset. 
+ * TraceExperiment records posteriors with it when \ref responseLockedWindow is set. 
+ */
+class ResponseLockedDatum : public Datum<Timepoint> {
+public: 
+	ResponseLockedDatum(unsigned window=50, unsigned tail=30, bool storeTraces=true); 
+	virtual void record(const Timepoint & val); 
+	virtual void newTrial(); 
+	unsigned getWindow() const; 
+	unsigned getTail() const; 
+	unsigned getWidth() const; 
+	unsigned getNRows() const; 
+	int getNDecisions() const; 
+	arma::mat getTraces() const; 
+	int getN(int offset) const; 
+	arma::mat getMeans() const; 
+	arma::mat getVariances() const; 
+	void merge(const ResponseLockedDatum & other); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual size_t bytesUsed() const; 
+	virtual bool freeze(); 
+protected: 
+	void _startTrial(int trialId); 
+	void _commit(double time, const double * values, int offset); 
+	unsigned _window; ///< timepoints kept before (and including) the decision
+	unsigned _tail; ///< timepoints kept after the decision
+	bool _storeTraces; ///< store committed timepoints, not just their averages? 
+	unsigned _width; ///< number of cells of the recorded vectors, 0 until the first record()
+	vector<double> _ring; ///< the last _window timepoints of the current trial (time, then values), oldest at _ringStart
+	unsigned _ringStart; ///< position of the oldest timepoint in _ring
+	unsigned _ringSize; ///< timepoints in _ring
+	int _trialId; ///< trial the ring buffer belongs to
+	bool _decided; ///< has the current trial's decision come in? 
+	double _decisionTime; ///< time of the current trial's decision
+	unsigned _tailKept; ///< timepoints kept after the current trial's decision
+	int _nDecisions; ///< trials committed
+	vector<double> _rows; ///< stored timepoints (trace ID, time relative to the decision, values) with storeTraces
+	vector<int> _n; ///< committed timepoints at each offset (offset + _window - 1)
+	vector<double> _mean; ///< running mean of each cell at each offset, by offset then cell
+	vector<double> _ssq; ///< running sum of square deviations of each cell at each offset, by offset then cell
 };
 
+/**
+ * @brief Per-timestep summary of the vectors (e.g. posteriors) recorded over many trials, in fixed memory. 
+ * @details Timepoints are aggregated by their step, round(time / timePerStep) (stimulus-locked, 
+ * like the times tasks record), rather than stored: for each step and each cell of the vector 
+ * it keeps a running mean and variance (Welford), and with quantileBins > 0 also a histogram of 
+ * the cell over [0, 1] in that many bins, from which quantiles are interpolated (to within a 
+ * bin width; values outside [0, 1] count in the end bins). Memory is nSteps * cells * 
+ * (2 + quantileBins) whatever the number of trials; timepoints past the last step are only 
+ * counted (getOverflow()). Batch and Event experiments record posteriors with it when 
+ * \ref aggregateTraces is set. 
+ * 
+ * The CSV is in long format: time,cell,n,mean,variance (and q<level> columns for the 
+ * quantile levels if there are bins), one row per recorded step and cell. 
+ */
+class TrajectoryDatum : public Datum<Timepoint> {
+public: 
+	TrajectoryDatum(double timePerStep=10, unsigned nSteps=1000, unsigned quantileBins=0, const vector<double> & quantileLevels={0.1, 0.5, 0.9}); 
+	virtual void record(const Timepoint & val); 
+	double getTimePerStep() const; 
+	unsigned getNSteps() const; 
+	unsigned getWidth() const; 
+	int getN(unsigned step) const; 
+	int getOverflow() const; 
+	arma::mat getMeans() const; 
+	arma::mat getVariances() const; 
+	double getQuantile(unsigned step, unsigned cell, double q) const; 
+	const vector<double> & getQuantileLevels() const; 
+	void merge(const TrajectoryDatum & other); 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual size_t bytesUsed() const; 
+protected: 
+	void _allocate(unsigned width); 
+	double _timePerStep; ///< width of a step
+	unsigned _nSteps; ///< number of steps kept
+	unsigned _quantileBins; ///< histogram bins per step and cell over [0, 1] (0 for no quantiles)
+	vector<double> _quantileLevels; ///< quantiles written to the CSV and columns
+	unsigned _width; ///< number of cells of the recorded vectors, 0 until the first record()
+	vector<int> _n; ///< timepoints recorded at each step
+	vector<double> _mean; ///< running mean of each cell, by step then cell
+	vector<double> _ssq; ///< running sum of square deviations of each cell, by step then cell
+	vector<int> _bins; ///< histogram counts, by step, then cell, then bin
+	int _overflow; ///< timepoints past the last step
+};
+
+/**
+ * @brief One row per trial, stored as columns. 
+ * @details Holds the trial ID, context and target of every trial, one column per trial-level 
+ * observation (e.g. RT, Resp, Acc) and a start and end column per event, each a contiguous 
+ * std::vector preallocated for the expected number of trials. A row is added the first time 
+ * something is recorded in a trial, with every column NaN (and context and target -1) until 
+ * set, so observations that don't happen on a trial (e.g. the sampling event of a premature 
+ * response) stay NaN. Columns and events are addressed by their position in the names passed 
+ * to the constructor. 
+ */
+class TrialTable : public IDatum {
+public: 
+	TrialTable(); 
+	TrialTable(const vector<string> & columnNames, const vector<string> & eventNames, unsigned expectedTrials); 
+	void setCondition(int context, int target); 
+	void record(unsigned column, double val); 
+	void recordEvent(unsigned event, const Event & val); 
+	virtual void newTrial(); 
+	unsigned getNRows() const; 
+	int getColumnId(const string & name) const; 
+	int getEventId(const string & name) const; 
+	const vector<int> & getTrialIds() const; 
+	const vector<int> & getContexts() const; 
+	const vector<int> & getTargets() const; 
+	const vector<double> & getColumn(unsigned column) const; 
+	const vector<double> & getEventStarts(unsigned event) const; 
+	const vector<double> & getEventEnds(unsigned event) const; 
+	virtual std::string getStringRepr() const; 
+	virtual void writeCsv(CsvWriter & out) const; 
+	virtual void writeColumns(ColumnFileWriter & out, const std::string & key) const; 
+	virtual size_t bytesUsed() const; 
+protected: 
+	void _row(); 
+	static void _writeField(CsvWriter & out, double x); 
+	vector<string> _columnNames; ///< names of the observation columns
+	vector<string> _eventNames; ///< names of the events
+	vector<int> _trialIds; ///< trial ID of each row
+	vector<int> _contexts; ///< context of each row
+	vector<int> _targets; ///< target of each row
+	vector<vector<double> > _columns; ///< observation columns
+	vector<vector<double> > _eventStarts; ///< event start time columns
+	vector<vector<double> > _eventEnds; ///< event end time columns
+}; 
+
 /**
  * @brief Recorder supports recording and storing arbitrary types from the simulator. 
+ * @details Datums live in an array of slots, with a string index used only at registration 
+ * and lookup time. Tasks get a DatumHandle per datum once and record through it. Recorder 
+ * also owns the trial counter: newTrial() increments it, and every registered datum reads 
+ * its trial IDs from it. 
  */
 class Recorder {
 public:
+	Recorder(); 
 	template<typename T> void registerDatum(const string & key, const T & ex); 
-	template<typename T> T getDatum(const string & key); 
+	template<typename T> const T & getDatum(const string & key); 
+	template<typename T> DatumHandle<T> getHandle(const string & key); 
+	bool hasDatum(const string & key); 
 	template<typename T> void updateDatum(const string & key, const T & val); 
+	template<typename T> void updateDatum(const DatumHandle<T> & handle, const typename DatumHandle<T>::value_type & val); 
+	template<typename T> void updateDatum(const DatumHandle<T> & handle, typename DatumHandle<T>::value_type && val); 
 	void printKnownKeys(); ///< mostly for debugging
 	void writeToFiles(string basedir); 
+	void setCsvShortest(bool shortest); 
+	void setAsyncWriter(AsyncWriter * writer); 
+	void streamToFiles(string basedir, size_t bufferBytes); 
+	void writeColumnFile(string filename); 
+	void registerTrialTable(const TrialTable & ex); 
+	TrialTable * getTrialTable(); 
+	/// What to do when the datums outgrow the memory budget (see setMemoryBudget()). 
+	enum MemoryPolicy {
+		SPILL, ///< stream the datums that can (traces) to files, and stop if that is not enough
+		FREEZE, ///< stop datums that keep every observation from storing more (keeping what they have), and stop if the rest keeps growing
+		STOP ///< stop recording
+	}; 
+	static MemoryPolicy memoryPolicyFromString(const string & name); 
+	void setMemoryBudget(size_t bytes, MemoryPolicy policy=STOP, const string & spillDir=""); 
+	size_t bytesUsed() const; 
+	std::map<string,size_t> getMemoryUsage() const; 
+	bool overMemoryBudget() const; 
+	void writeMemoryReport(std::ostream & out) const; 
 	virtual bool recordedEnough(); 
 	void newTrial(); 
+	int getTrialId(); 
 	void reset(); 
 
 protected:
-	typedef std::unordered_map<string,std::unique_ptr< IDatum > >::iterator umapi; ///< iterator for our map of datums
-	std::unordered_map<string,std::unique_ptr< IDatum > > _contents; ///< a hash map of IDatum holding all of our templated Datums. 
-	bool _empty; ///< \todo remove _empty, it is not used
+	void _enforceMemoryBudget(); 
+	int _slotOf(const string & key); 
+	typedef std::unordered_map<string,int>::iterator umapi; ///< iterator for our map of datum slots
+	std::unordered_map<string,int> _index; ///< slot of each datum by key (used at registration and lookup, not when recording through handles)
+	std::vector<std::unique_ptr< IDatum > > _slots; ///< all of our templated Datums, in registration order
+	int _trialId; ///< ID of the current trial (-1 before the first newTrial()), shared by all datums
+	TrialTable * _trialTable; ///< the registered TrialTable (owned by _slots), or nullptr
+	bool _csvShortest; ///< write CSVs with shortest round trip numbers (see setCsvShortest())
+	AsyncWriter * _asyncWriter; ///< background writer for output (not owned), or nullptr
+	size_t _memoryBudget; ///< bytes the datums may hold (0 for no budget)
+	MemoryPolicy _memoryPolicy; ///< what to do over budget
+	string _spillDir; ///< where SPILL streams to
+	bool _memoryActed; ///< has the policy's action (spill or freeze) been taken already?
+	size_t _memoryAtAction; ///< bytes held right after the policy's action
+	bool _memoryStopped; ///< stopped recording for memory
+	vector<string> _memoryLog; ///< what was done about the budget, and when, for writeMemoryReport()
 }; 
 
 /**
  * @brief Tell recorder about a datum. 
  * @details Recorder needs to know the data it will be recording, identified
- * by a string label and a Datum type. 
+ * by a string label and a Datum type. The datum is copied from the example, and 
+ * follows the Recorder's trial counter from then on. 
  * 
  * @param key The string key by which this datum can be accessed for read/write. 
- * @param ex An empty example of the kind of Datum this key points to 
- * (e.g. EventDatum()) so that we can do memory allocation. 
+ * @param ex An example of the kind of Datum this key points to 
+ * (e.g. EventDatum()), usually empty. 
  */
 template<typename T>
 void Recorder::registerDatum(const string & key, const T & ex){
 	#ifndef DISABLE_ERROR_CHECKS
-	if (_contents.find(key) != _contents.end()) throw fatal_error() << "ERROR: attempting to register datum " << key << " which was already registered!"; 
+	if (_index.find(key) != _index.end()) throw fatal_error() << "ERROR: attempting to register datum " << key << " which was already registered!"; 
 	#endif
-	_contents[key] = std::unique_ptr<T>(new T); 
+	_slots.push_back(std::unique_ptr<T>(new T(ex))); 
+	_slots.back()->attachTrialCounter(&_trialId); 
+	_slots.back()->attachAsyncWriter(_asyncWriter); 
+	_index[key] = _slots.size() - 1; 
 }
 
 /**
  * @brief Returns a datum by name. 
+ * @details Returns a reference to the stored datum, so bind it to a const reference 
+ * (rather than assigning it to a datum) to read results without copying them. 
  * @param key a string-valued name for the datum we want
  * @tparam T the type we should return. Casting up or down the Datum class 
- * hierarchy is supported and intended. 
+ * hierarchy is supported and intended (as long as the datum is a T). 
  */
 template<typename T>
-T Recorder::getDatum(const string & key){
+const T & Recorder::getDatum(const string & key){
+	IDatum * datum = _slots[_slotOf(key)].get(); 
 	#ifndef DISABLE_ERROR_CHECKS
-	if (_contents.find(key)==_contents.end()) throw fatal_error() << "ERROR: attempting to get datum " << key << " which was not registered to the recorder!"; 
+	if (dynamic_cast<T*>(datum) == nullptr) throw fatal_error() << "ERROR: datum " << key << " is not of the requested type!"; 
 	#endif
+	return *static_cast<T*>(datum);
+}
 
-	return *static_cast<T*>(_contents[key].get());
+/**
+ * @brief Get a stable handle for recording into a datum without string lookups. 
+ * @param key name of the datum
+ * @tparam T the type of observation the datum records (e.g. double, Event, Timepoint). 
+ */
+template<typename T>
+DatumHandle<T> Recorder::getHandle(const string & key){
+	int slot = _slotOf(key); 
+	#ifndef DISABLE_ERROR_CHECKS
+	if (dynamic_cast<Datum<T>*>(_slots[slot].get()) == nullptr) throw fatal_error() << "ERROR: datum " << key << " does not record the requested type!"; 
+	#endif
+	return DatumHandle<T>(slot); 
 }
 
 /**
  * @brief Update a datum with a new value. 
+ * @details Does a string lookup: fine for occasional use, but tasks should record through handles. 
  * @param key name of the datum
  * @param val value to record
  */
 template<typename T>
 void Recorder::updateDatum(const string& key, const T & val){
+	static_cast<Datum<T>*>(_slots[_slotOf(key)].get())->record(val); 
+}
+
+/**
+ * @brief Update a datum with a new value through its handle. 
+ * @param handle handle from Recorder::getHandle()
+ * @param val value to record
+ */
+template<typename T>
+inline void Recorder::updateDatum(const DatumHandle<T> & handle, const typename DatumHandle<T>::value_type & val){
+	#ifndef DISABLE_ERROR_CHECKS
+	if (handle.slot() < 0 || handle.slot() >= int(_slots.size())) throw fatal_error() << "ERROR: attempting to update datum through an invalid handle (slot " << handle.slot() << ")!"; 
+	#endif
+	static_cast<Datum<T>*>(_slots[handle.slot()].get())->record(val); 
+}
+
+/**
+ * @brief Update a datum with a temporary value through its handle (moved into the datum where it stores values). 
+ * @param handle handle from Recorder::getHandle()
+ * @param val value to record
+ */
+template<typename T>
+inline void Recorder::updateDatum(const DatumHandle<T> & handle, typename DatumHandle<T>::value_type && val){
 	#ifndef DISABLE_ERROR_CHECKS
-	if (_contents.find(key)==_contents.end()) throw fatal_error() << "ERROR: attempting to update datum " << key << " which was not registered to the recorder!"; 
+	if (handle.slot() < 0 || handle.slot() >= int(_slots.size())) throw fatal_error() << "ERROR: attempting to update datum through an invalid handle (slot " << handle.slot() << ")!"; 
 	#endif
-	static_cast<Datum<T>*>(_contents[key].get())->record(val); 
+	static_cast<Datum<T>*>(_slots[handle.slot()].get())->record(std::move(val)); 
 }
 
 /**
  * @brief Does nothing.
  */
 template<typename T>
-void DummyDatum<T>::record(T val){};
+void DummyDatum<T>::record(const T & val){};
 
 /**
  * @brief Does nothing.
  * @return an empty string. 
  */
 template<typename T>
-std::string DummyDatum<T>::getStringRepr(){
+std::string DummyDatum<T>::getStringRepr() const {
 	return std::string(""); 
 };
 
+/**
+ * @brief Bytes of memory the datum holds (just the object). 
+ */
+template<typename T>
+size_t DummyDatum<T>::bytesUsed() const {
+	return sizeof(*this); 
+}
+
 /**
  * @brief Initialize a vector of T
  * @tparam T type that can be stored in a std::vector
@@ -297,7 +976,7 @@ RawVectorsDatum<T>::RawVectorsDatum() {
  * @details Uses the kahan summation algorithm, should be pretty accurate. 
  */
 template<typename T>
-T RawVectorsDatum<T>::getMean(){
+T RawVectorsDatum<T>::getMean() const {
 	return utils::mean(_rawData);
 	
 }
@@ -307,7 +986,7 @@ T RawVectorsDatum<T>::getMean(){
  * @details Uses the kahan summation algorithm, should be pretty accurate. 
  */
 template<typename T>
-T RawVectorsDatum<T>::getVariance(){
+T RawVectorsDatum<T>::getVariance() const {
 	return utils::variance(_rawData);
 }
 
@@ -315,8 +994,9 @@ T RawVectorsDatum<T>::getVariance(){
  * @brief Add the current value to the vector. 
  */
 template<typename T>
-void RawVectorsDatum<T>::record(T val){
-	_traceIds.push_back(_latestTraceId);
+void RawVectorsDatum<T>::record(const T & val){
+	if (this->_frozen) return; 
+	_traceIds.push_back(this->_currentTrialId());
 	_rawData.push_back(val); 
 }
 
@@ -324,29 +1004,96 @@ void RawVectorsDatum<T>::record(T val){
  * @brief Return the number of observations so far. 
  */
  template<typename T>
-int RawVectorsDatum<T>::getN(){
+int RawVectorsDatum<T>::getN() const {
 	return _rawData.size();  
 }
 
 /**
- * @brief Return the raw observation vector so far. 
+ * @brief Return the raw observation vector so far (by reference, bind to a const reference to avoid a copy). 
  */
 template<typename T>
-vector<T> RawVectorsDatum<T>::getRawData(){
+const vector<T> & RawVectorsDatum<T>::getRawData() const {
 	return _rawData; 
 }
 
+/**
+ * @brief Return the trial IDs of the observations. 
+ */
+template<typename T>
+const vector<int> & RawVectorsDatum<T>::getTraceIds() const {
+	return _traceIds; 
+}
+
+/**
+ * @brief Iterate over the observations of each trial (positions into getRawData()). 
+ */
+template<typename T>
+TrialSegments RawVectorsDatum<T>::getSegments() const {
+	return TrialSegments(_traceIds); 
+}
+
+/**
+ * @brief Append another datum's observations to this one's, as trials after this one's last. 
+ * @details The other datum's trial IDs are offset by one past the largest of ours, so the 
+ * trials of two shards stay distinct and in order (see getSegments()). 
+ */
+template<typename T>
+void RawVectorsDatum<T>::merge(const RawVectorsDatum<T> & other){
+	int offset = _traceIds.empty() ? 0 : *std::max_element(_traceIds.begin(), _traceIds.end()) + 1; 
+	_rawData.insert(_rawData.end(), other._rawData.begin(), other._rawData.end()); 
+	_traceIds.reserve(_traceIds.size() + other._traceIds.size()); 
+	for (int id : other._traceIds) _traceIds.push_back(id + offset); 
+	if (!_traceIds.empty()) this->_latestTraceId = std::max(this->_latestTraceId, _traceIds.back()); // standalone, later trials come after the merged ones
+}
+
 /**
  * @brief Return a comma-separated string representation of the observation vector. 
  */
 template<typename T>
-std::string RawVectorsDatum<T>::getStringRepr(){
-	std::ostringstream out; 
+std::string RawVectorsDatum<T>::getStringRepr() const {
+	return this->_csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+template<typename T>
+size_t RawVectorsDatum<T>::bytesUsed() const {
+	return sizeof(*this) + this->_bytesOf(_rawData) + this->_bytesOf(_traceIds); 
+}
+
+/**
+ * @brief Stop storing observations: the ones stored so far stay, and getMean(), getVariance() and getN() describe them. 
+ */
+template<typename T>
+bool RawVectorsDatum<T>::freeze(){
+	this->_frozen = true; 
+	return true; 
+}
+
+/**
+ * @brief Write "trial,value" rows (values as std::ostream would print them). 
+ */
+template<typename T>
+void RawVectorsDatum<T>::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::GENERAL, 6); 
 	// assume one per trial ID
 	for (unsigned i = 0; i<_rawData.size(); ++i){
-		out << _traceIds[i] << ","<< _rawData[i] << std::endl; 
+		out.field(_traceIds[i]); 
+		out.field(_rawData[i]); 
+		out.endRow(); 
 	}
-	return out.str(); 
+}
+
+/**
+ * @brief Write the observations as columns trial and value, indexed by trial. 
+ */
+template<typename T>
+void RawVectorsDatum<T>::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	out.beginDatum(key, _rawData.size()); 
+	out.column("trial", _traceIds.data()); 
+	out.column("value", _rawData.data()); 
+	out.index(getSegments()); 
 }
 
 /**
@@ -355,26 +1102,153 @@ std::string RawVectorsDatum<T>::getStringRepr(){
  */
 template<typename T>
 void RawVectorsDatum<T>::newTrial(){
-	++_latestTraceId; 
+	++this->_latestTraceId; 
+}
+
+/**
+ * @brief Constructor for SampledRawVectorsDatum. 
+ * @param reservoir the condition's TrialReservoir (share it with the condition's other sampled datums)
+ */
+template<typename T>
+SampledRawVectorsDatum<T>::SampledRawVectorsDatum(std::shared_ptr<TrialReservoir> reservoir): _reservoir(reservoir), _slots(reservoir->getCapacity()), _slotTrials(reservoir->getCapacity(), -1) {}
+
+/**
+ * @brief Add the value to the exact summary, and keep it if its trial is in the sample. 
+ */
+template<typename T>
+void SampledRawVectorsDatum<T>::record(const T & val){
+	_summary.record(val); 
+	int trial = this->_currentTrialId(); 
+	int slot = _reservoir->slotFor(trial); 
+	if (slot < 0) return; 
+	if (_slotTrials[slot] != trial){
+		_slotTrials[slot] = trial; 
+		_slots[slot].clear(); 
+	}
+	_slots[slot].push_back(val); 
 }
 
+/**
+ * @brief Return the mean of all observations (exact, not just the sampled trials). 
+ */
 template<typename T>
-IncrementalMeanVarianceDatum<T>::IncrementalMeanVarianceDatum(): _mean(0), _ssq(0), _n(0) {}
+T SampledRawVectorsDatum<T>::getMean() const {
+	return _summary.getMean(); 
+}
+
+/**
+ * @brief Return the variance of all observations (exact, not just the sampled trials). 
+ */
+template<typename T>
+T SampledRawVectorsDatum<T>::getVariance() const {
+	return _summary.getVariance(); 
+}
+
+/**
+ * @brief Return the number of all observations (not just the sampled ones). 
+ */
+template<typename T>
+int SampledRawVectorsDatum<T>::getN() const {
+	return _summary.getN(); 
+}
+
+/**
+ * @brief Return the observations of the sampled trials, in trial order. 
+ */
+template<typename T>
+vector<T> SampledRawVectorsDatum<T>::getRawData() const {
+	vector<T> data; 
+	for (unsigned slot : _reservoir->keptSlots()){
+		if (_slotTrials[slot] != _reservoir->trialInSlot(slot)) continue; 
+		data.insert(data.end(), _slots[slot].begin(), _slots[slot].end()); 
+	}
+	return data; 
+}
+
+/**
+ * @brief Return the trial IDs of getRawData(). 
+ */
+template<typename T>
+vector<int> SampledRawVectorsDatum<T>::getTraceIds() const {
+	vector<int> ids; 
+	for (unsigned slot : _reservoir->keptSlots()){
+		if (_slotTrials[slot] != _reservoir->trialInSlot(slot)) continue; 
+		ids.insert(ids.end(), _slots[slot].size(), _slotTrials[slot]); 
+	}
+	return ids; 
+}
+
+/**
+ * @brief Return the CSV of the sampled trials (see writeCsv()). 
+ */
+template<typename T>
+std::string SampledRawVectorsDatum<T>::getStringRepr() const {
+	return this->_csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+template<typename T>
+size_t SampledRawVectorsDatum<T>::bytesUsed() const {
+	size_t bytes = sizeof(*this) + this->_bytesOf(_slots) + this->_bytesOf(_slotTrials); 
+	for (const vector<T> & slot : _slots) bytes += this->_bytesOf(slot); 
+	return bytes; 
+}
+
+/**
+ * @brief Write "trial,value" rows of the sampled trials, like RawVectorsDatum. 
+ */
+template<typename T>
+void SampledRawVectorsDatum<T>::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::GENERAL, 6); 
+	vector<T> data = getRawData(); 
+	vector<int> ids = getTraceIds(); 
+	for (unsigned i = 0; i<data.size(); ++i){
+		out.field(ids[i]); 
+		out.field(data[i]); 
+		out.endRow(); 
+	}
+}
+
+/**
+ * @brief Write the sampled observations as columns trial and value, indexed by trial. 
+ */
+template<typename T>
+void SampledRawVectorsDatum<T>::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	vector<T> data = getRawData(); 
+	vector<int> ids = getTraceIds(); 
+	out.beginDatum(key, data.size()); 
+	out.column("trial", ids.data()); 
+	out.column("value", data.data()); 
+	out.index(TrialSegments(ids)); 
+}
+
+/**
+ * @brief Register a new trial. 
+ */
+template<typename T>
+void SampledRawVectorsDatum<T>::newTrial(){
+	++this->_latestTraceId; 
+}
+
+template<typename T>
+IncrementalMeanVarianceDatum<T>::IncrementalMeanVarianceDatum() {}
 
 /**
  * @brief Return the mean of the observations so far. 
  */
 template<typename T>
-T IncrementalMeanVarianceDatum<T>::getMean(){
-	return _mean; 
+T IncrementalMeanVarianceDatum<T>::getMean() const {
+	return _moments.getMean(); 
 }
 
 /**
  * @brief Return the variance of the observations so far. 
  */
 template<typename T>
-T IncrementalMeanVarianceDatum<T>::getVariance(){
-	return _ssq / (_n-1); 
+T IncrementalMeanVarianceDatum<T>::getVariance() const {
+	return _moments.getVariance(); 
 }
 
 /**
@@ -382,19 +1256,26 @@ T IncrementalMeanVarianceDatum<T>::getVariance(){
  * @details \sa https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
  */
 template<typename T>
-void IncrementalMeanVarianceDatum<T>::record(T val){
-	T oldMean = _mean; 
-	++_n;
-	_mean += _n == 0 ? val : (val - oldMean) / _n;
-	_ssq += (val - oldMean) * (val - _mean);
+void IncrementalMeanVarianceDatum<T>::record(const T & val){
+	_moments.record(val); 
 }
 
 /**
  * @brief Return the number of observations in the datum. 
  */
 template<typename T>
-int  IncrementalMeanVarianceDatum<T>::getN(){
-	return _n; 
+int  IncrementalMeanVarianceDatum<T>::getN() const {
+	return _moments.getN(); 
+}
+
+/**
+ * @brief Add another datum's observations to this one (exactly, up to rounding). 
+ * @details So e.g. runs of the same parameters on several machines give what one long run 
+ * would have (see utils::RunningMoments::merge()). 
+ */
+template<typename T>
+void IncrementalMeanVarianceDatum<T>::merge(const IncrementalMeanVarianceDatum<T> & other){
+	_moments.merge(other._moments); 
 }
 
 /**
@@ -402,10 +1283,41 @@ int  IncrementalMeanVarianceDatum<T>::getN(){
  * @return "mean,variance,n"
  */
 template<typename T>
-std::string IncrementalMeanVarianceDatum<T>::getStringRepr(){
-	std::ostringstream out; 
-	out << _mean << "," << (_ssq / (_n-1)) << "," << _n << std::endl; 
-	return out.str(); 
+std::string IncrementalMeanVarianceDatum<T>::getStringRepr() const {
+	return this->_csvString(); 
+}
+
+/**
+ * @brief Bytes of memory the datum holds (see IDatum::bytesUsed()). 
+ */
+template<typename T>
+size_t IncrementalMeanVarianceDatum<T>::bytesUsed() const {
+	return sizeof(*this); 
+}
+
+/**
+ * @brief Write the "mean,variance,n" row. 
+ */
+template<typename T>
+void IncrementalMeanVarianceDatum<T>::writeCsv(CsvWriter & out) const {
+	out.setFormat(CsvWriter::GENERAL, 6); 
+	out.field(_moments.getMean()); 
+	out.field(getVariance()); 
+	out.field(_moments.getN()); 
+	out.endRow(); 
+}
+
+/**
+ * @brief Write the datum as a single row with columns mean, variance and n. 
+ */
+template<typename T>
+void IncrementalMeanVarianceDatum<T>::writeColumns(ColumnFileWriter & out, const std::string & key) const {
+	T mean = _moments.getMean(), variance = getVariance(); 
+	int n = _moments.getN(); 
+	out.beginDatum(key, 1); 
+	out.column("mean", &mean); 
+	out.column("variance", &variance); 
+	out.column("n", &n); 
 }
 
 
@@ -78,6 +78,18 @@ double RNG::dnorm(double x, double m, double s){
   return inv_sqrt_2pi / s * std::exp(-0.5f * a * a);
 }
 
+/**
+ * @brief Compute gaussian cumulative distribution function. 
+ * @param x point to evaluate the CDF
+ * @param m mean of the gaussian
+ * @param s standard deviation of the gaussian
+ * @return \f$P(X \leq x)\f$ for \f$X \sim N(m, s^2)\f$
+ */
+double RNG::pnorm(double x, double m, double s){
+  static const double inv_sqrt_2 = 0.7071067811865475;
+  return 0.5 * std::erfc(-(x - m) / s * inv_sqrt_2);
+}
+
 /**
  * @brief Generate random gamma variates parameterized by expected value and variance.
  * @details Gamma scale and shape are hard to interpret, so it's easier to use
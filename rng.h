@@ -22,6 +22,7 @@ class RNG{
 		static int runif_int(const int max); 
 		static int rbernoulli(const double p); 
 		static double dnorm(const double x, const double m, const double s); 
+		static double pnorm(const double x, const double m, const double s); 
 };
 
 #endif
@@ -20,9 +20,7 @@ void Task::drawTrialType(){
     for (unsigned c = 0; c < _trialDist.n_rows; ++c){
         for (unsigned t = 0; t < _trialDist.n_cols; ++t){
             if (p <= (_trialDist(c, t) + probSoFar)){
-                _context = c;
-                _target = t;
-                _trialLabel = "Context" + to_string(_context) + "_Target" + to_string(_target) + "_"; 
+                _setTrialType(c, t); 
                 return; 
             }
             probSoFar += _trialDist(c, t);
@@ -33,6 +31,87 @@ void Task::drawTrialType(){
     #endif
 }
 
+/**
+ * @brief Set the context and target of the current trial, and the matching _condition. 
+ */
+void Task::_setTrialType(int context, int target){
+    _context = context;
+    _target = target;
+    _condition = context * _trialDist.n_cols + target; 
+    if (_trialTable != nullptr) _trialTable->setCondition(context, target); 
+}
+
+/**
+ * @brief Prefix of the Recorder keys of the datums of a trial type, e.g. "Context0_Target1_". 
+ */
+std::string Task::conditionLabel(int context, int target){
+    return "Context" + to_string(context) + "_Target" + to_string(target) + "_"; 
+}
+
+/**
+ * @brief Look up handles for all datums of all trial types in the Recorder. 
+ * @details Called by Experiment::run() once the datums are registered (and again 
+ * after every Recorder::reset(), since that invalidates handles). If the Recorder has a 
+ * TrialTable, summary and event datums go there (with the datum IDs as its column and 
+ * event positions), and only trace datums are looked up per trial type. CAF datums 
+ * (see _recordResponse()) are looked up if the Experiment registered them. 
+ */
+void Task::bindDatums(){
+    _traceHandles.clear(); 
+    _summaryHandles.clear(); 
+    _eventHandles.clear(); 
+    _responseHandles.clear(); 
+    _trialTable = _recorder->getTrialTable(); 
+    bool caf = _recorder->hasDatum(conditionLabel(0, 0) + "CAF"); 
+    for (unsigned c = 0; c < _trialDist.n_rows; ++c){
+        for (unsigned t = 0; t < _trialDist.n_cols; ++t){
+            std::string label = conditionLabel(c, t); 
+            for (unsigned i=0; i<_traceDatumNames.size(); ++i){
+                _traceHandles.push_back(_recorder->getHandle<Timepoint>(label + _traceDatumNames[i])); 
+            }
+            if (caf) _responseHandles.push_back(_recorder->getHandle<Response>(label + "CAF")); 
+            if (_trialTable != nullptr) continue; 
+            for (unsigned i=0; i<_summaryDatumNames.size(); ++i){
+                _summaryHandles.push_back(_recorder->getHandle<double>(label + _summaryDatumNames[i])); 
+            }
+            for (unsigned i=0; i<_eventDatumNames.size(); ++i){
+                _eventHandles.push_back(_recorder->getHandle<Event>(label + _eventDatumNames[i])); 
+            }
+        }
+    }
+}
+
+/**
+ * @brief Position of name in names, throws if it is not there. 
+ */
+static unsigned datumId(const std::vector<std::string> & names, const std::string & name){
+    for (unsigned i=0; i<names.size(); ++i){
+        if (names[i] == name) return i; 
+    }
+    throw fatal_error() << "ERROR: task does not record a datum named " << name << "!"; 
+}
+
+/**
+ * @brief ID of a trace datum for _recordTrace() (look this up once, not per trial). 
+ */
+unsigned Task::_traceDatumId(const std::string & name){
+    return datumId(_traceDatumNames, name); 
+}
+
+/**
+ * @brief ID of a summary datum for _recordSummary() (look this up once, not per trial). 
+ */
+unsigned Task::_summaryDatumId(const std::string & name){
+    return datumId(_summaryDatumNames, name); 
+}
+
+/**
+ * @brief ID of an event datum for _recordEvent() (look this up once, not per trial). 
+ */
+unsigned Task::_eventDatumId(const std::string & name){
+    return datumId(_eventDatumNames, name); 
+}
+
 /**
  * @brief Getter for context for current trial. 
  */
@@ -68,6 +147,105 @@ std::vector<std::string> Task::getEventDatumNames(){
     return _eventDatumNames;
 }
 
+/**
+ * @brief Getter for the (sorted) decision thresholds swept in one pass, empty if not sweeping. 
+ */
+std::vector<double> Task::getDecisionThreshes(){
+    return _decisionThreshes;
+}
+
+/**
+ * @brief Set up a single-pass sweep over several decision thresholds, if the Config asks for one. 
+ * @details Reads \ref decisionThreshes (if set), sorts them ascending, and replaces the summary 
+ * datums with one copy of each of perThreshDatumNames per threshold, named by 
+ * Task::_threshDatumName(). Threshold indices refer to the sorted order. 
+ * 
+ * @param perThreshDatumNames summary datums the task records for every threshold
+ */
+void Task::_setupThresholdSweep(const std::vector<std::string> & perThreshDatumNames){
+    if (!_config->keyExists("decisionThreshes")) return; 
+    arma::vec threshes = arma::sort(arma::vectorise(_config->get<mat>("decisionThreshes"))); 
+    #ifndef DISABLE_ERROR_CHECKS
+    if (threshes.empty()) throw fatal_error() << "ERROR: decisionThreshes is set but empty!"; 
+    if (threshes.min() <= 0.5 || threshes.max() >= 1) throw fatal_error() << "ERROR: decisionThreshes should all be in (0.5, 1) (thresholds are in prob space, not log space), got " << threshes.t(); 
+    #endif
+    _decisionThreshes = arma::conv_to<std::vector<double> >::from(threshes); 
+    _summaryDatumNames.clear(); 
+    for (unsigned k=0; k<_decisionThreshes.size(); ++k){
+        for (unsigned i=0; i<perThreshDatumNames.size(); ++i){
+            _summaryDatumNames.push_back(_threshDatumName(k, perThreshDatumNames[i])); 
+        }
+    }
+}
+
+/**
+ * @brief Name of the summary datum for threshold k in a threshold sweep, e.g. "Thresh0_RT". 
+ */
+std::string Task::_threshDatumName(unsigned k, const std::string & name){
+    return "Thresh" + to_string(k) + "_" + name; 
+}
+
+/**
+ * @brief Summary datum IDs of name for every threshold in the sweep (empty if not sweeping). 
+ */
+std::vector<unsigned> Task::_threshDatumIds(const std::string & name){
+    std::vector<unsigned> ids; 
+    for (unsigned k=0; k<_decisionThreshes.size(); ++k){
+        ids.push_back(_summaryDatumId(_threshDatumName(k, name))); 
+    }
+    return ids; 
+}
+
+/**
+ * @brief Give the task a DecisionCache to store its decisions in (and replay them from). 
+ * @details The cache key is computed from the Config here, so set the cache after the Config is final. 
+ * Not supported together with \ref decisionThreshes, since a trial then makes several decisions. 
+ * 
+ * @param cache the DecisionCache, owned by the caller (nullptr to stop caching)
+ */
+void Task::setDecisionCache(DecisionCache * cache){
+    #ifndef DISABLE_ERROR_CHECKS
+    if (cache != nullptr && !_decisionThreshes.empty()) throw fatal_error() << "ERROR: decision caching does not support decisionThreshes!"; 
+    #endif
+    _decisionCache = cache; 
+    _decisionKey = cache == nullptr ? "" : DecisionCache::decisionKey(_config); 
+}
+
+/**
+ * @brief Getter for the DecisionCache (nullptr if not caching). 
+ */
+DecisionCache * Task::getDecisionCache(){
+    return _decisionCache; 
+}
+
+/**
+ * @brief Getter for the key of this task's Config in the DecisionCache. 
+ */
+std::string Task::getDecisionKey(){
+    return _decisionKey; 
+}
+
+/**
+ * @brief Replay a cached decision, drawing new nondecision times. 
+ * @details Tasks that support DecisionCache override this to set the trial type and 
+ * record the same trial-level datums run() would, given the cached decision. 
+ */
+void Task::replay(const DecisionSample & /*s*/){
+    throw fatal_error() << "ERROR: this task does not support replaying cached decisions!"; 
+}
+
+/**
+ * @brief Store the decision of the current trial in the DecisionCache, if there is one. 
+ * @param decisionTime time of the decision (in ms, from the start of decision sampling)
+ * @param resp the response
+ * @param premature true if this was a premature response made without sampling
+ */
+void Task::_cacheDecision(double decisionTime, int resp, bool premature){
+    if (_decisionCache == nullptr) return; 
+    DecisionSample s = {_context, _target, decisionTime, resp, premature}; 
+    _decisionCache->record(s); 
+}
+
 /**
  * @brief Verify that the distribution of trial (context,target) types sums to 1, else throw error
  */
@@ -80,7 +258,7 @@ void Task::_checkTrialDistProperness(){
  * @param c Config, containing at least \ref trialDist. 
  * * @param r Recorder (empty). 
  */
-Task::Task(const Config * c, Recorder * r):_context(-1), _target(-1){
+Task::Task(const Config * c, Recorder * r):_context(-1), _target(-1), _condition(-1), _trialTable(nullptr){
     _config = c; 
     _recorder = r; 
     _trialDist = c->get<mat>("trialDist");
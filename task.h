@@ -2,12 +2,14 @@
 #define TASK_H
 
 class Config;
-class Recorder;
 
 #include <armadillo>
 #include <string>
+#include <vector>
 #include "architecture.h"
 #include "belief.h"
+#include "decisioncache.h"
+#include "recorder.h"
 
 using arma::mat; 
 using std::to_string; 
@@ -18,7 +20,10 @@ using std::to_string;
  *  first, an event loop in run(). Second, _traceDatumNames, 
  *  _summaryDatumNames and _eventDatumNames for things that run() will record. 
  *  The relevant subclass of Experiment will take care of registering those 
- *  Datum's with Recorder. 
+ *  Datum's with Recorder, and of calling bindDatums() before the first trial. 
+ *  run() then records with _recordTrace(), _recordSummary() and _recordEvent(), 
+ *  using datum IDs looked up once in the constructor (e.g. with _summaryDatumId()), 
+ *  so no strings are built or hashed per trial. 
  */
 class Task{
 public:
@@ -30,21 +35,85 @@ public:
     std::vector<std::string> getTraceDatumNames();
     std::vector<std::string> getSummaryDatumNames();
     std::vector<std::string> getEventDatumNames();
+    std::vector<double> getDecisionThreshes();
+    void setDecisionCache(DecisionCache * cache);
+    DecisionCache * getDecisionCache();
+    std::string getDecisionKey();
+    virtual void replay(const DecisionSample & s);
+    void bindDatums();
+    static std::string conditionLabel(int context, int target);
 
 protected: 
     void _checkTrialDistProperness();
+    void _setTrialType(int context, int target);
+    void _cacheDecision(double decisionTime, int resp, bool premature=false);
+    void _setupThresholdSweep(const std::vector<std::string> & perThreshDatumNames);
+    static std::string _threshDatumName(unsigned k, const std::string & name);
+    std::vector<unsigned> _threshDatumIds(const std::string & name);
+    unsigned _traceDatumId(const std::string & name);
+    unsigned _summaryDatumId(const std::string & name);
+    unsigned _eventDatumId(const std::string & name);
+    void _recordTrace(unsigned id, const Timepoint & val);
+    void _recordSummary(unsigned id, double val);
+    void _recordEvent(unsigned id, const Event & val);
+    void _recordResponse(double rt, bool correct);
     const Config * _config; ///< pointer to the config object
     Recorder * _recorder; ///< pointer to recorder 
     mat _trialDist; ///< distribution of stimuli to show in trials
     int _context; ///< holds context for current trial
     int _target; ///< holds target for current trial
-    std::string _trialLabel; ///< string label for current trial type (used to access Datums in Recorder)
+    int _condition; ///< index of the current trial type, context * nTargets + target (used to find the Datums of the trial in the handle arrays)
     std::vector<std::string> _traceDatumNames = {}; ///< names of datums that should use TraceDatum() (Experiment uses them to set up the Recorder)
     std::vector<std::string> _summaryDatumNames = {}; ///< names of datums that should use some SummaryDatum() (Experiment uses them to set up the Recorder)
     std::vector<std::string> _eventDatumNames = {}; ///< names of datums that should use some EventDatum() (Experiment uses them to set up the Recorder)
+    std::vector<double> _decisionThreshes = {}; ///< sorted thresholds to sweep in one pass (see \ref decisionThreshes), empty if not sweeping
+    DecisionCache * _decisionCache = nullptr; ///< cache of decisions for replaying with new nondecision times, or nullptr if not caching
+    std::string _decisionKey; ///< key of this task's Config in the DecisionCache
+    std::vector<DatumHandle<Timepoint> > _traceHandles; ///< handles of the trace datums, indexed by condition * _traceDatumNames.size() + datum ID (filled by bindDatums())
+    std::vector<DatumHandle<double> > _summaryHandles; ///< handles of the summary datums, indexed like _traceHandles
+    std::vector<DatumHandle<Event> > _eventHandles; ///< handles of the event datums, indexed like _traceHandles
+    std::vector<DatumHandle<Response> > _responseHandles; ///< handles of the per-condition "CAF" datums, indexed by condition, or empty if the Recorder has none
+    TrialTable * _trialTable; ///< the Recorder's TrialTable, which gets summary and event datums instead of the handles if it is not nullptr
 
 };
 
+/**
+ * @brief Record a Timepoint into trace datum id of the current trial type. 
+ */
+inline void Task::_recordTrace(unsigned id, const Timepoint & val){
+    _recorder->updateDatum(_traceHandles[_condition * _traceDatumNames.size() + id], val); 
+}
+
+/**
+ * @brief Record an observation into summary datum id of the current trial type (or into the TrialTable). 
+ */
+inline void Task::_recordSummary(unsigned id, double val){
+    if (_trialTable != nullptr){
+        _trialTable->record(id, val); 
+        return; 
+    }
+    _recorder->updateDatum(_summaryHandles[_condition * _summaryDatumNames.size() + id], val); 
+}
+
+/**
+ * @brief Record an Event into event datum id of the current trial type (or into the TrialTable). 
+ */
+inline void Task::_recordEvent(unsigned id, const Event & val){
+    if (_trialTable != nullptr){
+        _trialTable->recordEvent(id, val); 
+        return; 
+    }
+    _recorder->updateDatum(_eventHandles[_condition * _eventDatumNames.size() + id], val); 
+}
+
+/**
+ * @brief Record the response of the current trial into the CAF datum of its trial type, if there is one (see \ref batchCaf). 
+ */
+inline void Task::_recordResponse(double rt, bool correct){
+    if (_responseHandles.empty()) return; 
+    _recorder->updateDatum(_responseHandles[_condition], Response(rt, correct)); 
+}
+
 /**
  * @brief Task stub for testing. 
  */
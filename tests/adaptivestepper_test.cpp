@@ -0,0 +1,115 @@
+#include "catch_main.h"
+#include "../adaptivestepper.h"
+#include "../belief.h"
+#include "../config.h"
+#include "../rng.h"
+#include <armadillo>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+using arma::mat;
+
+TEST_CASE("Belief updates from sums of samples"){
+	Config conf; 
+	conf.set("urPrior", "0.45 0.05; 0.05 0.45"); 
+	Belief b(&conf); 
+	b.setTrueStim(0, 1); 
+
+	SECTION("One sample matches the single-sample likelihood"){
+		b.updateFromSum(Target, 0.7, 1, 2); 
+		mat expected = conf.get<mat>("urPrior"); 
+		for (unsigned i=0; i<2; ++i){
+			for (unsigned j=0; j<2; ++j){
+				expected(i,j) *= RNG::dnorm(0.7, j, 2); 
+			}
+		}
+		expected = expected / accu(expected); 
+		mat post = b.getBelief(); 
+		for (unsigned k=0; k<4; ++k){
+			REQUIRE(post(k) == Approx(expected(k))); 
+		}
+	}
+
+	SECTION("Updating from two sums is the same as from their total"){
+		Belief b2(&conf); 
+		b.updateFromSum(Context, 1.5, 3, 1.2); 
+		b.updateFromSum(Context, -0.4, 2, 1.2); 
+		b2.updateFromSum(Context, 1.1, 5, 1.2); 
+		mat post = b.getBelief(); 
+		mat post2 = b2.getBelief(); 
+		for (unsigned k=0; k<4; ++k){
+			REQUIRE(post(k) == Approx(post2(k))); 
+		}
+	}
+
+	SECTION("Large sums don't underflow"){
+		b.updateFromSum(Target, 5000, 5000, 3); 
+		mat post = b.getBelief(); 
+		REQUIRE(accu(post) == Approx(1)); 
+		double target1 = post(0,1) + post(1,1); 
+		REQUIRE(target1 > 0.99); 
+	}
+}
+
+// Two-sample Kolmogorov-Smirnov statistic: the largest distance between the empirical CDFs of a and b. 
+static double ksStatistic(std::vector<int> a, std::vector<int> b){
+	std::sort(a.begin(), a.end()); 
+	std::sort(b.begin(), b.end()); 
+	unsigned i = 0, j = 0; 
+	double d = 0; 
+	while (i < a.size() && j < b.size()){
+		int x = std::min(a[i], b[j]); 
+		while (i < a.size() && a[i] == x) ++i; 
+		while (j < b.size() && b[j] == x) ++j; 
+		d = std::max(d, std::fabs(double(i) / a.size() - double(j) / b.size())); 
+	}
+	return d; 
+}
+
+TEST_CASE("AdaptiveStepper matches stepping through every timestep at the default tolerance"){
+	Config conf; 
+	conf.set("urPrior", "0.45 0.05; 0.05 0.45"); 
+	conf.set("decisionThresh", 0.9); // adaptiveCrossingTol unset, so the default 1e-4
+	double contextNoise = 9, targetNoise = 9; 
+	mat dvWeights = "1 0; 1 0"; // flanker: marginal probability of target 0
+	int n = 10000; 
+	Belief b(&conf); 
+	AdaptiveStepper stepper(&conf, &b, dvWeights, contextNoise, 2, targetNoise, 1); 
+	int adaptiveCorrect = 0, steppedCorrect = 0; 
+	std::vector<int> adaptiveSteps, steppedSteps; 
+	for (int i=0; i<n; ++i){
+		b.setTrueStim(1, 0); // incongruent
+		b.reset(); 
+		double dv; 
+		int steps = stepper.run(100000, dv); 
+		adaptiveSteps.push_back(steps); 
+		adaptiveCorrect += dv > 0.5; 
+
+		b.reset(); 
+		for (int samp=1; samp<=100000; ++samp){
+			b.updateFromContext(contextNoise); 
+			b.updateFromContext(contextNoise); 
+			b.updateFromTarget(targetNoise); 
+			mat post = b.getBelief(); 
+			dv = post(0,0) + post(1,0); 
+			if (dv > 0.9 || dv < 0.1){
+				steppedSteps.push_back(samp); 
+				steppedCorrect += dv > 0.5; 
+				break; 
+			}
+		}
+	}
+	double adaptiveAcc = double(adaptiveCorrect) / n; 
+	double steppedAcc = double(steppedCorrect) / n; 
+	double adaptiveMean = std::accumulate(adaptiveSteps.begin(), adaptiveSteps.end(), 0.0) / n; 
+	double steppedMean = std::accumulate(steppedSteps.begin(), steppedSteps.end(), 0.0) / n; 
+	double blocksPerTrial = double(stepper.getBlocksComputed()) / n; 
+	REQUIRE(steppedSteps.size() == unsigned(n)); 
+	REQUIRE(adaptiveAcc == Approx(steppedAcc).epsilon(0.03)); 
+	REQUIRE(adaptiveMean == Approx(steppedMean).epsilon(0.04)); 
+	// the whole distribution of decision steps: KS critical value at alpha 0.001 is 1.95 * sqrt(2 / n)
+	REQUIRE(ksStatistic(adaptiveSteps, steppedSteps) < 1.95 * sqrt(2.0 / n)); 
+	REQUIRE(blocksPerTrial < steppedMean / 3); 
+}
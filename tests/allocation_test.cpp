@@ -0,0 +1,100 @@
+#include "catch_main.h"
+#include "../task.h"
+#include "../config.h"
+#include "../recorder.h"
+#include "../experiment.h"
+#include "../examples/Flanker/flanker.h"
+#include "../examples/AX-CPT/axcpt.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations: operator new is replaced here, and with WRAP_MALLOC (GNU ld's
+// --wrap, see CMakeLists.txt) so are malloc and posix_memalign, which armadillo allocates
+// its larger matrices with. Built as its own binary, so the replacement stays out of the others.
+static std::atomic<long> allocations(0);
+
+#ifdef WRAP_MALLOC
+extern "C" {
+void * __real_malloc(size_t n);
+int __real_posix_memalign(void ** p, size_t alignment, size_t n);
+void * __wrap_malloc(size_t n){
+	++allocations;
+	return __real_malloc(n);
+}
+int __wrap_posix_memalign(void ** p, size_t alignment, size_t n){
+	++allocations;
+	return __real_posix_memalign(p, alignment, n);
+}
+}
+#endif
+
+void * operator new(size_t n){
+	#ifndef WRAP_MALLOC
+	++allocations; // else counted in malloc
+	#endif
+	void * p = std::malloc(n > 0 ? n : 1);
+	if (p == nullptr) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void * p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+	std::free(p);
+}
+
+// defaults of the flanker and AX-CPT runners
+static Config loopConfig(int trials){
+	Config conf;
+	conf.set("timePerStep", 10);
+	conf.set("retentionIntervalDur", 200);
+	conf.set("maxTrials", trials);
+	conf.set("maxSamps", 10000);
+	conf.set("contextNoise", 3);
+	conf.set("targetNoise", 3);
+	conf.set("decisionThresh", 0.95);
+	conf.set("eblMean", 50);
+	conf.set("motorPlanMean", 150);
+	conf.set("motorExecMean", 150);
+	conf.set("eblSd", 20);
+	conf.set("motorSd", 50);
+	conf.set("urPrior", "0.4 0.3; 0.2 0.1");
+	conf.set("trialDist", "0.4 0.3; 0.2 0.1");
+	conf.set("nContexts", 2);
+	conf.set("nTargets", 2);
+	conf.set("decayRate", 0.01);
+	conf.set("pPrematureResp", 0.05);
+	return conf;
+}
+
+// Heap allocations made by a batch run of the given number of trials (setup included).
+template<typename TaskType>
+static long allocationsOfBatchRun(int trials){
+	Config conf = loopConfig(trials);
+	Recorder r;
+	TaskType t(&conf, &r);
+	BatchExperiment experiment(&conf, &t, &r);
+	long before = allocations;
+	experiment.run();
+	return allocations - before;
+}
+
+TEST_CASE("The batch trial loop doesn't allocate"){
+	// setup allocates the same whatever the number of trials, so any difference is the trials'
+	SECTION("Flanker"){
+		long few = allocationsOfBatchRun<FlankerTask>(1000);
+		long many = allocationsOfBatchRun<FlankerTask>(10000);
+		REQUIRE(few > 0); // the counter works
+		REQUIRE(many == few);
+	}
+
+	SECTION("AX-CPT"){
+		long few = allocationsOfBatchRun<AxcptTask>(1000);
+		long many = allocationsOfBatchRun<AxcptTask>(10000);
+		REQUIRE(few > 0);
+		REQUIRE(many == few);
+	}
+}
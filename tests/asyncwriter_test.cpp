@@ -0,0 +1,89 @@
+#include "catch_main.h"
+#include "../asyncwriter.h"
+#include "../recorder.h"
+#include <armadillo>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <stdexcept>
+
+using std::vector;
+
+static std::string readFile(const std::string & filename){
+	std::ifstream f(filename);
+	std::stringstream contents;
+	contents << f.rdbuf();
+	return contents.str();
+}
+
+TEST_CASE("AsyncWriter"){
+	SECTION("Jobs run in order and flush waits for them"){
+		AsyncWriter w(2); // small queue, so submit has to wait
+		vector<int> done;
+		for (int i=0; i<100; ++i){
+			w.submit([&done, i]{ done.push_back(i); });
+		}
+		w.flush();
+		REQUIRE(done.size() == 100);
+		bool inOrder = true;
+		for (int i=0; i<100; ++i) inOrder = inOrder && done[i] == i;
+		REQUIRE(inOrder);
+	}
+
+	SECTION("Exceptions from jobs come back at the barrier"){
+		AsyncWriter w;
+		w.submit([]{ throw std::runtime_error("disk full"); });
+		REQUIRE_THROWS(w.flush());
+		REQUIRE_NOTHROW(w.flush());
+	}
+
+	SECTION("Close runs what's left and refuses new jobs"){
+		AsyncWriter w;
+		int n = 0;
+		for (int i=0; i<10; ++i) w.submit([&n]{ ++n; });
+		w.close();
+		REQUIRE(n == 10);
+		REQUIRE_FALSE(w.isOpen());
+		REQUIRE_THROWS(w.submit([]{}));
+	}
+}
+
+TEST_CASE("Recorder output through an AsyncWriter"){
+	arma::vec v(3);
+	Recorder direct, async;
+	AsyncWriter w;
+	async.setAsyncWriter(&w);
+	Recorder * recorders[2] = {&direct, &async};
+	for (Recorder * r : recorders){
+		r->registerDatum("trace", TraceDatum());
+		r->registerDatum("rt", RawVectorsDatum<double>());
+		r->registerDatum("ev", EventDatum());
+	}
+	async.streamToFiles("asyncwriter_test_streamed", 10 * 5 * sizeof(double)); // ten rows
+	for (int trial=0; trial<50; ++trial){
+		v.fill(trial);
+		for (Recorder * r : recorders){
+			r->newTrial();
+			for (int step=0; step<5; ++step) r->updateDatum("trace", Timepoint(step, v));
+			r->updateDatum("rt", 10.5 * trial);
+			r->updateDatum("ev", Event(trial, trial + 2));
+		}
+	}
+	direct.writeToFiles("asyncwriter_test_direct");
+	async.writeToFiles("asyncwriter_test_streamed");
+	w.flush();
+	const char * keys[3] = {"trace", "rt", "ev"};
+	for (const char * key : keys){
+		std::string directFile = std::string("asyncwriter_test_direct/") + key + ".csv";
+		std::string asyncFile = std::string("asyncwriter_test_streamed/") + key + ".csv";
+		std::string expected = readFile(directFile), actual = readFile(asyncFile);
+		INFO(key);
+		REQUIRE_FALSE(expected.empty());
+		REQUIRE(actual == expected);
+		std::remove(directFile.c_str());
+		std::remove(asyncFile.c_str());
+	}
+	std::remove("asyncwriter_test_direct");
+	std::remove("asyncwriter_test_streamed");
+}
@@ -0,0 +1,202 @@
+#include "catch_main.h"
+#include "../batchmerge.h"
+#include "../config.h"
+#include "../recorder.h"
+#include "../experiment.h"
+#include "../examples/Flanker/flanker.h"
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <cmath>
+
+using std::vector;
+
+/// Mean, variance and n of xs[begin, end) as a runner row for variable RT of condition 0,0.
+static std::string momentsRow(const vector<double> & xs, unsigned begin, unsigned end){
+	double n = end - begin;
+	double mean = std::accumulate(xs.begin() + begin, xs.begin() + end, 0.0) / n;
+	double ssq = 0;
+	for (unsigned i=begin; i<end; ++i) ssq += (xs[i] - mean) * (xs[i] - mean);
+	std::ostringstream row;
+	row.precision(17);
+	row << "0,0,RT," << mean << "," << ssq / (n - 1) << "," << int(n) << "\n";
+	return row.str();
+}
+
+/// The merged output, parsed back into rows of fields.
+static vector<vector<std::string> > mergedRows(BatchMerger & merger){
+	std::ostringstream out;
+	merger.write(out);
+	std::istringstream in(out.str());
+	vector<vector<std::string> > rows;
+	std::string line, field;
+	std::getline(in, line); // header
+	while (std::getline(in, line)){
+		vector<std::string> fields;
+		std::istringstream fieldsIn(line);
+		while (std::getline(fieldsIn, field, ',')) fields.push_back(field);
+		rows.push_back(fields);
+	}
+	return rows;
+}
+
+TEST_CASE("BatchMerger"){
+	SECTION("Means and variances of shards combine to those of all the observations"){
+		vector<double> xs(1000);
+		for (unsigned i=0; i<xs.size(); ++i) xs[i] = 1e6 + std::sin(i * 0.37) * 100 + i * 0.5; // more digits than std::ostream prints by default
+		std::string whole = momentsRow(xs, 0, 1000);
+		BatchMerger merger;
+		unsigned cuts[4] = {0, 100, 650, 1000};
+		for (unsigned s=0; s<3; ++s){
+			std::istringstream shard("context,target,variable,mean,variance,n\n" + momentsRow(xs, cuts[s], cuts[s + 1]) + "Found empty input line, exiting!\n");
+			merger.add(shard);
+		}
+		vector<vector<std::string> > rows = mergedRows(merger);
+		std::istringstream expected(whole);
+		vector<std::string> fields;
+		std::string field;
+		while (std::getline(expected, field, ',')) fields.push_back(field);
+		double mean = std::stod(rows[0][3]), variance = std::stod(rows[0][4]);
+		REQUIRE(merger.getNShards() == 3);
+		REQUIRE(rows.size() == 1);
+		REQUIRE(mean == Approx(std::stod(fields[3])).epsilon(1e-12));
+		REQUIRE(variance == Approx(std::stod(fields[4])).epsilon(1e-9));
+		REQUIRE(rows[0][5] == "1000");
+	}
+
+	SECTION("Curves, quantiles and parameter lines"){
+		// two input lines in each shard: the second starts where RT comes up again
+		std::istringstream first(
+			"0,0,RT,500,100,10\n0,0,RT_q0.5,490,NA,10\n"
+			"0,0,CorrectRT_cdf300,0.5,NA,10\n0,0,IncorrectRT_cdf300,0,NA,10\n"
+			"0,0,CorrectRT_cdf400,0.8,NA,10\n0,0,IncorrectRT_cdf400,0.2,NA,10\n"
+			"0,0,Accuracy_caf300,1,NA,5\n0,0,Accuracy_caf400,0.6,NA,5\n"
+			"0,0,RT,600,NA,1\n");
+		std::istringstream second(
+			"0,0,RT,520,100,30\n0,0,RT_q0.5,510,NA,30\n"
+			"0,0,CorrectRT_cdf350,0.6,NA,30\n0,0,IncorrectRT_cdf350,0.4,NA,30\n"
+			"0,0,Accuracy_caf400,0.8,NA,20\n0,0,Accuracy_cafinf,0.5,NA,10\n"
+			"0,0,RT,700,NA,1\n");
+		BatchMerger merger;
+		merger.add(first);
+		merger.add(second);
+		REQUIRE(merger.getNBlocks() == 2);
+		vector<vector<std::string> > rows = mergedRows(merger);
+		// RT, RT_q0.5, 3 CorrectRT_cdf and 3 IncorrectRT_cdf points, 3 CAF bins, then the second line's RT
+		REQUIRE(rows.size() == 12);
+		REQUIRE(rows[0][2] == "RT");
+		REQUIRE(std::stod(rows[0][3]) == Approx(515));
+		REQUIRE(rows[0][5] == "40");
+		REQUIRE(std::stod(rows[1][3]) == Approx(505)); // (10 * 490 + 30 * 510) / 40
+		// at 350 the first shard's CDF is still at its 300 point: (10 * 0.5 + 30 * 0.6) / 40
+		REQUIRE(rows[3][2] == "CorrectRT_cdf350");
+		REQUIRE(std::stod(rows[3][3]) == Approx(0.575));
+		REQUIRE(rows[4][2] == "CorrectRT_cdf400");
+		REQUIRE(std::stod(rows[4][3]) == Approx(0.65)); // (10 * 0.8 + 30 * 0.6) / 40
+		REQUIRE(rows[8][2] == "Accuracy_caf300");
+		REQUIRE(rows[9][2] == "Accuracy_caf400");
+		REQUIRE(std::stod(rows[9][3]) == Approx(0.76)); // (3 + 16) / 25
+		REQUIRE(rows[9][5] == "25");
+		REQUIRE(rows[10][2] == "Accuracy_cafinf");
+		REQUIRE(std::stod(rows[11][3]) == Approx(650));
+		REQUIRE(rows[11][4] == "5000");
+	}
+
+	SECTION("Outputs for different numbers of parameter lines don't merge"){
+		std::istringstream one("0,0,RT,500,100,10\n"), two("0,0,RT,500,100,10\n0,0,RT,500,100,10\n");
+		BatchMerger merger;
+		merger.add(one);
+		REQUIRE_THROWS(merger.add(two));
+	}
+}
+
+/// Defaults of the flanker runner.
+static Config batchConfig(){
+	Config conf;
+	conf.set("timePerStep", 10);
+	conf.set("maxTrials", 200);
+	conf.set("maxSamps", 1000);
+	conf.set("contextNoise", 3);
+	conf.set("targetNoise", 3);
+	conf.set("decisionThresh", 0.95);
+	conf.set("eblMean", 50);
+	conf.set("motorPlanMean", 150);
+	conf.set("motorExecMean", 150);
+	conf.set("eblSd", 20);
+	conf.set("motorSd", 50);
+	conf.set("urPrior", "0.4 0.3; 0.2 0.1");
+	conf.set("trialDist", "0.4 0.3; 0.2 0.1");
+	conf.set("nContexts", 2);
+	conf.set("nTargets", 2);
+	conf.set("pPrematureResp", 0.05);
+	return conf;
+}
+
+/// The rows of a Flanker batch run.
+static BatchRows flankerRows(Config & conf){
+	Recorder r;
+	FlankerTask t(&conf, &r);
+	BatchExperiment(&conf, &t, &r).run();
+	BatchRows rows(r, t, conf);
+	r.reset(); // the rows are copies
+	return rows;
+}
+
+/// Does a row's variable start with prefix?
+static bool hasVariable(const BatchRows & rows, const std::string & prefix){
+	for (const BatchRow & row : rows.getRows()){
+		if (row.variable.compare(0, prefix.size(), prefix) == 0) return true;
+	}
+	return false;
+}
+
+/// Written rows read back by BatchMerger: one shard merges into itself (with the points of a curve brought together).
+static void checkRoundTrip(const BatchRows & rows){
+	std::ostringstream out;
+	rows.write(out);
+	std::istringstream in(out.str());
+	BatchMerger merger;
+	merger.add(in);
+	vector<vector<std::string> > merged = mergedRows(merger);
+	REQUIRE(merger.getNBlocks() == 1);
+	REQUIRE(merged.size() == rows.getRows().size());
+	std::map<std::string, const vector<std::string> *> mergedByKey;
+	for (const vector<std::string> & fields : merged) mergedByKey[fields[0] + "," + fields[1] + "," + fields[2]] = &fields;
+	for (const BatchRow & row : rows.getRows()){
+		std::string key = std::to_string(row.context) + "," + std::to_string(row.target) + "," + row.variable;
+		INFO(key);
+		REQUIRE(mergedByKey.count(key) == 1);
+		const vector<std::string> & fields = *mergedByKey[key];
+		REQUIRE(std::stoi(fields[5]) == row.n);
+		if (row.n > 0) REQUIRE(std::stod(fields[3]) == Approx(row.mean).epsilon(1e-12));
+	}
+}
+
+TEST_CASE("BatchRows"){
+	Config conf = batchConfig();
+
+	SECTION("Summaries, histograms, CAF and aggregated traces"){
+		conf.set("batchHistograms", 1);
+		conf.set("batchCaf", 1);
+		conf.set("aggregateTraces", 1);
+		BatchRows rows = flankerRows(conf);
+		REQUIRE(rows.getRows()[0].variable == "RT");
+		REQUIRE(rows.getRows()[0].n > 0);
+		REQUIRE(hasVariable(rows, "CorrectRT_cdf"));
+		REQUIRE(hasVariable(rows, "IncorrectRT_cdf"));
+		REQUIRE(hasVariable(rows, "Accuracy_caf"));
+		REQUIRE(hasVariable(rows, "post0_t"));
+		checkRoundTrip(rows);
+	}
+
+	SECTION("Quantiles and response-locked traces"){
+		conf.set("batchQuantiles", 1);
+		conf.set("responseLockedWindow", 5);
+		BatchRows rows = flankerRows(conf);
+		REQUIRE(rows.getRows()[1].variable == "RT_q0.1");
+		REQUIRE(hasVariable(rows, "post0_r-4"));
+		checkRoundTrip(rows);
+	}
+}
@@ -1,6 +1,7 @@
 #include "catch_main.h"
 #include "../belief.h"
 #include "../config.h"
+#include "../rng.h"
 #include <armadillo>
 
 using arma::mat; 
@@ -192,4 +193,87 @@ TEST_CASE("DecayBelief tests"){
 				REQUIRE(lik(1,1)==Approx(correctB[i]));
 			}
 	}
-}
\ No newline at end of file
+}
+TEST_CASE("ForgetBelief tests"){
+	Config conf = Config(); 
+	conf.set("urPrior", "0.5 0.2; 0.2 0.1"); 
+
+	SECTION("forgetProb=0 means we never forget"){
+		conf.set("forgetProb", 0); 
+		ForgetBelief b(&conf); 
+		b.setTrueStim(1,0); 
+		b.reset(); 
+		vec out(100); 
+		for (unsigned i=0; i<100; ++i){
+			out[i] = b.contextForgetUpdate(5); 
+		}
+		REQUIRE(all(out==-1)); 
+	}
+
+	SECTION("Forget time matches forgetting with a Bernoulli draw on every update"){
+		double p = 0.05; 
+		conf.set("forgetProb", p); 
+		ForgetBelief b(&conf); 
+		b.setTrueStim(0,0); 
+		int n = 20000; 
+		vec geometricCount = arma::zeros<vec>(30); 
+		vec bernoulliCount = arma::zeros<vec>(30); 
+		int mismatches = 0; 
+		for (int i=0; i<n; ++i){
+			b.reset(); 
+			int update = 0; 
+			int drawType = -1; 
+			while (drawType == -1){
+				++update; 
+				drawType = b.contextForgetUpdate(5); 
+			}
+			mismatches += update != b.getForgetUpdate(); 
+			if (update <= 30) ++geometricCount[update-1]; 
+			// the per-update formulation
+			int bernoulliUpdate = 1; 
+			while (RNG::rbernoulli(p) == 0) ++bernoulliUpdate; 
+			if (bernoulliUpdate <= 30) ++bernoulliCount[bernoulliUpdate-1]; 
+		}
+		REQUIRE(mismatches == 0); 
+		for (unsigned k=0; k<15; k+=5){
+			double expected = n * pow(1-p, k) * p; 
+			INFO("update " << k+1); 
+			REQUIRE(geometricCount[k] == Approx(expected).epsilon(0.12)); 
+			REQUIRE(bernoulliCount[k] == Approx(expected).epsilon(0.12)); 
+		}
+		double geometricMean = 0; 
+		for (int i=0; i<n; ++i){
+			b.reset(); 
+			geometricMean += b.getForgetUpdate(); 
+		}
+		geometricMean /= n; 
+		REQUIRE(geometricMean == Approx(1/p).epsilon(0.03)); 
+	}
+
+	SECTION("Forgotten context is drawn from the prior"){
+		conf.set("forgetProb", 1); 
+		ForgetBelief b(&conf); 
+		b.setTrueStim(0,0); 
+		int context0DrawCount = 0; 
+		for (unsigned i=0; i<10000; ++i){
+			b.reset(); 
+			context0DrawCount += b.contextForgetUpdate(5) == 0; 
+		}
+		REQUIRE(context0DrawCount == Approx(7000).epsilon(0.03)); 
+	}
+
+	SECTION("reset() restores the true context"){
+		conf.set("urPrior", "0.5 0.5; 0 0"); // forgetting always goes to context 0
+		conf.set("forgetProb", 1); 
+		ForgetBelief b(&conf); 
+		b.setTrueStim(1,0); 
+		b.reset(); 
+		REQUIRE(b.contextForgetUpdate(5) == 0); 
+		REQUIRE(b.contextForgetUpdate(5) == -1); // only the update that forgets says so
+		double samp = b.drawSum(Context, 1e-9, 1); 
+		REQUIRE(samp == Approx(0)); 
+		b.reset(); 
+		samp = b.drawSum(Context, 1e-9, 1); 
+		REQUIRE(samp == Approx(1)); 
+	}
+}
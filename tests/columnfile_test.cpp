@@ -0,0 +1,81 @@
+#include "catch_main.h"
+#include "../columnfile.h"
+#include "../recorder.h"
+#include <armadillo>
+#include <cstdio>
+
+using arma::mat;
+using arma::vec;
+
+TEST_CASE("Column files"){
+	std::string filename = "columnfile_test.cddm";
+	Recorder r;
+	r.registerDatum("trace", TraceDatum());
+	r.registerDatum("rt", RawVectorsDatum<double>());
+	r.registerDatum("ev", EventDatum());
+	r.registerDatum("summary", IncrementalMeanVarianceDatum<double>());
+	r.registerDatum("dummy", DummyDatum<double>());
+	for (int trial=0; trial<5; ++trial){
+		r.newTrial();
+		for (int step=0; step<=trial; ++step){
+			vec v = {double(trial), 0.5 * step};
+			r.updateDatum("trace", Timepoint(10 * step, v));
+		}
+		r.updateDatum("rt", 100.0 + trial);
+		r.updateDatum("summary", 100.0 + trial);
+		if (trial % 2 == 0) r.updateDatum("ev", Event(trial, trial + 1));
+	}
+	r.writeColumnFile(filename);
+	ColumnFileReader f(filename);
+
+	SECTION("Directory lists the datums that have something to write"){
+		std::vector<std::string> names = f.getDatumNames();
+		REQUIRE(names.size() == 4);
+		REQUIRE_FALSE(f.hasDatum("dummy"));
+		REQUIRE(f.hasDatum("trace"));
+		std::vector<std::string> cols = f.getColumnNames("trace");
+		REQUIRE(cols.size() == 4);
+		REQUIRE(cols[3] == "value1");
+		REQUIRE(f.getColumnType("trace", "trial") == COLUMN_INT32);
+		REQUIRE(f.getColumnType("trace", "time") == COLUMN_FLOAT64);
+	}
+
+	SECTION("Whole datums match the recorded matrices"){
+		mat traces = r.getDatum<TraceDatum>("trace").getTraces();
+		mat fromFile = f.getMat("trace");
+		bool sameTraces = arma::all(arma::vectorise(traces == fromFile));
+		REQUIRE(sameTraces);
+		mat events = r.getDatum<EventDatum>("ev").getMatRepr();
+		mat eventsFromFile = f.getMat("ev");
+		bool sameEvents = arma::all(arma::vectorise(events == eventsFromFile));
+		REQUIRE(sameEvents);
+		ArrayView<double> rts = f.getColumn("rt", "value");
+		REQUIRE(rts.size() == 5);
+		REQUIRE(rts[4] == 104);
+		double mean = f.getColumn("summary", "mean")[0];
+		int n = f.getIntColumn("summary", "n")[0];
+		REQUIRE(mean == 102);
+		REQUIRE(n == 5);
+	}
+
+	SECTION("Random access to a trial through the index"){
+		std::vector<int> ids = f.getTrialIds("trace");
+		REQUIRE(ids.size() == 5);
+		mat trial3 = f.getTrial("trace", 3);
+		REQUIRE(trial3.n_rows == 4);
+		REQUIRE(trial3(3, 1) == 30);
+		REQUIRE(trial3(3, 3) == 1.5);
+		TrialSegment s = f.getTrialSegment("ev", 4);
+		REQUIRE(s.begin == 2);
+		REQUIRE(s.end == 3);
+		REQUIRE_THROWS(f.getTrial("ev", 3));
+	}
+
+	SECTION("Wrong types and names throw"){
+		REQUIRE_THROWS(f.getColumn("trace", "trial"));
+		REQUIRE_THROWS(f.getIntColumn("trace", "time"));
+		REQUIRE_THROWS(f.getColumn("trace", "nope"));
+		REQUIRE_THROWS(f.getNRows("nope"));
+	}
+	std::remove(filename.c_str());
+}
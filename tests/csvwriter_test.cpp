@@ -0,0 +1,144 @@
+#include "catch_main.h"
+#include "../csvwriter.h"
+#include "../recorder.h"
+#include <armadillo>
+#include <sstream>
+#include <limits>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using std::vector;
+
+static vector<double> testValues(){
+	vector<double> vals = {0, -0.0, 1, -1, 2.5, 0.1, 1e-300, -3.7e12, 123456, 999999, 1000000, 1234567, 1e15, 1e16, 123456789012345678.0,
+		std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+		std::numeric_limits<double>::max(), std::numeric_limits<double>::denorm_min()};
+	arma::vec r = arma::randn<arma::vec>(200) * 1000;
+	vals.insert(vals.end(), r.begin(), r.end());
+	return vals;
+}
+
+TEST_CASE("CsvWriter"){
+	vector<double> vals = testValues();
+
+	SECTION("General notation is what std::ostream writes"){
+		for (int precision : {6, 12}){
+			std::ostringstream expected, actual;
+			expected.precision(precision);
+			CsvWriter csv;
+			csv.attach(actual);
+			csv.setFormat(CsvWriter::GENERAL, precision);
+			for (double x : vals){
+				expected << x << "," << int(x) << "\n";
+				csv.field(x);
+				csv.field(int(x));
+				csv.endRow();
+			}
+			csv.detach();
+			std::string e = expected.str(), a = actual.str();
+			REQUIRE(a == e);
+		}
+	}
+
+	SECTION("Scientific notation is what armadillo writes"){
+		arma::mat m(vals.size(), 2);
+		for (unsigned i=0; i<vals.size(); ++i){
+			m(i, 0) = vals[i];
+			m(i, 1) = i;
+		}
+		std::ostringstream expected, actual;
+		m.save(expected, arma::csv_ascii);
+		CsvWriter csv(false, 64); // tiny buffer, so it flushes all the time
+		csv.attach(actual);
+		csv.setFormat(CsvWriter::SCIENTIFIC, 12);
+		for (unsigned i=0; i<vals.size(); ++i){
+			csv.field(vals[i]);
+			csv.field(double(i));
+			csv.endRow();
+		}
+		csv.detach();
+		std::string e = expected.str(), a = actual.str();
+		REQUIRE(a == e);
+	}
+
+	SECTION("Shortest round trip reads back exactly and is never longer than 17 digits"){
+		std::ostringstream out;
+		CsvWriter csv(true);
+		csv.attach(out);
+		csv.setFormat(CsvWriter::SCIENTIFIC, 12); // ignored
+		for (double x : vals){
+			csv.field(x);
+			csv.endRow();
+		}
+		csv.detach();
+		std::istringstream in(out.str());
+		std::string line;
+		for (double x : vals){
+			std::getline(in, line);
+			double back = strtod(line.c_str(), nullptr);
+			char longest[32];
+			snprintf(longest, 32, "%.17g", x);
+			INFO(x << " written as " << line);
+			bool same = (std::isnan(x) && std::isnan(back)) || back == x;
+			REQUIRE(same);
+			REQUIRE(line.size() <= std::string(longest).size());
+		}
+		std::ostringstream small;
+		csv.attach(small);
+		csv.field(0.1);
+		csv.field(2.0);
+		csv.field(1.0/3);
+		csv.detach();
+		std::string s = small.str();
+		REQUIRE(s == "0.1,2,0.3333333333333333");
+	}
+
+	SECTION("Raw text and strings"){
+		std::ostringstream out;
+		CsvWriter csv(false, 64);
+		csv.attach(out);
+		csv.field("a");
+		csv.field(std::string("b"));
+		csv.endRow();
+		csv.raw(std::string(100, 'x') + "\n");
+		csv.field(3);
+		csv.endRow();
+		csv.detach();
+		std::string expected = "a,b\n" + std::string(100, 'x') + "\n3\n";
+		REQUIRE(out.str() == expected);
+	}
+}
+
+TEST_CASE("CsvWriter benchmark on a million-row trace", "[.][benchmark]"){
+	TraceDatum d(1000000);
+	arma::vec v(4);
+	for (int trial=0; trial<10000; ++trial){
+		d.newTrial();
+		for (int step=0; step<100; ++step){
+			v.randu();
+			d.record(Timepoint(10 * step, v));
+		}
+	}
+	typedef std::chrono::steady_clock clock;
+	clock::time_point t0 = clock::now();
+	std::ostringstream viaArma;
+	d.getTraces().save(viaArma, arma::csv_ascii);
+	clock::time_point t1 = clock::now();
+	std::ostringstream viaWriter;
+	CsvWriter csv(false, 1 << 20);
+	csv.attach(viaWriter);
+	d.writeCsv(csv);
+	csv.detach();
+	clock::time_point t2 = clock::now();
+	std::ostringstream viaShortest;
+	CsvWriter shortest(true, 1 << 20);
+	shortest.attach(viaShortest);
+	d.writeCsv(shortest);
+	shortest.detach();
+	clock::time_point t3 = clock::now();
+	typedef std::chrono::duration<double> seconds;
+	WARN("1e6 rows, arma csv_ascii: " << seconds(t1 - t0).count() << "s, CsvWriter: " << seconds(t2 - t1).count()
+		<< "s, CsvWriter shortest: " << seconds(t3 - t2).count() << "s (" << viaShortest.str().size() / 1e6 << " MB vs " << viaWriter.str().size() / 1e6 << " MB)");
+	REQUIRE(viaWriter.str() == viaArma.str());
+}
@@ -0,0 +1,134 @@
+#include "catch_main.h"
+#include "../decisioncache.h"
+#include "../experiment.h"
+#include "../recorder.h"
+#include "../task.h"
+#include "../config.h"
+
+/**
+ * Task whose decision is made by counting runs, and whose RT adds eblMean deterministically. 
+ */
+class CountingTask : public Task{
+public: 
+	CountingTask(Config * c, Recorder * r): Task(c, r), nRuns(0), nReplays(0){
+		_summaryDatumNames = {"RT"}; 
+		_rtId = _summaryDatumId("RT"); 
+	}
+	void run(){
+		drawTrialType(); 
+		++nRuns; 
+		_cacheDecision(nRuns, 0); 
+		_recordSummary(_rtId, nRuns + _config->get<double>("eblMean")); 
+	}
+	void replay(const DecisionSample & s){
+		_setTrialType(s.context, s.target); 
+		++nReplays; 
+		_recordSummary(_rtId, s.decisionTime + _config->get<double>("eblMean")); 
+	}
+	int nRuns; 
+	int nReplays; 
+	unsigned _rtId; 
+};
+
+TEST_CASE("DecisionCache keys"){
+	Config conf; 
+	conf.set("decisionThresh", 0.9); 
+	conf.set("eblMean", 50); 
+	conf.set("motorSd", 20); 
+	std::string key = DecisionCache::decisionKey(&conf); 
+
+	SECTION("Nondecision parameters don't change the key"){
+		conf.set("eblMean", 80); 
+		conf.set("motorSd", 10); 
+		REQUIRE(DecisionCache::decisionKey(&conf) == key); 
+	}
+
+	SECTION("Decision parameters do"){
+		conf.set("decisionThresh", 0.95); 
+		REQUIRE(DecisionCache::decisionKey(&conf) != key); 
+	}
+
+	SECTION("Computing the key leaves the Config alone"){
+		REQUIRE(conf.keyExists("eblMean")); 
+	}
+}
+
+TEST_CASE("DecisionCache storage"){
+	DecisionCache cache(2); 
+	DecisionSample s = {1, 0, 120, 1, false}; 
+
+	SECTION("Runs are only stored when finished"){
+		cache.start("a"); 
+		cache.record(s); 
+		REQUIRE_FALSE(cache.contains("a")); 
+		cache.finish(); 
+		REQUIRE(cache.contains("a")); 
+		REQUIRE(cache.getSamples("a").size() == 1); 
+		REQUIRE(cache.getSamples("a")[0].decisionTime == 120); 
+	}
+
+	SECTION("Restarting discards an unfinished run"){
+		cache.start("a"); 
+		cache.record(s); 
+		cache.start("a"); 
+		cache.finish(); 
+		REQUIRE(cache.getSamples("a").empty()); 
+	}
+
+	SECTION("Recording without starting does nothing"){
+		cache.record(s); 
+		cache.finish(); 
+		REQUIRE(cache.size() == 0); 
+	}
+
+	SECTION("Oldest run is dropped over capacity"){
+		cache.start("a"); cache.finish(); 
+		cache.start("b"); cache.finish(); 
+		cache.start("c"); cache.finish(); 
+		REQUIRE(cache.size() == 2); 
+		REQUIRE_FALSE(cache.contains("a")); 
+		REQUIRE(cache.contains("c")); 
+	}
+}
+
+TEST_CASE("Experiment replays cached decisions"){
+	Config conf; 
+	conf.set("maxTrials", 50); 
+	conf.set("eblMean", 50); 
+	conf.set("trialDist", "0.4 0.3; 0.2 0.1"); 
+	conf.set("nContexts", 2); 
+	conf.set("nTargets", 2); 
+	Recorder r; 
+	DecisionCache cache; 
+
+	CountingTask first(&conf, &r); 
+	first.setDecisionCache(&cache); 
+	BatchExperiment(&conf, &first, &r).run(); 
+	REQUIRE(first.nRuns == 50); 
+	IncrementalMeanVarianceDatum<double> d = r.getDatum<IncrementalMeanVarianceDatum<double> >("Context0_Target0_RT"); 
+	double firstMean = d.getMean(); 
+	int firstN = d.getN(); 
+	r.reset(); 
+
+	SECTION("Changing a nondecision parameter replays"){
+		conf.set("eblMean", 80); 
+		CountingTask second(&conf, &r); 
+		second.setDecisionCache(&cache); 
+		BatchExperiment(&conf, &second, &r).run(); 
+		REQUIRE(second.nRuns == 0); 
+		REQUIRE(second.nReplays == 50); 
+		d = r.getDatum<IncrementalMeanVarianceDatum<double> >("Context0_Target0_RT"); 
+		REQUIRE(d.getN() == firstN); 
+		REQUIRE(d.getMean() == Approx(firstMean + 30)); 
+	}
+
+	SECTION("Changing a decision parameter reruns"){
+		conf.set("maxTrials", 20); 
+		CountingTask second(&conf, &r); 
+		second.setDecisionCache(&cache); 
+		BatchExperiment(&conf, &second, &r).run(); 
+		REQUIRE(second.nRuns == 20); 
+		REQUIRE(second.nReplays == 0); 
+		REQUIRE(cache.size() == 2); 
+	}
+}
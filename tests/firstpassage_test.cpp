@@ -0,0 +1,130 @@
+#include "catch_main.h"
+#include "../firstpassage.h"
+#include "../belief.h"
+#include "../config.h"
+#include <armadillo>
+
+using arma::mat;
+using arma::vec;
+
+TEST_CASE("FirstPassageSampler recognizes one-dimensional configs"){
+	Config conf;
+	conf.set("targetNoise", 2);
+
+	SECTION("Factorized prior is one-dimensional"){
+		conf.set("urPrior", "0.25 0.25; 0.25 0.25");
+		REQUIRE(FirstPassageSampler::isOneDimensional(&conf));
+		conf.set("urPrior", "0.42 0.28; 0.18 0.12");
+		REQUIRE(FirstPassageSampler::isOneDimensional(&conf));
+	}
+
+	SECTION("Correlated prior is not"){
+		conf.set("urPrior", "0.4 0.3; 0.2 0.1");
+		REQUIRE_FALSE(FirstPassageSampler::isOneDimensional(&conf));
+	}
+
+	SECTION("Decay is not"){
+		conf.set("urPrior", "0.25 0.25; 0.25 0.25");
+		conf.set("decayRate", 0.01);
+		REQUIRE_FALSE(FirstPassageSampler::isOneDimensional(&conf));
+		conf.set("decayRate", 0);
+		REQUIRE(FirstPassageSampler::isOneDimensional(&conf));
+	}
+
+	SECTION("Three targets is not"){
+		conf.set("urPrior", "0.2 0.1 0.2; 0.2 0.1 0.2");
+		REQUIRE_FALSE(FirstPassageSampler::isOneDimensional(&conf));
+	}
+}
+
+TEST_CASE("FirstPassageSampler PMF"){
+	SECTION("PMF is proper"){
+		FirstPassageSampler s(0.3, 0.05, 0.4, 3, 100000);
+		double total = accu(s.getUpperPMF()) + accu(s.getLowerPMF());
+		REQUIRE(total == Approx(1).epsilon(1e-6));
+	}
+
+	SECTION("Symmetric walk with no drift hits both bounds equally"){
+		FirstPassageSampler s(0, 0, 0.5, 2, 100000);
+		REQUIRE(accu(s.getUpperPMF()) == Approx(0.5).epsilon(1e-4));
+	}
+
+	SECTION("Throws on hitting maxSamps"){
+		FirstPassageSampler s(0, 0, 0.01, 5, 10);
+		int resp;
+		REQUIRE_THROWS(s.sample(resp));
+	}
+
+	SECTION("Draws match the PMF"){
+		FirstPassageSampler s(0.2, 0.1, 0.5, 2, 100000);
+		int nUpper = 0;
+		double stepSum = 0;
+		int n = 20000;
+		for (int i=0; i<n; ++i){
+			int resp;
+			stepSum += s.sample(resp);
+			nUpper += resp == 0;
+		}
+		double pUpper = double(nUpper)/n;
+		double meanSteps = stepSum/n;
+		REQUIRE(pUpper == Approx(accu(s.getUpperPMF())).epsilon(0.02));
+		REQUIRE(meanSteps == Approx(s.getMeanSteps()).epsilon(0.03));
+	}
+}
+
+// Run Belief to the threshold n times per target (two context samples per target sample, 
+// as in the tasks) and compare accuracy and steps with the sampler's PMF. 
+static void checkAgainstStepping(const Config & conf){
+	double contextNoise = 1;
+	double targetNoise = conf.get<double>("targetNoise");
+	double thresh = conf.get<double>("decisionThresh");
+	int n = 20000;
+	for (int target=0; target<2; ++target){
+		FirstPassageSampler s(&conf, target);
+		Belief b(&conf);
+		int nCorrect = 0;
+		double stepSum = 0;
+		for (int i=0; i<n; ++i){
+			b.setTrueStim(1, target);
+			b.reset();
+			for (int samp=1; samp<=10000; ++samp){
+				b.updateFromContext(contextNoise);
+				b.updateFromContext(contextNoise);
+				b.updateFromTarget(targetNoise);
+				mat post = b.getBelief();
+				double dv = post(0,0) + post(1,0);
+				if (dv > thresh || dv < 1 - thresh){
+					nCorrect += (dv > 0.5) == (target == 0);
+					stepSum += samp;
+					break;
+				}
+			}
+		}
+		INFO("target " << target);
+		double pCorrect = target == 0 ? accu(s.getUpperPMF()) : accu(s.getLowerPMF());
+		double actualCorrect = double(nCorrect)/n;
+		double meanSteps = stepSum/n;
+		REQUIRE(actualCorrect == Approx(pCorrect).epsilon(0.02));
+		REQUIRE(meanSteps == Approx(s.getMeanSteps()).epsilon(0.03));
+	}
+}
+
+TEST_CASE("FirstPassageSampler matches stepping through Belief"){
+	Config conf;
+	conf.set("urPrior", "0.42 0.28; 0.18 0.12");
+	conf.set("targetNoise", 1.5);
+	conf.set("decisionThresh", 0.9);
+	conf.set("maxSamps", 10000);
+
+	SECTION("Unit spacing"){
+		checkAgainstStepping(conf);
+	}
+
+	SECTION("Target means spaced out"){
+		// samples are drawn around the target's index, not its (spaced) mean, as in Belief::update()
+		conf.set("targetMeanSpacing", 2);
+		checkAgainstStepping(conf);
+		conf.set("targetMeanSpacing", 0.5);
+		checkAgainstStepping(conf);
+	}
+}
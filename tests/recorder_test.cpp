@@ -1,11 +1,14 @@
 #include "catch_main.h"
 #include "../recorder.h"
 #include "../rng.h" // for testing the GMM
+#include "../asyncwriter.h"
 
 #include <string>
 #include <armadillo>
 #include <vector>
 #include <algorithm> // std::equal
+#include <sstream>
+#include <cstdio>
 
 using std::vector; 
 
@@ -246,9 +249,154 @@ TEST_CASE("Tests for TraceDatum"){
 		INFO("Expected: " << expected << "Actual: " << actual); 
 		REQUIRE(actual==expected); 
 	}
+
+	SECTION("Views and per-trial segments"){
+		REQUIRE(d.getNRows() == 12); 
+		REQUIRE(d.getWidth() == 6); 
+		REQUIRE(d.getRow(4)[4] == vals[4][2]); 
+		vector<unsigned> sizes; 
+		for (TrialSegment seg : d.getSegments()){
+			REQUIRE(seg.trialId == int(sizes.size())); 
+			REQUIRE(d.getRow(seg.begin)[1] == times[seg.begin]); 
+			sizes.push_back(seg.size()); 
+		}
+		REQUIRE(sizes.size() == 3); 
+		REQUIRE(sizes[0] == 6); 
+		REQUIRE(sizes[2] == 3); 
+	}
+
+	SECTION("Matrix view uses the datum's storage"){
+		const arma::mat view = d.getTracesView(); 
+		REQUIRE(view.memptr() == d.getRows().data()); 
+		REQUIRE(all(vectorise(correctOut.t())==vectorise(view))); 
+	}
+
+	SECTION("Reserved datum records the same"){
+		TraceDatum reserved(100); 
+		reserved.newTrial(); 
+		for (unsigned i = 0; i< times.size(); ++i){
+			if (i > 0 && traceIds[i] > traceIds[i-1]) reserved.newTrial(); 
+			reserved.record(Timepoint(times[i], vals[i])); 
+		}
+		REQUIRE(reserved.getRows().capacity() == 600); 
+		REQUIRE(reserved.getStringRepr() == d.getStringRepr()); 
+		REQUIRE_THROWS(reserved.record(Timepoint(1, arma::vec(3)))); 
+	}
+
+	SECTION("Streaming writes the same file with a small buffer"){
+		TraceDatum streamed; 
+		std::string filename = "recorder_test_stream.csv"; 
+		streamed.streamTo(filename, 2 * 6 * sizeof(double), false); // two rows
+		streamed.newTrial(); 
+		for (unsigned i = 0; i< times.size(); ++i){
+			if (i > 0 && traceIds[i] > traceIds[i-1]) streamed.newTrial(); 
+			streamed.record(Timepoint(times[i], vals[i])); 
+		}
+		unsigned buffered = streamed.getNRows(); 
+		REQUIRE(buffered == 3); // the last trace, earlier ones are on disk
+		streamed.finishStream(); 
+		std::ifstream f(filename); 
+		std::stringstream contents; 
+		contents << f.rdbuf(); 
+		std::remove(filename.c_str()); 
+		REQUIRE(contents.str() == d.getStringRepr()); 
+	}
+	
+	SECTION("Every k-th timepoint, plus the first, last and marked ones"){
+		TraceDatum decimated(0, 3); 
+		decimated.newTrial(); 
+		for (unsigned i = 0; i< times.size(); ++i){
+			if (i > 0 && traceIds[i] > traceIds[i-1]) decimated.newTrial(); 
+			decimated.record(Timepoint(times[i], vals[i], i == 1)); 
+		}
+		arma::uvec kept{0, 1, 3, 5, 6, 8, 9, 11}; 
+		arma::mat expected = correctOut.rows(kept); 
+		arma::mat actual = decimated.getTraces(); 
+		INFO("Expected =\n" << expected << "Actual =\n" << actual); 
+		bool same = actual.n_rows == expected.n_rows && all(vectorise(actual) == vectorise(expected)); 
+		REQUIRE(same); 
+		REQUIRE(decimated.getSegments().size() == 3); 
+		REQUIRE(decimated.getSegments()[1].size() == 2); 
+	}
+
+	SECTION("Only timepoints that moved by more than epsilon, plus the last one"){
+		TraceDatum decimated(0, 1, 0.1); 
+		arma::vec moves{0, 0.05, 0.2, 0.25, 0.27}; 
+		decimated.newTrial(); 
+		for (unsigned i = 0; i< moves.size(); ++i){
+			decimated.record(Timepoint(i, arma::vec{moves[i], 1 - moves[i]})); 
+		}
+		arma::mat actual = decimated.getTraces(); 
+		INFO("Actual =\n" << actual); 
+		REQUIRE(actual.n_rows == 3); 
+		REQUIRE(actual(1, 1) == 2); 
+		REQUIRE(actual(2, 1) == 4); 
+		REQUIRE(actual(2, 2) == 0.27); 
+	}
 	
 }
 
+TEST_CASE("CompactTraceDatum"){
+	TraceDatum plain; 
+	CompactTraceDatum compact(10, 1.0 / 65536, 16); // small blocks, so traces span several
+	for (int trial=0; trial<50; trial++){
+		plain.newTrial(); 
+		compact.newTrial(); 
+		if (trial == 7) continue; // a trial without a trace
+		// a slowly moving 2-cell posterior, with a jump in time (e.g. motor planning) halfway
+		double p = 0.5; 
+		for (int step=0; step<100; step++){
+			p = std::min(0.999, std::max(0.001, p + RNG::rnorm(0, 0.005))); 
+			double time = (step < 50 ? step : step + 20) * 10.0; 
+			arma::vec v = {p, 1 - p}; 
+			plain.record(Timepoint(time, v)); 
+			compact.record(Timepoint(time, v)); 
+		}
+	}
+
+	SECTION("Decoding gives the traces back, to within the precision"){
+		arma::mat expected = plain.getTraces(), actual = compact.getTraces(); 
+		REQUIRE(compact.getNRows() == plain.getNRows()); 
+		REQUIRE(compact.getWidth() == plain.getWidth()); 
+		REQUIRE(actual.n_rows == expected.n_rows); 
+		REQUIRE(actual.n_cols == expected.n_cols); 
+		bool sameTimes = arma::all(arma::vectorise(actual.cols(0, 1) == expected.cols(0, 1))); 
+		double maxError = arma::abs(actual.cols(2, 3) - expected.cols(2, 3)).max(); 
+		REQUIRE(sameTimes); 
+		REQUIRE(maxError <= compact.getPrecision() / 2); 
+	}
+
+	SECTION("The encoding is several times smaller, and round trips through decode() and a file"){
+		vector<uint8_t> encoded = compact.getEncoded(); 
+		double ratio = double(plain.getRows().size() * sizeof(double)) / encoded.size(); 
+		REQUIRE(ratio > 5); 
+		arma::mat traces = compact.getTraces(), decoded = CompactTraceDatum::decode(encoded); 
+		bool same = arma::all(arma::vectorise(decoded == traces)); 
+		REQUIRE(same); 
+		compact.writeEncoded("compacttrace_test.bin"); 
+		arma::mat read = CompactTraceDatum::readEncoded("compacttrace_test.bin"); 
+		std::remove("compacttrace_test.bin"); 
+		bool sameRead = arma::all(arma::vectorise(read == traces)); 
+		REQUIRE(sameRead); 
+		encoded.resize(encoded.size() - 1); 
+		REQUIRE_THROWS(CompactTraceDatum::decode(encoded)); 
+	}
+
+	SECTION("The CSV is the decoded traces in TraceDatum's format"){
+		arma::mat fromCsv; 
+		std::istringstream csv(compact.getStringRepr()); 
+		fromCsv.load(csv, arma::csv_ascii); 
+		arma::mat traces = compact.getTraces(); 
+		double maxError = arma::abs(fromCsv - traces).max(); 
+		REQUIRE(fromCsv.n_rows == traces.n_rows); 
+		REQUIRE(maxError < 1e-9); 
+	}
+
+	SECTION("Timepoints of the wrong length are refused"){
+		REQUIRE_THROWS(compact.record(Timepoint(0, arma::vec(3)))); 
+	}
+}
+
 TEST_CASE("Tests for EventDatum"){
 
 	SECTION("Event throws if end before start but not if equal"){
@@ -293,6 +441,18 @@ TEST_CASE("Tests for EventDatum"){
 		INFO("Expected: " << expected << "Actual: " << actual); 
 		REQUIRE(actual==expected); 
 	}
+
+	SECTION("Views and per-trial segments"){
+		REQUIRE(d.getStartTimes()[2] == 300.5); 
+		REQUIRE(d.getEndTimes()[3] == 10000); 
+		unsigned nSegments = 0; 
+		for (TrialSegment seg : d.getSegments()){
+			REQUIRE(seg.size() == 2); 
+			REQUIRE(d.getTraceIds()[seg.begin] == seg.trialId); 
+			++nSegments; 
+		}
+		REQUIRE(nSegments == 2); 
+	}
 	
 }
 
@@ -352,8 +512,722 @@ TEST_CASE("GMMDatum"){
 			REQUIRE(hefts[1] == Approx(0.75).epsilon(0.01)); 
 		}
 	}
+
+	SECTION("Mean and variance are exact, and warm-started refits follow new data"){
+		GMMDatum d(2, 10); 
+		for (unsigned i=0; i<5000; i++){
+			d.record(RNG::rnorm(0, 1)); 
+			d.record(RNG::rnorm(5, 2)); 
+		}
+		rowvec means = d.getGaussMeans(); 
+		for (unsigned i=0; i<5000; i++){
+			d.record(RNG::rnorm(0, 1)); 
+			d.record(RNG::rnorm(5, 2)); 
+		}
+		means = d.getGaussMeans(); // warm-started from the fit above
+		double lo = means.min(), hi = means.max(); 
+		REQUIRE(lo == Approx(0).epsilon(0.1)); 
+		REQUIRE(hi == Approx(5).epsilon(0.1)); 
+		rowvec raw = d.getRawData(); 
+		double mean = arma::mean(raw), variance = arma::var(raw); 
+		REQUIRE(d.getMean() == Approx(mean)); 
+		REQUIRE(d.getVariance() == Approx(variance)); 
+	}
+}
+
+TEST_CASE("OnlineGMMDatum"){
+
+	SECTION("Correctly estimate two fed-in gaussians without keeping the data"){
+		// the online estimates only remember about n^0.6 observations, so their error is close to the 
+		// tolerances: fix the random stream, rather than depend on what the tests before this drew
+		arma::arma_rng::set_seed(1); 
+		OnlineGMMDatum d; 
+		for (unsigned i=0; i<10000; i++){
+			// 3:1 ratio, so hefts should be .75 and .25
+			d.record(RNG::rnorm(0, 1)); 
+			d.record(RNG::rnorm(0, 1)); 
+			d.record(RNG::rnorm(0, 1)); 
+			d.record(RNG::rnorm(5, 2)); 
+		}
+		rowvec means = d.getGaussMeans(), vars = d.getGaussVars(), hefts = d.getGaussWeights(); 
+		unsigned lo = means[0] < means[1] ? 0 : 1, hi = 1 - lo; 
+		REQUIRE(means[lo] == Approx(0).epsilon(0.1)); 
+		REQUIRE(means[hi] == Approx(5).epsilon(0.1)); 
+		REQUIRE(vars[lo] == Approx(1).epsilon(0.1)); 
+		REQUIRE(vars[hi] == Approx(4).epsilon(0.1)); 
+		REQUIRE(hefts[lo] == Approx(0.75).epsilon(0.03)); 
+		REQUIRE(hefts[hi] == Approx(0.25).epsilon(0.03)); 
+		REQUIRE(d.getN() == 40000); 
+		REQUIRE(d.getRawData().n_elem == 0); 
+	}
+
+	SECTION("Mean and variance are exact, also during warmup"){
+		OnlineGMMDatum d(2, 100, true); 
+		for (unsigned i=0; i<1000; i++){
+			d.record(RNG::rnorm(2, 3)); 
+			if (i == 50){
+				rowvec raw = d.getRawData(); 
+				double mean = arma::mean(raw); 
+				REQUIRE(d.getMean() == Approx(mean)); 
+				REQUIRE(d.getGaussMeans().n_elem == 2); // fit on the buffer so far
+			}
+		}
+		rowvec raw = d.getRawData(); 
+		double mean = arma::mean(raw), variance = arma::var(raw); 
+		REQUIRE(raw.n_elem == 1000); 
+		REQUIRE(d.getMean() == Approx(mean)); 
+		REQUIRE(d.getVariance() == Approx(variance)); 
+	}
+
+	SECTION("Warm-started refit over kept data"){
+		OnlineGMMDatum d(2, 500, true); 
+		for (unsigned i=0; i<5000; i++){
+			d.record(RNG::rnorm(0, 1)); 
+			d.record(RNG::rnorm(5, 2)); 
+		}
+		d.refit(10); 
+		rowvec means = d.getGaussMeans(), hefts = d.getGaussWeights(); 
+		double lo = means.min(), hi = means.max(), heftSum = arma::accu(hefts); 
+		REQUIRE(lo == Approx(0).epsilon(0.1)); 
+		REQUIRE(hi == Approx(5).epsilon(0.1)); 
+		REQUIRE(heftSum == Approx(1)); 
+		OnlineGMMDatum noRaw; 
+		REQUIRE_THROWS(noRaw.refit()); 
+	}
+}
+
+
+TEST_CASE("QuantileSketchDatum"){
+
+	SECTION("Few observations are kept exactly"){
+		QuantileSketchDatum d; 
+		vector<double> inputVec{0.1, 2, 3, 4.1, 5.7, 6.4}; 
+		for (auto i: inputVec){
+			d.record(i); 
+		}
+		REQUIRE(d.getMean() == Approx(3.55)); 
+		REQUIRE(d.getVariance() == Approx(5.531)); 
+		REQUIRE(d.getN() == 6); 
+		REQUIRE(d.getNCentroids() == 6); 
+		REQUIRE(d.getMin() == 0.1); 
+		REQUIRE(d.getMax() == 6.4); 
+		REQUIRE(d.getQuantile(0.5) == Approx(3.55)); // halfway between the middle two
+		std::string actual = d.getStringRepr(); 
+		std::string expected = "mean,weight\n0.1,0\n0.1,1\n2,1\n3,1\n4.1,1\n5.7,1\n6.4,1\n6.4,0\n"; 
+		REQUIRE(actual == expected); 
+	}
+
+	SECTION("Quantiles of many observations in fixed memory"){
+		QuantileSketchDatum d; 
+		vector<double> all; 
+		for (unsigned i=0; i<100000; i++){
+			// skewed, like an RT distribution
+			double x = 200 + exp(RNG::rnorm(5, 0.5)); 
+			d.record(x); 
+			all.push_back(x); 
+		}
+		std::sort(all.begin(), all.end()); 
+		REQUIRE(d.getNCentroids() <= 100); 
+		for (double q : {0.01, 0.1, 0.3, 0.5, 0.7, 0.9, 0.99}){
+			// rank of the estimate among the observations, as a quantile
+			double estimate = d.getQuantile(q); 
+			double rankQuantile = double(std::lower_bound(all.begin(), all.end(), estimate) - all.begin()) / all.size(); 
+			INFO("q = " << q << ", estimate " << estimate << " is at quantile " << rankQuantile); 
+			REQUIRE(rankQuantile == Approx(q).epsilon(0.005)); 
+		}
+		REQUIRE(d.getQuantile(0) == all.front()); 
+		REQUIRE(d.getQuantile(1) == all.back()); 
+	}
+
+	SECTION("Merging is the same as recording everything in one"){
+		QuantileSketchDatum whole, first, second; 
+		IncrementalMeanVarianceDatum<double> exact; 
+		for (unsigned i=0; i<20000; i++){
+			double x = RNG::rnorm(i < 5000 ? 0 : 3, 1); 
+			whole.record(x); 
+			exact.record(x); 
+			if (i % 2 == 0) first.record(x); 
+			else second.record(x); 
+		}
+		first.merge(second); 
+		REQUIRE(first.getN() == 20000); 
+		REQUIRE(first.getMean() == Approx(exact.getMean())); 
+		REQUIRE(first.getVariance() == Approx(exact.getVariance())); 
+		REQUIRE(first.getMin() == whole.getMin()); 
+		REQUIRE(first.getMax() == whole.getMax()); 
+		for (double q : {0.1, 0.25, 0.5, 0.9}){
+			REQUIRE(first.getQuantile(q) == Approx(whole.getQuantile(q)).epsilon(0.01)); 
+		}
+	}
+}
+
+
+TEST_CASE("HistogramDatum"){
+	HistogramDatum correct(10, 100), error(10, 100); 
+	vector<double> correctRTs{300, 310, 310, 330.0000001, 420, 5000}; 
+	vector<double> errorRTs{290, 310}; 
+	for (auto rt: correctRTs) correct.record(rt); 
+	for (auto rt: errorRTs) error.record(rt); 
+
+	SECTION("Counts per tick, with overflow"){
+		REQUIRE(correct.getN() == 6); 
+		REQUIRE(correct.getCounts()[31] == 2); 
+		REQUIRE(correct.getCounts()[33] == 1); 
+		REQUIRE(correct.getOverflow() == 1); 
+		REQUIRE(correct.getMean() == Approx(1111.66666667)); 
+		std::string actual = correct.getStringRepr(); 
+		std::string expected = "time,count\n300,1\n310,2\n330,1\n420,1\ninf,1\n"; 
+		REQUIRE(actual == expected); 
+	}
+
+	SECTION("Defective CDFs add up to the response proportions"){
+		arma::vec correctCdf = correct.getDefectiveCdf(error), errorCdf = error.getDefectiveCdf(correct); 
+		REQUIRE(correctCdf[30] == Approx(1.0 / 8)); 
+		REQUIRE(correctCdf[31] == Approx(3.0 / 8)); 
+		REQUIRE(errorCdf[31] == Approx(2.0 / 8)); 
+		REQUIRE(correctCdf[99] == Approx(5.0 / 8)); // the overflow is missing
+		REQUIRE(errorCdf[99] == Approx(2.0 / 8)); 
+	}
+
+	SECTION("Merging is exact"){
+		HistogramDatum whole(10, 100); 
+		for (auto rt: correctRTs) whole.record(rt); 
+		for (auto rt: errorRTs) whole.record(rt); 
+		correct.merge(error); 
+		REQUIRE(correct.getCounts() == whole.getCounts()); 
+		REQUIRE(correct.getOverflow() == whole.getOverflow()); 
+		REQUIRE(correct.getN() == whole.getN()); 
+		REQUIRE(correct.getMean() == Approx(whole.getMean())); 
+		REQUIRE(correct.getVariance() == Approx(whole.getVariance())); 
+		REQUIRE_THROWS(correct.merge(HistogramDatum(5, 100))); 
+	}
+}
+
+TEST_CASE("ConditionalAccuracyDatum"){
+
+	SECTION("Counts correct and total responses per RT bin"){
+		ConditionalAccuracyDatum d(50, 4); 
+		d.record(Response(10, true)); 
+		d.record(Response(49.9, false)); 
+		d.record(Response(50, true)); 
+		d.record(Response(120, true)); 
+		d.record(Response(130, false)); 
+		d.record(Response(140, true)); 
+		d.record(Response(-5, true)); 
+		d.record(Response(250, false)); 
+		vector<int> correct{2, 1, 2, 0}, total{3, 1, 3, 0}; 
+		REQUIRE(d.getCorrect() == correct); 
+		REQUIRE(d.getTotal() == total); 
+		REQUIRE(d.getOverflowTotal() == 1); 
+		REQUIRE(d.getOverflowCorrect() == 0); 
+		REQUIRE(d.getN() == 8); 
+		arma::vec acc = d.getAccuracy(); 
+		double acc2 = acc[2]; 
+		REQUIRE(acc2 == Approx(2.0 / 3)); 
+		REQUIRE(std::isnan(acc[3])); 
+		std::string expected = "time,correct,total\n0,2,3\n50,1,1\n100,2,3\ninf,0,1\n"; 
+		REQUIRE(d.getStringRepr() == expected); 
+	}
+
+	SECTION("Merges exactly"){
+		ConditionalAccuracyDatum whole(20, 50), first(20, 50), second(20, 50); 
+		for (unsigned i=0; i<2000; i++){
+			Response resp(RNG::rnorm(400, 150), RNG::rbernoulli(0.8) == 1); 
+			whole.record(resp); 
+			(i % 2 ? first : second).record(resp); 
+		}
+		first.merge(second); 
+		REQUIRE(first.getCorrect() == whole.getCorrect()); 
+		REQUIRE(first.getTotal() == whole.getTotal()); 
+		REQUIRE(first.getOverflowTotal() == whole.getOverflowTotal()); 
+		REQUIRE(first.getN() == 2000); 
+		REQUIRE_THROWS(first.merge(ConditionalAccuracyDatum(10, 50))); 
+	}
+}
+
+TEST_CASE("ResponseLockedDatum"){
+
+	SECTION("Keeps the window before the decision and the tail after it"){
+		ResponseLockedDatum d(3, 2); 
+		arma::vec v(2); 
+		// trial 0: decides at step 6, then samples 4 more
+		d.newTrial(); 
+		for (unsigned s=1; s<=10; s++){
+			v.fill(s); 
+			d.record(Timepoint(s * 10, v, false, s == 6)); 
+		}
+		// trial 1: decides at step 2 (a short window), then nothing
+		d.newTrial(); 
+		for (unsigned s=1; s<=2; s++){
+			v.fill(100 + s); 
+			d.record(Timepoint(s * 10, v, false, s == 2)); 
+		}
+		// trial 2: never decides, keeps nothing
+		d.newTrial(); 
+		for (unsigned s=1; s<=50; s++){
+			v.fill(-1); 
+			d.record(Timepoint(s * 10, v)); 
+		}
+		REQUIRE(d.getNDecisions() == 2); 
+		REQUIRE(d.getNRows() == 7); 
+		arma::mat traces = d.getTraces(); 
+		arma::vec expectedTimes{-20, -10, 0, 10, 20, -10, 0}; 
+		arma::vec expectedValues{4, 5, 6, 7, 8, 101, 102}; 
+		arma::vec times = traces.col(1), values = traces.col(2); 
+		bool timesMatch = arma::all(times == expectedTimes), valuesMatch = arma::all(values == expectedValues); 
+		REQUIRE(timesMatch); 
+		REQUIRE(valuesMatch); 
+		REQUIRE(d.getN(-2) == 1); 
+		REQUIRE(d.getN(0) == 2); 
+		REQUIRE(d.getN(2) == 1); 
+		arma::mat means = d.getMeans(); 
+		double atDecision = means(2, 1), before = means(1, 0); 
+		REQUIRE(atDecision == Approx(54)); 
+		REQUIRE(before == Approx(53)); 
+	}
+
+	SECTION("Averages alone are in fixed memory"){
+		ResponseLockedDatum stored(10, 5), averaged(10, 5, false); 
+		for (unsigned trial=0; trial<200; trial++){
+			stored.newTrial(); 
+			averaged.newTrial(); 
+			unsigned decisionStep = 3 + trial % 40; 
+			for (unsigned s=1; s<=decisionStep + 8; s++){
+				arma::vec v = arma::randu<arma::vec>(3); 
+				stored.record(Timepoint(s * 10, v, false, s == decisionStep)); 
+				averaged.record(Timepoint(s * 10, v, false, s == decisionStep)); 
+			}
+		}
+		REQUIRE(averaged.getNRows() == 0); 
+		arma::mat traces = stored.getTraces(), means = averaged.getMeans(); 
+		bool matches = true; 
+		for (int offset=-9; offset<=5; offset++){
+			arma::mat atOffset = traces.rows(arma::find(traces.col(1) == offset * 10)); 
+			matches = matches && averaged.getN(offset) == int(atOffset.n_rows); 
+			for (unsigned j=0; j<3; j++){
+				matches = matches && std::abs(means(offset + 9, j) - arma::mean(atOffset.col(j + 2))) < 1e-10; 
+			}
+		}
+		REQUIRE(matches); 
+		std::string csv = averaged.getStringRepr(); 
+		REQUIRE(csv.substr(0, csv.find('\n')) == "offset,n,mean0,mean1,mean2,variance0,variance1,variance2"); 
+	}
 }
 
+TEST_CASE("TrajectoryDatum"){
+
+	SECTION("Per-step means and variances match the stored traces"){
+		TrajectoryDatum agg(10, 50); 
+		TraceDatum traces; 
+		for (unsigned trial=0; trial<200; trial++){
+			traces.newTrial(); 
+			unsigned nSteps = 5 + trial % 30; 
+			for (unsigned s=1; s<=nSteps; s++){
+				arma::vec v = arma::randu<arma::vec>(3); 
+				agg.record(Timepoint(s * 10, v)); 
+				traces.record(Timepoint(s * 10, v)); 
+			}
+		}
+		arma::mat all = traces.getTraces(), means = agg.getMeans(), vars = agg.getVariances(); 
+		bool matches = true; 
+		for (unsigned s=1; s<=34; s++){
+			arma::mat atStep = all.rows(arma::find(all.col(1) == s * 10)); 
+			matches = matches && agg.getN(s) == int(atStep.n_rows); 
+			for (unsigned j=0; j<3; j++){
+				matches = matches && std::abs(means(s, j) - arma::mean(atStep.col(j + 2))) < 1e-10; 
+				matches = matches && std::abs(vars(s, j) - arma::var(atStep.col(j + 2))) < 1e-10; 
+			}
+		}
+		REQUIRE(matches); 
+		REQUIRE(agg.getN(0) == 0); 
+		REQUIRE(agg.getN(35) == 0); 
+		REQUIRE(agg.getWidth() == 3); 
+	}
+
+	SECTION("Quantiles, overflow and merging"){
+		TrajectoryDatum whole(10, 5, 100), first(10, 5, 100), second(10, 5, 100); 
+		arma::vec v(2); 
+		v[1] = 0.5; 
+		for (unsigned i=0; i<10000; i++){
+			v[0] = RNG::runif(1); 
+			whole.record(Timepoint(20, v)); 
+			(i % 2 ? first : second).record(Timepoint(20, v)); 
+		}
+		whole.record(Timepoint(60, v)); 
+		REQUIRE(whole.getOverflow() == 1); 
+		double median = whole.getQuantile(2, 0, 0.5), q9 = whole.getQuantile(2, 0, 0.9), constant = whole.getQuantile(2, 1, 0.5); 
+		REQUIRE(median == Approx(0.5).epsilon(0.02)); 
+		REQUIRE(q9 == Approx(0.9).epsilon(0.02)); 
+		REQUIRE(constant == Approx(0.5).epsilon(0.01)); 
+		first.merge(second); 
+		double mergedMean = first.getMeans()(2, 0), mean = whole.getMeans()(2, 0); 
+		double mergedVar = first.getVariances()(2, 0), var = whole.getVariances()(2, 0); 
+		double mergedMedian = first.getQuantile(2, 0, 0.5); 
+		REQUIRE(first.getN(2) == 10000); 
+		REQUIRE(mergedMean == Approx(mean)); 
+		REQUIRE(mergedVar == Approx(var)); 
+		REQUIRE(mergedMedian == Approx(median)); 
+		REQUIRE_THROWS(first.merge(TrajectoryDatum(10, 6, 100))); 
+	}
+}
+
+TEST_CASE("Reservoir-sampled datums"){
+
+	SECTION("Datums sharing a reservoir keep the same trials, and summaries stay exact"){
+		std::shared_ptr<TrialReservoir> reservoir = std::make_shared<TrialReservoir>(20); 
+		SampledRawVectorsDatum<double> rt(reservoir), errorRt(reservoir); 
+		SampledEventDatum ev(reservoir); 
+		IncrementalMeanVarianceDatum<double> exact; 
+		for (int trial=0; trial<1000; trial++){
+			rt.newTrial(); 
+			errorRt.newTrial(); 
+			ev.newTrial(); 
+			double val = RNG::rnorm(500, 100); 
+			rt.record(val); 
+			exact.record(val); 
+			if (trial % 3 == 0) errorRt.record(val); // only some trials, so its slots go stale
+			ev.record(Event(0, trial)); 
+			ev.record(Event(trial, trial + 1)); 
+		}
+		REQUIRE(reservoir->getNSeen() == 1000); 
+		vector<int> rtIds = rt.getTraceIds(), errorIds = errorRt.getTraceIds(); 
+		arma::mat events = ev.getEventTimes(); 
+		REQUIRE(rtIds.size() == 20); 
+		REQUIRE(events.n_rows == 40); 
+		bool coherent = std::is_sorted(rtIds.begin(), rtIds.end()); 
+		for (unsigned i=0; i<rtIds.size(); i++){
+			coherent = coherent && events(2*i, 0) == rtIds[i] && events(2*i + 1, 0) == rtIds[i] && events(2*i, 2) == rtIds[i]; 
+		}
+		for (int id : errorIds){
+			coherent = coherent && id % 3 == 0 && std::count(rtIds.begin(), rtIds.end(), id) == 1; 
+		}
+		REQUIRE(coherent); 
+		REQUIRE(rt.getN() == 1000); 
+		REQUIRE(rt.getMean() == Approx(exact.getMean())); 
+		REQUIRE(rt.getVariance() == Approx(exact.getVariance())); 
+		REQUIRE(ev.getN() == 2000); 
+		REQUIRE(ev.getDurationMean() == Approx(250.25)); // mean of (trial + 1) / 2
+	}
+
+	SECTION("The sample is uniform over trials"){
+		// each of 100 trials should be kept with probability 10 / 100
+		vector<int> kept(100, 0); 
+		for (int rep=0; rep<2000; rep++){
+			SampledRawVectorsDatum<double> d(std::make_shared<TrialReservoir>(10)); 
+			for (int trial=0; trial<100; trial++){
+				d.newTrial(); 
+				d.record(trial); 
+			}
+			for (int id : d.getTraceIds()) kept[id]++; 
+		}
+		int firstTen = std::accumulate(kept.begin(), kept.begin() + 10, 0); 
+		int lastTen = std::accumulate(kept.end() - 10, kept.end(), 0); 
+		// 2000 * 10 * 0.1 = 2000 expected, sd about 42
+		REQUIRE(firstTen == Approx(2000).epsilon(0.1)); 
+		REQUIRE(lastTen == Approx(2000).epsilon(0.1)); 
+	}
+}
+
+TEST_CASE("Merging datums"){
+	// one stream of observations split in two shards, against the same stream in one datum
+	vector<double> xs(3000); 
+	for (unsigned i=0; i<xs.size(); ++i) xs[i] = i % 2 ? RNG::rnorm(300, 20) : RNG::rnorm(600, 50); 
+	unsigned cut = 1000; 
+
+	SECTION("IncrementalMeanVarianceDatum"){
+		IncrementalMeanVarianceDatum<double> whole, a, b; 
+		for (unsigned i=0; i<xs.size(); ++i){
+			whole.record(xs[i]); 
+			if (i < cut) a.record(xs[i]); 
+			else b.record(xs[i]); 
+		}
+		a.merge(b); 
+		a.merge(IncrementalMeanVarianceDatum<double>()); // empty datums change nothing
+		REQUIRE(a.getN() == whole.getN()); 
+		REQUIRE(a.getMean() == Approx(whole.getMean())); 
+		REQUIRE(a.getVariance() == Approx(whole.getVariance())); 
+		IncrementalMeanVarianceDatum<double> empty; 
+		empty.merge(whole); 
+		REQUIRE(empty.getMean() == Approx(whole.getMean())); 
+		REQUIRE(empty.getVariance() == Approx(whole.getVariance())); 
+	}
+
+	SECTION("RawVectorsDatum"){
+		RawVectorsDatum<double> a, b; 
+		a.newTrial(); 
+		a.record(1); 
+		b.newTrial(); 
+		b.newTrial(); 
+		b.record(2); 
+		a.merge(b); 
+		vector<double> expected = {1, 2}; 
+		vector<int> expectedIds = {0, 2}; // b's trial 1 comes after a's trial 0
+		REQUIRE(a.getRawData() == expected); 
+		REQUIRE(a.getTraceIds() == expectedIds); 
+	}
+
+	SECTION("RawVectorsDatum shards keep disjoint trials"){
+		// two shards of the same two trials, three observations each
+		RawVectorsDatum<double> a, b; 
+		for (int trial=0; trial<2; ++trial){
+			a.newTrial(); 
+			b.newTrial(); 
+			for (int i=0; i<3; ++i){
+				a.record(trial); 
+				b.record(10 + trial); 
+			}
+		}
+		a.merge(b); 
+		vector<TrialSegment> segments; 
+		for (TrialSegment s : a.getSegments()) segments.push_back(s); 
+		REQUIRE(segments.size() == 4); 
+		for (unsigned k=0; k<segments.size(); ++k){
+			REQUIRE(segments[k].trialId == int(k)); 
+			REQUIRE(segments[k].begin == 3*k); 
+			REQUIRE(segments[k].size() == 3); 
+			REQUIRE(a.getRawData()[segments[k].begin] == (k < 2 ? k : 10 + k - 2)); 
+		}
+		a.newTrial(); 
+		a.record(5); 
+		REQUIRE(a.getTraceIds().back() == 4); 
+	}
+
+	SECTION("GMMDatum"){
+		GMMDatum whole(2, 10), a(2, 10), b(2, 10); // small, so merging has to grow the buffer
+		for (unsigned i=0; i<xs.size(); ++i){
+			whole.record(xs[i]); 
+			if (i < cut) a.record(xs[i]); 
+			else b.record(xs[i]); 
+		}
+		a.merge(b); 
+		arma::rowvec raw = a.getRawData(), wholeRaw = whole.getRawData(); 
+		bool sameRaw = arma::all(raw == wholeRaw); 
+		arma::rowvec means = arma::sort(a.getGaussMeans()); 
+		REQUIRE(a.getN() == whole.getN()); 
+		REQUIRE(sameRaw); 
+		REQUIRE(a.getMean() == Approx(whole.getMean())); 
+		REQUIRE(a.getVariance() == Approx(whole.getVariance())); 
+		REQUIRE(means[0] == Approx(300).epsilon(0.05)); 
+		REQUIRE(means[1] == Approx(600).epsilon(0.05)); 
+	}
+
+	SECTION("OnlineGMMDatum, online and in warmup"){
+		OnlineGMMDatum whole(2, 200), a(2, 200), b(2, 200), warming(2, 200); 
+		for (unsigned i=0; i<xs.size(); ++i){
+			whole.record(xs[i]); 
+			if (i < cut) a.record(xs[i]); 
+			else b.record(xs[i]); 
+		}
+		for (unsigned i=0; i<50; ++i) warming.record(xs[i]); 
+		a.merge(b); 
+		a.merge(warming); 
+		REQUIRE(a.getN() == whole.getN() + 50); 
+		warming.merge(b); // the datum in warmup takes over b's mixture
+		arma::rowvec means = arma::sort(a.getGaussMeans()), warmingMeans = arma::sort(warming.getGaussMeans()); 
+		REQUIRE(warming.getN() == 2050); 
+		REQUIRE(means[0] == Approx(300).epsilon(0.05)); 
+		REQUIRE(means[1] == Approx(600).epsilon(0.05)); 
+		REQUIRE(warmingMeans[0] == Approx(300).epsilon(0.05)); 
+		REQUIRE(warmingMeans[1] == Approx(600).epsilon(0.05)); 
+		REQUIRE_THROWS(a.merge(OnlineGMMDatum(3, 200))); 
+	}
+
+	SECTION("ResponseLockedDatum"){
+		ResponseLockedDatum whole(5, 2), a(5, 2), b(5, 2); 
+		ResponseLockedDatum * parts[2] = {&a, &b}; 
+		for (int trial=0; trial<20; trial++){
+			ResponseLockedDatum * part = parts[trial % 2]; 
+			whole.newTrial(); 
+			part->newTrial(); 
+			for (int step=0; step<10; step++){
+				arma::vec v = {RNG::runif(1.0), double(step)}; 
+				whole.record(Timepoint(step * 10, v, false, step == 6)); 
+				part->record(Timepoint(step * 10, v, false, step == 6)); 
+			}
+		}
+		a.merge(b); 
+		double meanError = arma::abs(a.getMeans() - whole.getMeans()).max(); 
+		double varError = arma::abs(a.getVariances() - whole.getVariances()).max(); 
+		REQUIRE(a.getNDecisions() == 20); 
+		REQUIRE(a.getNRows() == whole.getNRows()); 
+		REQUIRE(meanError < 1e-12); 
+		REQUIRE(varError < 1e-12); 
+		REQUIRE_THROWS(a.merge(ResponseLockedDatum(4, 2))); 
+	}
+}
+
+TEST_CASE("Memory budgets"){
+	SECTION("Datums count the values they hold"){
+		Recorder r; 
+		r.registerDatum("rt", RawVectorsDatum<double>()); 
+		r.registerDatum("trace", TraceDatum()); 
+		size_t empty = r.bytesUsed(); 
+		arma::vec v(3); 
+		for (int trial=0; trial<10; trial++){
+			r.newTrial(); 
+			r.updateDatum("rt", 100.0 * trial); 
+			for (int step=0; step<5; step++) r.updateDatum("trace", Timepoint(step, v)); 
+		}
+		std::map<string,size_t> usage = r.getMemoryUsage(); 
+		size_t total = usage["rt"] + usage["trace"]; 
+		REQUIRE(r.bytesUsed() >= empty + 10 * sizeof(double) + 50 * 3 * sizeof(double)); 
+		REQUIRE(r.bytesUsed() == total); 
+		REQUIRE_FALSE(r.overMemoryBudget()); 
+		REQUIRE_THROWS(Recorder::memoryPolicyFromString("shrink")); 
+		REQUIRE_THROWS(r.setMemoryBudget(1000, Recorder::SPILL)); 
+	}
+
+	SECTION("Stop"){
+		Recorder r; 
+		r.registerDatum("rt", RawVectorsDatum<double>()); 
+		r.setMemoryBudget(1000, Recorder::memoryPolicyFromString("stop")); 
+		int trials = 0; 
+		while (trials < 1000 && !r.recordedEnough()){
+			r.newTrial(); 
+			for (int i=0; i<5; i++) r.updateDatum("rt", 1.0 * i); 
+			trials++; 
+		}
+		std::ostringstream report; 
+		r.writeMemoryReport(report); 
+		REQUIRE(trials == 65); // over budget at the check starting trial 64
+		REQUIRE(r.overMemoryBudget()); 
+		REQUIRE(report.str().find("budget,1000") != string::npos); 
+		REQUIRE(report.str().find("stopped recording") != string::npos); 
+		r.reset(); 
+		REQUIRE_FALSE(r.recordedEnough()); 
+	}
+
+	SECTION("Freeze"){
+		Recorder r; 
+		IncrementalMeanVarianceDatum<double> expected; 
+		r.registerDatum("rt", RawVectorsDatum<double>()); 
+		r.registerDatum("trace", TraceDatum()); 
+		r.registerDatum("summary", IncrementalMeanVarianceDatum<double>()); 
+		r.setMemoryBudget(1000, Recorder::memoryPolicyFromString("freeze")); 
+		DatumHandle<double> rt = r.getHandle<double>("rt"); 
+		arma::vec v(3); 
+		for (int trial=0; trial<200; trial++){
+			r.newTrial(); 
+			for (int i=0; i<5; i++){
+				double x = RNG::rnorm(500, 100); 
+				if (trial < 64) expected.record(x); 
+				r.updateDatum(rt, x); 
+				r.updateDatum("summary", x); 
+			}
+			r.updateDatum("trace", Timepoint(0, v)); 
+		}
+		const RawVectorsDatum<double> & raw = r.getDatum<RawVectorsDatum<double> >("rt"); 
+		const TraceDatum & trace = r.getDatum<TraceDatum>("trace"); 
+		std::ostringstream report; 
+		r.writeMemoryReport(report); 
+		REQUIRE(r.overMemoryBudget()); 
+		REQUIRE_FALSE(r.recordedEnough()); // over budget, but not growing
+		REQUIRE(raw.isFrozen()); 
+		REQUIRE(raw.getN() == 320); // the trials before the check at trial 64 are kept
+		REQUIRE(raw.getTraceIds().back() == 63); 
+		REQUIRE(raw.getMean() == Approx(expected.getMean())); 
+		REQUIRE(raw.getVariance() == Approx(expected.getVariance())); 
+		REQUIRE(trace.getNRows() == 64); 
+		REQUIRE(r.getDatum<SummaryDatum<double> >("summary").getN() == 1000); 
+		REQUIRE(report.str().find("freezing rt trace") != string::npos); 
+		REQUIRE_THROWS(r.getDatum<TraceDatum>("rt")); 
+		REQUIRE_THROWS(r.getDatum<SummaryDatum<double> >("trace")); 
+	}
+
+	SECTION("Freeze stops if the rest keeps growing"){
+		Recorder r; 
+		r.registerDatum("rt", RawVectorsDatum<double>()); 
+		r.registerTrialTable(TrialTable(vector<string>(1, "rt"), vector<string>(), 0)); 
+		r.setMemoryBudget(1000, Recorder::FREEZE); 
+		int trials = 0; 
+		while (trials < 1000 && !r.recordedEnough()){
+			r.newTrial(); 
+			r.updateDatum("rt", 1.0); 
+			r.getTrialTable()->record(0, 1.0); // TrialTable doesn't freeze
+			trials++; 
+		}
+		std::ostringstream report; 
+		r.writeMemoryReport(report); 
+		REQUIRE(trials == 129); // frozen at the check starting trial 64, still growing at 128
+		REQUIRE(r.recordedEnough()); 
+		REQUIRE(report.str().find("stopped recording") != string::npos); 
+	}
+
+	SECTION("Spill"){
+		Recorder direct, spilled; 
+		direct.registerDatum("trace", TraceDatum()); 
+		spilled.registerDatum("trace", TraceDatum()); 
+		spilled.setMemoryBudget(4000, Recorder::SPILL, "recorder_test_spill"); 
+		arma::vec v(3); 
+		for (int trial=0; trial<300; trial++){
+			direct.newTrial(); 
+			spilled.newTrial(); 
+			v.fill(trial); 
+			for (int step=0; step<5; step++){
+				direct.updateDatum("trace", Timepoint(step, v)); 
+				spilled.updateDatum("trace", Timepoint(step, v)); 
+			}
+		}
+		direct.writeToFiles("recorder_test_direct"); 
+		spilled.writeToFiles("recorder_test_spill"); 
+		std::ifstream directFile("recorder_test_direct/trace.csv"), spilledFile("recorder_test_spill/trace.csv"); 
+		std::stringstream expected, actual; 
+		expected << directFile.rdbuf(); 
+		actual << spilledFile.rdbuf(); 
+		REQUIRE(spilled.overMemoryBudget()); 
+		REQUIRE_FALSE(spilled.recordedEnough()); 
+		REQUIRE_FALSE(expected.str().empty()); 
+		REQUIRE(actual.str() == expected.str()); 
+		std::remove("recorder_test_direct/trace.csv"); 
+		std::remove("recorder_test_spill/trace.csv"); 
+		std::remove("recorder_test_direct"); 
+		std::remove("recorder_test_spill"); 
+	}
+
+	SECTION("Spilling releases the trace buffer"){
+		for (int async=0; async<2; async++){
+			AsyncWriter writer; 
+			Recorder r; 
+			if (async) r.setAsyncWriter(&writer); 
+			r.registerDatum("trace", TraceDatum(100000)); 
+			r.setMemoryBudget(4000, Recorder::SPILL, "recorder_test_spill"); 
+			const TraceDatum & trace = r.getDatum<TraceDatum>("trace"); 
+			arma::vec v(3); 
+			size_t reserved = 0, usedBefore = 0; 
+			for (int trial=0; trial<100; trial++){
+				r.newTrial(); 
+				for (int step=0; step<5; step++) r.updateDatum("trace", Timepoint(step, v)); 
+				if (trial == 63){
+					reserved = trace.getRows().capacity(); 
+					usedBefore = r.bytesUsed(); 
+				}
+			}
+			REQUIRE(reserved == 100000 * 5); 
+			REQUIRE(usedBefore < 64 * 5 * 5 * sizeof(double) + 1000); // only the touched part of the reservation counts
+			REQUIRE(r.overMemoryBudget()); 
+			REQUIRE(trace.getRows().capacity() <= (2000 / (5 * sizeof(double)) + 1) * 5); // cut down to the spill buffer
+			REQUIRE(r.bytesUsed() <= 4000); 
+			r.writeToFiles("recorder_test_spill"); 
+			writer.flush(); 
+			std::remove("recorder_test_spill/trace.csv"); 
+			std::remove("recorder_test_spill"); 
+		}
+	}
+
+	SECTION("Spill with nothing to stream stops at once"){
+		Recorder r; 
+		r.registerDatum("rt", RawVectorsDatum<double>()); 
+		r.setMemoryBudget(1000, Recorder::SPILL, "recorder_test_spill"); 
+		for (int trial=0; trial<=64; trial++){
+			r.newTrial(); 
+			for (int i=0; i<5; i++) r.updateDatum("rt", 1.0 * i); 
+		}
+		std::ostringstream report; 
+		r.writeMemoryReport(report); 
+		REQUIRE(r.recordedEnough()); 
+		REQUIRE(report.str().find("nothing to spill, stopped recording") != string::npos); 
+	}
+}
 
 TEST_CASE("Tests for Recorder"){
 	Recorder r; 
@@ -507,4 +1381,64 @@ TEST_CASE("Tests for Recorder"){
 
 		REQUIRE(all(vectorise(correctOut.t())==vectorise(out)));
 	}
-}
\ No newline at end of file
+
+	SECTION("Handles"){
+		r.registerDatum("a", IncrementalMeanVarianceDatum<double>()); 
+		r.registerDatum("ed", EventDatum()); 
+		DatumHandle<double> h = r.getHandle<double>("a"); 
+		REQUIRE(h.isValid()); 
+		r.updateDatum(h, 2.0); 
+		r.updateDatum("a", 4.0); 
+		double mean = r.getDatum<IncrementalMeanVarianceDatum<double> >("a").getMean(); 
+		REQUIRE(mean == Approx(3)); 
+		REQUIRE_THROWS(r.getHandle<double>("ed")); 
+		REQUIRE_THROWS(r.getHandle<double>("bad")); 
+		REQUIRE_THROWS(r.updateDatum(DatumHandle<double>(), 1.0)); 
+	}
+
+	SECTION("All datums share the recorder's trial counter"){
+		r.registerDatum("ed", EventDatum()); 
+		r.registerDatum("rvd", RawVectorsDatum<double>()); 
+		REQUIRE(r.getTrialId() == -1); 
+		r.newTrial(); 
+		r.newTrial(); 
+		r.updateDatum(r.getHandle<Event>("ed"), Event(1, 2)); 
+		r.updateDatum(r.getHandle<double>("rvd"), 1.0); 
+		arma::mat events = r.getDatum<EventDatum>("ed").getEventTimes(); 
+		REQUIRE(events(0,0) == 1); 
+		std::string rvd = r.getDatum<RawVectorsDatum<double> >("rvd").getStringRepr(); 
+		REQUIRE(rvd.find("1,1") != std::string::npos); 
+		r.reset(); 
+		REQUIRE(r.getTrialId() == -1); 
+		REQUIRE_FALSE(r.hasDatum("ed")); 
+	}
+
+	SECTION("TrialTable"){
+		r.registerTrialTable(TrialTable({"RT", "Acc"}, {"ebl"}, 10)); 
+		TrialTable * tt = r.getTrialTable(); 
+		REQUIRE(tt != nullptr); 
+		r.newTrial(); 
+		tt->setCondition(1, 0); 
+		tt->record(0, 300); 
+		tt->record(1, 1); 
+		tt->recordEvent(0, Event(0, 50)); 
+		r.newTrial(); 
+		r.newTrial(); 
+		tt->setCondition(0, 1); 
+		tt->record(0, 400); 
+		REQUIRE(tt->getNRows() == 2); 
+		REQUIRE(tt->getTrialIds()[1] == 2); 
+		REQUIRE(tt->getContexts()[0] == 1); 
+		REQUIRE(tt->getTargets()[1] == 1); 
+		REQUIRE(tt->getColumn(0)[1] == 400); 
+		REQUIRE(std::isnan(tt->getColumn(1)[1])); 
+		REQUIRE(tt->getEventEnds(0)[0] == 50); 
+		REQUIRE(tt->getColumnId("Acc") == 1); 
+		REQUIRE(tt->getEventId("bad") == -1); 
+		std::string csv = tt->getStringRepr(); 
+		REQUIRE(csv.find("trial,context,target,RT,Acc,eblStart,eblEnd") == 0); 
+		REQUIRE(csv.find("2,0,1,400,NA,NA,NA") != std::string::npos); 
+		r.reset(); 
+		REQUIRE(r.getTrialTable() == nullptr); 
+	}
+}
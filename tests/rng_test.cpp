@@ -45,3 +45,9 @@ TEST_CASE("Dump some bernoullis"){
 
 }
 
+TEST_CASE("Test for cumulative distribution function correctness"){
+	REQUIRE(RNG::pnorm(0,0,1) == Approx(0.5));
+	REQUIRE(RNG::pnorm(1.96,0,1) == Approx(0.9750021));
+	REQUIRE(RNG::pnorm(-1,1,2) == Approx(0.1586553));
+}
+
@@ -2,7 +2,12 @@
 #include "../task.h"
 #include "../config.h"
 #include "../recorder.h"
+#include "../experiment.h"
+#include "../decisioncache.h"
+#include "../examples/Flanker/flanker.h"
+#include "../examples/AX-CPT/axcpt.h"
 #include <armadillo>
+#include <cmath>
 
 using arma::mat; 
 
@@ -12,7 +17,10 @@ public:
 	void run(); 
 };
 
-DummyTask::DummyTask(Config * c, Recorder * r): Task(c, r){}
+DummyTask::DummyTask(Config * c, Recorder * r): Task(c, r){
+	_summaryDatumNames = {"RT"}; 
+	_setupThresholdSweep({"RT", "Acc"}); 
+}
 void DummyTask::run(){
 	std::cout << "I ran"; 
 }
@@ -43,3 +51,260 @@ TEST_CASE("Task auxiliary methods"){
 		REQUIRE(arma::all(correctbool==1));
 	}
 }
+
+TEST_CASE("Threshold sweep setup"){
+	Config conf; 
+	conf.set("trialDist", "0.25 0.25; 0.25 0.25"); 
+	Recorder r; 
+
+	SECTION("No sweep leaves summary datums alone"){
+		DummyTask t(&conf, &r); 
+		REQUIRE(t.getDecisionThreshes().empty()); 
+		REQUIRE(t.getSummaryDatumNames() == std::vector<std::string>({"RT"})); 
+	}
+
+	SECTION("Sweep sorts thresholds and names datums per threshold"){
+		conf.set("decisionThreshes", "0.99 0.9"); 
+		DummyTask t(&conf, &r); 
+		REQUIRE(t.getDecisionThreshes() == std::vector<double>({0.9, 0.99})); 
+		REQUIRE(t.getSummaryDatumNames() == std::vector<std::string>({"Thresh0_RT", "Thresh0_Acc", "Thresh1_RT", "Thresh1_Acc"})); 
+	}
+
+	SECTION("Sweep thresholds must be in (0.5, 1)"){
+		conf.set("decisionThreshes", "0.9 1.2"); 
+		REQUIRE_THROWS(DummyTask(&conf, &r)); 
+	}
+
+	SECTION("Sweeps can't go with batchHistograms or batchCaf"){
+		conf.set("decisionThreshes", "0.9 0.99"); 
+		conf.set("maxTrials", 10); 
+		conf.set("nContexts", 2); 
+		conf.set("nTargets", 2); 
+		conf.set("timePerStep", 10); 
+		DummyTask t(&conf, &r); 
+		conf.set("batchCaf", 1); 
+		REQUIRE_THROWS(BatchExperiment(&conf, &t, &r)); 
+		r.reset(); 
+		conf.set("batchCaf", 0); 
+		conf.set("batchHistograms", 1); 
+		REQUIRE_THROWS(BatchExperiment(&conf, &t, &r)); 
+	}
+}
+
+// defaults of the flanker and AX-CPT runners
+static Config sweepConfig(){
+	Config conf; 
+	conf.set("timePerStep", 10); 
+	conf.set("retentionIntervalDur", 200); 
+	conf.set("maxTrials", 20000); 
+	conf.set("maxSamps", 1000); 
+	conf.set("contextNoise", 3); 
+	conf.set("targetNoise", 3); 
+	conf.set("decisionThresh", 0.95); 
+	conf.set("eblMean", 50); 
+	conf.set("motorPlanMean", 150); 
+	conf.set("motorExecMean", 150); 
+	conf.set("eblSd", 20); 
+	conf.set("motorSd", 50); 
+	conf.set("urPrior", "0.4 0.3; 0.2 0.1"); 
+	conf.set("trialDist", "0.4 0.3; 0.2 0.1"); 
+	conf.set("nContexts", 2); 
+	conf.set("nTargets", 2); 
+	conf.set("decayRate", 0.01); 
+	conf.set("pPrematureResp", 0); 
+	return conf; 
+}
+
+// A sweep over decisionThresh alone should give the RT and Acc of a normal run, up to sampling error. 
+template<typename TaskType>
+static void checkOneThresholdSweep(Config conf){
+	Recorder plain, swept; 
+	TaskType plainTask(&conf, &plain); 
+	BatchExperiment plainExperiment(&conf, &plainTask, &plain); 
+	plainExperiment.run(); 
+	conf.set("decisionThreshes", "0.95"); 
+	TaskType sweptTask(&conf, &swept); 
+	BatchExperiment sweptExperiment(&conf, &sweptTask, &swept); 
+	sweptExperiment.run(); 
+	const char * names[2] = {"RT", "Acc"}; 
+	for (int c=0; c<2; ++c){
+		for (int t=0; t<2; ++t){
+			for (const char * name : names){
+				const SummaryDatum<double> & a = plain.getDatum<SummaryDatum<double> >(Task::conditionLabel(c, t) + name); 
+				const SummaryDatum<double> & b = swept.getDatum<SummaryDatum<double> >(Task::conditionLabel(c, t) + "Thresh0_" + name); 
+				double se = sqrt(a.getVariance() / a.getN() + b.getVariance() / b.getN()); 
+				double diff = fabs(a.getMean() - b.getMean()); 
+				INFO(Task::conditionLabel(c, t) << name << ": " << a.getMean() << " vs " << b.getMean()); 
+				REQUIRE(diff <= 5 * se + 1e-9); 
+			}
+		}
+	}
+}
+
+// With two thresholds, the lower one is crossed no later than the higher one on every trial. 
+template<typename TaskType>
+static void checkTwoThresholdSweep(Config conf){
+	conf.set("maxTrials", 2000); 
+	conf.set("decisionThreshes", "0.9 0.99"); 
+	Recorder r; 
+	TaskType task(&conf, &r); 
+	TraceExperiment experiment(&conf, &task, &r); 
+	experiment.run(); 
+	int nTrials = 0, nLater = 0, nStrictlyEarlier = 0; 
+	for (int c=0; c<2; ++c){
+		for (int t=0; t<2; ++t){
+			const vector<double> & lower = r.getDatum<RawVectorsDatum<double> >(Task::conditionLabel(c, t) + "Thresh0_DecisionTime").getRawData(); 
+			const vector<double> & upper = r.getDatum<RawVectorsDatum<double> >(Task::conditionLabel(c, t) + "Thresh1_DecisionTime").getRawData(); 
+			REQUIRE(lower.size() == upper.size()); 
+			for (unsigned i=0; i<lower.size(); ++i){
+				nLater += lower[i] > upper[i]; 
+				nStrictlyEarlier += lower[i] < upper[i]; 
+			}
+			nTrials += lower.size(); 
+		}
+	}
+	REQUIRE(nTrials == 2000); 
+	REQUIRE(nLater == 0); 
+	REQUIRE(nStrictlyEarlier > 0); 
+}
+
+TEST_CASE("Threshold sweep runs"){
+	Config conf = sweepConfig(); 
+
+	SECTION("Flanker: one threshold matches a normal run"){
+		checkOneThresholdSweep<FlankerTask>(conf); 
+	}
+
+	SECTION("Flanker: lower thresholds are crossed first"){
+		checkTwoThresholdSweep<FlankerTask>(conf); 
+	}
+
+	SECTION("AX-CPT: one threshold matches a normal run"){
+		conf.set("maxSamps", 10000); // context decay makes for the odd very long trial
+		checkOneThresholdSweep<AxcptTask>(conf); 
+	}
+
+	SECTION("AX-CPT: lower thresholds are crossed first (or latch together)"){
+		conf.set("maxSamps", 10000); 
+		checkTwoThresholdSweep<AxcptTask>(conf); 
+	}
+}
+
+// A sweep over decisionThresh alone draws premature responses like a normal run, and records the events of every trial. 
+template<typename TaskType>
+static void checkSweepEvents(Config conf){
+	conf.set("maxTrials", 500); 
+	conf.set("pPrematureResp", 1); 
+	Recorder plain, swept; 
+	arma::arma_rng::set_seed(42); 
+	TaskType plainTask(&conf, &plain); 
+	TraceExperiment(&conf, &plainTask, &plain).run(); 
+	conf.set("decisionThreshes", "0.95"); 
+	arma::arma_rng::set_seed(42); 
+	TaskType sweptTask(&conf, &swept); 
+	TraceExperiment(&conf, &sweptTask, &swept).run(); 
+	for (int c=0; c<2; ++c){
+		for (int t=0; t<2; ++t){
+			std::string label = Task::conditionLabel(c, t); 
+			INFO(label); 
+			// same random draws, so the same trials
+			REQUIRE(swept.getDatum<RawVectorsDatum<double> >(label + "Thresh0_RT").getRawData() == plain.getDatum<RawVectorsDatum<double> >(label + "RT").getRawData()); 
+			REQUIRE(swept.getDatum<EventDatum>(label + "motorPlanEvent").getEndTimes() == plain.getDatum<EventDatum>(label + "motorPlanEvent").getEndTimes()); 
+			REQUIRE(swept.getDatum<EventDatum>(label + "motorExecEvent").getEndTimes() == plain.getDatum<EventDatum>(label + "motorExecEvent").getEndTimes()); 
+		}
+	}
+	// trials that sample record their motor events too
+	conf.set("pPrematureResp", 0.05); 
+	Recorder r; 
+	TaskType task(&conf, &r); 
+	TraceExperiment(&conf, &task, &r).run(); 
+	for (int c=0; c<2; ++c){
+		for (int t=0; t<2; ++t){
+			std::string label = Task::conditionLabel(c, t); 
+			const vector<double> & rts = r.getDatum<RawVectorsDatum<double> >(label + "Thresh0_RT").getRawData(); 
+			REQUIRE(r.getDatum<EventDatum>(label + "motorPlanEvent").getEndTimes().size() == rts.size()); 
+			REQUIRE(r.getDatum<EventDatum>(label + "motorExecEvent").getEndTimes().size() == rts.size()); 
+		}
+	}
+}
+
+TEST_CASE("Threshold sweeps record events"){
+	Config conf = sweepConfig(); 
+	conf.set("maxSamps", 10000); 
+
+	SECTION("Flanker"){
+		checkSweepEvents<FlankerTask>(conf); 
+	}
+
+	SECTION("AX-CPT"){
+		checkSweepEvents<AxcptTask>(conf); 
+	}
+}
+
+// A replayed trial records the same events as the trial it replays (with new nondecision times). 
+TEST_CASE("AX-CPT replay records the events of run()"){
+	Config conf = sweepConfig(); 
+	conf.set("maxTrials", 200); 
+	conf.set("maxSamps", 10000); // context decay makes for the odd very long trial
+	conf.set("pPrematureResp", 0.1); 
+	DecisionCache cache; 
+	Recorder ran, replayed; 
+	AxcptTask first(&conf, &ran); 
+	first.setDecisionCache(&cache); 
+	EventExperiment(&conf, &first, &ran).run(); 
+	AxcptTask second(&conf, &replayed); 
+	second.setDecisionCache(&cache); 
+	EventExperiment(&conf, &second, &replayed).run(); 
+	const TrialTable & a = ran.getDatum<TrialTable>("trials"); 
+	const TrialTable & b = replayed.getDatum<TrialTable>("trials"); 
+	REQUIRE(a.getNRows() == 200); 
+	REQUIRE(b.getNRows() == 200); 
+	for (const std::string & name : first.getEventDatumNames()){
+		int event = a.getEventId(name); 
+		for (unsigned i=0; i<200; ++i){
+			INFO(name << " of trial " << i); 
+			REQUIRE(std::isnan(a.getEventStarts(event)[i]) == std::isnan(b.getEventStarts(event)[i])); 
+		}
+	}
+	int context = a.getEventId("samplingContextEvent"); 
+	REQUIRE(b.getEventEnds(context) == a.getEventEnds(context)); 
+}
+
+// Premature responses count towards RT, Resp and Acc, but CorrectRT and IncorrectRT only hold sampled decisions. 
+template<typename TaskType>
+static void checkPrematureResponsesSkipCorrectRT(Config conf){
+	conf.set("maxTrials", 200); 
+	conf.set("pPrematureResp", 1); 
+	Recorder r; 
+	TaskType task(&conf, &r); 
+	BatchExperiment(&conf, &task, &r).run(); 
+	int nTrials = 0; 
+	for (int c=0; c<2; ++c){
+		for (int t=0; t<2; ++t){
+			nTrials += r.getDatum<SummaryDatum<double> >(Task::conditionLabel(c, t) + "RT").getN(); 
+			REQUIRE(r.getDatum<SummaryDatum<double> >(Task::conditionLabel(c, t) + "CorrectRT").getN() == 0); 
+			REQUIRE(r.getDatum<SummaryDatum<double> >(Task::conditionLabel(c, t) + "IncorrectRT").getN() == 0); 
+		}
+	}
+	REQUIRE(nTrials == 200); 
+}
+
+TEST_CASE("Premature responses aren't counted as correct or incorrect RTs"){
+	SECTION("Flanker"){
+		checkPrematureResponsesSkipCorrectRT<FlankerTask>(sweepConfig()); 
+	}
+
+	SECTION("AX-CPT"){
+		checkPrematureResponsesSkipCorrectRT<AxcptTask>(sweepConfig()); 
+	}
+}
+
+TEST_CASE("AX-CPT rejects adaptiveStepping"){
+	Config conf = sweepConfig(); 
+	conf.set("decayRate", 0); 
+	conf.set("adaptiveStepping", 1); 
+	Recorder r; 
+	REQUIRE_THROWS(AxcptTask(&conf, &r)); 
+	conf.set("adaptiveStepping", 0); 
+	REQUIRE_NOTHROW(AxcptTask(&conf, &r)); 
+}
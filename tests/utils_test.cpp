@@ -17,6 +17,32 @@ TEST_CASE("Mean and variance computations are correct"){
 	}	
 }
 
+TEST_CASE("RunningMoments match the batch computations"){
+	vector<double> inputVec{0.1, 2, 3578, 4.1, 5.7, 6.4}; 
+	utils::RunningMoments<double> whole, first, second, empty; 
+	for (unsigned i=0; i<inputVec.size(); ++i){
+		whole.record(inputVec[i]); 
+		if (i < 2) first.record(inputVec[i]); 
+		else second.record(inputVec[i]); 
+	}
+
+	SECTION("Recording"){
+		REQUIRE(whole.getN() == 6); 
+		REQUIRE(whole.getMean() == Approx(utils::mean(inputVec))); 
+		REQUIRE(whole.getVariance() == Approx(utils::variance(inputVec))); 
+	}
+
+	SECTION("Merging"){
+		first.merge(second); 
+		first.merge(empty); 
+		empty.merge(whole); 
+		REQUIRE(first.getN() == 6); 
+		REQUIRE(first.getMean() == Approx(whole.getMean())); 
+		REQUIRE(first.getVariance() == Approx(whole.getVariance())); 
+		REQUIRE(empty.getMean() == Approx(whole.getMean())); 
+		REQUIRE(empty.getVariance() == Approx(whole.getVariance())); 
+	}
+}
 
 TEST_CASE("Round to increment works with integer increments"){
 	REQUIRE(utils::roundToIncrement(3.3,1) == Approx(3)); 
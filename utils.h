@@ -86,6 +86,64 @@ namespace utils{
 		}
 		return s2 / (container.size()-1);
 	}
+	/**
+	 * @brief Running count, mean and sum of square deviations of a stream of numbers. 
+	 * @details record() is Welford's online update and merge() Chan et al.'s pairwise one, 
+	 * so the moments of two streams combine exactly (up to rounding) into those of both. 
+	 * The static update() and combine() do the same to a mean and sum of square deviations 
+	 * kept elsewhere, e.g. for many cells sharing one count. 
+	 * \sa https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+	 * 
+	 * @tparam T arithmetic type
+	 */
+	template<typename T>
+	class RunningMoments {
+	public:
+		RunningMoments(): _mean(0), _ssq(0), _n(0) {}
+
+		/// Add an observation. 
+		void record(const T & val){
+			++_n; 
+			update(_mean, _ssq, _n, val); 
+		}
+
+		/// Add the observations other summarizes. 
+		void merge(const RunningMoments<T> & other){
+			combine(_mean, _ssq, _n, other._mean, other._ssq, other._n); 
+			_n += other._n; 
+		}
+
+		T getMean() const { return _mean; }
+		T getVariance() const { return _ssq / (_n - 1); } ///< sample variance (NaN below two observations)
+		T getSsq() const { return _ssq; }
+		int getN() const { return _n; }
+
+		/**
+		 * @brief Welford's update of mean and ssq with val, the nth observation. 
+		 */
+		static void update(T & mean, T & ssq, int n, const T & val){
+			T oldMean = mean; 
+			mean += (val - oldMean) / n; 
+			ssq += (val - oldMean) * (val - mean); 
+		}
+
+		/**
+		 * @brief Chan et al.'s pairwise update of the mean and ssq of n observations with those of otherN others. 
+		 */
+		static void combine(T & mean, T & ssq, double n, const T & otherMean, const T & otherSsq, double otherN){
+			if (otherN == 0) return; 
+			double total = n + otherN; 
+			T delta = otherMean - mean; 
+			ssq += otherSsq + delta * delta * n * otherN / total; 
+			mean += delta * otherN / total; 
+		}
+
+	protected:
+		T _mean; ///< mean so far
+		T _ssq; ///< sum of square deviations so far
+		int _n; ///< number of observations so far
+	}; 
+
 	// // ...but if we get an int in, just transparently return int sum
 	// template<typename Container, EnableIf<std::is_integral<typename Container::value_type>>...>
 	// typename Container::value_type kahanSum(const Container& container) {